@@ -0,0 +1 @@
+../x3270/bintrace.h
\ No newline at end of file
@@ -758,15 +758,29 @@ screen_disp(Boolean erasing _is_unused)
 		/* Tell curses to forget what may be on the screen already. */
 		endwin();
 		erase();
+		ctlr_changed(0, ROWS*COLS);
 	}
 #endif /*]*/
 
-	fa = get_field_attribute(0);
-	fa_addr = find_field_attribute(0);
-	field_attrs = calc_attrs(0, fa_addr, fa);
+	/*
+	 * Redraw only the rows that have changed, unless DBCS is in play:
+	 * DBCS characters can straddle rows.
+	 */
 	for (row = 0; row < ROWS; row++) {
 		int baddr;
 
+		if (!dbcs && !ctlr_row_changed(row))
+			continue;
+
+		/* Find the field this row starts in. */
+		baddr = row*cCOLS;
+		fa = get_field_attribute(baddr);
+		fa_addr = find_field_attribute(baddr);
+		if (fa_addr >= 0 && fa_addr < baddr)
+			field_attrs = calc_attrs(fa_addr, fa_addr, fa);
+		else
+			field_attrs = calc_attrs(0, fa_addr, fa);
+
 		if (!flipped)
 			move(row, 0);
 		for (col = 0; col < cCOLS; col++) {
@@ -860,6 +874,7 @@ screen_disp(Boolean erasing _is_unused)
 			}
 		}
 	}
+	ctlr_changes_displayed();
 	if (status_row)
 		draw_oia();
 	(void) attrset(defattr);
@@ -1206,6 +1221,7 @@ screen_resume(void)
 		    	x3270_exit(1);
 	}
 #endif /*]*/
+	ctlr_changed(0, ROWS*COLS);
 	screen_disp(False);
 	refresh();
 	input_id = AddInput(0, kybd_input);
@@ -1220,12 +1236,14 @@ cursor_move(int baddr)
 void
 toggle_monocase(struct toggle *t _is_unused, enum toggle_type tt _is_unused)
 {
+	ctlr_changed(0, ROWS*COLS);
 	screen_disp(False);
 }
 
 void
 toggle_underscore(struct toggle *t _is_unused, enum toggle_type tt _is_unused)
 {
+	ctlr_changed(0, ROWS*COLS);
 	screen_disp(False);
 }
 
@@ -1531,6 +1549,7 @@ void
 screen_flip(void)
 {
 	flipped = !flipped;
+	ctlr_changed(0, ROWS*COLS);
 	screen_disp(False);
 }
 
@@ -0,0 +1 @@
+../x3270/sessionc.h
\ No newline at end of file
@@ -46,16 +46,24 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #if !defined(_WIN32) /*[*/
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
 #endif /*]*/
 #include <signal.h>
+#include <time.h>
 #include "globals.h"
 #include "3270ds.h"
 #include "charsetc.h"
 #include "ctlrc.h"
+#include "sessionc.h"
 #include "trace_dsc.h"
 #include "sfc.h"
 #include "tablesc.h"
+#include "telnetc.h"
 #include "unicodec.h"
 #if defined(_WIN32) /*[*/
 #include "wsc.h"
@@ -64,6 +72,9 @@
 
 #if !defined(_WIN32) /*[*/
 extern char *command;
+extern unsigned long outbuf_size;	/* print command output buffer size */
+extern char *spool_dir;			/* spool directory, or NULL */
+extern char *spool_notify;		/* socket to notify of new jobs */
 #else /*][*/
 extern char *printer;
 extern int printercp;
@@ -103,20 +114,31 @@ static int ll_len[] = { 132, 40, 64, 80 };
 static unsigned char default_gr;
 static unsigned char default_cs;
 static int line_length = MAX_LL;
-static ucs4_t page_buf[MAX_BUF];
+static ucs4_t *page_buf = NULL;	/* MAX_BUF characters */
 static int baddr = 0;
 static Boolean page_buf_initted = False;
 static Boolean any_3270_printable = False;
 static int any_3270_output = 0;
 #if !defined(_WIN32) /*[*/
-static FILE *prfile = NULL;
+static int prfd = -1;			/* pipe to the print command */
 static int prpid = -1;
+static unsigned char *prbuf = NULL;	/* output not yet written to prfd */
+static size_t prbuf_len = 0;
+static char *spool_tmp = NULL;		/* spool file being written */
+static char *spool_name = NULL;		/* what it will be renamed to */
+static unsigned long spool_seq = 0;	/* spool file sequence number */
+static int notify_sock = -1;		/* for notifying spool_notify */
 #else /*][*/
 static int ws_initted = 0;
 static int ws_needpre = 1;
 #endif /*]*/
 static unsigned char wcc_line_length;
 
+/* uoutput() state. */
+static char uo_buf[MAX_LL];
+static int uo_col = 0;
+static int uo_maxcol = 0;
+
 static int ctlr_erase(void);
 static int dump_formatted(void);
 static int dump_unformatted(void);
@@ -154,6 +176,17 @@ static unsigned char scs_dbcs_c1 = 0;
 static unsigned scs_cs = 0;
 
 
+/*
+ * Initialize the printer state.
+ */
+void
+ctlr_init(void)
+{
+	if (page_buf == NULL)
+		page_buf = (ucs4_t *)Malloc(MAX_BUF * sizeof(ucs4_t));
+	(void) memset(page_buf, '\0', MAX_BUF * sizeof(ucs4_t));
+}
+
 /*
  * Interpret an incoming 3270 command.
  */
@@ -1383,25 +1416,23 @@ sigchld_handler(int sig)
 
 /*
  * Special version of popen where the child ignores SIGINT.
+ * Returns the write end of the pipe, or -1.
  */
-static FILE *
+static int
 popen_no_sigint(char *command)
 {
 	int fds[2];
-	FILE *f;
 
 	/* Create a pipe. */
 	if (pipe(fds) < 0) {
-		return NULL;
+		return -1;
 	}
 
-	/* Create a stdio stream from the write end. */
-	f = fdopen(fds[1], "w");
-	if (f == NULL) {
-		close(fds[0]);
-		close(fds[1]);
-		return NULL;
-	}
+	/*
+	 * Keep the write end out of print commands started later for other
+	 * sessions, or this one would never see end-of-file.
+	 */
+	(void) fcntl(fds[1], F_SETFD, 1);
 
 	/* Handle SIGCHLD signals. */
 	(void) signal(SIGCHLD, sigchld_handler);
@@ -1409,7 +1440,7 @@ popen_no_sigint(char *command)
 	/* Fork a child process. */
 	switch ((prpid = fork())) {
 	case 0:		/* child */
-		fclose(f);
+		close(fds[1]);
 		dup2(fds[0], 0);
 		signal(SIGINT, SIG_IGN);
 		execl("/bin/sh", "sh", "-c", command, NULL);
@@ -1418,24 +1449,24 @@ popen_no_sigint(char *command)
 		exit(1);
 		break;
 	case -1:	/* parent, error */
-		fclose(f);
 		close(fds[0]);
-		return NULL;
+		close(fds[1]);
+		return -1;
 	default:	/* parent, success */
 		close(fds[0]);
 		break;
 	}
 
-	return f;
+	return fds[1];
 }
 
 static int
-pclose_no_sigint(FILE *f)
+pclose_no_sigint(int fd)
 {
 	int rc;
 	int status;
 
-	fclose(f);
+	close(fd);
 	do {
 		rc = waitpid(prpid, &status, 0);
 	} while (rc < 0 && errno == EINTR);
@@ -1445,6 +1476,176 @@ pclose_no_sigint(FILE *f)
 	else
 		return status;
 }
+
+/*
+ * Write the buffered output, followed by len bytes from buf, to the print
+ * command.  Returns 0 for success, -1 (with errno set) for failure.
+ */
+static int
+prwritev(const unsigned char *buf, size_t len)
+{
+	struct iovec iov[2];
+	struct iovec *v = iov;
+	int n = 0;
+	size_t total = prbuf_len + len;
+	ssize_t nw;
+
+	if (prbuf_len) {
+		iov[n].iov_base = (void *)prbuf;
+		iov[n++].iov_len = prbuf_len;
+	}
+	if (len) {
+		iov[n].iov_base = (void *)buf;
+		iov[n++].iov_len = len;
+	}
+	while (n) {
+		nw = writev(prfd, v, n);
+		if (nw < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		/* Skip what was written, which may end mid-buffer. */
+		while (n && (size_t)nw >= v->iov_len) {
+			nw -= v->iov_len;
+			v++;
+			n--;
+		}
+		if (n) {
+			v->iov_base = (char *)v->iov_base + nw;
+			v->iov_len -= nw;
+		}
+	}
+	prbuf_len = 0;
+	session_count_bytes(total);
+	return 0;
+}
+
+/*
+ * Buffer len bytes for the print command, writing them out if the buffer is
+ * full.  Returns 0 for success, -1 (with errno set) for failure.
+ */
+static int
+prwrite(const unsigned char *buf, size_t len)
+{
+	if (prbuf_len + len <= outbuf_size) {
+		(void) memcpy(prbuf + prbuf_len, buf, len);
+		prbuf_len += len;
+		return 0;
+	}
+	return prwritev(buf, len);
+}
+
+/*
+ * Create a spool file for a new print job.
+ * The file is written under a unique temporary name, and is renamed when the
+ * job is complete.  The final name includes the process ID, so that several
+ * copies of pr3287 can share a spool directory.  Returns the file
+ * descriptor, or -1.
+ */
+static int
+spool_open(void)
+{
+	const char *lu = net_query_lu_name();
+	char ts[32];
+	time_t now = time(NULL);
+	mode_t mask;
+	int fd;
+
+	(void) strftime(ts, sizeof(ts), "%Y%m%d%H%M%S", localtime(&now));
+	spool_seq++;
+	Replace(spool_name, Malloc(strlen(spool_dir) + strlen(lu) + 80));
+	(void) sprintf(spool_name, "%s/%s.%d.%lu.%s", spool_dir,
+	    lu[0]? lu: "pr3287", (int)getpid(), spool_seq, ts);
+	Replace(spool_tmp, Malloc(strlen(spool_name) + 16));
+	(void) sprintf(spool_tmp, "%s/.%s.XXXXXX", spool_dir,
+	    spool_name + strlen(spool_dir) + 1);
+
+	fd = mkstemp(spool_tmp);
+	if (fd < 0) {
+		errmsg("%s: %s", spool_tmp, strerror(errno));
+		return -1;
+	}
+
+	/* mkstemp() makes it private; give it the usual permissions. */
+	mask = umask(0);
+	(void) umask(mask);
+	(void) fchmod(fd, 0644 & ~mask);
+	(void) fcntl(fd, F_SETFD, 1);
+	trace_ds("Spooling to %s.\n", spool_tmp);
+	return fd;
+}
+
+/* Tell whoever is listening on the notify socket about a new spool file. */
+static void
+spool_notify_send(const char *path)
+{
+	struct sockaddr_un ssun;
+	char msg[1024];
+	int len;
+
+	if (notify_sock < 0) {
+		notify_sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+		if (notify_sock < 0) {
+			errmsg("notify socket: %s", strerror(errno));
+			return;
+		}
+		(void) fcntl(notify_sock, F_SETFD, 1);
+	}
+	(void) memset(&ssun, '\0', sizeof(ssun));
+	ssun.sun_family = AF_UNIX;
+	(void) strncpy(ssun.sun_path, spool_notify,
+	    sizeof(ssun.sun_path) - 1);
+	len = snprintf(msg, sizeof(msg), "%s\n", path);
+	if (len >= (int)sizeof(msg))
+		len = sizeof(msg) - 1;
+
+	/* Never wait for the listener; it can rescan the directory. */
+	if (sendto(notify_sock, msg, len, MSG_DONTWAIT,
+		    (struct sockaddr *)&ssun, sizeof(ssun)) < 0)
+		trace_ds("Notify %s: %s\n", spool_notify, strerror(errno));
+}
+
+/*
+ * Close the spool file.  If keep is set, give it its final name and notify
+ * the listener, otherwise remove it.  Returns 0 for success, -1 for failure.
+ */
+static int
+spool_close(Boolean keep)
+{
+	(void) close(prfd);
+	if (!keep) {
+		(void) unlink(spool_tmp);
+		return 0;
+	}
+	if (rename(spool_tmp, spool_name) < 0) {
+		errmsg("rename %s: %s", spool_tmp, strerror(errno));
+		(void) unlink(spool_tmp);
+		return -1;
+	}
+	trace_ds("Spooled %s.\n", spool_name);
+	if (spool_notify != NULL)
+		spool_notify_send(spool_name);
+	return 0;
+}
+
+/*
+ * Report a failure writing to the print command, and abandon the job.
+ */
+static int
+prfail(const char *what)
+{
+	errmsg("%s error to '%s': %s", what,
+	    (spool_dir != NULL)? spool_tmp: command, strerror(errno));
+	if (spool_dir != NULL)
+		(void) spool_close(False);
+	else
+		(void) pclose_no_sigint(prfd);
+	prfd = -1;
+	prbuf_len = 0;
+	return -1;
+}
 #endif /*]*/
 
 /*
@@ -1473,30 +1674,30 @@ stash(unsigned char c)
 	    	return -1;
 	}
 #else /*][*/
-	if (prfile == NULL) {
-		prfile = popen_no_sigint(command);
-		if (prfile == NULL) {
-			errmsg("%s: %s", command, strerror(errno));
-			return -1;
+	if (prfd < 0) {
+		if (spool_dir != NULL)
+			prfd = spool_open();
+		else {
+			prfd = popen_no_sigint(command);
+			if (prfd < 0)
+				errmsg("%s: %s", command, strerror(errno));
 		}
+		if (prfd < 0)
+			return -1;
+		if (prbuf == NULL)
+			prbuf = (unsigned char *)Malloc(outbuf_size);
+		prbuf_len = 0;
 		if ((trnpre_data != NULL) &&
-			fwrite(trnpre_data, 1, trnpre_size,
-					    prfile) != trnpre_size) {
+			prwrite((unsigned char *)trnpre_data,
+			    trnpre_size) < 0) {
 
-			errmsg("Write error to '%s': %s", command,
-				strerror(errno));
-			(void) pclose_no_sigint(prfile);
-			prfile = NULL;
-			return -1;
+			return prfail("Write");
 		}
 	}
 
-	if (fputc(c, prfile) == EOF) {
-		errmsg("Write error to '%s': %s", command, strerror(errno));
-		(void) pclose_no_sigint(prfile);
-		prfile = NULL;
-		return -1;
-	}
+	if (prbuf_len >= outbuf_size && prwritev(NULL, 0) < 0)
+		return prfail("Write");
+	prbuf[prbuf_len++] = c;
 #endif /*]*/
 
 	return 0;
@@ -1513,14 +1714,9 @@ prflush(void)
     	if (ws_initted && ws_flush() < 0)
 		return -1;
 #else /*][*/
-	if (prfile != NULL) {
-		if (fflush(prfile) < 0) {
-			errmsg("Flush error to '%s': %s", command,
-			    strerror(errno));
-			(void) pclose_no_sigint(prfile);
-			prfile = NULL;
-			return -1;
-		}
+	if (prfd >= 0 && prbuf_len) {
+		if (prwritev(NULL, 0) < 0)
+			return prfail("Flush");
 	}
 #endif /*]*/
 	return 0;
@@ -1573,18 +1769,15 @@ ctlr_add(ucs4_t c, unsigned char cs, unsigned char gr)
 static int
 uoutput(char c)
 {
-	static char buf[MAX_LL];
-	static int col = 0;
-	static int maxcol = 0;
 	int i;
 
 	switch (c) {
 	case '\r':
-		col = 0;
+		uo_col = 0;
 		break;
 	case '\n':
-		for (i = 0; i < maxcol; i++) {
-			if (stash(buf[i]) < 0)
+		for (i = 0; i < uo_maxcol; i++) {
+			if (stash(uo_buf[i]) < 0)
 				return -1;
 		}
 		if (crlf) {
@@ -1593,32 +1786,32 @@ uoutput(char c)
 		}
 		if (stash(c) < 0)
 			return -1;
-		col = maxcol = 0;
+		uo_col = uo_maxcol = 0;
 		break;
 	case '\f':
 		if (any_3270_printable || !ffskip) {
-			for (i = 0; i < maxcol; i++) {
-				if (stash(buf[i]) < 0)
+			for (i = 0; i < uo_maxcol; i++) {
+				if (stash(uo_buf[i]) < 0)
 					return -1;
 			}
 			if (stash(c) < 0)
 				return -1;
 		}
-		col = maxcol = 0;
+		uo_col = uo_maxcol = 0;
 		break;
 	default:
 		/* Don't overwrite with spaces. */
 		if (c == ' ') {
-			if (col >= maxcol)
-				buf[col++] = c;
+			if (uo_col >= uo_maxcol)
+				uo_buf[uo_col++] = c;
 			else
-				col++;
+				uo_col++;
 		} else {
-			buf[col++] = c;
+			uo_buf[uo_col++] = c;
 			any_3270_printable = True;
 		}
-		if (col > maxcol)
-			maxcol = col;
+		if (uo_col > uo_maxcol)
+			uo_maxcol = uo_col;
 		break;
 	}
 	return 0;
@@ -1714,7 +1907,7 @@ dump_unformatted(void)
 	if (ws_initted)
 		(void) ws_flush();
 #else /*][*/
-	fflush(prfile);
+	(void) prflush();
 #endif /*]*/
 	any_3270_output = 0;
 
@@ -1840,7 +2033,7 @@ dump_formatted(void)
 	if (ws_initted)
 		(void) ws_flush();
 #else /*][*/
-	fflush(prfile);
+	(void) prflush();
 #endif /*]*/
 	any_3270_output = 0;
 
@@ -1881,15 +2074,24 @@ print_eoj(void)
 		ws_needpre = 1;
 	}
 #else /*]*/
-	if (prfile != NULL) {
+	if (prfd >= 0) {
 		trace_ds("End of print job.\n");
-		if (trnpost_data != NULL &&
-			fwrite(trnpost_data, 1, trnpost_size,
-						    prfile) != trnpost_size) {
-		    rc = -1;
+		session_count_job();
+		if ((trnpost_data != NULL &&
+			prwrite((unsigned char *)trnpost_data,
+			    trnpost_size) < 0) ||
+		    prwritev(NULL, 0) < 0) {
+			errmsg("Write error to '%s': %s",
+			    (spool_dir != NULL)? spool_tmp: command,
+			    strerror(errno));
+			rc = -1;
 		}
-		rc = pclose_no_sigint(prfile);
-		if (rc) {
+		prbuf_len = 0;
+		if (spool_dir != NULL) {
+			/* A partial job is not worth keeping. */
+			if (spool_close(rc == 0) < 0)
+				rc = -1;
+		} else if ((rc = pclose_no_sigint(prfd)) != 0) {
 			if (rc < 0)
 				errmsg("Close error on '%s': %s", command,
 				    strerror(errno));
@@ -1904,7 +2106,7 @@ print_eoj(void)
 				    command, rc);
 			rc = -1;
 		}
-		prfile = NULL;
+		prfd = -1;
 	}
 #endif /*]*/
 
@@ -1953,3 +2155,50 @@ ctlr_erase(void)
 	baddr = 0;
 	return 0;
 }
+
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+ctlr_session_vars(void)
+{
+	SESSION_VAR(default_gr);
+	SESSION_VAR(default_cs);
+	SESSION_VAR(line_length);
+	SESSION_VAR(page_buf);
+	SESSION_VAR(baddr);
+	SESSION_VAR(page_buf_initted);
+	SESSION_VAR(any_3270_printable);
+	SESSION_VAR(any_3270_output);
+	SESSION_VAR(prfd);
+	SESSION_VAR(prpid);
+	SESSION_VAR(prbuf);
+	SESSION_VAR(prbuf_len);
+	SESSION_VAR(spool_tmp);
+	SESSION_VAR(spool_name);
+	SESSION_VAR(wcc_line_length);
+	SESSION_VAR(uo_buf);
+	SESSION_VAR(uo_col);
+	SESSION_VAR(uo_maxcol);
+	SESSION_VAR(linebuf);
+	SESSION_VAR(trnbuf);
+	SESSION_VAR(htabs);
+	SESSION_VAR(vtabs);
+	SESSION_VAR(lm);
+	SESSION_VAR(tm);
+	SESSION_VAR(bm);
+	SESSION_VAR(mpp);
+	SESSION_VAR(mpl);
+	SESSION_VAR(scs_any);
+	SESSION_VAR(pp);
+	SESSION_VAR(line);
+	SESSION_VAR(scs_initted);
+	SESSION_VAR(any_scs_output);
+	SESSION_VAR(scs_leftover_len);
+	SESSION_VAR(scs_leftover_buf);
+	SESSION_VAR(scs_dbcs_subfield);
+#if defined(X3270_DBCS) /*[*/
+	SESSION_VAR(scs_dbcs_c1);
+#endif /*]*/
+	SESSION_VAR(scs_cs);
+}
+#endif /*]*/
@@ -39,8 +39,12 @@ enum pds {
 };
 
 extern void ctlr_add(ucs4_t c, unsigned char cs, unsigned char gr);
+extern void ctlr_init(void);
 extern void ctlr_write(unsigned char buf[], int buflen, Boolean erase);
 extern int print_eoj(void);
 extern void print_unbind(void);
 extern enum pds process_ds(unsigned char *buf, int buflen);
 extern enum pds process_scs(unsigned char *buf, int buflen);
+#if defined(X3270_SESSIONS) /*[*/
+extern void ctlr_session_vars(void);
+#endif /*]*/
@@ -67,5 +67,9 @@ extern char *NewString(const char *);
 extern void Warning(const char *s);
 extern void Error(const char *s);
 #define X3270_TRACE 1
+#if !defined(_WIN32) /*[*/
+#define X3270_SESSIONS 1
+#endif /*]*/
 
 extern void errmsg(const char *, ...);
+extern void infomsg(const char *, ...);
@@ -44,6 +44,10 @@
  *		expand newlines to CR/LF (Windows only)
  *          -blanklines
  *		display blank lines even if they're empty (formatted LU3)
+ *          -bufsize n
+ *		buffer n bytes of output to the print command (POSIX only)
+ *          -connecttimeout n
+ *              give up connecting to the host after n seconds
  *          -eojtimeout n
  *              time out end of job after n seconds
  *          -ffthru
@@ -59,6 +63,12 @@
  *	    	proxy specification
  *          -reconnect
  *		keep trying to reconnect
+ *	    -server file
+ *		run the printer sessions listed in a file (POSIX only)
+ *	    -spooldir dir
+ *		write each print job to a file in dir (POSIX only)
+ *	    -spoolnotify socket
+ *		notify a Unix-domain socket of new spool files (POSIX only)
  *	    -trace
  *		trace data stream to a file
  *          -tracedir dir
@@ -86,6 +96,8 @@
 #include <unistd.h>
 #endif /*]*/
 #if !defined(_WIN32) /*[*/
+#include <sys/ioctl.h>
+#include <sys/wait.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -105,6 +117,7 @@
 #include "popupsc.h"
 #include "proxyc.h"
 #include "resolverc.h"
+#include "sessionc.h"
 #include "telnetc.h"
 #include "utf8c.h"
 #if defined(_WIN32) /*[*/
@@ -122,6 +135,30 @@
 #define INADDR_NONE	0xffffffffL
 #endif /*]*/
 
+#if defined(_WIN32) /*[*/
+#define socket_errno()	WSAGetLastError()
+#define set_socket_errno(e)	WSASetLastError(e)
+#define SE_EWOULDBLOCK	WSAEWOULDBLOCK
+#define SE_EINPROGRESS	WSAEINPROGRESS
+#define SE_EINTR	WSAEINTR
+#define SE_ETIMEDOUT	WSAETIMEDOUT
+#define SOCK_CLOSE(s)	closesocket(s)
+#define SOCK_IOCTL(s, f, v)	ioctlsocket(s, f, (DWORD *)v)
+#else /*][*/
+#define socket_errno()	errno
+#define set_socket_errno(e)	(errno = (e))
+#define SE_EWOULDBLOCK	EWOULDBLOCK
+#define SE_EINPROGRESS	EINPROGRESS
+#define SE_EINTR	EINTR
+#define SE_ETIMEDOUT	ETIMEDOUT
+#define SOCK_CLOSE(s)	close(s)
+#define SOCK_IOCTL	ioctl
+#endif /*]*/
+
+#define CONNECT_STAGGER_MS	250	/* delay before trying another address */
+#define BACKOFF_MIN		1	/* first reconnect delay, in seconds */
+#define BACKOFF_MAX		60	/* longest reconnect delay, in seconds */
+
 /* Externals. */
 extern char *build;
 extern FILE *tracef;
@@ -145,6 +182,12 @@ int ffskip = 0;
 int verbose = 0;
 int ssl_host = 0;
 unsigned long eoj_timeout = 0L; /* end of job timeout */
+unsigned long connect_timeout = 15L; /* host connect timeout */
+#if !defined(_WIN32) /*[*/
+unsigned long outbuf_size = 16384L; /* print command output buffer size */
+char *spool_dir = NULL;		/* spool directory, instead of a command */
+char *spool_notify = NULL;	/* socket to notify of new spool files */
+#endif /*]*/
 char *trnpre_data = NULL;
 size_t trnpre_size = 0;
 char *trnpost_data = NULL;
@@ -164,6 +207,9 @@ static int tracing = 0;		/* are we tracing? */
 #if !defined(_WIN32) /*[*/
 static char *tracedir = "/tmp";	/* where we are tracing */
 #endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+static char *server_file = NULL;	/* server-mode session list */
+#endif /*]*/
 char *proxy_spec;		/* proxy specification */
 
 static int proxy_type = 0;
@@ -183,7 +229,13 @@ static void
 usage(void)
 {
 	(void) fprintf(stderr, "usage: %s [options] [lu[,lu...]@]host[:port]\n"
+#if defined(X3270_SESSIONS) /*[*/
+"       %s [options] -server <file>\n"
+#endif /*]*/
 "Options:\n%s%s%s%s", programname,
+#if defined(X3270_SESSIONS) /*[*/
+programname,
+#endif /*]*/
 #if !defined(_WIN32) /*[*/
 "  -daemon          become a daemon after connecting\n"
 #endif /*]*/
@@ -193,11 +245,16 @@ usage(void)
 "  -command \"<cmd>\" use <cmd> for printing (default \"lpr\")\n"
 #endif /*]*/
 "  -blanklines      display blank lines even if empty (formatted LU3)\n"
+#if !defined(_WIN32) /*[*/
+"  -bufsize <bytes> buffer size for output to the print command\n"
+#endif /*]*/
 #if defined(_WIN32) /*[*/
 "  -nocrlf          don't expand newlines to CR/LF\n"
 #else /*][*/
 "  -crlf            expand newlines to CR/LF\n"
 #endif /*]*/
+"  -connecttimeout <seconds>\n"
+"                   time out connecting to the host (default 15)\n"
 "  -eojtimeout <seconds>\n"
 "                   time out end of print job\n"
 "  -ffthru          pass through SCS FF orders\n"
@@ -213,6 +270,14 @@ usage(void)
 "  -proxy \"<spec>\"\n"
 "                   connect to host via specified proxy\n"
 "  -reconnect       keep trying to reconnect\n"
+#if defined(X3270_SESSIONS) /*[*/
+"  -server <file>   run the [lu@]host[:port] [command] sessions in <file>\n"
+#endif /*]*/
+#if !defined(_WIN32) /*[*/
+"  -spooldir <dir>  write print jobs to files in <dir> instead of a command\n"
+"  -spoolnotify <socket>\n"
+"                   send new spool file names to a Unix-domain socket\n"
+#endif /*]*/
 "  -trace           trace data stream to /tmp/x3trc.<pid>\n",
 #if !defined(_WIN32) /*[*/
 "  -tracedir <dir>  directory to keep trace information in\n"
@@ -263,6 +328,25 @@ errmsg(const char *fmt, ...)
 	va_end(args);
 }
 
+/* Print an informational message. */
+void
+infomsg(const char *fmt, ...)
+{
+	va_list args;
+	char buf[4096];
+
+	va_start(args, fmt);
+	(void) vsprintf(buf, fmt, args);
+	va_end(args);
+#if !defined(_WIN32) /*[*/
+	if (bdaemon == AM_DAEMON) {
+		syslog(LOG_INFO, "%s: %s", programname, buf);
+		return;
+	}
+#endif /*]*/
+	(void) fprintf(stderr, "%s: %s\n", programname, buf);
+}
+
 /* Memory allocation. */
 void *
 Malloc(size_t len)
@@ -282,6 +366,18 @@ Free(void *p)
 	free(p);
 }
 
+void *
+Calloc(size_t nelem, size_t elsize)
+{
+	void *p = calloc(nelem, elsize);
+
+	if (p == NULL) {
+		errmsg("Out of memory");
+		pr3287_exit(1);
+	}
+	return p;
+}
+
 void *
 Realloc(void *p, size_t len)
 {
@@ -374,26 +470,722 @@ read_trn(char *filename, char **data, size_t *size)
 	close(fd);
 }
 
+/*
+ * Split a [lu[,lu...]@]host[:port] specification into its parts.  The port
+ * defaults to "telnet".  Returns 0 for success, -1 for a syntax error.
+ */
 int
-main(int argc, char *argv[])
+parse_host_spec(char *spec, char **lu, char **host, char **port)
 {
-	int i;
 	char *at, *colon;
 	int len;
+
+	*lu = NULL;
+	*port = "telnet";
+	if ((at = strchr(spec, '@')) != NULL) {
+		len = at - spec;
+		if (!len)
+			return -1;
+		*lu = Malloc(len + 1);
+		(void) strncpy(*lu, spec, len);
+		(*lu)[len] = '\0';
+		*host = at + 1;
+	} else
+		*host = spec;
+
+	/*
+	 * Allow the hostname to be enclosed in '[' and ']' to quote any
+	 * IPv6 numeric-address ':' characters.
+	 */
+	if ((*host)[0] == '[') {
+		char *tmp;
+		char *rbracket;
+
+		rbracket = strchr(*host+1, ']');
+		if (rbracket != NULL) {
+			len = rbracket - (*host+1);
+			tmp = Malloc(len + 1);
+			(void) strncpy(tmp, *host+1, len);
+			tmp[len] = '\0';
+			*host = tmp;
+			if (*(rbracket + 1) == ':')
+				*port = rbracket + 2;
+		}
+	} else {
+		colon = strchr(*host, ':');
+		if (colon != NULL) {
+			char *tmp;
+
+			len = colon - *host;
+			if (!len || !*(colon + 1))
+				return -1;
+			*port = colon + 1;
+			tmp = Malloc(len + 1);
+			(void) strncpy(tmp, *host, len);
+			tmp[len] = '\0';
+			*host = tmp;
+		}
+	}
+	return 0;
+}
+
+/* Milliseconds from one time to another. */
+static long
+ms_since(struct timeval *from, struct timeval *to)
+{
+	return (to->tv_sec - from->tv_sec) * 1000L +
+	    (to->tv_usec - from->tv_usec) / 1000L;
+}
+
+/* Put a socket into or out of non-blocking mode. */
+static int
+set_nonblocking(int s, int on)
+{
+#if defined(_WIN32) /*[*/
+	u_long v = on;
+#else /*][*/
+	int v = on;
+#endif /*]*/
+
+	return SOCK_IOCTL(s, FIONBIO, &v);
+}
+
+/*
+ * A connection in progress: a look-up of the host or proxy server's name, then
+ * a connection to one of its addresses, then through the proxy, if there is
+ * one, to the host.  Except on Windows, a name that is not in the cache is
+ * looked up by a child process, and so is the host's address if a SOCKS
+ * proxy needs it.
+ *
+ * If an address has not answered within CONNECT_STAGGER_MS, the next one is
+ * tried alongside it, and the first to answer wins.  The attempt gives up
+ * after connect_timeout seconds, or when the proxy negotiation times out.
+ *
+ * Nothing here blocks: pconn_fds() says what to wait for and for how long,
+ * and pconn_step() carries on from there.
+ */
+struct pconn {
+	rhaddrs_t r;			/* addresses to try */
+	int	 socks[RH_MAX_ADDRS];	/* attempts in progress, or -1 */
+	int	 next;			/* next address to try */
+	int	 active;		/* number of attempts in progress */
+	int	 err;			/* error from the last failed attempt */
+	struct timeval start;		/* when the first attempt began */
+	long	 next_at;		/* when the next one is due, in ms */
+	char	*chost;			/* what we connect to */
+	char	*cport;
+	char	*host;			/* host at the far end of the proxy */
+	unsigned short port;
+	int	 sock;			/* socket talking to the proxy, or -1 */
+	proxy_state_t *ps;		/* proxy negotiation, or NULL */
+	int	 want;			/* what the proxy is waiting for */
+	int	 wfds[RH_MAX_ADDRS];	/* sockets listed by pconn_fds() */
+	int	 nw;
+	unsigned short *pp;		/* where the host port goes */
+#if !defined(_WIN32) /*[*/
+	pid_t	 rpid;			/* resolver process, or 0 */
+	int	 rfd;			/* pipe from it, or -1 */
+#endif /*]*/
+};
+typedef struct pconn pconn_t;
+
+#if !defined(_WIN32) /*[*/
+/* Stop waiting for the resolver process. */
+static void
+pconn_resolve_cancel(pconn_t *pc)
+{
+	if (pc->rfd >= 0) {
+		(void) close(pc->rfd);
+		pc->rfd = -1;
+	}
+	if (pc->rpid > 0) {
+		(void) kill(pc->rpid, SIGKILL);
+		(void) waitpid(pc->rpid, NULL, 0);
+		pc->rpid = 0;
+	}
+}
+
+/*
+ * Start a resolver process to look up a host name and port, so that a slow
+ * or unreachable name server does not hold up the other sessions.  The
+ * answer is read by pconn_resolve_read() when pc->rfd is readable.
+ * Returns 0 for success, -1 (after reporting the problem) for failure.
+ */
+static int
+pconn_resolve(pconn_t *pc, const char *host, char *portname)
+{
+	int fds[2];
+	rhresult_t res;
+
+	if (pipe(fds) < 0) {
+		popup_an_errno(errno, "pipe");
+		return -1;
+	}
+	switch (pc->rpid = fork()) {
+	case -1:
+		popup_an_errno(errno, "fork");
+		(void) close(fds[0]);
+		(void) close(fds[1]);
+		pc->rpid = 0;
+		return -1;
+	case 0:
+		/* Child: look it up and report back. */
+		(void) close(fds[0]);
+		(void) memset(&res, '\0', sizeof(res));
+		res.rc = resolve_host_and_port_all(host, portname, &res.addrs,
+		    res.errmsg, sizeof(res.errmsg));
+		(void) write(fds[1], &res, sizeof(res));
+		_exit(0);
+		break;
+	default:
+		break;
+	}
+	(void) close(fds[1]);
+	(void) fcntl(fds[0], F_SETFD, 1);
+	pc->rfd = fds[0];
+	trace_ds("Resolving %s/%s\n", host, portname);
+	return 0;
+}
+
+/*
+ * Read the resolver process's answer into *res, and stop waiting for it.
+ * Returns the look-up result.
+ */
+static int
+pconn_resolve_read(pconn_t *pc, const char *host, char *portname,
+    rhresult_t *res)
+{
+	ssize_t nr;
+
+	nr = read(pc->rfd, res, sizeof(*res));
+	pconn_resolve_cancel(pc);
+	if (nr != sizeof(*res)) {
+		res->rc = -1;
+		(void) snprintf(res->errmsg, sizeof(res->errmsg),
+		    "%s/%s: Resolver failed", host, portname);
+	}
+	if (res->rc == 0)
+		resolve_cache_add(host, portname, &res->addrs);
+	return res->rc;
+}
+#endif /*]*/
+
+/* Give up on a connection attempt, closing its sockets. */
+void
+pconn_abort(pconn_t *pc)
+{
+	int i;
+
+#if !defined(_WIN32) /*[*/
+	pconn_resolve_cancel(pc);
+#endif /*]*/
+
+	for (i = 0; i < RH_MAX_ADDRS; i++) {
+		if (pc->socks[i] >= 0)
+			SOCK_CLOSE(pc->socks[i]);
+	}
+	if (pc->ps != NULL)
+		proxy_abort(pc->ps);
+	if (pc->sock >= 0)
+		SOCK_CLOSE(pc->sock);
+	Free(pc->chost);
+	Free(pc->cport);
+	Free(pc->host);
+	Free(pc);
+}
+
+/* Fail a connection attempt with socket error 'err'. */
+static int
+pconn_fail(pconn_t *pc, int err)
+{
+	set_socket_errno(err);
+	popup_a_sockerr("%s", pc->chost);
+
+	/* The host may have moved. */
+	resolve_cache_flush(pc->chost, pc->cport);
+	pconn_abort(pc);
+	return -1;
+}
+
+/* Finish a connection attempt, handing back the socket in *sp. */
+static int
+pconn_done(pconn_t *pc, int s, int *sp)
+{
+	(void) set_nonblocking(s, 0);
+	*sp = s;
+	pconn_abort(pc);
+	return 1;
+}
+
+/* Move the proxy negotiation along. */
+static int
+pconn_proxy(pconn_t *pc, int *sp)
+{
+	int s;
+
+	pc->want = proxy_continue(pc->ps);
+	if (pc->want == PX_WANTREAD || pc->want == PX_WANTWRITE)
+		return 0;
+
+	/* proxy_continue() has freed the state. */
+	pc->ps = NULL;
+	if (pc->want != PX_SUCCESS) {
+		pconn_abort(pc);
+		return -1;
+	}
+	s = pc->sock;
+	pc->sock = -1;
+	return pconn_done(pc, s, sp);
+}
+
+/*
+ * Look up the host's address for a SOCKS proxy to connect to.  A cached
+ * answer is used at once; otherwise (except on Windows) a resolver process
+ * is started, pconn_target_done() carries on, and True is returned.
+ */
+static Boolean
+pconn_target(pconn_t *pc)
+{
+	char portname[16];
+	rhaddrs_t r;
+	int i;
+
+	if (!proxy_wants_addr(pc->ps))
+		return False;
+	(void) snprintf(portname, sizeof(portname), "%u", pc->port);
+	if (resolve_cache_lookup(pc->host, portname, &r)) {
+		for (i = 0; i < r.n; i++)
+			proxy_set_addr(pc->ps, &r.addr[i].sa, r.len[i]);
+		return False;
+	}
+#if !defined(_WIN32) /*[*/
+	return pconn_resolve(pc, pc->host, portname) == 0;
+#else /*][*/
+	proxy_resolve(pc->ps);
+	return False;
+#endif /*]*/
+}
+
+#if !defined(_WIN32) /*[*/
+/*
+ * The host's address for the proxy has been looked up, or has taken too
+ * long ('ready' is False).  If it could not be found, the proxy is sent the
+ * name instead.
+ */
+static int
+pconn_target_done(pconn_t *pc, Boolean ready, int *sp)
+{
+	char portname[16];
+	rhresult_t res;
+	int i;
+
+	(void) snprintf(portname, sizeof(portname), "%u", pc->port);
+	if (!ready) {
+		trace_ds("Timed out resolving %s, sending the name to the "
+		    "proxy\n", pc->host);
+		pconn_resolve_cancel(pc);
+		res.addrs.n = 0;
+	} else if (pconn_resolve_read(pc, pc->host, portname, &res) < 0) {
+		trace_ds("%s, sending the name to the proxy\n", res.errmsg);
+		res.addrs.n = 0;
+	}
+	for (i = 0; i < res.addrs.n; i++)
+		proxy_set_addr(pc->ps, &res.addrs.addr[i].sa,
+		    res.addrs.len[i]);
+	proxy_set_addr(pc->ps, NULL, 0);
+	return pconn_proxy(pc, sp);
+}
+#endif /*]*/
+
+/* One of the addresses has answered. */
+static int
+pconn_connected(pconn_t *pc, int s, int *sp)
+{
+	int i;
+
+	/* Clean up the losers. */
+	for (i = 0; i < RH_MAX_ADDRS; i++) {
+		if (pc->socks[i] >= 0) {
+			SOCK_CLOSE(pc->socks[i]);
+			pc->socks[i] = -1;
+		}
+	}
+	pc->active = 0;
+	if (proxy_type <= 0)
+		return pconn_done(pc, s, sp);
+
+	/* Connect to the host through the proxy. */
+	if (verbose) {
+		(void) fprintf(stderr, "Connected to proxy server %s, "
+			       "port %u\n", proxy_host, proxy_port);
+	}
+	pc->sock = s;
+	if ((pc->ps = proxy_start(proxy_type, s, pc->host, pc->port)) ==
+		    NULL) {
+		pconn_abort(pc);
+		return -1;
+	}
+	if (pconn_target(pc))
+		return 0;
+	return pconn_proxy(pc, sp);
+}
+
+/*
+ * The host or proxy server's addresses are known.  Note the port, and get
+ * ready to connect.
+ */
+static void
+pconn_resolved(pconn_t *pc, rhaddrs_t *r)
+{
+	pc->r = *r;
+	if (proxy_type > 0)
+		proxy_port = r->port;
+	else
+		pc->port = r->port;
+	*pc->pp = pc->port;
+
+	/* The connect time limit starts now. */
+	(void) gettimeofday(&pc->start, NULL);
+}
+
+/*
+ * Start connecting to a host, through the proxy if there is one.  The host
+ * port is put in *pp once it is known.
+ * Returns NULL (after reporting the problem) for a failure worth retrying.
+ */
+pconn_t *
+pconn_start(char *host, char *port, unsigned short *pp)
+{
+	pconn_t *pc;
+	rhaddrs_t r;
+	char *chost, *cport;	/* what we connect to */
+	unsigned short p = 0;
+	int i;
+#if defined(_WIN32) /*[*/
+	char errtxt[1024];
+#endif /*]*/
+
+	if (proxy_type > 0) {
+		unsigned long lport;
+		char *ptr;
+		struct servent *sp;
+
+		chost = proxy_host;
+		cport = proxy_portname;
+
+		lport = strtoul(port, &ptr, 0);
+		if (ptr == port || *ptr != '\0' || lport == 0L ||
+			    lport & ~0xffff) {
+			if (!(sp = getservbyname(port, "tcp"))) {
+				popup_an_error("Unknown port number "
+					"or service: %s", port);
+				return NULL;
+			}
+			p = ntohs(sp->s_port);
+		} else
+			p = (unsigned short)lport;
+	} else {
+		chost = host;
+		cport = port;
+	}
+
+	pc = (pconn_t *)Calloc(1, sizeof(pconn_t));
+	for (i = 0; i < RH_MAX_ADDRS; i++)
+		pc->socks[i] = -1;
+	pc->err = SE_ETIMEDOUT;
+	(void) gettimeofday(&pc->start, NULL);
+	pc->chost = NewString(chost);
+	pc->cport = NewString(cport);
+	pc->host = NewString(host);
+	pc->port = p;
+	pc->pp = pp;
+	pc->sock = -1;
+#if !defined(_WIN32) /*[*/
+	pc->rfd = -1;
+#endif /*]*/
+
+	/* Resolve the host name. */
+	if (resolve_cache_lookup(chost, cport, &r)) {
+		pconn_resolved(pc, &r);
+		return pc;
+	}
+#if !defined(_WIN32) /*[*/
+	if (pconn_resolve(pc, chost, cport) < 0) {
+		pconn_abort(pc);
+		return NULL;
+	}
+#else /*][*/
+	if (resolve_host_and_port_all(chost, cport, &r, errtxt,
+		    sizeof(errtxt)) < 0) {
+		popup_an_error("%s", errtxt);
+		pconn_abort(pc);
+		return NULL;
+	}
+	pconn_resolved(pc, &r);
+#endif /*]*/
+	return pc;
+}
+
+/*
+ * List the sockets a connection attempt is waiting on, and what for
+ * (PX_WANTREAD or PX_WANTWRITE), in fds[] and wants[].  There are never more
+ * than RH_MAX_ADDRS of them; the number is returned in *nfds.  Returns the
+ * number of milliseconds after which pconn_step() must be called even if
+ * none of them is ready.
+ */
+long
+pconn_fds(pconn_t *pc, int *fds, int *wants, int *nfds)
+{
+	struct timeval now;
+	long elapsed, wait;
+	int i;
+
+	pc->nw = 0;
+#if !defined(_WIN32) /*[*/
+	if (pc->rfd >= 0) {
+		pc->wfds[pc->nw++] = pc->rfd;
+		fds[0] = pc->rfd;
+		wants[0] = PX_WANTREAD;
+		*nfds = pc->nw;
+		if (pc->ps != NULL)
+			return (long)proxy_timeout_ms(pc->ps) + 1L;
+		(void) gettimeofday(&now, NULL);
+		wait = (long)connect_timeout * 1000L -
+		    ms_since(&pc->start, &now);
+		return (wait > 0)? wait: 0L;
+	}
+#endif /*]*/
+	if (pc->ps != NULL) {
+		pc->wfds[pc->nw++] = pc->sock;
+		fds[0] = pc->sock;
+		wants[0] = (pc->want == PX_WANTREAD)? PX_WANTREAD: PX_WANTWRITE;
+		*nfds = pc->nw;
+		return (long)proxy_timeout_ms(pc->ps) + 1L;
+	}
+
+	for (i = 0; i < pc->next; i++) {
+		if (pc->socks[i] >= 0) {
+			fds[pc->nw] = pc->socks[i];
+			wants[pc->nw] = PX_WANTWRITE;
+			pc->wfds[pc->nw++] = pc->socks[i];
+		}
+	}
+	*nfds = pc->nw;
+	(void) gettimeofday(&now, NULL);
+	elapsed = ms_since(&pc->start, &now);
+	wait = (long)connect_timeout * 1000L - elapsed;
+	if (pc->next < pc->r.n && pc->next_at - elapsed < wait)
+		wait = pc->next_at - elapsed;
+	return (wait > 0)? wait: 0L;
+}
+
+/* Check whether a socket listed by pconn_fds() is ready. */
+static Boolean
+pconn_ready(pconn_t *pc, const int *ready, int s)
+{
+	int i;
+
+	if (ready == NULL)
+		return False;
+	for (i = 0; i < pc->nw; i++) {
+		if (pc->wfds[i] == s)
+			return ready[i] != 0;
+	}
+	return False;
+}
+
+/*
+ * Move a connection attempt along, given which of the sockets listed by the
+ * last pconn_fds() call are ready (a nonzero entry in ready[] for each one
+ * that is), or NULL the first time.  A socket is ready when it can do what
+ * it was listed for, or has an error pending.  Returns 1 with the connected, blocking socket in *sp, 0 if it is
+ * still in progress, or -1 (after reporting the problem) if it has failed.
+ * 'pc' is freed unless 0 is returned.
+ */
+int
+pconn_step(pconn_t *pc, const int *ready, int *sp)
+{
+	struct timeval now;
+	long elapsed;
+	int i;
+
+#if !defined(_WIN32) /*[*/
+	if (pc->rfd >= 0) {
+		Boolean answered = pconn_ready(pc, ready, pc->rfd);
+		rhresult_t res;
+
+		/* Waiting for the host's address for the proxy. */
+		if (pc->ps != NULL) {
+			if (answered || !proxy_timeout_ms(pc->ps))
+				return pconn_target_done(pc, answered, sp);
+			return 0;
+		}
+
+		/* Waiting for the address to connect to. */
+		if (!answered) {
+			(void) gettimeofday(&now, NULL);
+			if (ms_since(&pc->start, &now) >=
+				    (long)connect_timeout * 1000L) {
+				popup_an_error("%s/%s: Timed out resolving",
+				    pc->chost, pc->cport);
+				pconn_abort(pc);
+				return -1;
+			}
+			return 0;
+		}
+		if (pconn_resolve_read(pc, pc->chost, pc->cport, &res) < 0) {
+			popup_an_error("%s", res.errmsg);
+			pconn_abort(pc);
+			return -1;
+		}
+		pconn_resolved(pc, &res.addrs);
+	}
+#endif /*]*/
+	if (pc->ps != NULL)
+		return pconn_proxy(pc, sp);
+
+	/* Collect the answers. */
+	for (i = 0; ready != NULL && i < pc->next; i++) {
+		int s = pc->socks[i];
+		int e = 0;
+		socklen_t len = sizeof(e);
+
+		if (s < 0 || !pconn_ready(pc, ready, s))
+			continue;
+		pc->socks[i] = -1;
+		pc->active--;
+		if (getsockopt(s, SOL_SOCKET, SO_ERROR, (char *)&e, &len) < 0)
+			e = socket_errno();
+		if (!e)
+			return pconn_connected(pc, s, sp);
+		pc->err = e;
+		SOCK_CLOSE(s);
+	}
+
+	/* Start the next attempt, if it is due. */
+	for (;;) {
+		int s;
+		int e;
+
+		(void) gettimeofday(&now, NULL);
+		elapsed = ms_since(&pc->start, &now);
+		if (elapsed >= (long)connect_timeout * 1000L)
+			return pconn_fail(pc, SE_ETIMEDOUT);
+		if (pc->next >= pc->r.n ||
+		    (pc->active && elapsed < pc->next_at))
+			break;
+
+		i = pc->next++;
+		pc->next_at = elapsed + CONNECT_STAGGER_MS;
+		s = socket(pc->r.addr[i].sa.sa_family, SOCK_STREAM, 0);
+		if (s < 0) {
+			pc->err = socket_errno();
+			continue;
+		}
+#if !defined(_WIN32) /*[*/
+		/* Keep it out of the print command. */
+		(void) fcntl(s, F_SETFD, 1);
+#endif /*]*/
+		(void) set_nonblocking(s, 1);
+		if (connect(s, &pc->r.addr[i].sa, pc->r.len[i]) == 0)
+			return pconn_connected(pc, s, sp);
+		e = socket_errno();
+		if (e != SE_EINPROGRESS && e != SE_EWOULDBLOCK) {
+			pc->err = e;
+			SOCK_CLOSE(s);
+			continue;
+		}
+		pc->socks[i] = s;
+		pc->active++;
+	}
+
+	if (!pc->active)
+		return pconn_fail(pc, pc->err);
+	return 0;
+}
+
+/*
+ * Resolve a host name and connect to it, through the proxy if there is one,
+ * waiting for the connection to finish.
+ * Returns the socket, or -1 for a failure worth retrying.  The host port is
+ * returned in *pp.
+ */
+int
+pr3287_connect(char *host, char *port, unsigned short *pp)
+{
+	pconn_t *pc;
+	int s = -1;
+	int rv;
+
+	if ((pc = pconn_start(host, port, pp)) == NULL)
+		return -1;
+	rv = pconn_step(pc, NULL, &s);
+	while (!rv) {
+		fd_set rfds, wfds, efds;
+		struct timeval t;
+		int fds[RH_MAX_ADDRS], wants[RH_MAX_ADDRS];
+		int ready[RH_MAX_ADDRS];
+		int nfds;
+		int maxfd = -1;
+		long wait;
+		int i;
+
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		FD_ZERO(&efds);
+		wait = pconn_fds(pc, fds, wants, &nfds);
+		for (i = 0; i < nfds; i++) {
+			FD_SET(fds[i], (wants[i] == PX_WANTREAD)? &rfds: &wfds);
+			FD_SET(fds[i], &efds);
+			if (fds[i] > maxfd)
+				maxfd = fds[i];
+		}
+		t.tv_sec = wait / 1000L;
+		t.tv_usec = (wait % 1000L) * 1000L;
+		if (select(maxfd + 1, &rfds, &wfds, &efds, &t) < 0) {
+			FD_ZERO(&rfds);
+			FD_ZERO(&wfds);
+			FD_ZERO(&efds);
+		}
+		for (i = 0; i < nfds; i++)
+			ready[i] = FD_ISSET(fds[i], &rfds) ||
+			    FD_ISSET(fds[i], &wfds) || FD_ISSET(fds[i], &efds);
+		rv = pconn_step(pc, ready, &s);
+	}
+	return (rv > 0)? s: -1;
+}
+
+/*
+ * Work out how long to wait before reconnecting, and double *backoff for
+ * next time.  The wait is randomized between half and all of *backoff, so
+ * that many printers cut off by the same outage do not all come back at the
+ * same moment.
+ */
+int
+reconnect_delay(int *backoff)
+{
+	int delay;
+
+	if (*backoff < BACKOFF_MIN)
+		*backoff = BACKOFF_MIN;
+	delay = (*backoff + 1) / 2 + rand() % (*backoff / 2 + 1);
+	*backoff *= 2;
+	if (*backoff > BACKOFF_MAX)
+		*backoff = BACKOFF_MAX;
+	return delay;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i;
 	char *charset = "us";
 	char *lu = NULL;
 	char *host = NULL;
 	char *port = "telnet";
 	unsigned short p;
-	union {
-		struct sockaddr sa;
-		struct sockaddr_in sin;
-#if defined(AF_INET6) /*[*/
-		struct sockaddr_in6 sin6;
-#endif /*]*/
-	} ha;
-	socklen_t ha_len = sizeof(ha);
 	int s = -1;
+	int backoff = BACKOFF_MIN;
 	int rc = 0;
 	int report_success = 0;
 #if defined(HAVE_LIBSSL) /*[*/
@@ -470,6 +1262,28 @@ main(int argc, char *argv[])
 		} else if (!strcmp(argv[i], "-crlf")) {
 			crlf = 1;
 #endif /*]*/
+#if !defined(_WIN32) /*[*/
+		} else if (!strcmp(argv[i], "-bufsize")) {
+			if (argc <= i + 1 || !argv[i + 1][0]) {
+				(void) fprintf(stderr,
+				    "Missing value for -bufsize\n");
+				usage();
+			}
+			outbuf_size = strtoul(argv[i + 1], NULL, 0);
+			if (outbuf_size == 0L)
+				usage();
+			i++;
+#endif /*]*/
+		} else if (!strcmp(argv[i], "-connecttimeout")) {
+			if (argc <= i + 1 || !argv[i + 1][0]) {
+				(void) fprintf(stderr,
+				    "Missing value for -connecttimeout\n");
+				usage();
+			}
+			connect_timeout = strtoul(argv[i + 1], NULL, 0);
+			if (connect_timeout == 0L)
+				usage();
+			i++;
 		} else if (!strcmp(argv[i], "-eojtimeout")) {
 			if (argc <= i + 1 || !argv[i + 1][0]) {
 				(void) fprintf(stderr,
@@ -504,6 +1318,34 @@ main(int argc, char *argv[])
 #endif /*]*/
 		} else if (!strcmp(argv[i], "-reconnect")) {
 			reconnect = 1;
+#if !defined(_WIN32) /*[*/
+		} else if (!strcmp(argv[i], "-spooldir")) {
+			if (argc <= i + 1 || !argv[i + 1][0]) {
+				(void) fprintf(stderr,
+				    "Missing value for -spooldir\n");
+				usage();
+			}
+			spool_dir = argv[i + 1];
+			i++;
+		} else if (!strcmp(argv[i], "-spoolnotify")) {
+			if (argc <= i + 1 || !argv[i + 1][0]) {
+				(void) fprintf(stderr,
+				    "Missing value for -spoolnotify\n");
+				usage();
+			}
+			spool_notify = argv[i + 1];
+			i++;
+#endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+		} else if (!strcmp(argv[i], "-server")) {
+			if (argc <= i + 1 || !argv[i + 1][0]) {
+				(void) fprintf(stderr,
+				    "Missing value for -server\n");
+				usage();
+			}
+			server_file = argv[i + 1];
+			i++;
+#endif /*]*/
 		} else if (!strcmp(argv[i], "-v")) {
 			printf("%s\n%s\n", build, build_options());
 			exit(0);
@@ -550,6 +1392,22 @@ main(int argc, char *argv[])
 		} else
 			usage();
 	}
+#if !defined(_WIN32) /*[*/
+	if (spool_notify != NULL && spool_dir == NULL) {
+		(void) fprintf(stderr, "-spoolnotify requires -spooldir\n");
+		usage();
+	}
+#endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+	if (server_file != NULL) {
+		/* The sessions come from the file. */
+		if (argc != i)
+			usage();
+		session_init();
+		if (session_read_config(server_file) < 0)
+			pr3287_exit(1);
+	} else
+#endif /*]*/
 	if (argc != i + 1)
 		usage();
 
@@ -557,6 +1415,9 @@ main(int argc, char *argv[])
 #if defined(_WIN32) /*[*/
 	sockstart();
 #endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+	if (server_file == NULL) {
+#endif /*]*/
 #if defined(HAVE_LIBSSL) /*[*/
 	do {
 		if (!strncasecmp(argv[i], "l:", 2)) {
@@ -567,51 +1428,11 @@ main(int argc, char *argv[])
 			any_prefixes = False;
 	} while (any_prefixes);
 #endif /*]*/
-	if ((at = strchr(argv[i], '@')) != NULL) {
-		len = at - argv[i];
-		if (!len)
-			usage();
-		lu = Malloc(len + 1);
-		(void) strncpy(lu, argv[i], len);
-		lu[len] = '\0';
-		host = at + 1;
-	} else
-		host = argv[i];
-
-	/*
-	 * Allow the hostname to be enclosed in '[' and ']' to quote any
-	 * IPv6 numeric-address ':' characters.
-	 */
-	if (host[0] == '[') {
-		char *tmp;
-		char *rbracket;
-
-		rbracket = strchr(host+1, ']');
-		if (rbracket != NULL) {
-			len = rbracket - (host+1);
-			tmp = Malloc(len + 1);
-			(void) strncpy(tmp, host+1, len);
-			tmp[len] = '\0';
-			host = tmp;
-		}
-		if (*(rbracket + 1) == ':') {
-			port = rbracket + 2;
-		}
-	} else {
-		colon = strchr(host, ':');
-		if (colon != NULL) {
-			char *tmp;
-
-			len = colon - host;
-			if (!len || !*(colon + 1))
-				usage();
-			port = colon + 1;
-			tmp = Malloc(len + 1);
-			(void) strncpy(tmp, host, len);
-			tmp[len] = '\0';
-			host = tmp;
-		}
+	if (parse_host_spec(argv[i], &lu, &host, &port) < 0)
+		usage();
+#if defined(X3270_SESSIONS) /*[*/
 	}
+#endif /*]*/
 
 #if defined(_WIN32) /*[*/
 	/* Set the printer code page. */
@@ -692,6 +1513,13 @@ main(int argc, char *argv[])
 	}
 #endif /*]*/
 
+	/* Seed the reconnect jitter. */
+#if !defined(_WIN32) /*[*/
+	srand((unsigned)time(NULL) ^ (unsigned)getpid());
+#else /*][*/
+	srand((unsigned)time(NULL));
+#endif /*]*/
+
 	/* Handle signals. */
 	(void) signal(SIGTERM, fatal_signal);
 	(void) signal(SIGINT, fatal_signal);
@@ -708,77 +1536,28 @@ main(int argc, char *argv[])
 			pr3287_exit(1);
 	}
 
+#if defined(X3270_SESSIONS) /*[*/
+	/* In server mode, the session loop takes over from here. */
+	if (server_file != NULL)
+		session_run();
+#endif /*]*/
+
+	/* Set up the printer state. */
+	ctlr_init();
+
 	/*
 	 * One-time initialization is now complete.
 	 * (Most) everything beyond this will now be retried, if the -reconnect
 	 * option is in effect.
 	 */
 	for (;;) {
-		char errtxt[1024];
-
-		/* Resolve the host name. */
-	    	if (proxy_type > 0) {
-		    	unsigned long lport;
-			char *ptr;
-			struct servent *sp;
-
-			if (resolve_host_and_port(proxy_host, proxy_portname,
-				    &proxy_port, &ha.sa, &ha_len, errtxt,
-				    sizeof(errtxt)) < 0) {
-			    popup_an_error("%s/%s: %s", proxy_host,
-				    proxy_portname, errtxt);
-			    rc = 1;
-			    goto retry;
-			}
-
-			lport = strtoul(port, &ptr, 0);
-			if (ptr == port || *ptr != '\0' || lport == 0L ||
-				    lport & ~0xffff) {
-				if (!(sp = getservbyname(port, "tcp"))) {
-					popup_an_error("Unknown port number "
-						"or service: %s", port);
-					rc = 1;
-					goto retry;
-				}
-				p = ntohs(sp->s_port);
-			} else
-				p = (unsigned short)lport;
-		} else {
-			if (resolve_host_and_port(host, port, &p, &ha.sa,
-				    &ha_len, errtxt, sizeof(errtxt)) < 0) {
-			    popup_an_error("%s/%s: %s", host, port, errtxt);
-			    rc = 1;
-			    goto retry;
-			}
-		}
-
 		/* Connect to the host. */
-		s = socket(ha.sa.sa_family, SOCK_STREAM, 0);
+		s = pr3287_connect(host, port, &p);
 		if (s < 0) {
-			popup_a_sockerr("socket");
-			pr3287_exit(1);
-		}
-
-		if (connect(s, &ha.sa, ha_len) < 0) {
-			popup_a_sockerr("%s", (proxy_type > 0)? proxy_host:
-								host);
 			rc = 1;
 			goto retry;
 		}
 
-		if (proxy_type > 0) {
-		    	/* Connect to the host through the proxy. */
-		    	if (verbose) {
-			    	(void) fprintf(stderr, "Connected to proxy "
-					       "server %s, port %u\n",
-					       proxy_host, proxy_port);
-			}
-		    	if (proxy_negotiate(proxy_type, s, host, p) < 0) {
-				rc = 1;
-				goto retry;
-			}
-		}
-
 		/* Say hello. */
 		if (verbose) {
 			(void) fprintf(stderr, "Connected to %s, port %u%s\n",
@@ -804,6 +1583,9 @@ main(int argc, char *argv[])
 			goto retry;
 		}
 
+		/* Start the reconnect delays over. */
+		backoff = BACKOFF_MIN;
+
 		/* Report sudden success. */
 		if (report_success) {
 			errmsg("Connected to %s, port %u", host, p);
@@ -836,12 +1618,19 @@ main(int argc, char *argv[])
 		report_success = 1;
 
 		/* Wait a while, to reduce thrash. */
-		if (rc)
+		if (rc) {
+			int delay = reconnect_delay(&backoff);
+
+			if (verbose)
+				(void) fprintf(stderr,
+				    "Reconnecting in %d second%s.\n", delay,
+				    (delay == 1)? "": "s");
 #if !defined(_WIN32) /*[*/
-			sleep(5);
+			sleep(delay);
 #else /*][*/
-			Sleep(5 * 1000000);
+			Sleep(delay * 1000);
 #endif /*]*/
+		}
 
 		rc = 0;
 	}
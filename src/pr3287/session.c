@@ -0,0 +1,542 @@
+/*
+ * Copyright (c) 2009, Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ *	session.c
+ *		Server mode: many printer sessions in one process.
+ *
+ *		The printer and telnet code keeps its state in file-scope
+ *		variables.  Each module registers those variables here, and a
+ *		session is a private copy of all of them.  The session loop
+ *		switches to the session that owns a socket before handing it
+ *		input, so the rest of the code never needs to know about
+ *		sessions.
+ *
+ *		The sessions are listed in a file, one per line:
+ *			[lu[,lu...]@]host[:port] [command]
+ *		Blank lines and lines starting with '#' are ignored.  A session
+ *		that fails or is disconnected is retried, waiting longer after
+ *		each consecutive failure (see reconnect_delay()).
+ */
+
+#include "globals.h"
+
+#if defined(X3270_SESSIONS) /*[*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "ctlrc.h"
+#include "proxyc.h"
+#include "resolverc.h"
+#include "sessionc.h"
+#include "sfc.h"
+#include "telnetc.h"
+#include "trace_dsc.h"
+
+#define LINE_MAX_LEN	1024	/* longest line in the session file */
+
+/* Externals. */
+extern const char *command;
+extern unsigned long eoj_timeout;
+extern int ssl_host;
+extern int parse_host_spec(char *spec, char **lu, char **host, char **port);
+extern struct pconn *pconn_start(char *host, char *port,
+    unsigned short *pp);
+extern long pconn_fds(struct pconn *pc, int *fds, int *wants, int *nfds);
+extern int pconn_step(struct pconn *pc, const int *ready, int *sp);
+extern void pr3287_exit(int);
+extern int reconnect_delay(int *backoff);
+
+struct session {
+	struct session *next;	/* next in the list of all sessions */
+	char	*name;		/* as written in the file, for messages */
+	char	*lu;		/* LU list, or NULL */
+	char	*host;		/* host name */
+	char	*port;		/* port name or number */
+	char	*command;	/* print command, or NULL for the default */
+	int	 ssl;		/* True to tunnel through SSL */
+	struct pconn *pc;	/* connection in progress, or NULL */
+	unsigned short pport;	/* host port being connected to */
+	int	 sock;		/* socket, or -1 if not connected */
+	int	 pfd_ix;	/* first of its entries in the poll() list */
+	int	 npfd;		/* how many there are */
+	Boolean	 negotiated;	/* True once TN3270(E) negotiation completes */
+	time_t	 retry_at;	/* when to try connecting again */
+	int	 backoff;	/* next retry delay, in seconds */
+	time_t	 last_input;	/* last input of the job in progress, or 0 */
+	unsigned long jobs;	/* print jobs completed */
+	unsigned long bytes;	/* bytes sent to the print command */
+	unsigned long connects;	/* connection attempts */
+	unsigned char *context;	/* saved copies of the registered variables */
+};
+
+static session_t *sessions = NULL;	/* all sessions, in file order */
+static session_t *current = NULL;	/* session whose state is loaded */
+
+static volatile sig_atomic_t exit_signal = 0;
+static volatile sig_atomic_t flush_pending = 0;
+static volatile sig_atomic_t report_pending = 0;
+static int sig_pipe[2] = { -1, -1 };	/* wakes up poll() for a signal */
+
+/* Make a session current. */
+static void
+session_switch(session_t *s)
+{
+	if (s == current)
+		return;
+	if (current != NULL)
+		session_save(current->context);
+	session_load(s->context);
+	current = s;
+}
+
+/*
+ * One-time initialization.
+ *
+ * Must be called before any per-session storage is allocated, so that the
+ * state each session starts from does not refer to it.
+ */
+void
+session_init(void)
+{
+	ctlr_session_vars();
+	net_session_vars();
+	sf_session_vars();
+	SESSION_VAR(command);
+	SESSION_VAR(ssl_host);
+}
+
+/*
+ * Read the list of sessions.
+ * Returns 0 for success, -1 (after reporting the problem) for failure.
+ */
+int
+session_read_config(const char *file)
+{
+	FILE *f;
+	char buf[LINE_MAX_LEN];
+	int line = 0;
+	session_t *s;
+	session_t **tail = &sessions;
+
+	if ((f = fopen(file, "r")) == NULL) {
+		errmsg("%s: %s", file, strerror(errno));
+		return -1;
+	}
+	while (fgets(buf, sizeof(buf), f) != NULL) {
+		char *spec;
+		char *cmd;
+		size_t sl;
+
+		line++;
+		sl = strlen(buf);
+		while (sl && isspace((unsigned char)buf[sl - 1]))
+			buf[--sl] = '\0';
+		spec = buf;
+		while (isspace((unsigned char)*spec))
+			spec++;
+		if (!*spec || *spec == '#')
+			continue;
+		cmd = spec;
+		while (*cmd && !isspace((unsigned char)*cmd))
+			cmd++;
+		if (*cmd) {
+			*cmd++ = '\0';
+			while (isspace((unsigned char)*cmd))
+				cmd++;
+		}
+
+		s = (session_t *)Calloc(1, sizeof(session_t));
+		s->name = NewString(spec);
+		s->command = *cmd? NewString(cmd): NULL;
+		s->ssl = ssl_host;
+#if defined(HAVE_LIBSSL) /*[*/
+		if (!strncasecmp(spec, "l:", 2)) {
+			s->ssl = True;
+			spec += 2;
+		}
+#endif /*]*/
+		if (parse_host_spec(NewString(spec), &s->lu, &s->host,
+			    &s->port) < 0) {
+			errmsg("%s, line %d: invalid host '%s'", file, line,
+			    spec);
+			(void) fclose(f);
+			return -1;
+		}
+		s->sock = -1;
+		*tail = s;
+		tail = &s->next;
+	}
+	(void) fclose(f);
+
+	if (sessions == NULL) {
+		errmsg("%s: no sessions", file);
+		return -1;
+	}
+	return 0;
+}
+
+/* Count bytes sent to the print command. */
+void
+session_count_bytes(int n)
+{
+	if (current != NULL)
+		current->bytes += n;
+}
+
+/* Count a completed print job. */
+void
+session_count_job(void)
+{
+	if (current != NULL)
+		current->jobs++;
+}
+
+/* Report the per-session statistics. */
+void
+session_report(void)
+{
+	session_t *s;
+	int n = 0, up = 0;
+	unsigned long jobs = 0, bytes = 0;
+
+	for (s = sessions; s != NULL; s = s->next) {
+		infomsg("%s: %s, %lu job%s, %lu bytes, %lu connect%s",
+		    s->name,
+		    s->negotiated? "connected":
+			((s->sock >= 0)? "negotiating":
+			 ((s->pc != NULL)? "connecting": "waiting")),
+		    s->jobs, (s->jobs == 1)? "": "s",
+		    s->bytes,
+		    s->connects, (s->connects == 1)? "": "s");
+		n++;
+		if (s->negotiated)
+			up++;
+		jobs += s->jobs;
+		bytes += s->bytes;
+	}
+	infomsg("%d session%s, %d connected, %lu job%s, %lu bytes",
+	    n, (n == 1)? "": "s", up, jobs, (jobs == 1)? "": "s", bytes);
+}
+
+/* Finish the print job in progress on every session. */
+static void
+session_eoj_all(void)
+{
+	session_t *s;
+
+	for (s = sessions; s != NULL; s = s->next) {
+		if (s->sock < 0)
+			continue;
+		session_switch(s);
+		(void) print_eoj();
+		s->last_input = 0;
+	}
+}
+
+/* Close the current session's connection and schedule a retry. */
+static void
+session_drop(session_t *s, time_t now)
+{
+	int delay;
+
+	(void) print_eoj();
+	net_disconnect();
+	if (s->negotiated)
+		infomsg("%s: Disconnected", s->name);
+	s->sock = -1;
+	s->last_input = 0;
+	if (s->negotiated)
+		s->backoff = 0;
+	delay = reconnect_delay(&s->backoff);
+	s->retry_at = now + delay;
+	trace_ds("Retrying %s in %d seconds\n", s->name, delay);
+	s->negotiated = False;
+}
+
+/*
+ * Move a session's connection along, given which of the sockets it listed
+ * are ready (NULL the first time).  The connect and any proxy negotiation
+ * are done a step at a time, so that a slow or unreachable host does not
+ * hold up the others.
+ */
+static void
+session_connect_step(session_t *s, const int *ready, time_t now)
+{
+	int sock;
+	int rv;
+
+	rv = pconn_step(s->pc, ready, &sock);
+	if (!rv)
+		return;
+	s->pc = NULL;
+	session_switch(s);
+	if (rv > 0 && net_start(sock, s->lu, NULL) < 0) {
+		(void) close(sock);
+		rv = -1;
+	}
+	if (rv < 0) {
+		session_drop(s, now);
+		return;
+	}
+	s->sock = sock;
+	trace_ds("Connected %s to %s, port %u\n", s->name, s->host, s->pport);
+}
+
+/* Start connecting a session. */
+static void
+session_connect(session_t *s, time_t now)
+{
+	session_switch(s);
+	if (!s->connects)
+		ctlr_init();
+	s->connects++;
+	if (s->command != NULL)
+		command = s->command;
+	ssl_host = s->ssl;
+
+	if ((s->pc = pconn_start(s->host, s->port, &s->pport)) == NULL) {
+		session_drop(s, now);
+		return;
+	}
+	session_connect_step(s, NULL, now);
+}
+
+/*
+ * Wake up poll() after a signal.  The flags are checked before poll() is
+ * called, so a signal that arrives in between would otherwise wait for the
+ * next input or timeout.
+ */
+static void
+sig_wakeup(void)
+{
+	int save_errno = errno;
+
+	(void) write(sig_pipe[1], "", 1);
+	errno = save_errno;
+}
+
+/* Signal handler for SIGTERM, SIGINT and SIGHUP. */
+static void
+exit_sig(int sig)
+{
+	exit_signal = sig;
+	sig_wakeup();
+}
+
+/* Signal handler for SIGUSR1. */
+static void
+flush_sig(int sig)
+{
+	flush_pending = 1;
+	sig_wakeup();
+}
+
+/* Signal handler for SIGUSR2. */
+static void
+report_sig(int sig)
+{
+	report_pending = 1;
+	sig_wakeup();
+}
+
+/*
+ * Run the sessions.  Never returns.
+ *
+ * The signals that the single-session code handles on the spot are
+ * deferred here until the loop is between sessions.
+ */
+void
+session_run(void)
+{
+	session_t *s;
+	unsigned char *pristine;
+	struct pollfd *pfds;
+	int npfds = 0;
+
+	/* Give each session a copy of the initial state. */
+	pristine = (unsigned char *)Malloc(session_context_size());
+	session_save(pristine);
+	for (s = sessions; s != NULL; s = s->next) {
+		s->context = (unsigned char *)Malloc(session_context_size());
+		(void) memcpy(s->context, pristine, session_context_size());
+	}
+	Free(pristine);
+
+	/*
+	 * poll() is used rather than select(), because with hundreds of
+	 * sessions the descriptors can go past FD_SETSIZE.  Each session has
+	 * at most RH_MAX_ADDRS of them, and the signal pipe comes first.
+	 */
+	for (s = sessions; s != NULL; s = s->next)
+		npfds += RH_MAX_ADDRS;
+	pfds = (struct pollfd *)Malloc((1 + npfds) * sizeof(struct pollfd));
+
+	if (pipe(sig_pipe) < 0) {
+		errmsg("pipe: %s", strerror(errno));
+		pr3287_exit(1);
+	}
+	(void) fcntl(sig_pipe[0], F_SETFD, 1);
+	(void) fcntl(sig_pipe[1], F_SETFD, 1);
+	(void) fcntl(sig_pipe[0], F_SETFL,
+	    fcntl(sig_pipe[0], F_GETFL) | O_NONBLOCK);
+	(void) fcntl(sig_pipe[1], F_SETFL,
+	    fcntl(sig_pipe[1], F_GETFL) | O_NONBLOCK);
+
+	(void) signal(SIGTERM, exit_sig);
+	(void) signal(SIGINT, exit_sig);
+	(void) signal(SIGHUP, exit_sig);
+	(void) signal(SIGUSR1, flush_sig);
+	(void) signal(SIGUSR2, report_sig);
+
+	for (;;) {
+		time_t now;
+		long wait = -1;	/* in milliseconds */
+		int nr;
+
+		if (exit_signal) {
+			trace_ds("Fatal signal %d\n", (int)exit_signal);
+			session_eoj_all();
+			errmsg("Exiting on signal %d", (int)exit_signal);
+			pr3287_exit(0);
+		}
+		if (flush_pending) {
+			flush_pending = 0;
+			trace_ds("Flush signal\n");
+			session_eoj_all();
+		}
+		if (report_pending) {
+			report_pending = 0;
+			session_report();
+		}
+
+		/* Start the connections that are due, and find the sockets. */
+		now = time(NULL);
+		pfds[0].fd = sig_pipe[0];
+		pfds[0].events = POLLIN;
+		pfds[0].revents = 0;
+		npfds = 1;
+		for (s = sessions; s != NULL; s = s->next) {
+			long w;
+
+			if (s->sock < 0 && s->pc == NULL && now >= s->retry_at)
+				session_connect(s, now);
+			s->pfd_ix = npfds;
+			s->npfd = 0;
+			if (s->pc != NULL) {
+				int fds[RH_MAX_ADDRS], wants[RH_MAX_ADDRS];
+				int i;
+
+				w = pconn_fds(s->pc, fds, wants, &s->npfd);
+				for (i = 0; i < s->npfd; i++) {
+					pfds[npfds].fd = fds[i];
+					pfds[npfds].events =
+					    (wants[i] == PX_WANTREAD)?
+						POLLIN: POLLOUT;
+					pfds[npfds++].revents = 0;
+				}
+			} else if (s->sock < 0) {
+				w = (s->retry_at - now) * 1000L;
+			} else {
+				pfds[npfds].fd = s->sock;
+				pfds[npfds].events = POLLIN;
+				pfds[npfds++].revents = 0;
+				s->npfd = 1;
+				if (!eoj_timeout || !s->last_input)
+					continue;
+				w = (s->last_input + eoj_timeout - now) *
+				    1000L;
+			}
+			if (w < 0)
+				w = 0;
+			if (wait < 0 || w < wait)
+				wait = w;
+		}
+
+		nr = poll(pfds, npfds, (wait >= 0)? (int)wait: -1);
+		if (nr < 0) {
+			if (errno == EINTR)
+				continue;
+			errmsg("poll: %s", strerror(errno));
+			pr3287_exit(1);
+		}
+		if (nr > 0 && pfds[0].revents) {
+			char buf[64];
+
+			/* The flags are acted on at the top of the loop. */
+			while (read(sig_pipe[0], buf, sizeof(buf)) > 0)
+				;
+		}
+
+		now = time(NULL);
+		for (s = sessions; s != NULL; s = s->next) {
+			if (s->pc != NULL) {
+				int ready[RH_MAX_ADDRS];
+				int i;
+
+				for (i = 0; i < s->npfd; i++)
+					ready[i] = (nr > 0 &&
+					    pfds[s->pfd_ix + i].revents);
+				session_connect_step(s, ready, now);
+				continue;
+			}
+			if (s->sock < 0)
+				continue;
+
+			if (nr > 0 && s->npfd &&
+			    pfds[s->pfd_ix].revents) {
+				session_switch(s);
+				s->last_input = now;
+				if (net_input(s->sock) < 0 || !net_connected()) {
+					session_drop(s, now);
+					continue;
+				}
+				if (!s->negotiated && net_negotiated()) {
+					s->negotiated = True;
+					s->backoff = 0;
+					infomsg("%s: Connected to %s", s->name,
+					    s->host);
+				}
+			} else if (eoj_timeout && s->last_input &&
+				   now - s->last_input >= (time_t)eoj_timeout) {
+				/* Nothing more for this job. */
+				session_switch(s);
+				(void) print_eoj();
+				s->last_input = 0;
+			}
+		}
+	}
+}
+
+#endif /*]*/
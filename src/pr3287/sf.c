@@ -42,6 +42,7 @@
 #if defined(X3270_FT) /*[*/
 #include "ft_dftc.h"
 #endif /*]*/
+#include "sessionc.h"
 #include "sfc.h"
 #include "telnetc.h"
 #include "trace_dsc.h"
@@ -683,3 +684,12 @@ query_reply_end(void)
 {
 	net_output();
 }
+
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+sf_session_vars(void)
+{
+	SESSION_VAR(qr_in_progress);
+}
+#endif /*]*/
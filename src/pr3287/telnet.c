@@ -72,6 +72,7 @@
 #include "tn3270e.h"
 
 #include "ctlrc.h"
+#include "sessionc.h"
 #include "telnetc.h"
 
 #if !defined(TELOPT_STARTTLS) /*[*/
@@ -165,12 +166,17 @@ static char	**lus = (char **)NULL;
 static char	**curr_lu = (char **)NULL;
 static char	*try_lu = NULL;
 static char	*try_assoc = NULL;
+#define LU_MAX	32
+static char	reported_lu[LU_MAX+1];
+static char	reported_type[LU_MAX+1];
 
 static void setup_lus(char *luname, const char *assoc);
 static int telnet_fsm(unsigned char c);
 static void net_rawout(unsigned const char *buf, int len);
 static void check_in3270(void);
 static void store3270in(unsigned char c);
+static void store3270in_run(const unsigned char *buf, int len);
+static unsigned char *grow3270buf(unsigned char *buf, int *size, int need);
 static int tn3270e_negotiate(void);
 static int process_eor(void);
 static const char *tn3270e_function_names(const unsigned char *, int);
@@ -346,11 +352,12 @@ popup_a_sockerr(char *fmt, ...)
 
 
 /*
- * negotiate
- *	Initialize the connection, and negotiate TN3270 options with the host.
+ * net_start
+ *	Initialize the connection.  Negotiation with the host then proceeds as
+ *	net_input() is called.
  */
 int
-negotiate(int s, char *lu, char *assoc)
+net_start(int s, char *lu, char *assoc)
 {
 	/* Set options for inline out-of-band data and keepalives. */
 	if (setsockopt(s, SOL_SOCKET, SO_OOBINLINE, (char *)&on,
@@ -423,11 +430,53 @@ negotiate(int s, char *lu, char *assoc)
 	tn3270e_submode = E_NONE;
 	tn3270e_bound = 0;
 
-	/* Speak with the host until we suceed or give up. */
 	cstate = CONNECTED_INITIAL;
 	sock = s; /* hack! */
-	while (!tn3270e_negotiated &&		/* TN3270E */
-	       cstate != CONNECTED_3270 &&	/* TN3270 */
+	return 0;
+}
+
+/*
+ * net_negotiated
+ *	Returns 1 if TN3270 or TN3270E negotiation is complete.
+ */
+int
+net_negotiated(void)
+{
+	return tn3270e_negotiated || cstate == CONNECTED_3270;
+}
+
+/* Return the LU name. */
+const char *
+net_query_lu_name(void)
+{
+	if (cstate != NOT_CONNECTED && connected_lu != NULL)
+		return connected_lu;
+	else
+		return "";
+}
+
+/*
+ * net_connected
+ *	Returns 1 if the connection is still up.
+ */
+int
+net_connected(void)
+{
+	return cstate != NOT_CONNECTED;
+}
+
+/*
+ * negotiate
+ *	Initialize the connection, and negotiate TN3270 options with the host.
+ */
+int
+negotiate(int s, char *lu, char *assoc)
+{
+	if (net_start(s, lu, assoc) < 0)
+		return -1;
+
+	/* Speak with the host until we suceed or give up. */
+	while (!net_negotiated() &&
 	       cstate != NOT_CONNECTED) {	/* gave up */
 
 		if (net_input(s) < 0)
@@ -595,6 +644,23 @@ net_input(int s)
 
 	ns_brcvd += nr;
 	for (cp = netrbuf; cp < (netrbuf + nr); cp++) {
+		if (telnet_state == TNS_DATA && *cp != IAC &&
+		    !(IN_ANSI && !IN_E)) {
+			unsigned char *iac;
+
+			/*
+			 * Fast path for 3270 data: copy everything up to the
+			 * next IAC directly into ibuf.  Only IAC sequences go
+			 * through telnet_fsm.
+			 */
+			iac = (unsigned char *)memchr(cp, IAC,
+			    (netrbuf + nr) - cp);
+			if (iac == (unsigned char *)NULL)
+				iac = netrbuf + nr;
+			store3270in_run(cp, iac - cp);
+			cp = iac - 1;
+			continue;
+		}
 		if (telnet_fsm(*cp)) {
 			cstate = NOT_CONNECTED;
 			return -1;
@@ -932,9 +998,6 @@ tn3270e_request(void)
 static int
 tn3270e_negotiate(void)
 {
-#define LU_MAX	32
-	static char reported_lu[LU_MAX+1];
-	static char reported_type[LU_MAX+1];
 	int sblen;
 	unsigned long e_rcvd;
 
@@ -1471,6 +1534,28 @@ check_in3270(void)
 	}
 }
 
+/*
+ * grow3270buf
+ *	Grow a 3270 I/O buffer so that it can hold at least <need> bytes.
+ *	The buffer is doubled each time, so a large record costs only a
+ *	few reallocations, and is never shrunk, so it is reused for the
+ *	rest of the session.
+ *	Returns the (possibly moved) buffer and updates *size.
+ */
+static unsigned char *
+grow3270buf(unsigned char *buf, int *size, int need)
+{
+	int new_size = *size? *size: BUFSIZ;
+
+	while (new_size < need)
+		new_size *= 2;
+	if (new_size != *size) {
+		buf = (unsigned char *)Realloc((char *)buf, new_size);
+		*size = new_size;
+	}
+	return buf;
+}
+
 /*
  * store3270in
  *	Store a character in the 3270 input buffer, checking for buffer
@@ -1480,42 +1565,54 @@ static void
 store3270in(unsigned char c)
 {
 	if (ibptr - ibuf >= ibuf_size) {
-		ibuf_size += BUFSIZ;
-		ibuf = (unsigned char *)Realloc((char *)ibuf, ibuf_size);
-		ibptr = ibuf + ibuf_size - BUFSIZ;
+		int nc = ibptr - ibuf;
+
+		ibuf = grow3270buf(ibuf, &ibuf_size, nc + 1);
+		ibptr = ibuf + nc;
 	}
 	*ibptr++ = c;
 }
 
+/*
+ * store3270in_run
+ *	Store a run of characters (which contains no IACs) in the 3270 input
+ *	buffer, reallocating ibuf if necessary.
+ */
+static void
+store3270in_run(const unsigned char *buf, int len)
+{
+	int nc = ibptr - ibuf;
+
+	if (nc + len > ibuf_size) {
+		ibuf = grow3270buf(ibuf, &ibuf_size, nc + len);
+		ibptr = ibuf + nc;
+	}
+	(void) memcpy(ibptr, buf, len);
+	ibptr += len;
+}
+
 /*
  * space3270out
  *	Ensure that <n> more characters will fit in the 3270 output buffer.
- *	Allocates the buffer in BUFSIZ chunks.
  *	Allocates hidden space at the front of the buffer for TN3270E.
  */
 void
 space3270out(int n)
 {
 	unsigned nc = 0;	/* amount of data currently in obuf */
-	unsigned more = 0;
 
 	if (obuf_size)
 		nc = obptr - obuf;
 
-	while ((nc + n + EH_SIZE) > (obuf_size + more)) {
-		more += BUFSIZ;
-	}
-
-	if (more) {
-		obuf_size += more;
-		obuf_base = (unsigned char *)Realloc((char *)obuf_base,
-			obuf_size);
+	if ((int)(nc + n + EH_SIZE) > obuf_size) {
+		obuf_base = grow3270buf(obuf_base, &obuf_size,
+			nc + n + EH_SIZE);
 		obuf = obuf_base + EH_SIZE;
 		obptr = obuf + nc;
 	}
 }
 
-
+
 /*
  * nnn
  *	Expands a number to a character string, for displaying unknown telnet
@@ -1564,13 +1661,17 @@ opt(unsigned char c)
 
 
 #define LINEDUMP_MAX	32
+#define LINEDUMP_LEN	(2 * LINEDUMP_MAX + 32)	/* longest formatted line */
 
 void
 trace_netdata(char direction, unsigned const char *buf, int len)
 {
+	static const char hexdigit[] = "0123456789abcdef";
 	int offset;
 	struct timeval ts;
 	double tdiff;
+	char dbuf[64 * LINEDUMP_LEN];
+	char *dp = dbuf;
 
 	if (tracef == NULL)
 		return;
@@ -1581,13 +1682,22 @@ trace_netdata(char direction, unsigned const char *buf, int len)
 		(void) fprintf(tracef, "%c +%gs\n", direction, tdiff);
 	}
 	ds_ts = ts;
+
+	/* Format the dump a block of lines at a time. */
 	for (offset = 0; offset < len; offset++) {
-		if (!(offset % LINEDUMP_MAX))
-			(void) fprintf(tracef, "%s%c 0x%-3x ",
+		if (!(offset % LINEDUMP_MAX)) {
+			if (dp - dbuf > (int)sizeof(dbuf) - LINEDUMP_LEN) {
+				(void) fwrite(dbuf, dp - dbuf, 1, tracef);
+				dp = dbuf;
+			}
+			dp += sprintf(dp, "%s%c 0x%-3x ",
 			    (offset ? "\n" : ""), direction, offset);
-		(void) fprintf(tracef, "%02x", buf[offset]);
+		}
+		*dp++ = hexdigit[buf[offset] >> 4];
+		*dp++ = hexdigit[buf[offset] & 0x0f];
 	}
-	(void) fprintf(tracef, "\n");
+	*dp++ = '\n';
+	(void) fwrite(dbuf, dp - dbuf, 1, tracef);
 }
 
 
@@ -1622,30 +1732,27 @@ net_output(void)
 
 	/* Count the number of IACs in the message. */
 	{
-		char *buf = (char *)BSTART;
-		int len = obptr - BSTART;
-		char *iac;
+		unsigned char *src = BSTART;
+		unsigned char *dst;
+		unsigned char *iac;
 		int cnt = 0;
 
-		while (len && (iac = memchr(buf, IAC, len)) != NULL) {
+		while (src < obptr &&
+		       (iac = memchr(src, IAC, obptr - src)) != NULL) {
 			cnt++;
-			len -= iac - buf + 1;
-			buf = iac + 1;
+			src = iac + 1;
 		}
 		if (cnt) {
 			space3270out(cnt);
-			len = obptr - BSTART;
-			buf = (char *)BSTART;
 
-			/* Now quote them. */
-			while (len && (iac = memchr(buf, IAC, len)) != NULL) {
-				int ml = len - (iac - buf);
-
-				memmove(iac + 1, iac, ml);
-				len -= iac - buf + 1;
-				buf = iac + 2;
-				obptr++;
+			/* Now quote them, working back from the end. */
+			src = obptr;
+			dst = obptr + cnt;
+			while (dst != src) {
+				if ((*--dst = *--src) == IAC)
+					*--dst = IAC;
 			}
+			obptr += cnt;
 		}
 	}
 
@@ -1968,3 +2075,52 @@ continue_tls(unsigned char *sbbuf, int len)
 }
 
 #endif /*]*/
+
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+net_session_vars(void)
+{
+	SESSION_VAR(cstate);
+	SESSION_VAR(connected_lu);
+	SESSION_VAR(connected_type);
+	SESSION_VAR(ns_time);
+	SESSION_VAR(ns_brcvd);
+	SESSION_VAR(ns_rrcvd);
+	SESSION_VAR(ns_bsent);
+	SESSION_VAR(ns_rsent);
+	SESSION_VAR(obuf);
+	SESSION_VAR(obuf_size);
+	SESSION_VAR(obptr);
+	SESSION_VAR(linemode);
+	SESSION_VAR(ds_ts);
+	SESSION_VAR(sock);
+	SESSION_VAR(myopts);
+	SESSION_VAR(hisopts);
+	SESSION_VAR(ibuf);
+	SESSION_VAR(ibptr);
+	SESSION_VAR(ibuf_size);
+	SESSION_VAR(obuf_base);
+	SESSION_VAR(sbbuf);
+	SESSION_VAR(sbptr);
+	SESSION_VAR(telnet_state);
+	SESSION_VAR(syncing);
+	SESSION_VAR(e_funcs);
+	SESSION_VAR(e_xmit_seq);
+	SESSION_VAR(response_required);
+	SESSION_VAR(tn3270e_negotiated);
+	SESSION_VAR(tn3270e_submode);
+	SESSION_VAR(tn3270e_bound);
+	SESSION_VAR(lus);
+	SESSION_VAR(curr_lu);
+	SESSION_VAR(try_lu);
+	SESSION_VAR(try_assoc);
+	SESSION_VAR(reported_lu);
+	SESSION_VAR(reported_type);
+#if defined(HAVE_LIBSSL) /*[*/
+	SESSION_VAR(secure_connection);
+	SESSION_VAR(ssl_con);
+	SESSION_VAR(need_tls_follows);
+#endif /*]*/
+}
+#endif /*]*/
@@ -38,9 +38,16 @@ extern Boolean net_add_dummy_tn3270e(void);
 extern void net_add_eor(unsigned char *buf, int len);
 extern void net_disconnect(void);
 extern void net_exception(void);
+extern int net_connected(void);
 extern int net_input(int s);
+extern int net_negotiated(void);
 extern void net_output(void);
+extern const char *net_query_lu_name(void);
 extern int process(int s);
+extern int net_start(int s, char *lu, char *assoc);
 extern void space3270out(int n);
 extern void trace_netdata(char direction, unsigned const char *buf, int len);
 extern void popup_a_sockerr(char *fmt, ...);
+#if defined(X3270_SESSIONS) /*[*/
+extern void net_session_vars(void);
+#endif /*]*/
@@ -0,0 +1,157 @@
+#! /usr/bin/env python3
+
+# Copyright (c) 2009, Paul Mattes.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of Paul Mattes nor his contributors may be used
+#       to endorse or promote products derived from this software without
+#       specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+# NO EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# SCS print throughput benchmark for pr3287.
+#
+# Usage: scs.py [pr3287]
+#
+# A fake TN3270E host binds pr3287 as an LU1 printer and sends it an SCS
+# report, 200 pages of 60 lines, in 4K records, then unbinds to end the
+# job.  pr3287 runs it once with -bufsize 1, which writes the print command
+# a byte at a time as it used to, and once with the default buffer.  The
+# output must be the same; the CPU time pr3287 used and the throughput are
+# reported for each.
+
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+IAC, DO, SB, SE, EOR = 255, 253, 250, 240, 239
+TN3270E = 40
+OP_DEVICE_TYPE, OP_FUNCTIONS, OP_IS, OP_SEND, OP_CONNECT = \
+    2, 3, 4, 8, 1
+DT_SCS_DATA, DT_BIND_IMAGE, DT_UNBIND = 0x01, 0x03, 0x04
+SCS_NL, SCS_FF = 0x15, 0x0c
+
+pr3287 = sys.argv[1] if len(sys.argv) > 1 else './pr3287'
+PAGES, LINES, RECORD = 200, 60, 4096
+
+def report():
+    data = bytearray()
+    for page in range(PAGES):
+        for line in range(LINES):
+            text = 'PAGE %4d LINE %2d ' % (page + 1, line + 1)
+            text += 'ABCDEFGHIJKLMNOPQRSTUVWXYZ 0123456789 ' * 3
+            data += text.encode('cp037') + bytes([SCS_NL])
+        data += bytes([SCS_FF])
+    return bytes(data)
+
+def record(dt, seq, data):
+    h = bytes([dt, 0, 0, (seq >> 8) & 0xff, seq & 0xff])
+    return (h + data).replace(bytes([IAC]), bytes([IAC, IAC])) + \
+        bytes([IAC, EOR])
+
+def subneg(c, buf):
+    # Returns the next TN3270E subnegotiation from the client, and what
+    # follows it.
+    while bytes([IAC, SE]) not in buf[buf.find(bytes([IAC, SB])):]:
+        d = c.recv(4096)
+        if not d:
+            raise EOFError
+        buf += d
+    i = buf.index(bytes([IAC, SB]))
+    j = buf.index(bytes([IAC, SE]), i)
+    return buf[i + 3:j], buf[j + 2:]
+
+def serve(l, data, done):
+    c, _ = l.accept()
+    try:
+        c.sendall(bytes([IAC, DO, TN3270E]))
+        c.sendall(bytes([IAC, SB, TN3270E, OP_SEND, OP_DEVICE_TYPE,
+                         IAC, SE]))
+        sb, buf = subneg(c, b'')
+        c.sendall(bytes([IAC, SB, TN3270E, OP_DEVICE_TYPE, OP_IS]) +
+                  b'IBM-3287-1' + bytes([OP_CONNECT]) + b'LU1' +
+                  bytes([IAC, SE]))
+        sb, buf = subneg(c, buf)
+        # Accept whatever functions it asks for.
+        c.sendall(bytes([IAC, SB, TN3270E, OP_FUNCTIONS, OP_IS]) +
+                  sb[2:] + bytes([IAC, SE]))
+        seq = 0
+        # An LU1 BIND image, in case it asked for BIND-IMAGE.
+        out = record(DT_BIND_IMAGE, seq,
+                     bytes([0x31, 0x01, 0x03, 0x03, 0xa1, 0xa0]))
+        for i in range(0, len(data), RECORD):
+            seq += 1
+            out += record(DT_SCS_DATA, seq, data[i:i + RECORD])
+        out += record(DT_UNBIND, seq + 1, bytes([0x32, 0x01]))
+        done.append(time.time())
+        c.sendall(out)
+        # Hang up, and wait for it to finish and go away.
+        c.shutdown(socket.SHUT_WR)
+        while c.recv(4096):
+            pass
+    except (EOFError, OSError):
+        pass
+    c.close()
+
+def run(data, bufsize, outfile):
+    l = socket.socket()
+    l.bind(('127.0.0.1', 0))
+    l.listen(1)
+    done = []
+    t = threading.Thread(target=serve, args=(l, data, done), daemon=True)
+    t.start()
+    args = [pr3287, '-command', 'cat >%s' % outfile]
+    if bufsize:
+        args += ['-bufsize', str(bufsize)]
+    args.append('127.0.0.1:%d' % l.getsockname()[1])
+    p = subprocess.Popen(args, stdout=subprocess.DEVNULL,
+                         stderr=subprocess.DEVNULL)
+    t.join(120)
+    end = time.time()
+    _, _, ru = os.wait4(p.pid, 0)
+    l.close()
+    with open(outfile, 'rb') as f:
+        out = f.read()
+    return out, ru.ru_utime + ru.ru_stime, end - done[0]
+
+data = report()
+failed = False
+with tempfile.TemporaryDirectory() as tmp:
+    results = {}
+    for what, bufsize in (('bytewise', 1), ('buffered', None)):
+        out, cpu, wall = run(data, bufsize, os.path.join(tmp, what))
+        results[what] = out
+        print('ok   %s: %d bytes of output, pr3287 CPU %.3f s, '
+              '%.1f MB/s' % (what, len(out), cpu,
+                             len(data) / wall / 1e6))
+    if not results['buffered'] or \
+       results['buffered'] != results['bytewise']:
+        print('FAIL buffered output differs from bytewise output')
+        failed = True
+    elif results['buffered'].count(b'PAGE ') != PAGES * LINES or \
+         b'PAGE  200 LINE 60 ' not in results['buffered']:
+        print('FAIL output is not the whole report')
+        failed = True
+
+sys.exit(1 if failed else 0)
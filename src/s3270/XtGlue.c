@@ -35,6 +35,9 @@
 #include "trace_dsc.h"
 #include "xioc.h"
 #endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+#include "sessionc.h"
+#endif /*]*/
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -52,6 +55,11 @@
 #if defined(SEPARATE_SELECT_H) /*[*/
 #include <sys/select.h>
 #endif /*]*/
+#if defined(HAVE_SYS_EPOLL_H) /*[*/
+#include <sys/epoll.h>
+#include <fcntl.h>
+#define USE_EPOLL	1
+#endif /*]*/
 #endif /*]*/
 
 #define InputReadMask	0x1
@@ -377,6 +385,17 @@ KeysymToString(KeySym k)
 
 /* Timeouts. */
 
+/*
+ * Timeouts are kept in a binary heap ordered by expiration time, so adding
+ * and removing a timeout takes O(log n) time.  Each timeout remembers its
+ * position in the heap so it can be removed without a search.  Timeouts with
+ * the same expiration time fire in the order they were added.
+ *
+ * Expiration times are in milliseconds on Windows and in microseconds
+ * elsewhere, measured by a clock that does not jump when the time of day is
+ * changed.
+ */
+
 #if defined(_WIN32) /*[*/
 static void
 ms_ts(unsigned long long *u)
@@ -390,68 +409,143 @@ ms_ts(unsigned long long *u)
 	/* Divide by 10,000 to get ms. */
 	*u /= 10000ULL;
 }
+#define TS_NOW(u)	ms_ts(u)
+#define TS_PER_MS	1ULL
+#else /*][*/
+static void
+us_ts(unsigned long long *u)
+{
+#if defined(CLOCK_MONOTONIC) /*[*/
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		*u = (ts.tv_sec * (unsigned long long)MILLION) +
+		     (ts.tv_nsec / 1000L);
+		return;
+	}
+#endif /*]*/
+	{
+		struct timeval tv;
+
+		(void) gettimeofday(&tv, NULL);
+		*u = (tv.tv_sec * (unsigned long long)MILLION) + tv.tv_usec;
+	}
+}
+#define TS_NOW(u)	us_ts(u)
+#define TS_PER_MS	1000ULL
 #endif /*]*/
 
 typedef struct timeout {
-	struct timeout *next;
-#if defined(_WIN32) /*[*/
-	unsigned long long ts;
-#else /*][*/
-	struct timeval tv;
-#endif /*]*/
+	unsigned long long ts;	/* expiration time */
+	unsigned long seq;	/* order added, to break ties */
+	int index;		/* position in the heap */
 	void (*proc)(void);
 	Boolean in_play;
+#if defined(X3270_SESSIONS) /*[*/
+	session_t *session;	/* session to switch to before calling proc */
+#endif /*]*/
 } timeout_t;
 #define TN	(timeout_t *)NULL
-static timeout_t *timeouts = TN;
+
+/*
+ * Inputs and timeouts belong to the session that was current when they were
+ * added, and that session is made current again before they are called.
+ */
+#if defined(X3270_SESSIONS) /*[*/
+#define SESSION_SAVE(x)		(x)->session = session_current()
+#define SESSION_ENTER(x)	session_switch((x)->session)
+#else /*][*/
+#define SESSION_SAVE(x)
+#define SESSION_ENTER(x)
+#endif /*]*/
+static timeout_t **timeouts = (timeout_t **)NULL;
+static int n_timeouts = 0;
+static int max_timeouts = 0;
+static unsigned long timeout_seq = 0L;
+
+/* Returns True if timeout a expires before timeout b. */
+#define TIMEOUT_BEFORE(a, b) \
+	((a)->ts < (b)->ts || ((a)->ts == (b)->ts && (a)->seq < (b)->seq))
+
+/* Put a timeout into a heap slot. */
+static void
+timeout_set(int i, timeout_t *t)
+{
+	timeouts[i] = t;
+	t->index = i;
+}
+
+/* Move a timeout toward the root of the heap until it is in order. */
+static void
+timeout_up(int i)
+{
+	timeout_t *t = timeouts[i];
+
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+
+		if (!TIMEOUT_BEFORE(t, timeouts[parent]))
+			break;
+		timeout_set(i, timeouts[parent]);
+		i = parent;
+	}
+	timeout_set(i, t);
+}
+
+/* Move a timeout toward the leaves of the heap until it is in order. */
+static void
+timeout_down(int i)
+{
+	timeout_t *t = timeouts[i];
+
+	for (;;) {
+		int child = (2 * i) + 1;
+
+		if (child >= n_timeouts)
+			break;
+		if (child + 1 < n_timeouts &&
+		    TIMEOUT_BEFORE(timeouts[child + 1], timeouts[child]))
+			child++;
+		if (!TIMEOUT_BEFORE(timeouts[child], t))
+			break;
+		timeout_set(i, timeouts[child]);
+		i = child;
+	}
+	timeout_set(i, t);
+}
+
+/* Remove the timeout at a given heap position. */
+static void
+timeout_delete(int i)
+{
+	if (--n_timeouts == i)
+		return;
+	timeout_set(i, timeouts[n_timeouts]);
+	timeout_down(i);
+	timeout_up(timeouts[i]->index);
+}
 
 unsigned long
 AddTimeOut(unsigned long interval_ms, void (*proc)(void))
 {
 	timeout_t *t_new;
-	timeout_t *t;
-	timeout_t *prev = TN;
 
 	t_new = (timeout_t *)Malloc(sizeof(timeout_t));
 	t_new->proc = proc;
 	t_new->in_play = False;
-#if defined(_WIN32) /*[*/
-	ms_ts(&t_new->ts);
-	t_new->ts += interval_ms;
-#else /*][*/
-	(void) gettimeofday(&t_new->tv, NULL);
-	t_new->tv.tv_sec += interval_ms / 1000L;
-	t_new->tv.tv_usec += (interval_ms % 1000L) * 1000L;
-	if (t_new->tv.tv_usec > MILLION) {
-		t_new->tv.tv_sec += t_new->tv.tv_usec / MILLION;
-		t_new->tv.tv_usec %= MILLION;
-	}
-#endif /*]*/
-
-	/* Find where to insert this item. */
-	for (t = timeouts; t != TN; t = t->next) {
-#if defined(_WIN32) /*[*/
-		if (t->ts > t_new->ts)
-#else /*][*/
-		if (t->tv.tv_sec > t_new->tv.tv_sec ||
-		    (t->tv.tv_sec == t_new->tv.tv_sec &&
-		     t->tv.tv_usec > t_new->tv.tv_usec))
-#endif /*]*/
-			break;
-		prev = t;
-	}
+	SESSION_SAVE(t_new);
+	t_new->seq = timeout_seq++;
+	TS_NOW(&t_new->ts);
+	t_new->ts += interval_ms * TS_PER_MS;
 
 	/* Insert it. */
-	if (prev == TN) {	/* Front. */
-		t_new->next = timeouts;
-		timeouts = t_new;
-	} else if (t == TN) {	/* Rear. */
-		t_new->next = TN;
-		prev->next = t_new;
-	} else {				/* Middle. */
-		t_new->next = t;
-		prev->next = t_new;
+	if (n_timeouts >= max_timeouts) {
+		max_timeouts = max_timeouts? max_timeouts * 2: 16;
+		timeouts = (timeout_t **)Realloc(timeouts,
+			max_timeouts * sizeof(timeout_t *));
 	}
+	timeout_set(n_timeouts, t_new);
+	timeout_up(n_timeouts++);
 
 	return (unsigned long)t_new;
 }
@@ -460,22 +554,26 @@ void
 RemoveTimeOut(unsigned long timer)
 {
 	timeout_t *st = (timeout_t *)timer;
-	timeout_t *t;
-	timeout_t *prev = TN;
 
 	if (st->in_play)
 		return;
-	for (t = timeouts; t != TN; t = t->next) {
-		if (t == st) {
-			if (prev != TN)
-				prev->next = t->next;
-			else
-				timeouts = t->next;
-			Free(t);
-			return;
-		}
-		prev = t;
-	}
+	timeout_delete(st->index);
+	Free(st);
+}
+
+/*
+ * Return the time until the next timeout expires, in milliseconds on Windows
+ * and microseconds elsewhere.  Must not be called with no timeouts pending.
+ */
+static unsigned long long
+timeout_wait(void)
+{
+	unsigned long long now;
+
+	TS_NOW(&now);
+	if (timeouts[0]->ts <= now)
+		return 0ULL;
+	return timeouts[0]->ts - now;
 }
 
 /* Input events. */ 
@@ -484,9 +582,149 @@ typedef struct input {
         int source; 
         int condition;
         void (*proc)(void);
+#if defined(USE_EPOLL) /*[*/
+	struct input *fd_next;	/* next input with the same source */
+#endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+	session_t *session;	/* session to switch to before calling proc */
+#endif /*]*/
 } input_t;          
 static input_t *inputs = (input_t *)NULL;
 static Boolean inputs_changed = False;
+static int input_source = -1;	/* source of the input being called */
+
+#if defined(USE_EPOLL) /*[*/
+/*
+ * epoll support.
+ *
+ * Each file descriptor is registered once with the kernel, with the union of
+ * the conditions of all of the inputs on it.  Registrations are only changed
+ * by AddInput, AddExcept, AddOutput and RemoveInput, so the event loop does
+ * not have to rebuild anything on each pass.
+ *
+ * Descriptors that epoll cannot watch (regular files, such as a script
+ * redirected from a file) are treated the way select() treats them: they are
+ * always ready.
+ */
+#define MAX_EPOLL_EVENTS	64
+
+typedef struct {
+	input_t *inputs;	/* inputs on this descriptor */
+	Boolean nopoll;		/* descriptor cannot be polled */
+} epoll_fd_t;
+static epoll_fd_t *epoll_fds = (epoll_fd_t *)NULL;
+static int epoll_fds_size = 0;
+static int n_nopoll = 0;	/* number of descriptors with nopoll set */
+static int epfd = -1;
+
+/* Create the epoll descriptor. */
+static void
+epoll_init(void)
+{
+	if (epfd >= 0)
+		return;
+	epfd = epoll_create(MAX_EPOLL_EVENTS);
+	if (epfd < 0)
+		Error("epoll_create failed");
+	(void) fcntl(epfd, F_SETFD, FD_CLOEXEC);
+}
+
+/* Return the epoll events corresponding to a set of input conditions. */
+static unsigned
+epoll_events(int condition)
+{
+	unsigned events = 0;
+
+	if (condition & InputReadMask)
+		events |= EPOLLIN;
+	if (condition & InputWriteMask)
+		events |= EPOLLOUT;
+	if (condition & InputExceptMask)
+		events |= EPOLLPRI;
+	return events;
+}
+
+/* Update the kernel registration for a descriptor. */
+static void
+epoll_sync(int fd)
+{
+	input_t *ip;
+	struct epoll_event ev;
+	int condition = 0;
+	int rv;
+
+	epoll_init();
+
+	for (ip = epoll_fds[fd].inputs; ip != (input_t *)NULL;
+	     ip = ip->fd_next)
+		condition |= ip->condition;
+
+	if (!condition) {
+		/* Failure is okay; the descriptor may already be closed. */
+		(void) epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+		if (epoll_fds[fd].nopoll) {
+			epoll_fds[fd].nopoll = False;
+			n_nopoll--;
+		}
+		return;
+	}
+	if (epoll_fds[fd].nopoll)
+		return;
+
+	(void) memset(&ev, '\0', sizeof(ev));
+	ev.events = epoll_events(condition);
+	ev.data.fd = fd;
+
+	/*
+	 * The descriptor may have been closed and reopened without being
+	 * removed first, so our idea of whether it is registered cannot be
+	 * trusted.  Try a modify first, and fall back to an add.
+	 */
+	rv = epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+	if (rv < 0 && errno == ENOENT)
+		rv = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+	if (rv < 0 && errno == EPERM) {
+		epoll_fds[fd].nopoll = True;
+		n_nopoll++;
+	}
+}
+
+/* Add an input to the per-descriptor list and register it. */
+static void
+epoll_add(input_t *ip)
+{
+	if (ip->source >= epoll_fds_size) {
+		int new_size = epoll_fds_size? epoll_fds_size: 64;
+
+		while (new_size <= ip->source)
+			new_size *= 2;
+		epoll_fds = (epoll_fd_t *)Realloc(epoll_fds,
+			new_size * sizeof(epoll_fd_t));
+		(void) memset(epoll_fds + epoll_fds_size, '\0',
+			(new_size - epoll_fds_size) * sizeof(epoll_fd_t));
+		epoll_fds_size = new_size;
+	}
+	ip->fd_next = epoll_fds[ip->source].inputs;
+	epoll_fds[ip->source].inputs = ip;
+	epoll_sync(ip->source);
+}
+
+/* Remove an input from the per-descriptor list and update its registration. */
+static void
+epoll_remove(input_t *ip)
+{
+	input_t **ipp;
+
+	for (ipp = &epoll_fds[ip->source].inputs; *ipp != (input_t *)NULL;
+	     ipp = &(*ipp)->fd_next) {
+		if (*ipp == ip) {
+			*ipp = ip->fd_next;
+			break;
+		}
+	}
+	epoll_sync(ip->source);
+}
+#endif /*]*/
 
 unsigned long
 AddInput(int source, void (*fn)(void))
@@ -497,9 +735,13 @@ AddInput(int source, void (*fn)(void))
 	ip->source = source;
 	ip->condition = InputReadMask;
 	ip->proc = fn;
+	SESSION_SAVE(ip);
 	ip->next = inputs;
 	inputs = ip;
 	inputs_changed = True;
+#if defined(USE_EPOLL) /*[*/
+	epoll_add(ip);
+#endif /*]*/
 	return (unsigned long)ip;
 }
 
@@ -515,9 +757,13 @@ AddExcept(int source, void (*fn)(void))
 	ip->source = source;
 	ip->condition = InputExceptMask;
 	ip->proc = fn;
+	SESSION_SAVE(ip);
 	ip->next = inputs;
 	inputs = ip;
 	inputs_changed = True;
+#if defined(USE_EPOLL) /*[*/
+	epoll_add(ip);
+#endif /*]*/
 	return (unsigned long)ip;
 #endif /*]*/
 }
@@ -532,13 +778,27 @@ AddOutput(int source, void (*fn)(void))
 	ip->source = source;
 	ip->condition = InputWriteMask;
 	ip->proc = fn;
+	SESSION_SAVE(ip);
 	ip->next = inputs;
 	inputs = ip;
 	inputs_changed = True;
+#if defined(USE_EPOLL) /*[*/
+	epoll_add(ip);
+#endif /*]*/
 	return (unsigned long)ip;
 }
 #endif /*]*/
 
+/*
+ * Returns the source of the input whose callback is running, so that one
+ * callback can serve several sources.
+ */
+int
+InputSource(void)
+{
+	return input_source;
+}
+
 void
 RemoveInput(unsigned long id)
 {
@@ -556,6 +816,9 @@ RemoveInput(unsigned long id)
 		prev->next = ip->next;
 	else
 		inputs = ip->next;
+#if defined(USE_EPOLL) /*[*/
+	epoll_remove(ip);
+#endif /*]*/
 	Free(ip);
 	inputs_changed = True;
 }
@@ -592,18 +855,12 @@ select_setup(int *nfds, fd_set *readfds, fd_set *writefds,
 			r = 1;
 		}
 	}
-	if (timeouts != TN) {
-		struct timeval now, twait;
-
-		(void) gettimeofday(&now, (void *)NULL);
-		twait.tv_sec = timeouts->tv.tv_sec - now.tv_sec;
-		twait.tv_usec = timeouts->tv.tv_usec - now.tv_usec;
-		if (twait.tv_usec < 0L) {
-			twait.tv_sec--;
-			twait.tv_usec += MILLION;
-		}
-		if (twait.tv_sec < 0L)
-			twait.tv_sec = twait.tv_usec = 0L;
+	if (n_timeouts) {
+		struct timeval twait;
+		unsigned long long wait = timeout_wait();
+
+		twait.tv_sec = wait / MILLION;
+		twait.tv_usec = wait % MILLION;
 
 		if (*timeout == NULL) {
 			/* No timeout yet -- we're it. */
@@ -626,6 +883,27 @@ select_setup(int *nfds, fd_set *readfds, fd_set *writefds,
 #define MAX_HA	256
 #endif /*]*/
 
+/*
+ * Called in a child process after fork().  The child would otherwise share
+ * its parent's epoll descriptor, and with it the parent's registrations.
+ */
+void
+process_events_fork(void)
+{
+#if defined(USE_EPOLL) /*[*/
+	int fd;
+
+	if (epfd < 0)
+		return;
+	(void) close(epfd);
+	epfd = -1;
+	for (fd = 0; fd < epoll_fds_size; fd++) {
+		if (epoll_fds[fd].inputs != (input_t *)NULL)
+			epoll_sync(fd);
+	}
+#endif /*]*/
+}
+
 /* Event dispatcher. */
 Boolean
 process_events(Boolean block)
@@ -637,10 +915,17 @@ process_events(Boolean block)
 	DWORD ret;
 	unsigned long long now;
 	int i;
+#else /*][*/
+#if defined(USE_EPOLL) /*[*/
+	struct epoll_event events[MAX_EPOLL_EVENTS];
+	int i;
+	int tmo;
 #else /*][*/
 	fd_set rfds, wfds, xfds;
+#endif /*]*/
 	int ns;
-	struct timeval now, twait, *tp;
+	unsigned long long now;
+	struct timeval twait, *tp;
 #endif /*]*/
 	input_t *ip, *ip_next;
 	struct timeout *t;
@@ -653,6 +938,11 @@ process_events(Boolean block)
 	if (processed_any)
 		block = False;
 	any_events = False;
+#if defined(USE_EPOLL) /*[*/
+	/* The registrations are already in place. */
+	if (inputs != (input_t *)NULL)
+		any_events = True;
+#else /*][*/
 #if defined(_WIN32) /*[*/
 	nha = 0;
 #else /*][*/
@@ -680,24 +970,16 @@ process_events(Boolean block)
 		}
 #endif /*]*/
 	}
+#endif /*]*/
 	if (block) {
-		if (timeouts != TN) {
+		if (n_timeouts) {
 #if defined(_WIN32) /*[*/
-			ms_ts(&now);
-			if (now > timeouts->ts)
-				tmo = 0;
-			else
-				tmo = timeouts->ts - now;
+			tmo = (DWORD)timeout_wait();
 #else /*][*/
-			(void) gettimeofday(&now, (void *)NULL);
-			twait.tv_sec = timeouts->tv.tv_sec - now.tv_sec;
-			twait.tv_usec = timeouts->tv.tv_usec - now.tv_usec;
-			if (twait.tv_usec < 0L) {
-				twait.tv_sec--;
-				twait.tv_usec += MILLION;
-			}
-			if (twait.tv_sec < 0L)
-				twait.tv_sec = twait.tv_usec = 0L;
+			unsigned long long wait = timeout_wait();
+
+			twait.tv_sec = wait / MILLION;
+			twait.tv_usec = wait % MILLION;
 			tp = &twait;
 #endif /*]*/
 			any_events = True;
@@ -722,6 +1004,18 @@ process_events(Boolean block)
 #if defined(_WIN32) /*[*/
 	ret = WaitForMultipleObjects(nha, ha, FALSE, tmo);
 	if (ret == WAIT_FAILED) {
+#elif defined(USE_EPOLL) /*][*/
+	if (tp == (struct timeval *)NULL)
+		tmo = -1;
+	else
+		tmo = (tp->tv_sec * 1000) + ((tp->tv_usec + 999) / 1000);
+	if (n_nopoll)
+		tmo = 0;
+	epoll_init();
+	ns = epoll_wait(epfd, events, MAX_EPOLL_EVENTS, tmo);
+	if (ns < 0) {
+		if (errno != EINTR)
+			Warning("process_events: epoll_wait() failed");
 #else /*][*/
 	ns = select(FD_SETSIZE, &rfds, &wfds, &xfds, tp);
 	if (ns < 0) {
@@ -731,6 +1025,42 @@ process_events(Boolean block)
 		return processed_any;
 	}
 	inputs_changed = False;
+#if defined(USE_EPOLL) /*[*/
+	for (i = 0; i < ns; i++) {
+		int fd = events[i].data.fd;
+		unsigned ev = events[i].events;
+
+		/* Like select(), report errors as readable and writable. */
+		if (ev & (EPOLLERR | EPOLLHUP))
+			ev |= EPOLLIN | EPOLLOUT;
+		for (ip = epoll_fds[fd].inputs; ip != (input_t *)NULL;
+		     ip = ip_next) {
+			ip_next = ip->fd_next;
+			if (epoll_events(ip->condition) & ev) {
+				SESSION_ENTER(ip);
+				input_source = ip->source;
+				(*ip->proc)();
+				processed_any = True;
+				if (inputs_changed)
+					goto retry;
+			}
+		}
+	}
+	if (n_nopoll) {
+		for (ip = inputs; ip != (input_t *)NULL; ip = ip_next) {
+			ip_next = ip->next;
+			if (epoll_fds[ip->source].nopoll &&
+			    (ip->condition & (InputReadMask | InputWriteMask))) {
+				SESSION_ENTER(ip);
+				input_source = ip->source;
+				(*ip->proc)();
+				processed_any = True;
+				if (inputs_changed)
+					goto retry;
+			}
+		}
+	}
+#else /*][*/
 #if defined(_WIN32) /*[*/
 	for (i = 0, ip = inputs; ip != (input_t *)NULL; ip = ip_next, i++) {
 #else /*][*/
@@ -743,6 +1073,8 @@ process_events(Boolean block)
 #else /*][*/
 		    FD_ISSET(ip->source, &rfds)) {
 #endif /*]*/
+			SESSION_ENTER(ip);
+			input_source = ip->source;
 			(*ip->proc)();
 			processed_any = True;
 			if (inputs_changed)
@@ -751,6 +1083,8 @@ process_events(Boolean block)
 #if !defined(_WIN32) /*[*/
 		if (((unsigned long)ip->condition & InputWriteMask) &&
 		    FD_ISSET(ip->source, &wfds)) {
+			SESSION_ENTER(ip);
+			input_source = ip->source;
 			(*ip->proc)();
 			processed_any = True;
 			if (inputs_changed)
@@ -758,6 +1092,8 @@ process_events(Boolean block)
 		}
 		if (((unsigned long)ip->condition & InputExceptMask) &&
 		    FD_ISSET(ip->source, &xfds)) {
+			SESSION_ENTER(ip);
+			input_source = ip->source;
 			(*ip->proc)();
 			processed_any = True;
 			if (inputs_changed)
@@ -765,29 +1101,18 @@ process_events(Boolean block)
 		}
 #endif /*]*/
 	}
+#endif /*]*/
 
 	/* See what's expired. */
-	if (timeouts != TN) {
-#if defined(_WIN32) /*[*/
-		ms_ts(&now);
-#else /*][*/
-		(void) gettimeofday(&now, (void *)NULL);
-#endif /*]*/
-		while ((t = timeouts) != TN) {
-#if defined(_WIN32) /*[*/
-			if (t->ts <= now) {
-#else /*][*/
-			if (t->tv.tv_sec < now.tv_sec ||
-			    (t->tv.tv_sec == now.tv_sec &&
-			     t->tv.tv_usec < now.tv_usec)) {
-#endif /*]*/
-				timeouts = t->next;
-				t->in_play = True;
-				(*t->proc)();
-				processed_any = True;
-				Free(t);
-			} else
-				break;
+	if (n_timeouts) {
+		TS_NOW(&now);
+		while (n_timeouts && (t = timeouts[0])->ts <= now) {
+			timeout_delete(0);
+			t->in_play = True;
+			SESSION_ENTER(t);
+			(*t->proc)();
+			processed_any = True;
+			Free(t);
 		}
 	}
 	if (inputs_changed)
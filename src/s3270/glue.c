@@ -432,6 +432,9 @@ parse_options(int *argcp, const char **argv)
     { OptMono,     OPT_BOOLEAN, True,  ResMono,      offset(mono) },
 # endif /*]*/
     { OptNoPrompt, OPT_BOOLEAN, True,  ResNoPrompt,  offset(no_prompt) },
+#endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+    { OptMultiSession,OPT_BOOLEAN,True,ResMultiSession,offset(multi_session) },
 #endif /*]*/
     { OptOnce,     OPT_BOOLEAN, True,  ResOnce,      offset(once) },
     { OptOversize, OPT_STRING,  False, ResOversize,  offset(oversize) },
@@ -449,18 +452,24 @@ parse_options(int *argcp, const char **argv)
 #endif /*]*/
     { OptSet,      OPT_SKIP2,   False, NULL,         NULL },
 #if defined(X3270_SCRIPT) /*[*/
+    { OptScriptPort,OPT_STRING, False, ResScriptPort,offset(script_port) },
     { OptSocket,   OPT_BOOLEAN, True,  ResSocket,    offset(socket) },
+    { OptSocketPath,OPT_STRING, False, ResSocketPath,offset(socket_path) },
 #endif /*]*/
     { OptTermName, OPT_STRING,  False, ResTermName,  offset(termname) },
 #if defined(WC3270) /*[*/
     { OptTitle,    OPT_STRING,  False, ResTitle,     offset(title) },
 #endif /*]*/
 #if defined(X3270_TRACE) /*[*/
+    { OptTraceBinary,OPT_BOOLEAN,True, ResTraceBinary,offset(trace_binary) },
     { OptTraceFile,OPT_STRING,  False, ResTraceFile, offset(trace_file) },
     { OptTraceFileSize,OPT_STRING,False,ResTraceFileSize,offset(trace_file_size) },
 #endif /*]*/
     { OptV,        OPT_V,	False, NULL,	     NULL },
     { OptVersion,  OPT_V,	False, NULL,	     NULL },
+#if defined(X3270_SESSIONS) /*[*/
+    { OptWorkers,  OPT_INT,	False, ResWorkers,   offset(workers) },
+#endif /*]*/
     { "-xrm",      OPT_XRM,     False, NULL,         NULL },
     { LAST_ARG,    OPT_DONE,    False, NULL,         NULL },
     { CN,          OPT_SKIP2,   False, NULL,         NULL }
@@ -547,6 +556,10 @@ parse_options(int *argcp, const char **argv)
 	appres.unlock_delay = True;
 	appres.unlock_delay_ms = 350;
 
+#if defined(X3270_SESSIONS) /*[*/
+	appres.workers = 1;
+#endif /*]*/
+
 #if defined(X3270_FT) /*[*/
 	appres.dft_buffer_size = DFT_BUF;
 #endif /*]*/
@@ -807,6 +820,8 @@ static struct {
 #endif /*]*/
 #if defined(X3270_SCRIPT) /*[*/
 	{ ResPluginCommand, offset(plugin_command), XRM_STRING },
+	{ ResScriptPort,offset(script_port),	XRM_STRING },
+	{ ResSocketPath,offset(socket_path),	XRM_STRING },
 #endif /*]*/
 #if defined(C3270) /*[*/
 	{ ResIdleCommand,offset(idle_command),	XRM_STRING },
@@ -839,6 +854,9 @@ static struct {
 	{ ResMono,	offset(mono),		XRM_BOOLEAN },
 # endif /*]*/
 	{ ResNoPrompt,	offset(no_prompt),	XRM_BOOLEAN },
+#endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+	{ ResMultiSession,offset(multi_session),XRM_BOOLEAN },
 #endif /*]*/
 	{ ResNumericLock, offset(numeric_lock),	XRM_BOOLEAN },
 	{ ResOerrLock,	offset(oerr_lock),	XRM_BOOLEAN },
@@ -865,6 +883,7 @@ static struct {
 #if !defined(_WIN32) /*[*/
 	{ ResTraceDir,	offset(trace_dir),	XRM_STRING },
 #endif /*]*/
+	{ ResTraceBinary,offset(trace_binary),	XRM_BOOLEAN },
 	{ ResTraceFile,	offset(trace_file),	XRM_STRING },
 	{ ResTraceFileSize,offset(trace_file_size),XRM_STRING },
 #if defined(WC3270) /*[*/
@@ -880,6 +899,9 @@ static struct {
 #if defined(X3270_ANSI) /*[*/
 	{ ResWerase,	offset(werase),		XRM_STRING },
 #endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+	{ ResWorkers,	offset(workers),	XRM_INT },
+#endif /*]*/
 
 	{ CN,		0,			XRM_STRING }
 };
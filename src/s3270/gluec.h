@@ -39,6 +39,7 @@ extern Boolean process_events(Boolean block);
 
 /* XtGlue.c */
 extern void (*Warning_redirect)(const char *);
+extern void process_events_fork(void);
 #if !defined(_WIN32) /*[*/
 extern int select_setup(int *nfds, fd_set *readfds, fd_set *writefds,
     fd_set *exceptfds, struct timeval **timeout, struct timeval *timebuf);
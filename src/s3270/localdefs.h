@@ -74,3 +74,4 @@ extern void Warning(const char *);
 
 /* "Required" optional parts. */
 #define X3270_SCRIPT	1
+#define X3270_SESSIONS	1
@@ -0,0 +1 @@
+../x3270/session.c
\ No newline at end of file
@@ -0,0 +1 @@
+../x3270/sessvars.c
\ No newline at end of file
@@ -58,6 +58,7 @@
 #include "popupsc.h"
 #include "screenc.h"
 #include "selectc.h"
+#include "sessionc.h"
 #include "tablesc.h"
 #include "telnetc.h"
 #include "togglesc.h"
@@ -93,6 +94,9 @@ main(int argc, char *argv[])
 	}
 	action_init();
 	ctlr_init(-1);
+#if defined(X3270_SESSIONS) /*[*/
+	session_init();
+#endif /*]*/
 	ctlr_reinit(-1);
 	kybd_init();
 	ansi_init();
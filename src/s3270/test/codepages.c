@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2009, Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	codepages.c
+ *		Unicode-to-EBCDIC lookup benchmark for unicode.c.
+ *
+ *		For every SBCS host code page that charset_list() lists,
+ *		selects it with set_uni() and looks up U+0020..U+25FF with
+ *		unicode_to_ebcdic_ge(), which uses the index set_uni() builds.
+ *		The same lookups are done with the linear scans the index
+ *		replaced, built from the EBCDIC-to-Unicode tables.  Fails if
+ *		the two ever disagree, and reports the time per lookup for
+ *		each.
+ */
+
+#include "globals.h"
+#include "charsetc.h"
+#include "unicodec.h"
+
+#include <sys/time.h>
+
+#define U_FIRST		0x0020
+#define U_LAST		0x25ff
+#define PASSES		20	/* passes through the index per code page */
+
+static volatile ebc_t sink;
+
+/* The s3270 objects refer to this, which is defined with main(). */
+void
+usage(char *msg _is_unused)
+{
+	exit(1);
+}
+
+/* The lookup from before the index: the base table, then the GE set. */
+static ebc_t
+linear_to_ebcdic_ge(ucs4_t u, Boolean *ge)
+{
+	ebc_t e;
+
+	*ge = False;
+	if (u == 0x0020)
+		return 0x40;
+	for (e = 0x41; e < 0xff; e++) {
+		if (ebcdic_base_to_unicode(e, False, False) == u)
+			return e;
+	}
+	for (e = 0x70; e <= 0xfe; e++) {
+		if ((ucs4_t)apl_to_unicode(e) == u) {
+			*ge = True;
+			return e;
+		}
+	}
+	return 0;
+}
+
+/* Returns the time since the last call, in microseconds. */
+static double
+lap(void)
+{
+	static struct timeval last;
+	struct timeval now;
+	double us;
+
+	(void) gettimeofday(&now, NULL);
+	us = ((now.tv_sec - last.tv_sec) * 1000000.0) +
+	    (now.tv_usec - last.tv_usec);
+	last = now;
+	return us;
+}
+
+/*
+ * Get the SBCS code page names from charset_list(), which prints them on
+ * one line, separated by commas, each followed by its aliases in
+ * parentheses.
+ */
+static char *
+sbcs_names(void)
+{
+	FILE *f;
+	int save;
+	static char buf[4096];
+	char *s, *t;
+	int depth = 0;
+
+	f = tmpfile();
+	if (f == NULL) {
+		perror("tmpfile");
+		exit(1);
+	}
+	(void) fflush(stdout);
+	save = dup(fileno(stdout));
+	(void) dup2(fileno(f), fileno(stdout));
+	charset_list();
+	(void) fflush(stdout);
+	(void) dup2(save, fileno(stdout));
+	(void) close(save);
+	rewind(f);
+	if (fgets(buf, sizeof(buf), f) == NULL ||
+	    strncmp(buf, "SBCS", 4) ||
+	    fgets(buf, sizeof(buf), f) == NULL) {
+		printf("FAIL no SBCS code pages from charset_list()\n");
+		exit(1);
+	}
+	(void) fclose(f);
+
+	/* Drop the aliases, leaving the names separated by spaces. */
+	for (s = t = buf; *s; s++) {
+		if (*s == '(')
+			depth++;
+		else if (*s == ')')
+			depth--;
+		else if (!depth)
+			*t++ = (*s == ',' || *s == '\n')? ' ': *s;
+	}
+	*t = '\0';
+	return buf;
+}
+
+int
+main(int argc _is_unused, char *argv[] _is_unused)
+{
+	char *names, *name;
+	const char *host_codepage, *cgcsgid, *display_charsets;
+	int n_pages = 0;
+	Boolean failed = False;
+	double t_index = 0.0, t_linear = 0.0;
+	unsigned long lookups = 0;
+
+	names = sbcs_names();
+	for (name = strtok(names, " "); name != CN; name = strtok(CN, " ")) {
+		ucs4_t u;
+		int i;
+		int mismatches = 0;
+
+		if (set_uni(name, &host_codepage, &cgcsgid,
+			    &display_charsets) < 0) {
+			printf("FAIL %s: set_uni() failed\n", name);
+			failed = True;
+			continue;
+		}
+		n_pages++;
+
+		(void) lap();
+		for (u = U_FIRST; u <= U_LAST; u++) {
+			Boolean ge;
+
+			sink = linear_to_ebcdic_ge(u, &ge);
+		}
+		t_linear += lap();
+
+		for (i = 0; i < PASSES; i++) {
+			for (u = U_FIRST; u <= U_LAST; u++) {
+				Boolean ge;
+
+				sink = unicode_to_ebcdic_ge(u, &ge);
+			}
+		}
+		t_index += lap() / PASSES;
+		lookups += U_LAST - U_FIRST + 1;
+
+		for (u = U_FIRST; u <= U_LAST; u++) {
+			Boolean ge_index, ge_linear;
+			ebc_t e_index, e_linear;
+
+			e_index = unicode_to_ebcdic_ge(u, &ge_index);
+			e_linear = linear_to_ebcdic_ge(u, &ge_linear);
+			if (e_index != e_linear || ge_index != ge_linear) {
+				if (!mismatches++)
+					printf("FAIL %s: U+%04x is X'%02x'%s, "
+					    "not X'%02x'%s\n", name,
+					    (unsigned)u, (unsigned)e_index,
+					    ge_index? " (GE)": "",
+					    (unsigned)e_linear,
+					    ge_linear? " (GE)": "");
+			}
+		}
+		if (mismatches) {
+			printf("FAIL %s: %d mismatches\n", name, mismatches);
+			failed = True;
+		}
+	}
+
+	if (!n_pages) {
+		printf("FAIL no code pages\n");
+		return 1;
+	}
+	printf("ok   %d code pages, U+%04X..U+%04X: linear %.1f ns, "
+	    "index %.1f ns per lookup (%.0fx)\n", n_pages, U_FIRST, U_LAST,
+	    t_linear * 1000.0 / lookups, t_index * 1000.0 / lookups,
+	    t_index > 0.0? t_linear / t_index: 0.0);
+	return failed? 1: 0;
+}
@@ -0,0 +1,95 @@
+#! /usr/bin/env python3
+
+# Copyright (c) 2009, Paul Mattes.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of Paul Mattes nor his contributors may be used
+#       to endorse or promote products derived from this software without
+#       specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+# NO EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Script command throughput benchmark for s3270.
+#
+# Usage: commands.py [s3270]
+#
+# Pipes 500,000 commands to s3270 on standard input and reports how many it
+# runs per second, once reading the replies through a pipe the way a script
+# does, and once with them going to /dev/null, which leaves out the cost of
+# the pipe and the reader.  The commands use full action names, abbreviations and
+# mixed case, so they cover the action name lookup and the parameter
+# parser.  Every command must get its reply, and a few known-bad names must
+# still be rejected the way they always have been, and a command too long to
+# buffer must get exactly one error reply.  Give it an older s3270
+# to compare.
+
+import subprocess
+import sys
+import tempfile
+import time
+
+s3270 = sys.argv[1] if len(sys.argv) > 1 else './s3270'
+N = 500000
+MIX = ['ignore', 'MoveCursor(1,1)', 'Home', 'movec(2,2)', 'Tab',
+       'IGNORE()', 'BackTab', 'clear', 'MoveCursor(10, 40)', 'Newline']
+
+failed = False
+
+def check(what, got, want):
+    global failed
+    if got == want:
+        print('ok   %s' % what)
+    else:
+        print('FAIL %s: got %r, not %r' % (what, got, want))
+        failed = True
+
+def run(commands, stdout=subprocess.PIPE):
+    with tempfile.TemporaryFile() as f:
+        f.write(''.join(c + '\n' for c in commands).encode())
+        f.seek(0)
+        start = time.time()
+        p = subprocess.run([s3270], stdin=f, stdout=stdout,
+                           stderr=subprocess.STDOUT, timeout=300)
+        secs = time.time() - start
+        return (p.stdout or b'').decode().split('\n'), secs
+
+# Names that must still fail.
+out, _ = run(['mo', 'nosuch', 'Strng("x")'])
+check('ambiguous abbreviation', 'data: Ambiguous action name: mo' in out,
+      True)
+check('unknown action', 'data: Unknown action: nosuch' in out, True)
+check('bad names rejected', out.count('error'), 3)
+
+# A command too long to buffer gets one error reply, in its turn.
+out, _ = run(['ignore', 'Ignore' + ' ' * 2000 + 'Ignore', 'ignore'])
+check('too-long command', [l for l in out if l in ('ok', 'error')],
+      ['ok', 'error', 'ok'])
+check('too-long message', out.count('data: command too long'), 1)
+
+commands = [MIX[i % len(MIX)] for i in range(N)]
+out, secs = run(commands)
+check('%d replies' % N, out.count('ok'), N)
+print('ok   %d commands in %.2f s, %.0f commands per second' %
+      (N, secs, N / secs))
+_, secs = run(commands, subprocess.DEVNULL)
+print('ok   %d commands in %.2f s, %.0f commands per second, '
+      'replies to /dev/null' % (N, secs, N / secs))
+
+sys.exit(1 if failed else 0)
@@ -0,0 +1,89 @@
+#! /usr/bin/env python3
+
+# Copyright (c) 2009, Paul Mattes.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of Paul Mattes nor his contributors may be used
+#       to endorse or promote products derived from this software without
+#       specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+# NO EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Check Expect() against a host that sends plain text, so s3270 is in NVT
+# mode.
+#
+# Usage: expect.py [s3270]
+
+import socket
+import subprocess
+import sys
+import threading
+
+s3270 = sys.argv[1] if len(sys.argv) > 1 else './s3270'
+failed = False
+
+def check(what, got, want):
+    global failed
+    if got == want:
+        print('ok   %s' % what)
+    else:
+        print('FAIL %s: got %r, not %r' % (what, got, want))
+        failed = True
+
+def serve(l):
+    c, _ = l.accept()
+    c.sendall(b'Welcome\r\nlogin: \r\nPassword: \r\nDone\r\n')
+    c.recv(1)
+    c.close()
+
+l = socket.socket()
+l.bind(('127.0.0.1', 0))
+l.listen(1)
+threading.Thread(target=serve, args=(l,), daemon=True).start()
+
+# Each case is (what, Expect parameters, expected data, expected result).
+cases = [
+    ('two patterns', '"login:","Welcome"', ['1'], 'ok'),
+    ('timeout', '"Password:",5', [], 'ok'),
+    ('timeout in seconds', '"nothing","Done",5s', ['1'], 'ok'),
+    ('time out', '"nothing",1', [], 'error'),
+    ('bad timeout', '"Welcome",0', ['Expect: Invalid timeout: 0'], 'error'),
+]
+script = 'Connect(127.0.0.1:%d)\n' % l.getsockname()[1]
+for _, params, _, _ in cases:
+    script += 'Expect(%s)\n' % params
+script += 'Disconnect()\n'
+p = subprocess.run([s3270], input=script.encode(), stdout=subprocess.PIPE,
+                   stderr=subprocess.STDOUT, timeout=30)
+
+# Split the output into replies, skipping the one for Connect().
+replies = []
+data = []
+for line in p.stdout.decode().split('\n'):
+    if line in ('ok', 'error'):
+        replies.append((data, line))
+        data = []
+    elif line.startswith('data: '):
+        data.append(line[6:])
+for (what, _, want_data, want), (got_data, got) in zip(cases, replies[1:]):
+    check(what, (got_data, got), (want_data, want))
+check('replies', len(replies), len(cases) + 2)
+
+sys.exit(1 if failed else 0)
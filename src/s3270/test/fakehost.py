@@ -0,0 +1,101 @@
+#! /usr/bin/env python3
+
+# Copyright (c) 2009, Paul Mattes.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of Paul Mattes nor his contributors may be used
+#       to endorse or promote products derived from this software without
+#       specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+# NO EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+
+# A fake TN3270 host for the s3270 checks.
+#
+# Usage: fakehost.py portfile [text]
+#
+# Listens on a free loopback port and writes the port number to
+# 'portfile'.  Each client is taken through TN3270 negotiation and sent a
+# screen with 'text' (default "FAKEHOST OK") at the top left.  Anything the
+# client sends after that is answered with the same screen.
+
+import os
+import socket
+import sys
+import threading
+
+IAC, DO, WILL, SB, SE, EOR = 255, 253, 251, 250, 240, 239
+BINARY, TTYPE, OEOR = 0, 24, 25
+
+def expect(c, buf, want):
+    while want not in buf:
+        d = c.recv(1024)
+        if not d:
+            raise EOFError
+        buf += d
+    return buf[buf.index(want) + len(want):]
+
+def serve(c, screen):
+    try:
+        c.sendall(bytes([IAC, DO, TTYPE]))
+        buf = expect(c, b'', bytes([IAC, WILL, TTYPE]))
+        c.sendall(bytes([IAC, SB, TTYPE, 1, IAC, SE]))
+        expect(c, buf, bytes([IAC, SE]))
+        c.sendall(bytes([IAC, DO, OEOR, IAC, WILL, OEOR,
+                         IAC, DO, BINARY, IAC, WILL, BINARY]))
+        while True:
+            c.sendall(screen)
+            if not c.recv(4096):
+                break
+    except (EOFError, OSError):
+        pass
+    c.close()
+
+def accept(l, screen):
+    while True:
+        c, _ = l.accept()
+        threading.Thread(target=serve, args=(c, screen), daemon=True).start()
+
+def main():
+    text = sys.argv[2] if len(sys.argv) > 2 else 'FAKEHOST OK'
+    # Erase/Write, restore the keyboard, a protected field with the text.
+    screen = bytes([0xf5, 0xc2, 0x1d, 0x60]) + text.encode('cp037') + \
+        bytes([IAC, EOR])
+    # Listen on the IPv4 loopback address, and the IPv6 one if there is
+    # one, so "localhost" works either way.
+    s = socket.socket()
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    s.bind(('127.0.0.1', 0))
+    port = s.getsockname()[1]
+    listeners = [s]
+    try:
+        s6 = socket.socket(socket.AF_INET6)
+        s6.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        s6.bind(('::1', port))
+        listeners.append(s6)
+    except OSError:
+        pass
+    for l in listeners:
+        l.listen(5)
+        threading.Thread(target=accept, args=(l, screen), daemon=True).start()
+    with open(sys.argv[1] + '.tmp', 'w') as f:
+        f.write('%d\n' % port)
+    os.rename(sys.argv[1] + '.tmp', sys.argv[1])
+    threading.Event().wait()
+
+main()
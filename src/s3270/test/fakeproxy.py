@@ -0,0 +1,155 @@
+#! /usr/bin/env python3
+
+# Copyright (c) 2009, Paul Mattes.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of Paul Mattes nor his contributors may be used
+#       to endorse or promote products derived from this software without
+#       specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+# NO EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+
+# A fake proxy server for the s3270 checks.
+#
+# Usage: fakeproxy.py type portfile logfile [delay]
+#
+# 'type' is http, socks4 or socks5.  Listens on a free port on 127.0.0.1
+# and writes the port number to 'portfile'.  Each request is logged to
+# 'logfile' as a line giving the type and what the client asked for:
+#
+#	http host:port
+#	socks4 ip a.b.c.d:port		socks4 name host:port
+#	socks5 ip a.b.c.d:port		socks5 name host:port
+#
+# then, after 'delay' seconds, the connection is made and relayed.  A
+# reply is sent in pieces, to check that the client collects it.
+
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+lock = threading.Lock()
+
+def log(line):
+    with lock:
+        with open(sys.argv[3], 'a') as f:
+            f.write(line + '\n')
+
+def recv_n(c, n):
+    b = b''
+    while len(b) < n:
+        d = c.recv(n - len(b))
+        if not d:
+            raise EOFError
+        b += d
+    return b
+
+def recv_to(c, end):
+    b = b''
+    while not b.endswith(end):
+        b += recv_n(c, 1)
+    return b[:-len(end)]
+
+def send_slowly(c, data):
+    for i in range(0, len(data), 3):
+        c.sendall(data[i:i + 3])
+        time.sleep(0.02)
+
+def relay(a, b):
+    try:
+        while True:
+            d = a.recv(4096)
+            if not d:
+                break
+            b.sendall(d)
+    except OSError:
+        pass
+    try:
+        b.shutdown(socket.SHUT_WR)
+    except OSError:
+        pass
+
+def http(c):
+    req = recv_to(c, b'\r\n\r\n').split(b'\r\n')[0].split()
+    host, port = req[1].decode().rsplit(':', 1)
+    log('http %s:%s' % (host, port))
+    return host.strip('[]'), int(port), \
+        b'HTTP/1.1 200 Connection established\r\nProxy: fake\r\n\r\n'
+
+def socks4(c):
+    _, _, port = struct.unpack('>BBH', recv_n(c, 4))
+    addr = recv_n(c, 4)
+    recv_to(c, b'\0')		# user
+    if addr[:3] == b'\0\0\0' and addr[3]:
+        host = recv_to(c, b'\0').decode()
+        log('socks4 name %s:%d' % (host, port))
+    else:
+        host = socket.inet_ntoa(addr)
+        log('socks4 ip %s:%d' % (host, port))
+    return host, port, b'\0\x5a' + bytes(6)
+
+def socks5(c):
+    recv_n(c, recv_n(c, 2)[1])		# version, methods
+    c.sendall(b'\x05\x00')
+    _, _, _, atype = recv_n(c, 4)
+    if atype == 1:
+        host = socket.inet_ntoa(recv_n(c, 4))
+        kind = 'ip'
+    elif atype == 3:
+        host = recv_n(c, recv_n(c, 1)[0]).decode()
+        kind = 'name'
+    else:
+        host = socket.inet_ntop(socket.AF_INET6, recv_n(c, 16))
+        kind = 'ip'
+    port = struct.unpack('>H', recv_n(c, 2))[0]
+    log('socks5 %s %s:%d' % (kind, host, port))
+    return host, port, \
+        b'\x05\x00\x00\x03\x04fake' + struct.pack('>H', port)
+
+def serve(c, handler, delay):
+    try:
+        host, port, reply = handler(c)
+        time.sleep(delay)
+        t = socket.create_connection((host, port))
+        send_slowly(c, reply)
+        threading.Thread(target=relay, args=(t, c), daemon=True).start()
+        relay(c, t)
+    except (EOFError, OSError) as e:
+        log('error %s' % e)
+    c.close()
+
+def main():
+    handler = {'http': http, 'socks4': socks4, 'socks5': socks5}[sys.argv[1]]
+    delay = float(sys.argv[4]) if len(sys.argv) > 4 else 0
+    s = socket.socket()
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    s.bind(('127.0.0.1', 0))
+    s.listen(5)
+    with open(sys.argv[2] + '.tmp', 'w') as f:
+        f.write('%d\n' % s.getsockname()[1])
+    os.rename(sys.argv[2] + '.tmp', sys.argv[2])
+    while True:
+        c, _ = s.accept()
+        threading.Thread(target=serve, args=(c, handler, delay),
+                         daemon=True).start()
+
+main()
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2009, Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	layout.c
+ *		Screen buffer scan benchmark for ctlr.c.
+ *
+ *		Times ctlr_blank_area() and ctlr_next_fa(), which test a cell
+ *		of the screen buffer as one word, against the byte-at-a-time
+ *		loops they replaced, on a 27x132 (3270-5) screen.  Fails if
+ *		the two ever give different answers.
+ */
+
+#include "globals.h"
+#include "3270ds.h"
+#include "appres.h"
+#include "ctlrc.h"
+
+#include <sys/time.h>
+
+#define ROWS5		27
+#define COLS5		132
+#define N_CELLS		(ROWS5 * COLS5)
+#define PASSES		20000
+
+#define IsBlank(c)	((c == EBC_null) || (c == EBC_space))
+
+static struct ea screen[N_CELLS];
+static Boolean failed = False;
+static volatile int sink;
+
+/* The s3270 objects refer to this, which is defined with main(). */
+void
+usage(char *msg _is_unused)
+{
+	exit(1);
+}
+
+/* The loops from before ctlr_blank_area() and ctlr_next_fa(). */
+static int
+bytes_any_data(struct ea *buf, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (!IsBlank(buf[i].cc))
+			return 1;
+	}
+	return 0;
+}
+
+static int
+bytes_count_fa(struct ea *buf, int count)
+{
+	int i, n = 0;
+
+	for (i = 0; i < count; i++) {
+		if (buf[i].fa)
+			n++;
+	}
+	return n;
+}
+
+static int
+words_any_data(struct ea *buf, int count)
+{
+	return !ctlr_blank_area(buf, count, False);
+}
+
+/* The field index rebuild loop from ctlr.c. */
+static int
+words_count_fa(struct ea *buf, int count)
+{
+	int baddr = 0, n, nfa = 0;
+
+	while ((n = ctlr_next_fa(&buf[baddr], count - baddr)) >= 0) {
+		baddr += n + 1;
+		nfa++;
+	}
+	return nfa;
+}
+
+/* Returns the time since the last call, in microseconds. */
+static double
+lap(void)
+{
+	static struct timeval last;
+	struct timeval now;
+	double us;
+
+	(void) gettimeofday(&now, NULL);
+	us = ((now.tv_sec - last.tv_sec) * 1000000.0) +
+	    (now.tv_usec - last.tv_usec);
+	last = now;
+	return us;
+}
+
+static void
+compare(const char *what, int (*bytes)(struct ea *, int),
+    int (*words)(struct ea *, int))
+{
+	int want, got;
+	double t_bytes, t_words;
+	int i;
+
+	want = (*bytes)(screen, N_CELLS);
+	got = (*words)(screen, N_CELLS);
+	if (got != want) {
+		printf("FAIL %s: got %d, not %d\n", what, got, want);
+		failed = True;
+		return;
+	}
+
+	(void) lap();
+	for (i = 0; i < PASSES; i++)
+		sink = (*bytes)(screen, N_CELLS);
+	t_bytes = lap() / PASSES;
+	for (i = 0; i < PASSES; i++)
+		sink = (*words)(screen, N_CELLS);
+	t_words = lap() / PASSES;
+
+	printf("ok   %s: bytewise %.2f us, by word %.2f us (%.1fx)\n", what,
+	    t_bytes, t_words, t_words > 0.0? t_bytes / t_words: 0.0);
+}
+
+int
+main(int argc _is_unused, char *argv[] _is_unused)
+{
+	int i;
+
+	ctlr_init(0);
+
+	/* Cleared screen: nulls, no fields. */
+	compare("cleared screen, any data", bytes_any_data, words_any_data);
+	compare("cleared screen, fields", bytes_count_fa, words_count_fa);
+
+	/* Spaces, with a message on the last line. */
+	for (i = 0; i < N_CELLS; i++)
+		screen[i].cc = EBC_space;
+	screen[N_CELLS - 10].cc = 0xc1;
+	compare("message on last line, any data", bytes_any_data,
+	    words_any_data);
+
+	/* A formatted screen: a label and an input field on each line. */
+	for (i = 0; i < N_CELLS; i++)
+		screen[i].cc = EBC_null;
+	for (i = 0; i < ROWS5; i++) {
+		screen[(i * COLS5)].fa = 0xe0;
+		screen[(i * COLS5) + 20].fa = 0xc0;
+		screen[(i * COLS5) + 60].fa = 0xe0;
+	}
+	compare("formatted screen, fields", bytes_count_fa, words_count_fa);
+
+	return failed? 1: 0;
+}
@@ -0,0 +1,122 @@
+#! /bin/sh
+
+# Copyright (c) 2009, Paul Mattes.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of Paul Mattes nor his contributors may be used
+#       to endorse or promote products derived from this software without
+#       specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+# NO EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+
+# Connect s3270 to a fake host through each kind of fake proxy, and check
+# what the proxy was asked for and that the host's screen came through.
+#
+# Usage: proxy.sh [s3270]
+
+s3270=${1-./s3270}
+here=`dirname $0`
+tmp=/tmp/proxy.$$
+pids=
+trap 'kill $pids 2>/dev/null; rm -rf $tmp' 0
+trap 'exit 1' 1 2 15
+mkdir $tmp || exit 1
+
+if ! python3 -c '' 2>/dev/null
+then	echo "proxy.sh: python3 is needed, skipped"
+	exit 0
+fi
+to=
+command -v timeout >/dev/null && to="timeout 30"
+
+# Wait for a fake server to write its port number to file $1.
+port()
+{
+	i=0
+	while [ ! -s $1 ]
+	do	i=`expr $i + 1`
+		[ $i -gt 100 ] && { echo "proxy.sh: no $1" >&2; exit 1; }
+		sleep 0.1
+	done
+	cat $1
+}
+
+python3 $here/fakehost.py $tmp/host &
+pids="$pids $!"
+hport=`port $tmp/host`
+for type in http socks4 socks5
+do	python3 $here/fakeproxy.py $type $tmp/$type $tmp/$type.log 0.5 &
+	pids="$pids $!"
+	eval ${type}_port=`port $tmp/$type`
+done
+
+fail=0
+
+# check proxy-type proxy-port host expected-log-pattern
+check()
+{
+	: >$tmp/$2.log
+	out=`printf 'Connect(%s:%s)\nWait(Output)\nAscii(0,1,11)\nDisconnect()\n' \
+	    $3 $hport | $to $s3270 -proxy $1:127.0.0.1:$4 2>&1`
+	log=`cat $tmp/$2.log`
+	case "$out" in
+	*"data: FAKEHOST OK"*)
+		;;
+	*)	echo "FAIL $1: no screen"
+		echo "$out" | sed 's/^/	/'
+		fail=1
+		return
+		;;
+	esac
+	if expr "$log" : "$5" >/dev/null
+	then	echo "ok   $1: $log"
+	else	echo "FAIL $1: proxy was asked for '$log', not '$5'"
+		fail=1
+	fi
+}
+
+check http http 127.0.0.1 $http_port "http 127.0.0.1:$hport\$"
+check socks4 socks4 localhost $socks4_port "socks4 ip 127.0.0.1:$hport\$"
+check socks4a socks4 localhost $socks4_port "socks4 name localhost:$hport\$"
+check socks5 socks5 localhost $socks5_port "socks5 ip [0-9a-f.:]*:$hport\$"
+check socks5d socks5 localhost $socks5_port "socks5 name localhost:$hport\$"
+
+# The connection must not be reported as made until the proxy has connected
+# to the host, so a host that refuses the proxy is never seen as connected.
+cport=`python3 -c 'import socket; s = socket.socket(); s.bind(("127.0.0.1", 0)); print(s.getsockname()[1])'`
+for type in http socks4 socks5
+do	eval port=\$${type}_port
+	out=`printf 'Subscribe()\nConnect(127.0.0.1:%s)\n' $cport | \
+	    $to $s3270 -proxy $type:127.0.0.1:$port 2>&1`
+	case "$out" in
+	*"event: connection tn3270"*)
+		echo "FAIL $type: refused connection was reported as made"
+		echo "$out" | grep -v '^event: change' | sed 's/^/	/'
+		fail=1
+		;;
+	*error)	echo "ok   $type: refused"
+		;;
+	*)	echo "FAIL $type: no error for a refused connection"
+		echo "$out" | grep -v '^event: change' | sed 's/^/	/'
+		fail=1
+		;;
+	esac
+done
+
+exit $fail
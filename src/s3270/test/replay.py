@@ -0,0 +1,212 @@
+#! /usr/bin/env python3
+
+# Copyright (c) 2009, Paul Mattes.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of Paul Mattes nor his contributors may be used
+#       to endorse or promote products derived from this software without
+#       specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+# NO EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Differential check of the 3270 input fast path in net_input().
+#
+# Usage: replay.py [s3270 [reference [streamfile]]]
+#
+# Replays a host stream to a reference s3270 and then several times to the
+# s3270 under test, each time cut into different read-sized pieces.  The
+# screen s3270 ends up with, and its reply to the host's Read Buffer, must be
+# the same every time.  The reference defaults to test/s3270-bytewise, which
+# is built with X3270_TEST_BYTEWISE so every byte goes through telnet_fsm;
+# an s3270 from before the fast path will do as well.
+#
+# 'streamfile' is the raw host side of a TN3270 (not TN3270E) session after
+# negotiation, for instance one saved from a trace.  Its last record should
+# restore the keyboard.  Without one, a built-in stream is used: full-screen
+# writes with every order, doubled IACs in text and in 14-bit addresses, an
+# IAC NOP inside a record, a Read Buffer and a final write that unlocks the
+# keyboard.
+
+import random
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+IAC, DO, WILL, SB, SE, EOR, NOP = 255, 253, 251, 250, 240, 239, 241
+BINARY, TTYPE, OEOR = 0, 24, 25
+SF, SFE, SBA, SA, IC, PT, RA, EUA, GE = \
+    0x1d, 0x29, 0x11, 0x28, 0x13, 0x05, 0x3c, 0x12, 0x08
+
+s3270 = sys.argv[1] if len(sys.argv) > 1 else './s3270'
+reference = sys.argv[2] if len(sys.argv) > 2 else './test/s3270-bytewise'
+ROWS, COLS = 24, 80
+
+CODES = [0x40, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+         0xc8, 0xc9, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,
+         0x50, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+         0xd8, 0xd9, 0x5a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+         0x60, 0x61, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
+         0xe8, 0xe9, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+         0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+         0xf8, 0xf9, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f]
+
+def addr12(row, col):
+    a = row * COLS + col
+    return bytes([CODES[a >> 6], CODES[a & 0x3f]])
+
+def addr14(a):
+    return bytes([a >> 8, a & 0xff])
+
+def text(s):
+    return s.encode('cp037')
+
+def record(data):
+    return data.replace(bytes([IAC]), bytes([IAC, IAC])) + bytes([IAC, EOR])
+
+def builtin_stream():
+    # Erase/Write, keyboard left locked: a title, input fields with
+    # extended attributes, a full line of EO characters (X'FF').
+    w = bytearray([0xf5, 0x40])
+    w += bytes([SBA]) + addr12(0, 0) + bytes([SF, 0x60]) + text('REPLAY')
+    w += bytes([SA, 0x42, 0xf2]) + text(' red ') + bytes([SA, 0x00, 0x00])
+    for row in range(2, 22):
+        w += bytes([SBA]) + addr12(row, 0) + bytes([SF, 0xf0])
+        w += text('Field %02d' % row)
+        w += bytes([SBA]) + addr12(row, 20)
+        w += bytes([SFE, 2, 0xc0, 0x40, 0x41, 0xf4])
+        w += text(('%02d' % row) * 20)[:40] + bytes([0xff] * (row % 5))
+        w += bytes([SF, 0x60])
+    w += bytes([SBA]) + addr12(22, 0) + bytes([0xff] * COLS)
+    w += bytes([SBA]) + addr12(23, 0) + bytes([GE, 0xc5, GE, 0xff])
+    w += bytes([RA]) + addr12(23, 40) + bytes([0xff])
+    w += bytes([RA]) + addr12(23, 60) + text('*')
+    w += bytes([SBA]) + addr12(2, 20) + bytes([IC])
+    stream = record(bytes(w))
+
+    # Write: 14-bit addresses whose low byte is X'FF', EUA and PT, and an
+    # IAC NOP between the halves of the record.
+    w = bytearray([0xf1, 0x40])
+    for a in (0x0ff, 0x1ff, 0x2ff, 0x3ff, 0x4ff, 0x5ff, 0x6ff):
+        w += bytes([SBA]) + addr14(a) + text('@%x' % a) + bytes([0xff])
+    w += bytes([SBA]) + addr12(3, 21) + bytes([EUA]) + addr12(5, 0)
+    w += bytes([SBA]) + addr12(6, 0) + bytes([PT]) + text('tabbed')
+    half = len(w) // 2
+    stream += (bytes(w[:half]).replace(bytes([IAC]), bytes([IAC, IAC])) +
+               bytes([IAC, NOP]) + record(bytes(w[half:])))
+
+    # Read Buffer, then unlock the keyboard.
+    stream += record(bytes([0xf2]))
+    stream += record(bytes([0xf1, 0xc2]))
+    return stream
+
+def read_record(c, buf):
+    # Returns one client record, with IACs undoubled, and what follows it.
+    while bytes([IAC, EOR]) not in buf:
+        d = c.recv(4096)
+        if not d:
+            raise EOFError
+        buf += d
+    i = buf.index(bytes([IAC, EOR]))
+    return buf[:i].replace(bytes([IAC, IAC]), bytes([IAC])), buf[i + 2:]
+
+def serve(l, stream, seed, replies):
+    c, _ = l.accept()
+    c.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    try:
+        c.sendall(bytes([IAC, DO, TTYPE]))
+        buf = b''
+        while bytes([IAC, WILL, TTYPE]) not in buf:
+            buf += c.recv(1024)
+        c.sendall(bytes([IAC, SB, TTYPE, 1, IAC, SE]))
+        while bytes([IAC, SE]) not in buf:
+            buf += c.recv(1024)
+        buf = buf[buf.index(bytes([IAC, SE])) + 2:]
+        c.sendall(bytes([IAC, DO, OEOR, IAC, WILL, OEOR,
+                         IAC, DO, BINARY, IAC, WILL, BINARY]))
+        time.sleep(0.2)
+
+        # Send the stream in pieces, pausing so each is a separate read.
+        rng = random.Random(seed)
+        i = 0
+        while i < len(stream):
+            n = len(stream) if seed is None else rng.randint(1, 600)
+            c.sendall(stream[i:i + n])
+            i += n
+            time.sleep(0.005)
+        while True:
+            r, buf = read_record(c, buf)
+            replies.append(r)
+    except (EOFError, OSError):
+        pass
+    c.close()
+
+def run(stream, seed, binary):
+    l = socket.socket()
+    l.bind(('127.0.0.1', 0))
+    l.listen(1)
+    replies = []
+    t = threading.Thread(target=serve, args=(l, stream, seed, replies),
+                         daemon=True)
+    t.start()
+    script = ('Connect(127.0.0.1:%d)\nWait(10,Unlock)\n'
+              'ReadBuffer(Ascii)\nReadBuffer(Ebcdic)\nDisconnect()\n' %
+              l.getsockname()[1])
+    p = subprocess.run([binary, '-model', '2'], input=script.encode(),
+                       stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                       timeout=60)
+    t.join(10)
+    l.close()
+    # Drop the command timing at the end of each status line.
+    out = [line.rsplit(' ', 1)[0] if line.count(' ') == 11 else line
+           for line in p.stdout.decode('latin-1').split('\n')]
+    return out, replies
+
+if len(sys.argv) > 3:
+    with open(sys.argv[3], 'rb') as f:
+        stream = f.read()
+else:
+    stream = builtin_stream()
+
+failed = False
+want = run(stream, None, reference)
+if want[0].count('ok') != 5 or not want[1]:
+    print('FAIL reference replay: %r' % (want,))
+    failed = True
+for seed in (None, 1, 2, 3):
+    got = run(stream, seed, s3270)
+    what = 'replay in %s' % ('one piece' if seed is None else
+                             'pieces, seed %d' % seed)
+    if got == want:
+        print('ok   %s' % what)
+    else:
+        print('FAIL %s' % what)
+        failed = True
+for seed in (4, 5):
+    got = run(stream, seed, reference)
+    what = 'reference replay in pieces, seed %d' % seed
+    if got == want:
+        print('ok   %s' % what)
+    else:
+        print('FAIL %s' % what)
+        failed = True
+
+sys.exit(1 if failed else 0)
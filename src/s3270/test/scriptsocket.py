@@ -0,0 +1,141 @@
+#! /usr/bin/env python3
+
+# Copyright (c) 2009, Paul Mattes.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of Paul Mattes nor his contributors may be used
+#       to endorse or promote products derived from this software without
+#       specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+# NO EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Check the script socket with several clients sharing one session.
+#
+# Usage: scriptsocket.py [s3270]
+
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+s3270 = sys.argv[1] if len(sys.argv) > 1 else './s3270'
+failed = False
+
+def wait_for(path):
+    for _ in range(100):
+        if os.path.exists(path):
+            return
+        time.sleep(0.1)
+    sys.exit('scriptsocket.py: no %s' % path)
+
+def check(what, got, want):
+    global failed
+    if got == want:
+        print('ok   %s' % what)
+    else:
+        print('FAIL %s: got %r, not %r' % (what, got, want))
+        failed = True
+
+def reply_lines(s, n):
+    """Read lines up to the nth 'ok' or 'error', giving up after 10 seconds."""
+    s.settimeout(10)
+    f = s.makefile('r')
+    lines = []
+    got = 0
+    try:
+        while got < n:
+            line = f.readline()
+            if not line:
+                break
+            lines.append(line.rstrip('\n'))
+            if lines[-1] in ('ok', 'error'):
+                got += 1
+    except socket.timeout:
+        pass
+    f.close()
+    return lines
+
+def replies(s, n):
+    """Count up to n 'ok' or 'error' lines."""
+    return len([l for l in reply_lines(s, n) if l in ('ok', 'error')])
+
+tmp = tempfile.mkdtemp()
+procs = []
+try:
+    sock = os.path.join(tmp, 'sock')
+    procs.append(subprocess.Popen([s3270, '-socketpath', sock]))
+    wait_for(sock)
+
+    # More queries than fit in a client's buffer, sent all at once.  Each
+    # buffer-full is run straight away, and reading has to start again
+    # after it.
+    n = 200
+    a = socket.socket(socket.AF_UNIX)
+    a.connect(sock)
+    a.sendall(b'Query(ConnectionState)\n' * n)
+    check('queries', replies(a, n), n)
+    a.close()
+
+    # A command too long to buffer gets one error reply, after the command
+    # ahead of it and before the ones behind it.
+    a = socket.socket(socket.AF_UNIX)
+    a.connect(sock)
+    a.sendall(b'Ignore\nIgnore' + b' ' * 2000 +
+              b'Ignore\nQuery(ConnectionState)\n')
+    lines = reply_lines(a, 3)
+    check('too-long command', [l for l in lines if l in ('ok', 'error')],
+          ['ok', 'error', 'ok'])
+    check('too-long message', lines.count('data: command too long'), 1)
+    a.close()
+
+    # A second emulator must not take over a socket that is in use.
+    p = subprocess.Popen([s3270, '-socketpath', sock],
+                         stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                         stderr=subprocess.STDOUT)
+    time.sleep(1)
+    p.kill()
+    check('in use', b'socket path in use' in p.communicate()[0], True)
+    a = socket.socket(socket.AF_UNIX)
+    a.connect(sock)
+    a.sendall(b'Query(ConnectionState)\n')
+    check('still listening', replies(a, 1), 1)
+    a.close()
+
+    # But it can replace one that nothing is listening on.
+    procs[0].kill()
+    procs[0].wait()
+    procs.append(subprocess.Popen([s3270, '-socketpath', sock]))
+    time.sleep(1)
+    a = socket.socket(socket.AF_UNIX)
+    a.connect(sock)
+    a.sendall(b'Query(ConnectionState)\n')
+    check('stale', replies(a, 1), 1)
+    a.close()
+finally:
+    for p in procs:
+        p.kill()
+        p.wait()
+    for f in os.listdir(tmp):
+        os.unlink(os.path.join(tmp, f))
+    os.rmdir(tmp)
+
+sys.exit(1 if failed else 0)
@@ -0,0 +1,142 @@
+#! /usr/bin/env python3
+
+# Copyright (c) 2009, Paul Mattes.
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#     * Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#     * Neither the name of Paul Mattes nor his contributors may be used
+#       to endorse or promote products derived from this software without
+#       specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN
+# NO EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+# PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+# NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+
+# Check that Session() moves a -multisession script connection between
+# named sessions, and that a named session keeps its host connection when
+# the script connection that used it closes.
+#
+# Usage: sessions.py [s3270]
+
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+here = os.path.dirname(sys.argv[0])
+s3270 = sys.argv[1] if len(sys.argv) > 1 else './s3270'
+failed = False
+
+def wait_for(path):
+    for _ in range(100):
+        if os.path.exists(path):
+            return
+        time.sleep(0.1)
+    sys.exit('sessions.py: no %s' % path)
+
+class Script:
+    """A script connection to s3270."""
+    def __init__(self, path):
+        self.s = socket.socket(socket.AF_UNIX)
+        self.s.connect(path)
+        self.f = self.s.makefile('r')
+
+    def cmd(self, c):
+        """Run a command, returning (data lines, 'ok' or 'error')."""
+        self.s.sendall((c + '\n').encode())
+        data = []
+        while True:
+            line = self.f.readline()
+            if not line:
+                return data, 'eof'
+            line = line.rstrip('\n')
+            if line in ('ok', 'error'):
+                return data, line
+            if line.startswith('data: '):
+                data.append(line[6:])
+
+    def close(self):
+        self.f.close()
+        self.s.close()
+
+def check(what, got, want):
+    global failed
+    if got == want:
+        print('ok   %s' % what)
+    else:
+        print('FAIL %s: got %r, not %r' % (what, got, want))
+        failed = True
+
+def state(sc):
+    return ''.join(sc.cmd('Query(ConnectionState)')[0]).strip()
+
+tmp = tempfile.mkdtemp()
+procs = []
+try:
+    hostfile = os.path.join(tmp, 'host')
+    procs.append(subprocess.Popen(['python3',
+                                   os.path.join(here, 'fakehost.py'),
+                                   hostfile]))
+    wait_for(hostfile)
+    host = '127.0.0.1:%s' % open(hostfile).read().strip()
+    sock = os.path.join(tmp, 'sock')
+    procs.append(subprocess.Popen([s3270, '-multisession',
+                                   '-socketpath', sock]))
+    wait_for(sock)
+
+    # Name a session and connect it to the host.
+    a = Script(sock)
+    check('name', a.cmd('Session(alpha)'), ([], 'ok'))
+    check('query name', a.cmd('Session()'), (['alpha'], 'ok'))
+    a.cmd('Connect(%s)' % host)
+    a.cmd('Wait(Output)')
+    check('screen', a.cmd('Ascii(0,1,11)'), (['FAKEHOST OK'], 'ok'))
+    a.close()
+
+    # A new connection starts out in a session of its own.
+    b = Script(sock)
+    check('new session', state(b), '')
+    check('unnamed', b.cmd('Session()'), ([], 'ok'))
+
+    # Select the named session, which is still connected.
+    check('select', b.cmd('Session(alpha)'), ([], 'ok'))
+    check('still connected', state(b) != '', True)
+    check('same screen', b.cmd('Ascii(0,1,11)'), (['FAKEHOST OK'], 'ok'))
+
+    # Nobody else can have it while it is in use.
+    c = Script(sock)
+    check('in use', c.cmd('Session(alpha)')[1], 'error')
+    c.close()
+
+    # Move to a new named session, and back again.
+    check('new name', b.cmd('Session(beta)'), ([], 'ok'))
+    check('beta', b.cmd('Session()'), (['beta'], 'ok'))
+    check('beta not connected', state(b), '')
+    check('back', b.cmd('Session(alpha)'), ([], 'ok'))
+    check('alpha connected', state(b) != '', True)
+    b.cmd('Disconnect()')
+    b.close()
+finally:
+    for p in procs:
+        p.kill()
+        p.wait()
+    for f in os.listdir(tmp):
+        os.unlink(os.path.join(tmp, f))
+    os.rmdir(tmp)
+
+sys.exit(1 if failed else 0)
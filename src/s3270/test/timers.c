@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2009, Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	timers.c
+ *		Timeout benchmark for XtGlue.c.
+ *
+ *		Schedules 100,000 timeouts at random intervals, cancels a
+ *		random half of them, then the rest, and times each step.  Then
+ *		schedules 100,000 timeouts that are already due and times how
+ *		long process_events() takes to run them all.  Fails if a
+ *		timeout is lost or run twice, or if the whole thing takes more
+ *		than a couple of seconds, which a sorted list would.
+ */
+
+#include "globals.h"
+#if defined(X3270_SESSIONS) /*[*/
+#include "sessionc.h"
+#endif /*]*/
+#include "gluec.h"
+#include "utilc.h"
+
+#include <sys/time.h>
+
+#define N_TIMEOUTS	100000
+#define MAX_MS		(3600L * 1000L)	/* latest random expiration */
+#define LIMIT_MS	2000.0		/* slowest acceptable total time */
+
+static unsigned long ids[N_TIMEOUTS];
+static int fired = 0;
+static double total = 0.0;
+
+#if defined(X3270_SESSIONS) /*[*/
+/* XtGlue.c switches sessions around timeouts; there is only one here. */
+session_t *
+session_current(void)
+{
+	return (session_t *)NULL;
+}
+
+void
+session_switch(session_t *s _is_unused)
+{
+}
+#endif /*]*/
+
+static void
+timeout_fired(void)
+{
+	fired++;
+}
+
+static void
+timeout_never(void)
+{
+	printf("FAIL a cancelled timeout ran\n");
+	exit(1);
+}
+
+/* Returns the time since the last call, in milliseconds. */
+static double
+lap(void)
+{
+	static struct timeval last;
+	struct timeval now;
+	double ms;
+
+	(void) gettimeofday(&now, NULL);
+	ms = ((now.tv_sec - last.tv_sec) * 1000.0) +
+	    ((now.tv_usec - last.tv_usec) / 1000.0);
+	last = now;
+	return ms;
+}
+
+static void
+report(const char *what)
+{
+	double ms = lap();
+
+	printf("ok   %s: %.1f ms\n", what, ms);
+	total += ms;
+}
+
+int
+main(int argc _is_unused, char *argv[] _is_unused)
+{
+	int i;
+
+	srandom(1);
+	(void) lap();
+
+	for (i = 0; i < N_TIMEOUTS; i++)
+		ids[i] = AddTimeOut(1000L + (random() % MAX_MS),
+		    timeout_never);
+	report("schedule 100000 timeouts");
+
+	/* Cancel a random half, by shuffling the first half of ids. */
+	for (i = 0; i < N_TIMEOUTS / 2; i++) {
+		int j = i + (random() % (N_TIMEOUTS - i));
+		unsigned long id = ids[j];
+
+		ids[j] = ids[i];
+		ids[i] = id;
+		RemoveTimeOut(id);
+	}
+	report("cancel a random 50000");
+
+	for (i = N_TIMEOUTS - 1; i >= N_TIMEOUTS / 2; i--)
+		RemoveTimeOut(ids[i]);
+	report("cancel the other 50000");
+
+	for (i = 0; i < N_TIMEOUTS; i++)
+		(void) AddTimeOut(0L, timeout_fired);
+	report("schedule 100000 due timeouts");
+
+	while (fired < N_TIMEOUTS && process_events(True))
+		;
+	report("run 100000 due timeouts");
+
+	if (fired != N_TIMEOUTS) {
+		printf("FAIL %d of %d timeouts ran\n", fired, N_TIMEOUTS);
+		return 1;
+	}
+	if (process_events(False)) {
+		printf("FAIL events left over\n");
+		return 1;
+	}
+	if (total > LIMIT_MS) {
+		printf("FAIL took %.1f ms, more than %.0f ms\n", total,
+		    LIMIT_MS);
+		return 1;
+	}
+	printf("ok   total: %.1f ms\n", total);
+	return 0;
+}
@@ -724,6 +724,10 @@ void
 sms_continue(void)
 {
 }
+void
+sms_feed_changed(void)
+{
+}
 
 /* Data query actions. */
 
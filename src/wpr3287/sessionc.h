@@ -0,0 +1 @@
+../pr3287/sessionc.h
\ No newline at end of file
@@ -44,6 +44,8 @@
 #include <arpa/telnet.h>
 #include <sys/select.h>
 
+#include "../bintrace.h"
+
 #define PORT		4001
 #define BSIZE		16384
 #define LINEDUMP_MAX	32
@@ -58,6 +60,7 @@ static enum {
 	T_NONE, T_IAC
 } tstate = T_NONE;
 int fdisp = 0;
+int binary = 0;
 
 extern int optind;
 extern char *optarg;
@@ -119,6 +122,15 @@ main(int argc, char *argv[])
 		exit(1);
 	}
 
+	/* See if it's a binary trace. */
+	{
+		char magic[BT_MAGIC_LEN];
+
+		if (fread(magic, BT_MAGIC_LEN, 1, f) == 1 &&
+		    !memcmp(magic, BT_MAGIC, BT_MAGIC_LEN))
+			binary = 1;
+	}
+
 	/* Listen on a socket. */
 	s = socket(proto, SOCK_STREAM, 0);
 	if (s < 0) {
@@ -183,7 +195,10 @@ main(int argc, char *argv[])
 		    ntohs(addr.sin.sin_port)
 #endif /*]*/
 		);
-		rewind(f);
+		if (binary)
+			(void) fseek(f, BT_MAGIC_LEN, SEEK_SET);
+		else
+			rewind(f);
 		pstate = BASE;
 		fdisp = 0;
 		process(f, s2);
@@ -300,6 +315,73 @@ d: disconnect\n\
 	return;
 }
 
+/*
+ * Step through a binary trace file.  A 'line' is one network read by the
+ * emulator that made the trace.  There are no marks; 't' acts like 'r'.
+ */
+int
+step_binary(FILE *f, int s, int to_eor)
+{
+	unsigned char hdr[BT_HDR_LEN];
+	unsigned long len;
+	unsigned char *buf;
+	unsigned long i;
+	int at_eor = 0;
+
+	for (;;) {
+		if (fread(hdr, BT_HDR_LEN, 1, f) != 1) {
+			(void) printf("Playback file EOF.\n");
+			return 0;
+		}
+		len = BT_GET32(hdr + 4);
+		buf = (unsigned char *)malloc(len? len: 1);
+		if (buf == NULL) {
+			perror("malloc");
+			exit(1);
+		}
+		if (len && fread(buf, len, 1, f) != 1) {
+			free(buf);
+			(void) printf("Playback file EOF.\n");
+			return 0;
+		}
+
+		/* Show trace text; play back data from the host. */
+		if (hdr[0] == BT_TEXT) {
+			(void) printf("file %.*s", (int)len, buf);
+			free(buf);
+			continue;
+		}
+		if (hdr[0] != BT_DATA || hdr[1] != '<') {
+			free(buf);
+			continue;
+		}
+		trace_netdata("host", buf, len);
+		if (write(s, buf, len) < 0) {
+			perror("socket write");
+			free(buf);
+			return 0;
+		}
+
+		/* Look for IAC EOR. */
+		for (i = 0; i < len; i++) {
+			switch (tstate) {
+			    case T_NONE:
+				if (buf[i] == IAC)
+					tstate = T_IAC;
+				break;
+			    case T_IAC:
+				if (buf[i] == EOR)
+					at_eor = 1;
+				tstate = T_NONE;
+				break;
+			}
+		}
+		free(buf);
+		if (!to_eor || at_eor)
+			return 1;
+	}
+}
+
 int
 step(FILE *f, int s, int to_eor)
 {
@@ -314,6 +396,9 @@ step(FILE *f, int s, int to_eor)
 	int stop_eor = 0;
 #	define NO_FDISP { if (fdisp) { printf("\n"); fdisp = 0; } }
 
+	if (binary)
+		return step_binary(f, s, to_eor);
+
     top:
 	while (again || ((c = fgetc(f)) != EOF)) {
 		if (c == '\r')
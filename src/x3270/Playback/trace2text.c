@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2009, Paul Mattes.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Paul Mattes nor his contributors may be used
+ *       to endorse or promote products derived from this software without
+ *       specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * binary trace file to text converter for x3270
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../bintrace.h"
+
+#define LINEDUMP_MAX	32
+
+char *me;
+
+void
+usage(void)
+{
+	(void) fprintf(stderr, "usage: %s [file]\n", me);
+	exit(1);
+}
+
+/* Dump network data, the way the emulator's text trace does. */
+void
+trace_netdata(char direction, unsigned char *buf, unsigned long len)
+{
+	unsigned long offset;
+
+	for (offset = 0; offset < len; offset++) {
+		if (!(offset % LINEDUMP_MAX))
+			(void) printf("%s%c 0x%-3lx ",
+			    (offset ? "\n" : ""), direction, offset);
+		(void) printf("%02x", buf[offset]);
+	}
+	(void) printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	FILE *f;
+	char magic[BT_MAGIC_LEN];
+	unsigned char hdr[BT_HDR_LEN];
+	unsigned char *buf = NULL;
+	unsigned long bufsize = 0;
+	unsigned long len;
+	double ts, last_ts = -1.0;
+
+	if ((me = strrchr(argv[0], '/')) != NULL)
+		me++;
+	else
+		me = argv[0];
+
+	if (argc > 2 || (argc == 2 && argv[1][0] == '-' && argv[1][1]))
+		usage();
+	if (argc < 2 || !strcmp(argv[1], "-"))
+		f = stdin;
+	else if ((f = fopen(argv[1], "rb")) == NULL) {
+		perror(argv[1]);
+		exit(1);
+	}
+
+	if (fread(magic, BT_MAGIC_LEN, 1, f) != 1 ||
+	    memcmp(magic, BT_MAGIC, BT_MAGIC_LEN)) {
+		(void) fprintf(stderr, "%s: not a binary trace file\n", me);
+		exit(1);
+	}
+
+	while (fread(hdr, BT_HDR_LEN, 1, f) == 1) {
+		len = BT_GET32(hdr + 4);
+		if (len > bufsize) {
+			bufsize = len;
+			buf = (unsigned char *)realloc(buf, bufsize);
+			if (buf == NULL) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		if (len && fread(buf, len, 1, f) != 1) {
+			(void) fprintf(stderr, "%s: truncated frame\n", me);
+			exit(1);
+		}
+		ts = (double)BT_GET32(hdr + 8) * 4294967296.0 +
+		    (double)BT_GET32(hdr + 12) +
+		    ((double)BT_GET32(hdr + 16) / 1.0e6);
+		if (last_ts < 0.0)
+			last_ts = ts;
+
+		switch (hdr[0]) {
+		case BT_TEXT:
+		case BT_DECODE:
+			(void) fwrite(buf, len, 1, stdout);
+			break;
+		case BT_DATA:
+			if (hdr[2] & BTF_3270)
+				(void) printf("%c +%gs\n", hdr[1],
+				    ts - last_ts);
+			last_ts = ts;
+			trace_netdata(hdr[1], buf, len);
+			break;
+		default:
+			/* Skip frames we don't understand. */
+			break;
+		}
+	}
+
+	return 0;
+}
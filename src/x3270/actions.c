@@ -264,6 +264,9 @@ XtActionsRec all_actions[] = {
 #if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
 	{ "Script",		Script_action },
 #endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+	{ "Session",		Session_action },
+#endif /*]*/
 #if defined(C3270) /*[*/
 	{ "Show",		Show_action },
 #endif/*]*/
@@ -277,6 +280,9 @@ XtActionsRec all_actions[] = {
 	{ "Status",		Status_action },
 #endif /*]*/
 	{ "String",		String_action },
+#if defined(X3270_SCRIPT) /*[*/
+	{ "Subscribe",		Subscribe_action },
+#endif /*]*/
 	{ "SysReq",		SysReq_action },
 	{ "Tab",		Tab_action },
 #if defined(X3270_DISPLAY) || defined(WC3270) /*[*/
@@ -293,6 +299,9 @@ XtActionsRec all_actions[] = {
 #endif /*]*/
 #if defined(X3270_DISPLAY) /*[*/
 	{ "Unselect",		Unselect_action },
+#endif /*]*/
+#if defined(X3270_SCRIPT) /*[*/
+	{ "Unsubscribe",	Unsubscribe_action },
 #endif /*]*/
 	{ "Up",			Up_action },
 #if defined(X3270_SCRIPT) || defined(TCL3270) || defined(S3270) /*[*/
@@ -307,6 +316,20 @@ XtActionsRec all_actions[] = {
 int actioncount = XtNumber(all_actions);
 XtActionsRec *actions = NULL;
 
+/*
+ * Action name hash table, used by action_lookup().  There is an entry for
+ * each action name, and one for each proper prefix of each name.  Lookups
+ * ignore case.
+ */
+typedef struct {
+	const char *name;	/* action name, or NULL for an empty slot */
+	int len;		/* number of characters of name to match */
+	int ix;			/* index into actions[], or -1 if ambiguous */
+	Boolean exact;		/* True if this is a full action name */
+} ahash_t;
+static ahash_t *ahash = NULL;
+static unsigned ahash_mask;
+
 /* Actions that are aliases for other actions. */
 static char *aliased_actions[] = {
 	"Close", "HardPrint", "Open", NULL
@@ -349,6 +372,77 @@ action_suppressed(String name, char *suppress)
 	return False;
 }
 
+/* Case-insensitive FNV-1a hash of the first len characters of a name. */
+static unsigned
+action_hash(const char *name, int len)
+{
+	unsigned h = 2166136261U;
+
+	while (len--) {
+		h ^= tolower((unsigned char)*name++);
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/* Find the hash table slot for a name, or the empty slot where it goes. */
+static ahash_t *
+action_slot(const char *name, int len)
+{
+	unsigned h = action_hash(name, len) & ahash_mask;
+
+	while (ahash[h].name != CN &&
+	       (ahash[h].len != len ||
+		strncasecmp(ahash[h].name, name, len)))
+		h = (h + 1) & ahash_mask;
+	return &ahash[h];
+}
+
+/* Build the action name hash table. */
+static void
+action_hash_init(void)
+{
+	int i, j, len;
+	int n = 0;
+	unsigned size = 1;
+	ahash_t *a;
+
+	for (i = 0; i < actioncount; i++)
+		n += strlen(actions[i].string);
+	while (size < 2 * n)
+		size <<= 1;
+	Free(ahash);
+	ahash = (ahash_t *)Calloc(size, sizeof(ahash_t));
+	ahash_mask = size - 1;
+
+	/* Full names go in first, so they take precedence over prefixes. */
+	for (i = 0; i < actioncount; i++) {
+		len = strlen(actions[i].string);
+		a = action_slot(actions[i].string, len);
+		if (a->name == CN) {
+			a->name = actions[i].string;
+			a->len = len;
+			a->ix = i;
+			a->exact = True;
+		}
+	}
+
+	/* A prefix shared by two actions is ambiguous. */
+	for (i = 0; i < actioncount; i++) {
+		len = strlen(actions[i].string);
+		for (j = 1; j < len; j++) {
+			a = action_slot(actions[i].string, j);
+			if (a->name == CN) {
+				a->name = actions[i].string;
+				a->len = j;
+				a->ix = i;
+				a->exact = False;
+			} else if (!a->exact && a->ix != i)
+				a->ix = -1;
+		}
+	}
+}
+
 /*
  * Action table initialization.
  * Uses the suppressActions resource to prune the actions table.
@@ -361,18 +455,39 @@ action_init(void)
 
 	/* See if there are any filters at all. */
 	suppress = get_resource(ResSuppressActions);
-	if (suppress == CN) {
+	if (suppress == CN)
 		actions = all_actions;
-		return;
+	else {
+		/* Yes, we'll need to copy the table and prune it. */
+		actions = (XtActionsRec *)Malloc(sizeof(all_actions));
+		memcpy(actions, all_actions, sizeof(all_actions));
+		for (i = 0; i < actioncount; i++) {
+			if (action_suppressed(actions[i].string, suppress))
+				actions[i].proc = suppressed_action;
+		}
 	}
 
-	/* Yes, we'll need to copy the table and prune it. */
-	actions = (XtActionsRec *)Malloc(sizeof(all_actions));
-	memcpy(actions, all_actions, sizeof(all_actions));
-	for (i = 0; i < actioncount; i++) {
-		if (action_suppressed(actions[i].string, suppress))
-			actions[i].proc = suppressed_action;
-	}
+	action_hash_init();
+}
+
+/*
+ * Look up an action by name, ignoring case.  A prefix of an action name
+ * matches too, as long as it is not a prefix of any other action name.
+ * Returns the index into actions[], -1 if there is no match, or -2 if the
+ * name is an ambiguous prefix.
+ */
+int
+action_lookup(const char *name)
+{
+	ahash_t *a;
+	int len = strlen(name);
+
+	if (ahash == NULL || !len)
+		return -1;
+	a = action_slot(name, len);
+	if (a->name == CN)
+		return -1;
+	return (a->ix < 0)? -2: a->ix;
 }
 
 /*
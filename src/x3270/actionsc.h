@@ -52,6 +52,7 @@ extern void action_debug(XtActionProc action, XEvent *event, String *params,
 #define action_debug(a, e, p, n)
 #endif /*]*/
 extern void action_init(void);
+extern int action_lookup(const char *name);
 extern void action_internal(XtActionProc action, enum iaction cause,
     const char *parm1, const char *parm2);
 extern const char *action_name(XtActionProc action);
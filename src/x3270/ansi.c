@@ -48,6 +48,7 @@
 #include "hostc.h"
 #include "screenc.h"
 #include "scrollc.h"
+#include "sessionc.h"
 #include "tablesc.h"
 #include "telnetc.h"
 #include "trace_dsc.h"
@@ -476,6 +477,7 @@ static int	pe = 0;
 static unsigned char ped[PE_MAX];
 
 static Boolean  held_wrap = False;
+static Boolean  reset_first = True;
 
 static void	ansi_scroll(void);
 
@@ -562,7 +564,6 @@ static enum state
 ansi_reset(int ig1 _is_unused, int ig2 _is_unused)
 {
 	int i;
-	static Boolean first = True;
 
 	gr = 0;
 	saved_gr = 0;
@@ -595,14 +596,14 @@ ansi_reset(int ig1 _is_unused, int ig2 _is_unused)
 	for (i = 0; i < (COLS+7)/8; i++)
 		tabs[i] = 0x01;
 	held_wrap = False;
-	if (!first) {
+	if (!reset_first) {
 		ctlr_altbuffer(True);
 		ctlr_aclear(0, ROWS * COLS, 1);
 		ctlr_altbuffer(False);
 		ctlr_clear(False);
 		screen_80();
 	}
-	first = False;
+	reset_first = False;
 	pmi = 0;
 	return DATA;
 }
@@ -2415,4 +2416,53 @@ ansi_snap_modes(void)
 
 #endif /*]*/
 
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+ansi_session_vars(void)
+{
+	SESSION_VAR(state);
+	SESSION_VAR(saved_cursor);
+	SESSION_VAR(n);
+	SESSION_VAR(nx);
+	SESSION_VAR(text);
+	SESSION_VAR(tx);
+	SESSION_VAR(ansi_ch);
+	SESSION_VAR(gr);
+	SESSION_VAR(saved_gr);
+	SESSION_VAR(fg);
+	SESSION_VAR(saved_fg);
+	SESSION_VAR(bg);
+	SESSION_VAR(saved_bg);
+	SESSION_VAR(cset);
+	SESSION_VAR(saved_cset);
+	SESSION_VAR(csd);
+	SESSION_VAR(saved_csd);
+	SESSION_VAR(once_cset);
+	SESSION_VAR(insert_mode);
+	SESSION_VAR(auto_newline_mode);
+	SESSION_VAR(appl_cursor);
+	SESSION_VAR(saved_appl_cursor);
+	SESSION_VAR(wraparound_mode);
+	SESSION_VAR(saved_wraparound_mode);
+	SESSION_VAR(rev_wraparound_mode);
+	SESSION_VAR(saved_rev_wraparound_mode);
+	SESSION_VAR(allow_wide_mode);
+	SESSION_VAR(saved_allow_wide_mode);
+	SESSION_VAR(wide_mode);
+	SESSION_VAR(saved_wide_mode);
+	SESSION_VAR(saved_altbuffer);
+	SESSION_VAR(scroll_top);
+	SESSION_VAR(scroll_bottom);
+	SESSION_VAR(tabs);
+	SESSION_VAR(cs_to_change);
+	SESSION_VAR(pmi);
+	SESSION_VAR(pending_mbs);
+	SESSION_VAR(pe);
+	SESSION_VAR(ped);
+	SESSION_VAR(held_wrap);
+	SESSION_VAR(reset_first);
+}
+#endif /*]*/
+
 #endif /*]*/
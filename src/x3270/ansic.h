@@ -42,6 +42,9 @@ extern void ansi_send_pa(int nn);
 extern void ansi_send_pf(int nn);
 extern void ansi_send_right(void);
 extern void ansi_send_up(void);
+#if defined(X3270_SESSIONS) /*[*/
+extern void ansi_session_vars(void);
+#endif /*]*/
 extern void ansi_snap(void);
 extern void ansi_snap_modes(void);
 extern void toggle_lineWrap(struct toggle *t, enum toggle_type type);
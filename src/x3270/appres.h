@@ -148,6 +148,10 @@ typedef struct {
 #if defined(X3270_SCRIPT) /*[*/
 	Boolean socket;
 #endif /*]*/
+#if defined(X3270_SESSIONS) /*[*/
+	Boolean multi_session;
+	int	workers;
+#endif /*]*/
 
 	/* Named resources */
 #if defined(X3270_KEYPAD) /*[*/
@@ -208,6 +212,7 @@ typedef struct {
 	char	*trace_file;
 	char	*screentrace_file;
 	char	*trace_file_size;
+	Boolean	trace_binary;
 # if defined(X3270_DISPLAY) || defined(WC3270) /*[*/
 	Boolean	trace_monitor;
 # endif /*]*/
@@ -223,6 +228,8 @@ typedef struct {
 	char	*idle_timeout;
 #if defined(X3270_SCRIPT) /*[*/
 	char	*plugin_command;
+	char	*socket_path;
+	char	*script_port;
 #endif /*]*/
 #if defined(HAVE_LIBSSL) /*[*/
 	char	*cert_file;
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2009, Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ *	bintrace.h
+ *		Binary data stream trace file format.
+ *
+ * A binary trace file starts with BT_MAGIC, followed by frames.  Each frame
+ * is a BT_HDR_LEN-byte header, then 'length' bytes of payload.  Multi-byte
+ * header fields are big-endian.
+ *
+ *	offset	size	field
+ *	0	1	type: BT_TEXT, BT_DECODE or BT_DATA
+ *	1	1	direction of BT_DATA: '<' from host, '>' to host
+ *	2	1	flags: BTF_3270
+ *	3	1	reserved, 0
+ *	4	4	payload length
+ *	8	8	timestamp, seconds
+ *	16	4	timestamp, microseconds
+ *
+ * BT_TEXT frames hold trace text (events and telnet negotiation messages),
+ * exactly as the text trace would show it.  BT_DECODE frames hold the
+ * decoded data stream (orders, fields and so on), also as the text trace
+ * would show it, so they can be left out when only the raw data is wanted.
+ * BT_DATA frames hold raw network data, including any TN3270E headers.
+ */
+
+#define BT_MAGIC	"x3270 binary trace 1\n"
+#define BT_MAGIC_LEN	(sizeof(BT_MAGIC) - 1)
+
+#define BT_HDR_LEN	20
+
+#define BT_TEXT		'T'	/* trace text */
+#define BT_DECODE	'S'	/* data stream decode */
+#define BT_DATA		'D'	/* network data */
+
+#define BTF_3270	0x01	/* emulator was in 3270 mode */
+
+/* Fill in a frame header. */
+#define BT_PUT32(p, v) { \
+	(p)[0] = ((v) >> 24) & 0xff; \
+	(p)[1] = ((v) >> 16) & 0xff; \
+	(p)[2] = ((v) >> 8) & 0xff; \
+	(p)[3] = (v) & 0xff; \
+}
+#define BT_PUT64(p, v) { \
+	BT_PUT32(p, ((v) >> 16) >> 16); \
+	BT_PUT32((p) + 4, (v) & 0xffffffffUL); \
+}
+#define BT_GET32(p) \
+	(((unsigned long)(p)[0] << 24) | ((unsigned long)(p)[1] << 16) | \
+	 ((unsigned long)(p)[2] << 8) | (unsigned long)(p)[3])
@@ -33,8 +33,10 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include "appres.h"
 
 #include "popupsc.h"
+#include "trace_dsc.h"
 #include "utilc.h"
 
 #define CHILD_BUF	1024
@@ -117,6 +119,7 @@ fork_child(void)
 		child_discarding = False;
 
 	/* Fork and rearrange output. */
+	trace_flush();
 	pid = fork();
 	if (pid == 0) {
 		/* Child. */
@@ -58,6 +58,7 @@
 #include "scrollc.h"
 #include "seec.h"
 #include "selectc.h"
+#include "sessionc.h"
 #include "sfc.h"
 #include "statusc.h"
 #include "tablesc.h"
@@ -92,6 +93,36 @@ Boolean		dbcs = False;
 
 /* Statics */
 static unsigned char *zero_buf;	/* empty buffer, for area clears */
+static struct ea *real_ea_buf = NULL;	/* ea_buf, plus one slot before it */
+static struct ea *real_aea_buf = NULL;	/* aea_buf, plus one slot before it */
+static int	*fa_index = NULL;	/* sorted addresses of field attributes */
+static int	fa_count = 0;		/* number of entries in fa_index */
+static Boolean	fa_index_valid = False;	/* fa_index matches ea_buf */
+static unsigned char *changed_rows = NULL; /* bitmap of rows to redraw */
+static Boolean	all_rows_changed = True; /* redraw everything */
+static int	*span_start = NULL;	/* first changed column in each row */
+static int	*span_end = NULL;	/* last changed column + 1 in each row */
+static Boolean	spans_wanted = False;	/* a script has subscribed */
+static Boolean	spans_pending = False;	/* spans not reported yet */
+static void	rows_changed(int f, int l);
+static void	spans_changed(int f, int l);
+static void	spans_clear(void);
+static void	field_changed(int baddr);
+
+/*
+ * Bulk scans of the screen buffer.
+ *
+ * A struct ea is eight one-byte fields, so a cell can be tested as a single
+ * 64-bit word instead of a byte at a time.  The masks are built at run time
+ * from struct ea itself, so the byte order of the fields does not matter.
+ * If the compiler ever pads struct ea, the scans go a cell at a time.
+ */
+typedef unsigned long long ea_word_t;
+#define EA_WORDS	(sizeof(struct ea) == sizeof(ea_word_t))
+#define EA_CHUNK	32	/* cells ORed together between tests */
+static ea_word_t fa_word_mask;	/* fa */
+static ea_word_t blank_word_mask;	/* cc, except the bit in EBC_space */
+static ea_word_t null_word_mask;	/* cc */
 static void set_formatted(void);
 static void ctlr_blanks(void);
 static Boolean  trace_primed = False;
@@ -125,9 +156,12 @@ static unsigned char	code_table[64] = {
 
 #define ALL_CHANGED	{ \
 	screen_changed = True; \
+	all_rows_changed = True; \
+	if (spans_wanted) spans_changed(0, ROWS*COLS); \
 	if (IN_ANSI) { first_changed = 0; last_changed = ROWS*COLS; } }
 #define REGION_CHANGED(f, l)	{ \
 	screen_changed = True; \
+	rows_changed(f, l); \
 	if (IN_ANSI) { \
 	    if (first_changed == -1 || f < first_changed) first_changed = f; \
 	    if (last_changed == -1 || l > last_changed) last_changed = l; } }
@@ -159,6 +193,20 @@ ctlr_init(unsigned cmask _is_unused)
 	register_schange(ST_HALF_CONNECT, ctlr_half_connect);
 	register_schange(ST_CONNECT, ctlr_connect);
 	register_schange(ST_3270_MODE, ctlr_connect);
+
+	/* Set up the bulk scan masks. */
+	if (EA_WORDS) {
+		struct ea m;
+
+		(void) memset(&m, 0, sizeof(m));
+		m.fa = 0xff;
+		(void) memcpy(&fa_word_mask, &m, sizeof(m));
+		(void) memset(&m, 0, sizeof(m));
+		m.cc = (unsigned char)~EBC_space;
+		(void) memcpy(&blank_word_mask, &m, sizeof(m));
+		m.cc = 0xff;
+		(void) memcpy(&null_word_mask, &m, sizeof(m));
+	}
 }
 /*
  * Reinitialize the emulated 3270 hardware.
@@ -166,9 +214,6 @@ ctlr_init(unsigned cmask _is_unused)
 void
 ctlr_reinit(unsigned cmask)
 {
-	static struct ea *real_ea_buf = NULL;
-	static struct ea *real_aea_buf = NULL;
-
 	if (cmask & MODEL_CHANGE) {
 		/* Allocate buffers */
 		if (real_ea_buf)
@@ -183,6 +228,15 @@ ctlr_reinit(unsigned cmask)
 		aea_buf = real_aea_buf + 1;
 		Replace(zero_buf, (unsigned char *)Calloc(sizeof(struct ea),
 							  maxROWS * maxCOLS));
+		Replace(fa_index, (int *)Malloc(sizeof(int) *
+						maxROWS * maxCOLS));
+		fa_index_valid = False;
+		Replace(changed_rows, (unsigned char *)Calloc(1,
+							(maxROWS + 7) / 8));
+		all_rows_changed = True;
+		Replace(span_start, (int *)Malloc(sizeof(int) * maxROWS));
+		Replace(span_end, (int *)Malloc(sizeof(int) * maxROWS));
+		spans_clear();
 		cursor_addr = 0;
 		buffer_addr = 0;
 	}
@@ -278,6 +332,86 @@ set_rows_cols(int mn, int ovc, int ovr)
 }
 
 
+/*
+ * OR together the words for 'count' cells.
+ * Four cells go at a time into separate accumulators, so the loads do not
+ * wait on each other even when the compiler does not vectorize the loop.
+ */
+static ea_word_t
+ea_or(struct ea *buf, int count)
+{
+	ea_word_t acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0, w;
+	int i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		(void) memcpy(&w, &buf[i], sizeof(w));
+		acc0 |= w;
+		(void) memcpy(&w, &buf[i + 1], sizeof(w));
+		acc1 |= w;
+		(void) memcpy(&w, &buf[i + 2], sizeof(w));
+		acc2 |= w;
+		(void) memcpy(&w, &buf[i + 3], sizeof(w));
+		acc3 |= w;
+	}
+	for (; i < count; i++) {
+		(void) memcpy(&w, &buf[i], sizeof(w));
+		acc0 |= w;
+	}
+	return acc0 | acc1 | acc2 | acc3;
+}
+
+/*
+ * Find the first field attribute in an area of a buffer.
+ * Returns its offset from 'buf', or -1 if there isn't one.
+ */
+int
+ctlr_next_fa(struct ea *buf, int count)
+{
+	int i = 0;
+
+	if (EA_WORDS) {
+		/* Skip chunks with no attributes in them. */
+		while (count - i >= EA_CHUNK &&
+		       !(ea_or(&buf[i], EA_CHUNK) & fa_word_mask))
+			i += EA_CHUNK;
+	}
+	for (; i < count; i++) {
+		if (buf[i].fa)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Tell if an area of a buffer is blank, i.e., every character in it is a
+ * null or (unless nulls_only is set) a space.
+ */
+Boolean
+ctlr_blank_area(struct ea *buf, int count, Boolean nulls_only)
+{
+	int i = 0;
+
+	if (EA_WORDS) {
+		ea_word_t mask = nulls_only? null_word_mask: blank_word_mask;
+		int n;
+
+		while (i < count) {
+			n = count - i;
+			if (n > EA_CHUNK)
+				n = EA_CHUNK;
+			if (ea_or(&buf[i], n) & mask)
+				return False;
+			i += n;
+		}
+		return True;
+	}
+	for (; i < count; i++) {
+		if (nulls_only? (buf[i].cc != EBC_null): !IsBlank(buf[i].cc))
+			return False;
+	}
+	return True;
+}
+
 /*
  * Set the formatted screen flag.  A formatted screen is a screen that
  * has at least one field somewhere on it.
@@ -285,17 +419,7 @@ set_rows_cols(int mn, int ovc, int ovr)
 static void
 set_formatted(void)
 {
-	register int	baddr;
-
-	formatted = False;
-	baddr = 0;
-	do {
-		if (ea_buf[baddr].fa) {
-			formatted = True;
-			break;
-		}
-		INC_BA(baddr);
-	} while (baddr != 0);
+	formatted = ctlr_next_fa(ea_buf, ROWS*COLS) >= 0;
 }
 
 /*
@@ -324,6 +448,8 @@ ctlr_connect(Boolean ignored _is_unused)
 		ea_buf[-1].fa = FA_PRINTABLE | FA_PROTECT;
 		aea_buf[-1].fa = FA_PRINTABLE | FA_PROTECT;
 	}
+	/* The default attribute may have changed. */
+	all_rows_changed = True;
 	if (!IN_3270 || (IN_SSCP && (kybdlock & KL_OIA_TWAIT))) {
 		kybdlock_clr(KL_OIA_TWAIT, "ctlr_connect");
 		status_reset();
@@ -340,6 +466,97 @@ ctlr_connect(Boolean ignored _is_unused)
 
 
 
+/*
+ * The field index.
+ *
+ * fa_index holds the buffer addresses of every field attribute in ea_buf, in
+ * ascending order, so that the field containing a given address can be found
+ * with a binary search instead of a walk back through the buffer.
+ *
+ * Single field attributes added or removed through ctlr_add() and
+ * ctlr_add_fa() update the index in place.  Anything that moves or clears
+ * blocks of the buffer just marks it invalid, and it is rebuilt the next time
+ * it is needed.
+ */
+
+/* Rebuild the field index from ea_buf. */
+static void
+fa_index_rebuild(void)
+{
+	int baddr = 0;
+	int n;
+
+	fa_count = 0;
+	while ((n = ctlr_next_fa(&ea_buf[baddr], ROWS*COLS - baddr)) >= 0) {
+		baddr += n;
+		fa_index[fa_count++] = baddr++;
+	}
+	fa_index_valid = True;
+}
+
+/*
+ * Search the field index.  Returns the position of the last entry at or
+ * before baddr, or -1 if baddr comes before all of them.
+ */
+static int
+fa_index_search(int baddr)
+{
+	int lo = 0, hi = fa_count - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (fa_index[mid] <= baddr)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return hi;
+}
+
+/* Add a field attribute address to the index. */
+static void
+fa_index_add(int baddr)
+{
+	int i;
+
+	if (!fa_index_valid)
+		return;
+	i = fa_index_search(baddr) + 1;
+	(void) memmove(&fa_index[i + 1], &fa_index[i],
+	    (fa_count - i) * sizeof(int));
+	fa_index[i] = baddr;
+	fa_count++;
+}
+
+/* Remove a field attribute address from the index. */
+static void
+fa_index_remove(int baddr)
+{
+	int i;
+
+	if (!fa_index_valid)
+		return;
+	i = fa_index_search(baddr);
+	if (i < 0 || fa_index[i] != baddr) {
+		/* Shouldn't happen. */
+		fa_index_valid = False;
+		return;
+	}
+	fa_count--;
+	(void) memmove(&fa_index[i], &fa_index[i + 1],
+	    (fa_count - i) * sizeof(int));
+}
+
+/*
+ * Note that field attributes in ea_buf have been changed by something other
+ * than ctlr_add() or ctlr_add_fa().
+ */
+void
+ctlr_fa_changed(void)
+{
+	fa_index_valid = False;
+}
+
 /*
  * Find the buffer address of the field attribute for a given buffer address.
  * Returns -1 if the screen isn't formatted.
@@ -347,18 +564,21 @@ ctlr_connect(Boolean ignored _is_unused)
 int
 find_field_attribute(int baddr)
 {
-	int sbaddr;
+	int i;
 
 	if (!formatted)
 		return -1;
 
-	sbaddr = baddr;    
-	do {   
-		if (ea_buf[baddr].fa)
-			return baddr;
-		DEC_BA(baddr);
-	} while (baddr != sbaddr);
-	return -1;
+	if (!fa_index_valid)
+		fa_index_rebuild();
+	if (!fa_count)
+		return -1;
+
+	/* If there is no field attribute at or before baddr, wrap. */
+	i = fa_index_search(baddr);
+	if (i < 0)
+		i = fa_count - 1;
+	return fa_index[i];
 }
 
 /*
@@ -381,25 +601,24 @@ Boolean
 get_bounded_field_attribute(register int baddr, register int bound,
     unsigned char *fa_out)
 {
-	int	sbaddr;
+	int	faddr;
+	int	fdist, bdist;
 
-	if (!formatted) {
+	/* Screen is unformatted (or 'formatted' is inaccurate). */
+	faddr = find_field_attribute(baddr);
+	if (faddr < 0) {
 		*fa_out = ea_buf[-1].fa;
 		return True;
 	}
 
-	sbaddr = baddr;
-	do {
-		if (ea_buf[baddr].fa) {
-			*fa_out = ea_buf[baddr].fa;
-			return True;
-		}
-		DEC_BA(baddr);
-	} while (baddr != sbaddr && baddr != bound);
-
-	/* Screen is unformatted (and 'formatted' is inaccurate). */
-	if (baddr == sbaddr) {
-		*fa_out = ea_buf[-1].fa;
+	/*
+	 * The boundary itself is not searched, so the attribute counts only
+	 * if it is closer to baddr (going backwards) than the boundary is.
+	 */
+	fdist = (baddr - faddr + ROWS*COLS) % (ROWS*COLS);
+	bdist = (baddr - bound + ROWS*COLS) % (ROWS*COLS);
+	if (!bdist || fdist < bdist) {
+		*fa_out = ea_buf[faddr].fa;
 		return True;
 	}
 
@@ -2380,13 +2599,7 @@ ps_process(void)
 Boolean
 ctlr_any_data(void)
 {
-	register int i;
-
-	for (i = 0; i < ROWS*COLS; i++) {
-		if (!IsBlank(ea_buf[i].cc))
-			return True;
-	}
-	return False;
+	return !ctlr_blank_area(ea_buf, ROWS*COLS, False);
 }
 
 /*
@@ -2410,6 +2623,8 @@ ctlr_clear(Boolean can_snap)
 
 	/* Clear the screen. */
 	(void) memset((char *)ea_buf, 0, ROWS*COLS*sizeof(struct ea));
+	fa_count = 0;
+	fa_index_valid = True;
 	ALL_CHANGED;
 	cursor_move(0);
 	buffer_addr = 0;
@@ -2466,7 +2681,11 @@ ctlr_add(int baddr, unsigned char c, unsigned char cs)
 		ONE_CHANGED(baddr);
 		ea_buf[baddr].cc = c;
 		ea_buf[baddr].cs = cs;
-		ea_buf[baddr].fa = 0;
+		if (ea_buf[baddr].fa) {
+			ea_buf[baddr].fa = 0;
+			fa_index_remove(baddr);
+			field_changed(baddr);
+		}
 	}
 }
 
@@ -2484,6 +2703,8 @@ ctlr_add_fa(int baddr, unsigned char fa, unsigned char cs)
 	 * value will be non-zero.
 	 */
 	ea_buf[baddr].fa = FA_PRINTABLE | (fa & FA_MASK);
+	fa_index_add(baddr);
+	field_changed(baddr);
 }
 
 /* 
@@ -2510,6 +2731,8 @@ ctlr_add_gr(int baddr, unsigned char gr)
 		if (SELECTED(baddr))
 			unselect(baddr, 1);
 		ONE_CHANGED(baddr);
+		if (ea_buf[baddr].fa)
+			field_changed(baddr);
 		ea_buf[baddr].gr = gr;
 		if (gr & GR_BLINK)
 			blink_start();
@@ -2530,6 +2753,8 @@ ctlr_add_fg(int baddr, unsigned char color)
 		if (SELECTED(baddr))
 			unselect(baddr, 1);
 		ONE_CHANGED(baddr);
+		if (ea_buf[baddr].fa)
+			field_changed(baddr);
 		ea_buf[baddr].fg = color;
 	}
 }
@@ -2548,6 +2773,8 @@ ctlr_add_bg(int baddr, unsigned char color)
 		if (SELECTED(baddr))
 			unselect(baddr, 1);
 		ONE_CHANGED(baddr);
+		if (ea_buf[baddr].fa)
+			field_changed(baddr);
 		ea_buf[baddr].bg = color;
 	}
 }
@@ -2610,6 +2837,7 @@ ctlr_bcopy(int baddr_from, int baddr_to, int count, int move_ea)
 		   count * sizeof(struct ea))) {
 		(void) memmove(&ea_buf[baddr_to], &ea_buf[baddr_from],
 			           count * sizeof(struct ea));
+		fa_index_valid = False;
 		REGION_CHANGED(baddr_to, baddr_to + count);
 		/*
 		 * For the time being, if any selected text shifts around on
@@ -2635,6 +2863,7 @@ ctlr_aclear(int baddr, int count, int clear_ea)
 		    count * sizeof(struct ea))) {
 		(void) memset((char *) &ea_buf[baddr], 0,
 				count * sizeof(struct ea));
+		fa_index_valid = False;
 		REGION_CHANGED(baddr, baddr + count);
 		if (area_is_selected(baddr, count))
 			unselect(baddr, count);
@@ -2668,6 +2897,8 @@ ctlr_scroll(void)
 
 	/* Clear the last line. */
 	(void) memset((char *) &ea_buf[qty], 0, COLS * sizeof(struct ea));
+	fa_index_valid = False;
+	rows_changed(0, ROWS*COLS);
 
 	/* Update the screen. */
 	if (obscured) {
@@ -2687,6 +2918,155 @@ ctlr_changed(int bstart, int bend)
 	REGION_CHANGED(bstart, bend);
 }
 
+/*
+ * Row change tracking.
+ *
+ * Every change to the buffer marks the rows it touches in changed_rows, so a
+ * front end that redraws a row at a time can skip the rows that have not
+ * changed since its last update.  Erasing the screen, swapping buffers or
+ * changing the model marks everything.
+ */
+
+/* Mark the rows holding buffer addresses f through l-1 as changed. */
+static void
+rows_changed(int f, int l)
+{
+	int row, last_row;
+
+	if (spans_wanted)
+		spans_changed(f, l);
+	if (changed_rows == NULL || l <= f)
+		return;
+	last_row = (l - 1) / COLS;
+	if (last_row >= maxROWS)
+		last_row = maxROWS - 1;
+	for (row = f / COLS; row <= last_row; row++)
+		changed_rows[row / 8] |= 1 << (row % 8);
+}
+
+/*
+ * A field attribute, or the color or highlighting stored with it, has changed
+ * at baddr.  That changes how everything up to the next field attribute is
+ * displayed.
+ */
+static void
+field_changed(int baddr)
+{
+	int i;
+
+	if (!fa_index_valid)
+		fa_index_rebuild();
+	i = fa_index_search(baddr);
+	if (i + 1 < fa_count)
+		rows_changed(baddr, fa_index[i + 1]);
+	else {
+		/* The field wraps. */
+		rows_changed(baddr, ROWS*COLS);
+		rows_changed(0, fa_count? fa_index[0]: baddr);
+	}
+}
+
+/* Tell if a row has changed since the last ctlr_changes_displayed(). */
+Boolean
+ctlr_row_changed(int row)
+{
+	return all_rows_changed || changed_rows == NULL ||
+	    (changed_rows[row / 8] & (1 << (row % 8)));
+}
+
+/* Note that the front end has displayed all of the changes. */
+void
+ctlr_changes_displayed(void)
+{
+	all_rows_changed = False;
+	if (changed_rows != NULL)
+		(void) memset(changed_rows, 0, (maxROWS + 7) / 8);
+}
+
+/*
+ * Change spans for scripts.
+ *
+ * While a script is subscribed to screen changes, each change also widens the
+ * span of changed columns in the rows it touches.  The spans are kept apart
+ * from changed_rows, which the front end clears on its own schedule, and are
+ * cleared when the script feed has reported them.
+ */
+
+/* Forget all of the spans. */
+static void
+spans_clear(void)
+{
+	int row;
+
+	for (row = 0; row < maxROWS; row++) {
+		span_start[row] = -1;
+		span_end[row] = 0;
+	}
+	spans_pending = False;
+}
+
+/* Widen the spans to cover buffer addresses f through l-1. */
+static void
+spans_changed(int f, int l)
+{
+	int row, first_row, last_row;
+	int sc, ec;
+
+	if (span_start == NULL)
+		return;
+	if (l > ROWS*COLS)
+		l = ROWS*COLS;
+	if (l <= f)
+		return;
+	first_row = f / COLS;
+	last_row = (l - 1) / COLS;
+	for (row = first_row; row <= last_row; row++) {
+		sc = (row == first_row)? f % COLS: 0;
+		ec = (row == last_row)? ((l - 1) % COLS) + 1: COLS;
+		if (span_start[row] < 0 || sc < span_start[row])
+			span_start[row] = sc;
+		if (ec > span_end[row])
+			span_end[row] = ec;
+	}
+	if (!spans_pending) {
+		spans_pending = True;
+		sms_feed_changed();
+	}
+}
+
+/* Start or stop keeping change spans. */
+void
+ctlr_spans_wanted(Boolean wanted)
+{
+	spans_wanted = wanted;
+	if (span_start != NULL)
+		spans_clear();
+}
+
+/*
+ * Tell if part of a row has changed since the last ctlr_spans_reported().
+ * If so, returns the first changed column and the changed column after the
+ * last.
+ */
+Boolean
+ctlr_span(int row, int *start, int *end)
+{
+	if (!spans_pending || span_start == NULL || row >= maxROWS ||
+	    span_start[row] < 0)
+		return False;
+	*start = span_start[row];
+	*end = span_end[row];
+	return True;
+}
+
+/* Note that the script feed has reported all of the spans. */
+void
+ctlr_spans_reported(void)
+{
+	if (spans_pending)
+		spans_clear();
+}
+
 #if defined(X3270_ANSI) /*[*/
 /*
  * Swap the regular and alternate screen buffers
@@ -2701,6 +3081,7 @@ ctlr_altbuffer(Boolean alt)
 		etmp = ea_buf;
 		ea_buf = aea_buf;
 		aea_buf = etmp;
+		fa_index_valid = False;
 
 		is_altbuffer = alt;
 		ALL_CHANGED;
@@ -2871,3 +3252,49 @@ void
 toggle_nop(struct toggle *t _is_unused, enum toggle_type tt _is_unused)
 {
 }
+
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+ctlr_session_vars(void)
+{
+	SESSION_VAR(ROWS);
+	SESSION_VAR(COLS);
+	SESSION_VAR(cursor_addr);
+	SESSION_VAR(buffer_addr);
+	SESSION_VAR(screen_alt);
+	SESSION_VAR(is_altbuffer);
+	SESSION_VAR(ea_buf);
+	SESSION_VAR(aea_buf);
+	SESSION_VAR(real_ea_buf);
+	SESSION_VAR(real_aea_buf);
+	SESSION_VAR(fa_index);
+	SESSION_VAR(fa_count);
+	SESSION_VAR(fa_index_valid);
+	SESSION_VAR(changed_rows);
+	SESSION_VAR(all_rows_changed);
+	SESSION_VAR(span_start);
+	SESSION_VAR(span_end);
+	SESSION_VAR(spans_wanted);
+	SESSION_VAR(spans_pending);
+	SESSION_VAR(formatted);
+	SESSION_VAR(screen_changed);
+	SESSION_VAR(first_changed);
+	SESSION_VAR(last_changed);
+	SESSION_VAR(reply_mode);
+	SESSION_VAR(crm_nattr);
+	SESSION_VAR(crm_attr);
+	SESSION_VAR(trace_primed);
+	SESSION_VAR(default_fg);
+	SESSION_VAR(default_bg);
+	SESSION_VAR(default_gr);
+	SESSION_VAR(default_cs);
+	SESSION_VAR(default_ic);
+	SESSION_VAR(sscp_start);
+	SESSION_VAR(t_start);
+	SESSION_VAR(ticking);
+	SESSION_VAR(mticking);
+	SESSION_VAR(tick_id);
+	SESSION_VAR(t_want);
+}
+#endif /*]*/
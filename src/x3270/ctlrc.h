@@ -47,19 +47,27 @@ void ctlr_add_gr(int baddr, unsigned char gr);
 void ctlr_altbuffer(Boolean alt);
 Boolean ctlr_any_data(void);
 void ctlr_bcopy(int baddr_from, int baddr_to, int count, int move_ea);
+Boolean ctlr_blank_area(struct ea *buf, int count, Boolean nulls_only);
 void ctlr_changed(int bstart, int bend);
+void ctlr_changes_displayed(void);
 void ctlr_clear(Boolean can_snap);
 void ctlr_erase(Boolean alt);
 void ctlr_erase_all_unprotected(void);
+void ctlr_fa_changed(void);
 void ctlr_init(unsigned cmask);
+int ctlr_next_fa(struct ea *buf, int count);
 void ctlr_read_buffer(unsigned char aid_byte);
 void ctlr_read_modified(unsigned char aid_byte, Boolean all);
 void ctlr_reinit(unsigned cmask);
+Boolean ctlr_row_changed(int row);
 void ctlr_scroll(void);
 void ctlr_shrink(void);
 void ctlr_snap_buffer(void);
 void ctlr_snap_buffer_sscp_lu(void);
 Boolean ctlr_snap_modes(void);
+Boolean ctlr_span(int row, int *start, int *end);
+void ctlr_spans_reported(void);
+void ctlr_spans_wanted(Boolean wanted);
 void ctlr_wrapping_memmove(int baddr_to, int baddr_from, int count);
 enum pds ctlr_write(unsigned char buf[], int buflen, Boolean erase);
 void ctlr_write_sscp_lu(unsigned char buf[], int buflen);
@@ -74,6 +82,9 @@ int next_unprotected(int baddr0);
 enum pds process_ds(unsigned char *buf, int buflen);
 void ps_process(void);
 void set_rows_cols(int mn, int ovc, int ovr);
+#if defined(X3270_SESSIONS) /*[*/
+void ctlr_session_vars(void);
+#endif /*]*/
 void ticking_start(Boolean anyway);
 void toggle_nop(struct toggle *t, enum toggle_type tt);
 void toggle_showTiming(struct toggle *t, enum toggle_type tt);
@@ -66,6 +66,7 @@
 #include "objects.h"
 #include "popupsc.h"
 #include "screenc.h"
+#include "sessionc.h"
 #include "tablesc.h"
 #include "telnetc.h"
 #include "utilc.h"
@@ -85,6 +86,8 @@
 #define COLUMN_GAP	40	/* distance between columns */
 #endif /*]*/
 
+#define FT_IOBUF_SIZE	65536	/* local file stdio buffer */
+
 #define BN	(Boolean *)NULL
 
 /* Externals. */
@@ -123,6 +126,7 @@ static char *ft_host_filename;		/* Host file to transfer to/from */
 static Boolean receive_flag = True;	/* Current transfer is receive */
 static Boolean append_flag = False;	/* Append transfer */
 static Boolean vm_flag = False;		/* VM Transfer flag */
+static char *ft_iobuf = NULL;		/* stdio buffer for the local file */
 
 #if defined(X3270_DISPLAY) && defined(X3270_MENUS) /*[*/
 static Widget recfm_options[5];
@@ -246,6 +250,7 @@ static void toggle_receive(Widget w, XtPointer client_data,
 static void toggle_vm(Widget w, XtPointer client_data, XtPointer call_data);
 static void units_callback(Widget w, XtPointer user_data, XtPointer call_data);
 #endif /*]*/
+static double ft_bytes_sec(void);
 static void ft_connected(Boolean ignored);
 static void ft_in3270(Boolean ignored);
 
@@ -277,6 +282,19 @@ local_fflag(void)
 	return ret;
 }
 
+/*
+ * Give the local file a large buffer, so it is read ahead and written behind
+ * in big chunks instead of a record at a time.  Called right after the file
+ * is opened, before any I/O is done on it.
+ */
+static void
+local_setvbuf(void)
+{
+	if (ft_iobuf == NULL)
+		ft_iobuf = Malloc(FT_IOBUF_SIZE);
+	(void) setvbuf(ft_local_file, ft_iobuf, _IOFBF, FT_IOBUF_SIZE);
+}
+
 /* Timeout function for stalled transfers. */
 static void
 ft_didnt_start(void)
@@ -1086,6 +1104,7 @@ ft_start(void)
 		popup_an_errno(errno, "Open(%s)", ft_local_filename);
 		return 0;
 	}
+	local_setvbuf();
 
 	/* Build the ind$file command */
 	op[0] = '\0';
@@ -1526,17 +1545,11 @@ ft_complete(const char *errmsg)
 		popup_an_error("%s", msg_copy);
 		Free(msg_copy);
 	} else {
-		struct timeval t1;
-		double kbytes_sec;
 		char *buf;
 
-		(void) gettimeofday(&t1, (struct timezone *)NULL);
-		kbytes_sec = (double)ft_length / 1024.0 /
-			((double)(t1.tv_sec - t0.tv_sec) + 
-			 (double)(t1.tv_usec - t0.tv_usec) / 1.0e6);
 		buf = Malloc(256);
 		(void) sprintf(buf, get_message("ftComplete"), ft_length,
-		    kbytes_sec, ft_is_cut ? "CUT" : "DFT");
+		    ft_bytes_sec() / 1024.0, ft_is_cut ? "CUT" : "DFT");
 		if (ft_is_action) {
 #if defined(C3270) /*[*/
 			printf("\r%79s\n", "");
@@ -1553,6 +1566,50 @@ ft_complete(const char *errmsg)
 	}
 }
 
+/* Return the transfer rate so far, in bytes per second. */
+static double
+ft_bytes_sec(void)
+{
+	struct timeval t1;
+	double secs;
+
+	(void) gettimeofday(&t1, (struct timezone *)NULL);
+	secs = (double)(t1.tv_sec - t0.tv_sec) +
+	       (double)(t1.tv_usec - t0.tv_usec) / 1.0e6;
+	return (secs > 0.0)? (double)ft_length / secs: 0.0;
+}
+
+/*
+ * Report on the transfer in progress for Query(FileTransfer): its state,
+ * direction, bytes transferred so far and bytes per second.
+ */
+const char *
+ft_query(void)
+{
+	static char *s = CN;
+	const char *state;
+
+	switch (ft_state) {
+	case FT_NONE:
+	default:
+		return "";
+	case FT_AWAIT_ACK:
+		return receive_flag? "starting receive": "starting send";
+	case FT_RUNNING:
+		state = "running";
+		break;
+	case FT_ABORT_WAIT:
+	case FT_ABORT_SENT:
+		state = "aborting";
+		break;
+	}
+	Free(s);
+	s = xs_buffer("%s %s bytes %lu bytes/s %lu", state,
+	    receive_flag? "receive": "send", ft_length,
+	    (unsigned long)ft_bytes_sec());
+	return s;
+}
+
 /* Update the bytes-transferred count on the progress pop-up. */
 void
 ft_update_length(void)
@@ -1568,7 +1625,8 @@ ft_update_length(void)
 	}
 #endif /*]*/
 #if defined(C3270) /*[*/
-	printf("\r%79s\rTransferred %lu bytes. ", "", ft_length);
+	printf("\r%79s\rTransferred %lu bytes (%.2f Kbytes/sec). ", "",
+	    ft_length, ft_bytes_sec() / 1024.0);
 	fflush(stdout);
 #endif /*]*/
 }
@@ -1864,6 +1922,7 @@ Transfer_action(Widget w _is_unused, XEvent *event, String *params,
 		popup_an_errno(errno, "Open(%s)", ft_local_filename);
 		return;
 	}
+	local_setvbuf();
 
 	/* Build the ind$file command */
 	op[0] = '\0';
@@ -1983,4 +2042,36 @@ Transfer_action(Widget w _is_unused, XEvent *event, String *params,
 	ft_is_cut = False;
 }
 
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+ft_session_vars(void)
+{
+	SESSION_VAR(ft_state);
+	SESSION_VAR(ft_local_filename);
+	SESSION_VAR(ft_local_file);
+	SESSION_VAR(ft_last_cr);
+	SESSION_VAR(ascii_flag);
+	SESSION_VAR(cr_flag);
+	SESSION_VAR(remap_flag);
+	SESSION_VAR(ft_length);
+	SESSION_VAR(ft_host_filename);
+	SESSION_VAR(receive_flag);
+	SESSION_VAR(append_flag);
+	SESSION_VAR(vm_flag);
+	SESSION_VAR(ft_iobuf);
+	SESSION_VAR(recfm);
+	SESSION_VAR(units);
+	SESSION_VAR(t0);
+	SESSION_VAR(ft_is_cut);
+#if defined(X3270_DBCS) /*[*/
+	SESSION_VAR(ft_dbcs_state);
+	SESSION_VAR(ft_dbcs_byte1);
+	SESSION_VAR(ft_last_dbcs);
+#endif /*]*/
+	SESSION_VAR(ft_is_action);
+	SESSION_VAR(ft_start_id);
+}
+#endif /*]*/
+
 #endif /*]*/
@@ -48,6 +48,7 @@
 #include "ftc.h"
 #include "kybdc.h"
 #include "popupsc.h"
+#include "sessionc.h"
 #include "tablesc.h"
 #include "telnetc.h"
 #include "trace_dsc.h"
@@ -740,4 +741,19 @@ xlate_getc(void)
 	return r;
 }
 
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+ft_cut_session_vars(void)
+{
+	SESSION_VAR(cut_xfer_in_progress);
+	SESSION_VAR(quadrant);
+	SESSION_VAR(expanded_length);
+	SESSION_VAR(saved_errmsg);
+	SESSION_VAR(xlate_buffered);
+	SESSION_VAR(xlate_buf_ix);
+	SESSION_VAR(xlate_buf);
+}
+#endif /*]*/
+
 #endif /*]*/
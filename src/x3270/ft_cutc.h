@@ -26,3 +26,6 @@
  */
 
 extern void ft_cut_data(void);
+#if defined(X3270_SESSIONS) /*[*/
+extern void ft_cut_session_vars(void);
+#endif /*]*/
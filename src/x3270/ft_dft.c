@@ -45,6 +45,7 @@
 #include "kybdc.h"
 #include "ft_dftc.h"
 #include "ftc.h"
+#include "sessionc.h"
 #include "tablesc.h"
 #include "telnetc.h"
 #include "trace_dsc.h"
@@ -60,10 +61,12 @@ extern unsigned char aid;
 #define END_TRANSFER	"TRANS03"	/* Message for xfer complete */
 
 #define DFT_MIN_BUF	256
-#define DFT_MAX_BUF	32768
+#define DFT_MAX_BUF	65535	/* largest INLIM/OUTLIM in the DDM reply */
 
 #define DFT_MAX_UNGETC	32
 
+#define DFT_INBUF_SIZE	65536	/* local file read-ahead for ASCII uploads */
+
 /* Typedefs. */
 struct data_buffer {
 	char sf_length[2];		/* SF length = 0x0023 */
@@ -88,6 +91,18 @@ static int dft_savebuf_len = 0;
 static int dft_savebuf_max = 0;
 static unsigned char dft_ungetc_cache[DFT_MAX_UNGETC];
 static size_t dft_ungetc_count = 0;
+static unsigned char *dft_inbuf = NULL;
+static size_t dft_inbuf_len = 0;
+static size_t dft_inbuf_ix = 0;
+static short dft_xlate[256];
+static Boolean dft_xlate_valid = False;
+static unsigned char *dft_ra_buf = NULL;	/* next Get block, read ahead */
+static size_t dft_ra_max = 0;
+static size_t dft_ra_len = 0;
+static size_t dft_ra_ix = 0;
+static Boolean dft_ra_valid = False;
+static int dft_ra_errno = 0;
+static Boolean dft_flush_needed = False;
 
 static void dft_abort(const char *s, unsigned short code);
 static void dft_close_request(void);
@@ -187,6 +202,11 @@ dft_open_request(unsigned short len, unsigned char *cp)
 	dft_eof = False;
 	recnum = 1;
 	dft_ungetc_count = 0;
+	dft_inbuf_len = 0;
+	dft_inbuf_ix = 0;
+	dft_xlate_valid = False;
+	dft_ra_valid = False;
+	dft_flush_needed = False;
 
 	/* Acknowledge the Open. */
 	trace_ds("> WriteStructuredField FileTransferData OpenAck\n");
@@ -381,6 +401,7 @@ dft_data_insert(struct data_buffer *data_bufr)
 				(size_t)1, ft_local_file);
 			ft_length += my_length;
 		}
+		dft_flush_needed = True;
 
 		if (!rv) {
 			/* write failed */
@@ -434,6 +455,93 @@ store_inbyte(unsigned char c, unsigned char **bufptr, size_t *numbytes)
 }
 #endif /*]*/
 
+/* Refill the local file read-ahead buffer. Returns False at EOF. */
+static Boolean
+dft_inbuf_fill(void)
+{
+	if (dft_inbuf == NULL)
+		dft_inbuf = (unsigned char *)Malloc(DFT_INBUF_SIZE);
+	dft_inbuf_ix = 0;
+	dft_inbuf_len = fread(dft_inbuf, 1, DFT_INBUF_SIZE, ft_local_file);
+	return dft_inbuf_len > 0;
+}
+
+/* Read a byte from the local file, through the read-ahead buffer. */
+static int
+dft_getc(void)
+{
+	if (dft_inbuf_ix >= dft_inbuf_len && !dft_inbuf_fill())
+		return EOF;
+	return dft_inbuf[dft_inbuf_ix++];
+}
+
+/*
+ * Build the byte-to-host translation table for ASCII uploads.
+ * Each entry is computed by the same conversion dft_ascii_read() does one
+ * character at a time, so the table cannot disagree with it. Bytes that are
+ * not complete characters by themselves in the local encoding, or that map
+ * to DBCS, are marked -1 and left to the character-at-a-time code.
+ */
+static void
+dft_xlate_init(void)
+{
+	int b;
+
+	for (b = 0; b < 256; b++) {
+		char mb = (char)b;
+		int consumed = 0;
+		enum me_fail error = ME_NONE;
+		ucs4_t u;
+		ebc_t e;
+
+		dft_xlate[b] = -1;
+		u = multibyte_to_unicode(&mb, 1, &consumed, &error);
+		if (error != ME_NONE || consumed != 1)
+			continue;
+		if (u < 0x20 || ((u >= 0x80 && u < 0xa0)))
+			e = i_asc2ft[u];
+		else
+			e = unicode_to_ebcdic(u);
+		if (e & 0xff00)
+			continue;
+		dft_xlate[b] = e? i_ft2asc[e]: '?';
+	}
+	dft_xlate_valid = True;
+}
+
+/*
+ * Translate a run of single-byte characters from the local file through the
+ * translation table, including NL-to-CR/LF expansion.
+ * Stops at the first byte that needs dft_ascii_read()'s general code, at
+ * EOF, or when 'bufptr' is full. Returns the number of bytes stored.
+ */
+static size_t
+dft_ascii_run(unsigned char *bufptr, size_t numbytes)
+{
+	size_t nr = 0;
+
+	if (!dft_xlate_valid)
+		dft_xlate_init();
+	while (nr < numbytes &&
+	       (dft_inbuf_ix < dft_inbuf_len || dft_inbuf_fill())) {
+		unsigned char b = dft_inbuf[dft_inbuf_ix];
+
+		if (dft_xlate[b] < 0)
+			break;
+		if (cr_flag && !ft_last_cr && b == '\n') {
+			if (numbytes - nr < 2)
+				break;
+			bufptr[nr++] = '\r';
+			bufptr[nr++] = '\n';
+		} else {
+			bufptr[nr++] = (unsigned char)dft_xlate[b];
+			ft_last_cr = (b == '\r');
+		}
+		dft_inbuf_ix++;
+	}
+	return nr;
+}
+
 /*
  * Read a character from a local file in ASCII mode.
  * Stores the data in 'bufptr' and returns the number of bytes stored.
@@ -444,7 +552,7 @@ dft_ascii_read(unsigned char *bufptr, size_t numbytes)
 {
     	char inbuf[16];
 	int in_ix = 0;
-	char c;
+	int c;
 	enum me_fail error;
 	ebc_t e;
 	int consumed;
@@ -468,11 +576,22 @@ dft_ascii_read(unsigned char *bufptr, size_t numbytes)
 		return nm;
 	}
 
+	/* Translate runs of single-byte characters in bulk. */
+#if defined(X3270_DBCS) /*[*/
+	if (!ft_last_dbcs)
+#endif /*]*/
+	{
+		size_t nr = dft_ascii_run(bufptr, numbytes);
+
+		if (nr)
+			return nr;
+	}
+
 	/* Read bytes until we have a legal multibyte sequence. */
 	do {
 	    	int consumed;
 
-	    	c = fgetc(ft_local_file);
+	    	c = dft_getc();
 		if (c == EOF) {
 #if defined(X3270_DBCS) /*[*/
 		    	if (ft_last_dbcs) {
@@ -558,28 +677,16 @@ dft_ascii_read(unsigned char *bufptr, size_t numbytes)
 	}
 }
 
-/* Process a Get request. */
-static void
-dft_get_request(void)
+/*
+ * Read up to 'numbytes' bytes of file data for a Get request into 'bufptr'.
+ * Sets dft_eof at the end of the file.  Returns the number of bytes read.
+ */
+static size_t
+dft_read_block(unsigned char *bufptr, size_t numbytes)
 {
-	size_t numbytes;
 	size_t numread;
 	size_t total_read = 0;
-	unsigned char *bufptr;
-
-	trace_ds(" Get\n");
-
-	if (!message_flag && ft_state == FT_ABORT_WAIT) {
-		dft_abort(get_message("ftUserCancel"), TR_GET_REQ);
-		return;
-	}
 
-	/* Read a buffer's worth. */
-	set_dft_buffersize();
-	space3270out(dft_buffersize);
-	numbytes = dft_buffersize - 27; /* always read 5 bytes less than we're
-					   allowed */
-	bufptr = obuf + 17;
 	while (!dft_eof && numbytes) {
 	    	if (ascii_flag) {
 		    	numread = dft_ascii_read(bufptr, numbytes);
@@ -606,6 +713,66 @@ dft_get_request(void)
 			}
 		}
 	}
+	return total_read;
+}
+
+/*
+ * Read the block for the next Get request, so it is ready when the request
+ * arrives.  Called just after a Get reply is sent, while the host is busy
+ * with it.
+ */
+static void
+dft_read_ahead(void)
+{
+	size_t numbytes = dft_buffersize - 27;
+
+	if (dft_ra_max < numbytes) {
+		dft_ra_max = numbytes;
+		Replace(dft_ra_buf, (unsigned char *)Malloc(dft_ra_max));
+	}
+	errno = 0;
+	dft_ra_len = dft_read_block(dft_ra_buf, numbytes);
+	dft_ra_ix = 0;
+	dft_ra_errno = errno;
+	dft_ra_valid = True;
+}
+
+/* Process a Get request. */
+static void
+dft_get_request(void)
+{
+	size_t numbytes;
+	size_t total_read = 0;
+	unsigned char *bufptr;
+
+	trace_ds(" Get\n");
+
+	if (!message_flag && ft_state == FT_ABORT_WAIT) {
+		dft_abort(get_message("ftUserCancel"), TR_GET_REQ);
+		return;
+	}
+
+	/* Read a buffer's worth, or use the one read ahead. */
+	set_dft_buffersize();
+	space3270out(dft_buffersize);
+	numbytes = dft_buffersize - 27; /* always read 5 bytes less than we're
+					   allowed */
+	bufptr = obuf + 17;
+	if (dft_ra_valid) {
+		/*
+		 * The buffer may have shrunk since the block was read; what
+		 * does not fit now goes in the next one.
+		 */
+		total_read = dft_ra_len - dft_ra_ix;
+		if (total_read > numbytes)
+			total_read = numbytes;
+		memcpy(bufptr, dft_ra_buf + dft_ra_ix, total_read);
+		dft_ra_ix += total_read;
+		if (dft_ra_ix >= dft_ra_len)
+			dft_ra_valid = False;
+		errno = dft_ra_errno;
+	} else
+		total_read = dft_read_block(bufptr, numbytes);
 
 	/* Check for read error. */
 	if (ferror(ft_local_file)) {
@@ -663,6 +830,10 @@ dft_get_request(void)
 	/* Write the data. */
 	net_output();
 	ft_update_length();
+
+	/* Get the next block ready. */
+	if (total_read && !dft_eof && !dft_ra_valid)
+		dft_read_ahead();
 }
 
 /* Process a Close request. */
@@ -674,6 +845,21 @@ dft_close_request(void)
 	 * Return a close acknowledgement.
 	 */
 	trace_ds(" Close\n");
+
+	/* Write out what has been buffered for the local file. */
+	if (dft_flush_needed) {
+		dft_flush_needed = False;
+		if (fflush(ft_local_file) == EOF) {
+			char *buf;
+
+			buf = xs_buffer("write(%s): %s", ft_local_filename,
+			    strerror(errno));
+			dft_abort(buf, TR_CLOSE_REQ);
+			Free(buf);
+			return;
+		}
+	}
+
 	trace_ds("> WriteStructuredField FileTransferData CloseAck\n");
 	obptr = obuf;
 	space3270out(6);
@@ -737,4 +923,34 @@ set_dft_buffersize(void)
 }
 
 
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+ft_dft_session_vars(void)
+{
+	SESSION_VAR(dft_buffersize);
+	SESSION_VAR(message_flag);
+	SESSION_VAR(dft_eof);
+	SESSION_VAR(recnum);
+	SESSION_VAR(abort_string);
+	SESSION_VAR(dft_savebuf);
+	SESSION_VAR(dft_savebuf_len);
+	SESSION_VAR(dft_savebuf_max);
+	SESSION_VAR(dft_ungetc_cache);
+	SESSION_VAR(dft_ungetc_count);
+	SESSION_VAR(dft_inbuf);
+	SESSION_VAR(dft_inbuf_len);
+	SESSION_VAR(dft_inbuf_ix);
+	SESSION_VAR(dft_xlate);
+	SESSION_VAR(dft_xlate_valid);
+	SESSION_VAR(dft_ra_buf);
+	SESSION_VAR(dft_ra_max);
+	SESSION_VAR(dft_ra_len);
+	SESSION_VAR(dft_ra_ix);
+	SESSION_VAR(dft_ra_valid);
+	SESSION_VAR(dft_ra_errno);
+	SESSION_VAR(dft_flush_needed);
+}
+#endif /*]*/
+
 #endif /*]*/
@@ -29,4 +29,7 @@
 
 extern void ft_dft_data(unsigned char *data, int length);
 extern void dft_read_modified(void);
+#if defined(X3270_SESSIONS) /*[*/
+extern void ft_dft_session_vars(void);
+#endif /*]*/
 extern void set_dft_buffersize(void);
@@ -65,7 +65,11 @@ extern Boolean ft_last_dbcs;
 extern void ft_aborting(void);
 extern void ft_complete(const char *errmsg);
 extern void ft_init(void);
+extern const char *ft_query(void);
 extern void ft_running(Boolean is_cut);
+#if defined(X3270_SESSIONS) /*[*/
+extern void ft_session_vars(void);
+#endif /*]*/
 extern void ft_update_length(void);
 extern void PA_dialog_focus_action(Widget w, XEvent *event, String *parms,
     Cardinal *num_parms);
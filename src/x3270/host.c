@@ -41,6 +41,7 @@
 #include "macrosc.h"
 #include "menubarc.h"
 #include "popupsc.h"
+#include "sessionc.h"
 #include "telnetc.h"
 #include "trace_dsc.h"
 #include "utilc.h"
@@ -527,6 +528,75 @@ split_host(char *s, Boolean *ansi, Boolean *std_ds, Boolean *passthru,
 }
 
 
+static char *connect_ps = CN;	/* login macro for the pending connect */
+
+/*
+ * Finish off a connection attempt, once net_connect() has a socket (or has
+ * given up).  Returns 0 for success, -1 for error.
+ */
+static int
+host_connect_finish(Boolean pending)
+{
+	if (net_sock < 0) {
+		cstate = NOT_CONNECTED;
+#if defined(X3270_DISPLAY) || defined(C3270) /*[*/
+# if defined(X3270_DISPLAY) /*[*/
+		if (appres.once) {
+			/* Exit when the error pop-up pops down. */
+			exiting = True;
+		} else
+# endif /*]*/
+		if (appres.reconnect) {
+			auto_reconnect_inprogress = True;
+			reconnect_id = AddTimeOut(RECONNECT_ERR_MS,
+				try_reconnect);
+		}
+#endif /*]*/
+		/* Redundantly signal a disconnect. */
+		st_changed(ST_CONNECT, False);
+		return -1;
+	}
+
+	/* Success. */
+
+	/* Set pending string. */
+	if (connect_ps == CN)
+		connect_ps = appres.login_macro;
+	if (connect_ps != CN)
+		login_macro(connect_ps);
+
+	/* Prepare Xt for I/O. */
+	x_add_input(net_sock);
+
+	/* Set state and tell the world. */
+	if (pending) {
+		cstate = PENDING;
+		st_changed(ST_HALF_CONNECT, True);
+	} else {
+		cstate = CONNECTED_INITIAL;
+		st_changed(ST_CONNECT, True);
+#if defined(X3270_DISPLAY) /*[*/
+		if (appres.reconnect && error_popup_visible())
+			popdown_an_error();
+#endif /*]*/
+	}
+
+	return 0;
+}
+
+/*
+ * The host name passed to net_connect() has been looked up, and net_connect()
+ * has carried on with socket 's' (-1 for failure).
+ */
+void
+host_resolved(int s, Boolean pending)
+{
+	if (cstate != RESOLVING)
+		return;
+	net_sock = s;
+	(void) host_connect_finish(pending);
+}
+
 /*
  * Network connect/disconnect operations, combined with X input operations.
  *
@@ -645,59 +715,18 @@ host_connect(const char *n)
 
 	/* Attempt contact. */
 	ever_3270 = False;
+	connect_ps = ps;
 	net_sock = net_connect(chost, port, localprocess_cmd != CN, &resolving,
 	    &pending);
-	if (net_sock < 0 && !resolving) {
-#if defined(X3270_DISPLAY) || defined(C3270) /*[*/
-# if defined(X3270_DISPLAY) /*[*/
-		if (appres.once) {
-			/* Exit when the error pop-up pops down. */
-			exiting = True;
-		} else
-# endif /*]*/
-		if (appres.reconnect) {
-			auto_reconnect_inprogress = True;
-			reconnect_id = AddTimeOut(RECONNECT_ERR_MS,
-				try_reconnect);
-		}
-#endif /*]*/
-		/* Redundantly signal a disconnect. */
-		st_changed(ST_CONNECT, False);
-		return -1;
-	}
 
 	/* Still thinking about it? */
-	if (resolving) {
+	if (net_sock < 0 && resolving) {
 		cstate = RESOLVING;
 		st_changed(ST_RESOLVING, True);
 		return 0;
 	}
 
-	/* Success. */
-
-	/* Set pending string. */
-	if (ps == CN)
-		ps = appres.login_macro;
-	if (ps != CN)
-		login_macro(ps);
-
-	/* Prepare Xt for I/O. */
-	x_add_input(net_sock);
-
-	/* Set state and tell the world. */
-	if (pending) {
-		cstate = PENDING;
-		st_changed(ST_HALF_CONNECT, True);
-	} else {
-		cstate = CONNECTED_INITIAL;
-		st_changed(ST_CONNECT, True);
-#if defined(X3270_DISPLAY) /*[*/
-		if (appres.reconnect && error_popup_visible())
-			popdown_an_error();
-#endif /*]*/
-	}
-
-	return 0;
+	return host_connect_finish(pending);
 }
 
 #if defined(X3270_DISPLAY) || defined(C3270) /*[*/
@@ -1103,3 +1132,33 @@ Disconnect_action(Widget w _is_unused, XEvent *event, String *params,
 		return;
 	host_disconnect(False);
 }
+
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+host_session_vars(void)
+{
+	SESSION_VAR(cstate);
+	SESSION_VAR(connect_ps);
+	SESSION_VAR(std_ds_host);
+	SESSION_VAR(no_login_host);
+	SESSION_VAR(non_tn3270e_host);
+	SESSION_VAR(passthru_host);
+	SESSION_VAR(ssl_host);
+	SESSION_VAR(luname);
+	SESSION_VAR(connected_lu);
+	SESSION_VAR(connected_type);
+	SESSION_VAR(ever_3270);
+	SESSION_VAR(current_host);
+	SESSION_VAR(full_current_host);
+	SESSION_VAR(current_port);
+	SESSION_VAR(reconnect_host);
+	SESSION_VAR(qualified_host);
+	SESSION_VAR(last_host);
+	SESSION_VAR(auto_reconnect_inprogress);
+	SESSION_VAR(net_sock);
+#if defined(X3270_DISPLAY) || defined(C3270) /*[*/
+	SESSION_VAR(reconnect_id);
+#endif /*]*/
+}
+#endif /*]*/
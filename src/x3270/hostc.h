@@ -54,6 +54,10 @@ extern void host_cancel_reconnect(void);
 extern int host_connect(const char *n);
 extern void host_connected(void);
 extern void host_disconnect(Boolean disable);
+extern void host_resolved(int s, Boolean pending);
 extern void host_in3270(enum cstate);
+#if defined(X3270_SESSIONS) /*[*/
+extern void host_session_vars(void);
+#endif /*]*/
 extern void register_schange(int tx, void (*func)(Boolean));
 extern void st_changed(int tx, Boolean mode);
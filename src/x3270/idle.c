@@ -56,6 +56,7 @@
 #include "objects.h"
 #include "popupsc.h"
 #include "resources.h"
+#include "sessionc.h"
 #include "trace_dsc.h"
 #include "utilc.h"
 
@@ -694,4 +695,19 @@ idle_start(void)
 
 #endif /*]*/
 
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+idle_session_vars(void)
+{
+	SESSION_VAR(idle_enabled);
+	SESSION_VAR(idle_n);
+	SESSION_VAR(idle_multiplier);
+	SESSION_VAR(idle_id);
+	SESSION_VAR(idle_ms);
+	SESSION_VAR(idle_randomize);
+	SESSION_VAR(idle_ticking);
+}
+#endif /*]*/
+
 #endif /*]*/
@@ -40,6 +40,9 @@ enum idle_enum {
 extern void cancel_idle_timer(void);
 extern void idle_init(void);
 extern void reset_idle_timer(void);
+#if defined(X3270_SESSIONS) /*[*/
+extern void idle_session_vars(void);
+#endif /*]*/
 extern char *get_idle_command();
 extern char *get_idle_timeout();
 extern Boolean idle_changed;
@@ -53,4 +56,5 @@ extern void popup_idle(void);
 #define cancel_idle_timer()
 #define idle_init()
 #define reset_idle_timer()
+#define idle_session_vars()
 #endif /*]*/
@@ -72,6 +72,7 @@
 #if defined(X3270_DISPLAY) /*[*/
 #include "selectc.h"
 #endif /*]*/
+#include "sessionc.h"
 #include "statusc.h"
 #include "tablesc.h"
 #include "telnetc.h"
@@ -341,6 +342,7 @@ kybdlock_set(unsigned int bits, const char *cause _is_unused)
 		}
 		kybdlock = n;
 		status_kybdlock();
+		sms_feed_changed();
 	}
 }
 
@@ -365,6 +367,7 @@ kybdlock_clr(unsigned int bits, const char *cause _is_unused)
 		}
 		kybdlock = n;
 		status_kybdlock();
+		sms_feed_changed();
 	}
 }
 
@@ -4381,3 +4384,20 @@ TemporaryKeymap_action(Widget w _is_unused, XEvent *event, String *params, Cardi
 }
 
 #endif /*]*/
+
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+kybd_session_vars(void)
+{
+	SESSION_VAR(composing);
+	SESSION_VAR(unlock_id);
+	SESSION_VAR(unlock_delay_time);
+	SESSION_VAR(insert);
+	SESSION_VAR(reverse);
+	SESSION_VAR(kybdlock);
+	SESSION_VAR(aid);
+	SESSION_VAR(ta_head);
+	SESSION_VAR(ta_tail);
+}
+#endif /*]*/
@@ -154,5 +154,8 @@ extern void kybd_inhibit(Boolean inhibit);
 extern void kybd_init(void);
 extern int kybd_prime(void);
 extern void kybd_scroll_lock(Boolean lock);
+#if defined(X3270_SESSIONS) /*[*/
+extern void kybd_session_vars(void);
+#endif /*]*/
 extern Boolean run_ta(void);
 extern int state_from_keymap(char keymap[32]);
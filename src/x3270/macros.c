@@ -42,7 +42,9 @@
 #include <sys/signal.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
+#include <netinet/in.h>
 #endif /*]*/
 #include <errno.h>
 #include <fcntl.h>
@@ -67,8 +69,12 @@
 #if defined(X3270_PRINTER) /*[*/
 #include "printerc.h"
 #endif /*]*/
+#if !defined(_WIN32) /*[*/
+#include "resolverc.h"
+#endif /*]*/
 #include "screenc.h"
 #include "seec.h"
+#include "sessionc.h"
 #include "statusc.h"
 #include "tablesc.h"
 #include "telnetc.h"
@@ -139,6 +145,8 @@ typedef struct sms {
 	Boolean executing;	/* recursion avoidance */
 	Boolean accumulated;	/* accumulated time flag */
 	Boolean idle_error;	/* idle command caused an error */
+	Boolean subscribed;	/* receives screen change events */
+	Boolean discarding;	/* skipping the rest of a too-long command */
 	unsigned long msec;	/* total accumulated time */
 	FILE   *outfile;
 	int	infd;
@@ -155,6 +163,49 @@ static int sms_depth = 0;
 #if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
 static int socketfd = -1;
 static unsigned long socket_id = 0L;
+static char *socket_path = CN;
+static int socket_pid = 0;
+static int tcp_socketfd = -1;
+static unsigned long tcp_socket_id = 0L;
+#if defined(X3270_SESSIONS) /*[*/
+#define ACCEPT_DEFER_MS	100	/* how long a busy worker ignores connects */
+static unsigned long accept_defer_id = 0L;
+#endif /*]*/
+
+/*
+ * Script socket clients.
+ *
+ * Unless -multisession is in effect, any number of clients can be connected
+ * to the script socket at once.  They share one peer sms (peer_sms), which
+ * runs one command at a time from each client in turn.  A read-only command
+ * from a client with nothing else pending is run at once, even if another
+ * client's command is waiting.
+ */
+typedef struct peer {
+	struct peer *next;
+	int	fd;
+	FILE	*outfile;
+	unsigned long input_id;
+	char	buf[1024];	/* commands not yet run */
+	int	len;		/* length of buf */
+	Boolean	busy;		/* a command is running in peer_sms */
+	Boolean	eof;		/* connection closed */
+	Boolean	subscribed;	/* receives screen change events */
+	Boolean	discarding;	/* skipping the rest of a too-long command */
+} peer_t;
+
+/*
+ * A command too long for buf[] is replaced by this line, so its error reply
+ * goes out in turn.  It cannot come from the client, because returns are
+ * removed from the input.
+ */
+#define PEER_TOO_LONG	"\r"
+
+static peer_t *peers = NULL;		/* connected clients */
+static peer_t *peer_turn = NULL;	/* next client to be served */
+static peer_t *peer_current = NULL;	/* client whose command is running */
+static sms_t *peer_sms = SN;		/* sms that runs client commands */
+static unsigned long peer_kick_id = 0L;
 #endif /*]*/
 
 #if defined(X3270_TRACE) /*[*/
@@ -187,8 +238,22 @@ static unsigned long stdin_id = 0L;
 static unsigned char *ansi_save_buf;
 static int      ansi_save_cnt = 0;
 static int      ansi_save_ix = 0;
-static char    *expect_text = CN;
-static int	expect_len = 0;
+typedef struct {			/* Expect automaton state */
+	int child;			/* first state one byte further on */
+	int sib;			/* next state with the same parent */
+	int fail;			/* where to go without a transition */
+	int out;			/* pattern matched here (from 1), or 0 */
+	unsigned char c;		/* the byte that leads here */
+} expect_node_t;
+static expect_node_t *expect_nodes = NULL; /* Expect automaton */
+static int	*expect_root = NULL;	/* transitions from the start state */
+static int	expect_state = 0;	/* current automaton state */
+static int	expect_npatterns = 0;	/* number of Expect patterns */
+static int	feed_count = 0;		/* number of subscribed scripts */
+static unsigned long feed_id = 0L;	/* timeout for feed_report */
+static const char *feed_conn = CN;	/* connection state last reported */
+static int	feed_cursor = -1;	/* cursor address last reported */
+static char	feed_kb = '\0';		/* keyboard state last reported */
 static const char *st_name[] = { "String", "Macro", "Command", "KeymapAction",
 				 "IdleCommand", "ChildScript", "PeerScript",
 				 "File" };
@@ -200,14 +265,25 @@ static enum iaction st_cause[] = { IA_MACRO, IA_MACRO, IA_COMMAND, IA_KEYMAP,
 #if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
 static void cleanup_socket(Boolean b);
 #endif /*]*/
+enum em_stat { EM_CONTINUE, EM_PAUSE, EM_ERROR };
+static enum em_stat execute_command(enum iaction cause, char *s, char **np);
 static void script_prompt(Boolean success);
 static void script_input(void);
 static void sms_pop(Boolean can_exit);
 #if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
+static int unix_listen(void);
+static int tcp_listen(const char *spec);
 static void socket_connection(void);
+static void tcp_connection(void);
+static Boolean peer_fill(sms_t *s);
+static void peer_close_current(void);
+static void peer_sms_popped(void);
+static void peer_input(void);
 #endif /*]*/
 static void wait_timed_out(void);
 static void read_from_file(void);
+static void feed_report(FILE *only);
+static void feed_drop(void);
 static sms_t *sms_redirect_to(void);
 
 /* Macro that defines that the keyboard is locked due to user input. */
@@ -283,6 +359,8 @@ plugin_start_appres(Boolean complain)
 static void
 sms_connect(Boolean connected)
 {
+	sms_feed_changed();
+
 #if defined(X3270_SCRIPT) && defined(X3270_PLUGIN) /*[*/
 	if (connected) {
 		if (appres.plugin_command && !plugin_pid) {
@@ -311,6 +389,7 @@ sms_connect(Boolean connected)
 static void
 sms_in3270(Boolean in3270)
 {
+	sms_feed_changed();
 	if (in3270 || IN_SSCP)
 		sms_continue();
 }
@@ -446,6 +525,7 @@ new_sms(enum sms_type type)
 	s->executing = False;
 	s->accumulated = False;
 	s->idle_error = False;
+	s->subscribed = False;
 	s->msec = 0L;
 
 	return s;
@@ -526,6 +606,9 @@ static void
 sms_pop(Boolean can_exit)
 {
 	sms_t *s;
+#if defined(X3270_SESSIONS) /*[*/
+	Boolean end_session = False;
+#endif /*]*/
 
 	trace_dsn("%s[%d] complete\n", ST_NAME, sms_depth);
 
@@ -555,6 +638,10 @@ sms_pop(Boolean can_exit)
 	if (sms->wait_id != 0L)
 		RemoveTimeOut(sms->wait_id);
 
+	/* Stop sending it events. */
+	if (sms->subscribed)
+		feed_drop();
+
 	/*
 	 * If this was an idle command that generated an error, now is the
 	 * time to announce that.  (If we announced it when the error first
@@ -564,9 +651,14 @@ sms_pop(Boolean can_exit)
 		popup_an_error("Idle command disabled due to error");
 
 #if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
-	/* If this was a socket peer, get ready for another connection. */
-	if (sms->type == ST_PEER && appres.socket)
-		socket_id = AddInput(socketfd, socket_connection);
+#if defined(X3270_SESSIONS) /*[*/
+	/* If this was a socket peer, the session is finished. */
+	if (sms->type == ST_PEER && appres.multi_session)
+		end_session = True;
+#endif /*]*/
+	/* If this was the shared socket sms, it will be recreated on demand. */
+	if (sms == peer_sms)
+		peer_sms_popped();
 #endif /*]*/
 
 	/* Release the memory. */
@@ -590,6 +682,19 @@ sms_pop(Boolean can_exit)
 	} else if (sms->type == ST_FILE) {
 	    	read_from_file();
 	}
+
+#if defined(X3270_SESSIONS) /*[*/
+	/*
+	 * In multi-session mode, the session belongs to the peer.  Drop the
+	 * host connection and make the session available to the next one.
+	 * A session named with Session() keeps its host connection.
+	 */
+	if (end_session) {
+		if (PCONNECTED && session_name(session_current()) == CN)
+			host_disconnect(False);
+		session_release(session_current());
+	}
+#endif /*]*/
 }
 
 /*
@@ -605,38 +710,56 @@ peer_script_init(void)
 	Boolean on_top;
 
 #if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
-	if (appres.socket) {
-		struct sockaddr_un ssun;
-
-		/* -socket overrides -script */
+#if defined(X3270_SESSIONS) /*[*/
+	/* -multisession implies -socket */
+	if (appres.multi_session)
+		appres.socket = True;
+#endif /*]*/
+	/* -socketpath implies -socket. */
+	if (appres.socket_path != CN && *appres.socket_path)
+		appres.socket = True;
+	if (appres.socket ||
+	    (appres.script_port != CN && *appres.script_port)) {
+		/* -socket and -scriptport override -script */
 		appres.scripted = False;
 
-		/* Create the listening socket. */
-		socketfd = socket(AF_UNIX, SOCK_STREAM, 0);
-		if (socketfd < 0) {
-			popup_an_errno(errno, "Unix-domain socket");
-			return;
+		/* Create the listening socket(s). */
+		if (appres.socket) {
+			socketfd = unix_listen();
+			if (socketfd >= 0) {
+				socket_id = AddInput(socketfd,
+				    socket_connection);
+				register_schange(ST_EXITING, cleanup_socket);
+			}
 		}
-		(void) memset(&ssun, '\0', sizeof(ssun));
-		ssun.sun_family = AF_UNIX;
-		(void) sprintf(ssun.sun_path, "/tmp/x3sck.%u", getpid());
-		(void) unlink(ssun.sun_path);
-		if (bind(socketfd, (struct sockaddr *)&ssun, sizeof(ssun))
-				< 0) {
-			popup_an_errno(errno, "Unix-domain socket bind");
-			close(socketfd);
-			socketfd = -1;
-			return;
+		appres.socket = True;
+		if (appres.script_port != CN && *appres.script_port) {
+			tcp_socketfd = tcp_listen(appres.script_port);
+			if (tcp_socketfd >= 0)
+				tcp_socket_id = AddInput(tcp_socketfd,
+				    tcp_connection);
 		}
-		if (listen(socketfd, 1) < 0) {
-			popup_an_errno(errno, "Unix-domain socket listen");
-			close(socketfd);
-			socketfd = -1;
-			(void) unlink(ssun.sun_path);
+		if (socketfd < 0 && tcp_socketfd < 0)
 			return;
+#if defined(X3270_SESSIONS) /*[*/
+		if (appres.multi_session) {
+			/*
+			 * With several workers, each one is woken for a new
+			 * connection, and only one of them gets it.
+			 */
+			if (appres.workers > 1) {
+				if (socketfd >= 0)
+					(void) fcntl(socketfd, F_SETFL,
+					    fcntl(socketfd, F_GETFL) |
+						O_NONBLOCK);
+				if (tcp_socketfd >= 0)
+					(void) fcntl(tcp_socketfd, F_SETFL,
+					    fcntl(tcp_socketfd, F_GETFL) |
+						O_NONBLOCK);
+			}
+			session_start_workers(appres.workers);
 		}
-		socket_id = AddInput(socketfd, socket_connection);
-		register_schange(ST_EXITING, cleanup_socket);
+#endif /*]*/
 		return;
 	}
 #endif /*]*/
@@ -673,52 +796,616 @@ peer_script_init(void)
 }
 
 #if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
+/*
+ * Create the listening Unix-domain socket.
+ * Returns the socket, or -1 for failure.
+ */
+static int
+unix_listen(void)
+{
+	struct sockaddr_un ssun;
+	struct stat st;
+	int fd;
+
+	if (appres.socket_path != CN && *appres.socket_path) {
+		if (strlen(appres.socket_path) >= sizeof(ssun.sun_path)) {
+			popup_an_error("Unix-domain socket path too long");
+			return -1;
+		}
+		socket_path = NewString(appres.socket_path);
+	} else
+		socket_path = xs_buffer("/tmp/x3sck.%u", getpid());
+
+	(void) memset(&ssun, '\0', sizeof(ssun));
+	ssun.sun_family = AF_UNIX;
+	(void) strcpy(ssun.sun_path, socket_path);
+
+	/*
+	 * Replace a stale socket, but nothing else.  A socket is stale if
+	 * nothing is listening on it any more; one that is still in use
+	 * belongs to another emulator, and its clients stay with it.
+	 */
+	if (lstat(socket_path, &st) == 0) {
+		int e;
+
+		if (!S_ISSOCK(st.st_mode)) {
+			popup_an_error("%s exists and is not a socket",
+			    socket_path);
+			Replace(socket_path, CN);
+			return -1;
+		}
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+			popup_an_errno(errno, "Unix-domain socket");
+			Replace(socket_path, CN);
+			return -1;
+		}
+		(void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		e = (connect(fd, (struct sockaddr *)&ssun, sizeof(ssun)) < 0)?
+		    errno: 0;
+		(void) close(fd);
+		if (e != ECONNREFUSED) {
+			popup_an_error("%s: socket path in use", socket_path);
+			Replace(socket_path, CN);
+			return -1;
+		}
+		(void) unlink(socket_path);
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		popup_an_errno(errno, "Unix-domain socket");
+		return -1;
+	}
+	if (bind(fd, (struct sockaddr *)&ssun, sizeof(ssun)) < 0) {
+		popup_an_errno(errno, "Unix-domain socket bind");
+		close(fd);
+		return -1;
+	}
+	if (listen(fd, SOMAXCONN) < 0) {
+		popup_an_errno(errno, "Unix-domain socket listen");
+		close(fd);
+		(void) unlink(ssun.sun_path);
+		return -1;
+	}
+	socket_pid = getpid();
+	trace_dsn("Listening for script connections on %s\n", socket_path);
+	return fd;
+}
+
+/*
+ * Create the listening TCP socket.  The spec is [address:]port; the
+ * default address is the loopback address.  Anyone who can connect can
+ * run any action, so listening more widely has to be asked for with an
+ * explicit address.
+ * Returns the socket, or -1 for failure.
+ */
+static int
+tcp_listen(const char *spec)
+{
+	char *host;
+	char *port;
+	char *colon;
+	unsigned short pport;
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in sin;
+#if defined(AF_INET6) /*[*/
+		struct sockaddr_in6 sin6;
+#endif /*]*/
+	} addr;
+	socklen_t addr_len = sizeof(addr);
+	char errmsg[1024];
+	char *where;
+	int fd;
+	int on = 1;
+
+	host = NewString(spec);
+	if ((colon = strrchr(host, ':')) != CN) {
+		*colon = '\0';
+		port = colon + 1;
+		if (*host == '[' && colon > host + 1 && *(colon - 1) == ']') {
+			*(colon - 1) = '\0';
+			(void) memmove(host, host + 1, strlen(host));
+		}
+	} else {
+		port = host;
+		host = "127.0.0.1";
+	}
+	if (resolve_host_and_port(host, port, &pport, &addr.sa, &addr_len,
+		    errmsg, sizeof(errmsg)) < 0) {
+		popup_an_error("%s: %s", OptScriptPort, errmsg);
+		Free((colon != CN)? host: port);
+		return -1;
+	}
+	where = NewString(host);
+	Free((colon != CN)? host: port);
+
+	fd = socket(addr.sa.sa_family, SOCK_STREAM, 0);
+	if (fd < 0) {
+		popup_an_errno(errno, "Script socket");
+		Free(where);
+		return -1;
+	}
+	(void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (char *)&on,
+	    sizeof(on));
+	if (bind(fd, &addr.sa, addr_len) < 0) {
+		popup_an_errno(errno, "Script socket bind");
+		close(fd);
+		Free(where);
+		return -1;
+	}
+	if (listen(fd, SOMAXCONN) < 0) {
+		popup_an_errno(errno, "Script socket listen");
+		close(fd);
+		Free(where);
+		return -1;
+	}
+	trace_dsn("Listening for script connections on %s, port %u\n", where,
+	    pport);
+	Free(where);
+	return fd;
+}
+
+/* Returns True if socket clients share the session. */
+static Boolean
+peer_shared(void)
+{
+#if defined(X3270_SESSIONS) /*[*/
+	return !appres.multi_session;
+#else /*][*/
+	return True;
+#endif /*]*/
+}
+
+/* Returns True if a client has a complete command buffered. */
+static Boolean
+peer_ready(peer_t *p)
+{
+	return memchr(p->buf, '\n', p->len) != NULL;
+}
+
+/* Remove a client. */
+static void
+peer_free(peer_t *p)
+{
+	peer_t **pp;
+
+	for (pp = &peers; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == p) {
+			*pp = p->next;
+			break;
+		}
+	}
+	if (peer_turn == p)
+		peer_turn = p->next;
+	if (p->input_id != 0L)
+		RemoveInput(p->input_id);
+	if (p->subscribed)
+		feed_drop();
+	(void) fclose(p->outfile);
+	(void) close(p->fd);
+	Free(p);
+	trace_dsn("Script socket connection closed\n");
+}
+
+/*
+ * Returns True if a command is read-only, and can be run without waiting
+ * behind other clients' commands.
+ */
+static Boolean
+peer_readonly(const char *cmd)
+{
+	char aname[64 + 1];
+	int nx = 0;
+	int ix;
+	XtActionProc proc;
+
+	while (isspace(*cmd))
+		cmd++;
+	while ((isalnum(*cmd) || *cmd == '_' || *cmd == '-') && nx < 64)
+		aname[nx++] = *cmd++;
+	aname[nx] = '\0';
+	if (!nx || (ix = action_lookup(aname)) < 0)
+		return False;
+	proc = actions[ix].proc;
+	if (proc == Snap_action) {
+		/* Snap(Wait) waits for output. */
+		while (isspace(*cmd) || *cmd == '(' || *cmd == '"')
+			cmd++;
+		return strncasecmp(cmd, "Wait", 4) || isalnum(cmd[4]);
+	}
+	return proc == Ascii_action ||
+	       proc == AsciiField_action ||
+	       proc == Ebcdic_action ||
+	       proc == EbcdicField_action ||
+	       proc == ReadBuffer_action ||
+	       proc == Query_action;
+}
+
+/* Read from a client again, if it was stopped and there is now room. */
+static void
+peer_resume(peer_t *p)
+{
+	if (p->input_id == 0L && !p->eof && p->len < (int)sizeof(p->buf))
+		p->input_id = AddInput(p->fd, peer_input);
+}
+
+/*
+ * Run a client's leading read-only commands right away, using a temporary
+ * sms on top of the stack.
+ */
+static void
+peer_queries(peer_t *p)
+{
+	char *nl;
+	int cmd_len;
+	sms_t *s;
+	enum em_stat es;
+
+	while (!p->busy && (nl = memchr(p->buf, '\n', p->len)) != NULL) {
+		Boolean too_long;
+
+		*nl = '\0';
+		too_long = !strcmp(p->buf, PEER_TOO_LONG);
+		if (!too_long && !peer_readonly(p->buf)) {
+			*nl = '\n';
+			break;
+		}
+
+		s = new_sms(ST_PEER);
+		s->state = SS_RUNNING;
+		s->outfile = p->outfile;
+		s->next = sms;
+		sms = s;
+		if (too_long) {
+			trace_dsn("%s[%d]: command too long\n", ST_NAME,
+			    sms_depth);
+			(void) fprintf(p->outfile, "data: command too long\n");
+			es = EM_ERROR;
+		} else {
+			trace_dsn("%s[%d]: '%s' (immediate)\n", ST_NAME,
+			    sms_depth, p->buf);
+			s->executing = True;
+			es = execute_command(IA_SCRIPT, p->buf, (char **)NULL);
+		}
+		script_prompt(es != EM_ERROR && s->success);
+		sms = s->next;
+		Free(s);
+
+		cmd_len = nl + 1 - p->buf;
+		p->len -= cmd_len;
+		(void) memmove(p->buf, nl + 1, p->len);
+	}
+	peer_resume(p);
+}
+
+/* Start the shared sms, if a client has a command for it. */
+static void
+peer_kick(void)
+{
+	peer_t *p;
+
+	for (p = peers; p != NULL; p = p->next)
+		if (peer_ready(p))
+			break;
+	if (p == NULL)
+		return;
+
+	if (peer_sms == SN) {
+		(void) sms_push(ST_PEER);
+		peer_sms = sms;
+	} else if (sms != peer_sms || peer_sms->state != SS_IDLE)
+		return;
+	peer_sms->state = SS_INCOMPLETE;
+	sms_continue();
+}
+
+/* Timeout for peer_kick after the shared sms is popped. */
+static void
+peer_kick_timeout(void)
+{
+	peer_kick_id = 0L;
+	peer_kick();
+}
+
+/*
+ * Read from one client.
+ * Returns False if the client is gone.
+ */
+static Boolean
+peer_read(peer_t *p)
+{
+	char buf[sizeof(p->buf)];
+	int nr;
+	int i;
+
+	/*
+	 * A command that doesn't fit in the buffer can never be run.  Throw
+	 * it away, up to the end of the line.
+	 */
+	if (p->len >= (int)sizeof(p->buf) && !peer_ready(p)) {
+		trace_dsn("Script socket: command too long\n");
+		p->len = 0;
+		p->discarding = True;
+	}
+
+	/* Leave room for the PEER_TOO_LONG line, if one is coming. */
+	nr = read(p->fd, buf,
+	    sizeof(p->buf) - p->len - (p->discarding? 1: 0));
+	if (nr < 0 && (errno == EAGAIN || errno == EINTR))
+		return True;
+	if (nr <= 0) {
+		if (nr < 0)
+			trace_dsn("Script socket read: %s\n", strerror(errno));
+		trace_dsn("EOF on script socket connection\n");
+		p->eof = True;
+		RemoveInput(p->input_id);
+		p->input_id = 0L;
+		if (!p->busy && !peer_ready(p)) {
+			peer_free(p);
+			return False;
+		}
+		return True;
+	}
+
+	/* Append to the pending commands, ignoring returns. */
+	for (i = 0; i < nr; i++) {
+		if (p->discarding) {
+			if (buf[i] == '\n') {
+				p->discarding = False;
+				(void) memcpy(p->buf + p->len,
+				    PEER_TOO_LONG "\n", 2);
+				p->len += 2;
+			}
+		} else if (buf[i] != '\r')
+			p->buf[p->len++] = buf[i];
+	}
+
+	/* Stop reading if the buffer is full. */
+	if (p->len >= (int)sizeof(p->buf) && peer_ready(p)) {
+		RemoveInput(p->input_id);
+		p->input_id = 0L;
+	}
+	return True;
+}
+
+/* Input is ready from a client. */
+static void
+peer_input(void)
+{
+	int fd = InputSource();
+	peer_t *p;
+
+	for (p = peers; p != NULL; p = p->next) {
+		if (p->fd == fd && p->input_id != 0L) {
+			if (peer_read(p))
+				peer_queries(p);
+			break;
+		}
+	}
+	peer_kick();
+}
+
+/* Set up a new client. */
+static void
+peer_new(int fd)
+{
+	peer_t *p, **pp;
+
+	p = (peer_t *)Calloc(1, sizeof(peer_t));
+	p->fd = fd;
+	p->outfile = fdopen(dup(fd), "w");
+	(void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	p->input_id = AddInput(fd, peer_input);
+	for (pp = &peers; *pp != NULL; pp = &(*pp)->next)
+		;
+	*pp = p;
+}
+
+/*
+ * Finish the current client's command, and load the next client's next
+ * command into the shared sms.
+ * Returns True if there is a command to run.
+ */
+static Boolean
+peer_fill(sms_t *s)
+{
+	peer_t *p, *start;
+	char *nl;
+	int cmd_len;
+
+	s->msc_len = 0;
+
+	/* Finish with the current client. */
+	if ((p = peer_current) != NULL) {
+		peer_current = NULL;
+		p->busy = False;
+		if (p->eof && !peer_ready(p))
+			peer_free(p);
+		else
+			peer_queries(p);
+	}
+
+	/* Find the next client, in turn, with a command. */
+	if (peer_turn == NULL)
+		peer_turn = peers;
+	if ((start = p = peer_turn) == NULL)
+		return False;
+	do {
+		/* Answer too-long commands left behind by an Abort. */
+		if (p->len > 0 && p->buf[0] == PEER_TOO_LONG[0])
+			peer_queries(p);
+		if ((nl = memchr(p->buf, '\n', p->len)) != NULL) {
+			cmd_len = nl + 1 - p->buf;
+			(void) memcpy(s->msc, p->buf, cmd_len);
+			s->msc_len = cmd_len;
+			p->len -= cmd_len;
+			(void) memmove(p->buf, nl + 1, p->len);
+			peer_resume(p);
+			p->busy = True;
+			peer_current = p;
+			peer_turn = p->next;
+			s->outfile = p->outfile;
+			return True;
+		}
+		p = (p->next != NULL)? p->next: peers;
+	} while (p != start);
+
+	return False;
+}
+
+/* The current client ran CloseScript: disconnect it. */
+static void
+peer_close_current(void)
+{
+	peer_t *p = peer_current;
+
+	if (p == NULL)
+		return;
+	p->len = 0;
+	p->discarding = False;
+	p->eof = True;
+	if (p->input_id != 0L) {
+		RemoveInput(p->input_id);
+		p->input_id = 0L;
+	}
+}
+
+/* The shared sms was popped (by Abort). */
+static void
+peer_sms_popped(void)
+{
+	peer_t *p;
+
+	peer_sms = SN;
+	if ((p = peer_current) != NULL) {
+		peer_current = NULL;
+		p->busy = False;
+		if (p->eof && !peer_ready(p))
+			peer_free(p);
+	}
+
+	/* Don't push a new one while the stack is being unwound. */
+	if (peer_kick_id == 0L)
+		peer_kick_id = AddTimeOut(1L, peer_kick_timeout);
+}
+
+#if defined(X3270_SESSIONS) /*[*/
+static void socket_connection(void);
+static void tcp_connection(void);
+
+/* Start watching the listening sockets again. */
+static void
+accept_resume(void)
+{
+	accept_defer_id = 0L;
+	if (socketfd >= 0 && socket_id == 0L)
+		socket_id = AddInput(socketfd, socket_connection);
+	if (tcp_socketfd >= 0 && tcp_socket_id == 0L)
+		tcp_socket_id = AddInput(tcp_socketfd, tcp_connection);
+}
+
+/*
+ * Leave new connections to the other workers for a while.  The listening
+ * sockets stay readable until one of them accepts, so a busy worker has to
+ * stop watching them, or it would be woken again at once.
+ */
+static void
+accept_defer(void)
+{
+	if (socket_id != 0L) {
+		RemoveInput(socket_id);
+		socket_id = 0L;
+	}
+	if (tcp_socket_id != 0L) {
+		RemoveInput(tcp_socket_id);
+		tcp_socket_id = 0L;
+	}
+	if (accept_defer_id == 0L)
+		accept_defer_id = AddTimeOut(ACCEPT_DEFER_MS, accept_resume);
+}
+#endif /*]*/
+
 /* Accept a new socket connection. */
 static void
-socket_connection(void)
+script_accept(int lfd)
 {
 	int fd;
-	struct sockaddr_un ssun;
-	socklen_t len = sizeof(ssun);
 	sms_t *s;
 
+#if defined(X3270_SESSIONS) /*[*/
+	/* Leave it for a less busy worker. */
+	if (appres.multi_session && !session_accept_ok()) {
+		accept_defer();
+		return;
+	}
+#endif /*]*/
+
 	/* Accept the connection. */
-	(void) memset(&ssun, '\0', sizeof(ssun));
-	ssun.sun_family = AF_UNIX;
-	fd = accept(socketfd, (struct sockaddr *)&ssun, &len);
+	fd = accept(lfd, (struct sockaddr *)NULL, (socklen_t *)NULL);
 	if (fd < 0) {
-		popup_an_errno(errno, "Unix-domain socket accept");
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return;	/* another worker got it */
+		popup_an_errno(errno, "Script socket accept");
 		return;
 	}
+#if defined(X3270_SESSIONS) /*[*/
+	/* Some systems pass O_NONBLOCK on from the listening socket. */
+	if (appres.workers > 1)
+		(void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+#endif /*]*/
 	trace_dsn("New script socket connection\n");
 
+	/* Share the session with any other clients. */
+	if (peer_shared()) {
+		peer_new(fd);
+		return;
+	}
+
+#if defined(X3270_SESSIONS) /*[*/
+	/*
+	 * In multi-session mode, each connection gets a session of its own,
+	 * and every command it sends applies to that session.
+	 */
+	(void) session_new();
+#endif /*]*/
+
 	/* Push on a peer script. */
 	(void) sms_push(ST_PEER);
 	s = sms;
 	s->infd = fd;
 	s->outfile = fdopen(dup(fd), "w");
 	script_enable();
+}
 
-	/* Don't accept any more connections. */
-	RemoveInput(socket_id);
-	socket_id = 0L;
+/* Accept a new Unix-domain socket connection. */
+static void
+socket_connection(void)
+{
+	script_accept(socketfd);
+}
+
+/* Accept a new TCP socket connection. */
+static void
+tcp_connection(void)
+{
+	script_accept(tcp_socketfd);
 }
 
 /* Clean up the Unix-domain socket. */
 static void
 cleanup_socket(Boolean b _is_unused)
 {
-	char buf[1024];
-
-	(void) sprintf(buf, "/tmp/x3sck.%u", getpid());
-	(void) unlink(buf);
+	/* Only the process that created it (not a worker) removes it. */
+	if (socket_path != CN && getpid() == socket_pid)
+		(void) unlink(socket_path);
 }
 #endif /*]*/
 
 /*
  * Interpret and execute a script or macro command.
  */
-enum em_stat { EM_CONTINUE, EM_PAUSE, EM_ERROR };
 static enum em_stat
 execute_command(enum iaction cause, char *s, char **np)
 {
@@ -742,7 +1429,7 @@ execute_command(enum iaction cause, char *s, char **np)
 	int nx = 0;
 	Cardinal count = 0;
 	String params[64];
-	int i, any, exact;
+	int any;
 	int failreason = 0;
 	Boolean saw_paren = False;
 	static const char *fail_text[] = {
@@ -750,9 +1437,19 @@ execute_command(enum iaction cause, char *s, char **np)
 		/*2*/ "Syntax error in action name",
 		/*3*/ "Syntax error: \")\" or \",\" expected",
 		/*4*/ "Extra data after parameters",
-		/*5*/ "Syntax error: \")\" expected"
+		/*5*/ "Syntax error: \")\" expected",
+		/*6*/ "Too many parameters",
+		/*7*/ "Parameters too long"
 	};
 #define fail(n) { failreason = n; goto failure; }
+#define next_parm() { \
+	if (count >= 63) \
+		fail(6); \
+	if (nx >= 1024) \
+		fail(7); \
+	parm[nx++] = '\0'; \
+	params[++count] = &parm[nx]; \
+}
 #define free_params() { \
 	if (cause == IA_MACRO ||   cause == IA_KEYMAP || \
 	    cause == IA_COMMAND || cause == IA_IDLE) { \
@@ -813,8 +1510,7 @@ execute_command(enum iaction cause, char *s, char **np)
 		else if (c == '"')
 			state = ME_P_QPARM;
 		else if (c == ',') {
-			parm[nx++] = '\0';
-			params[++count] = &parm[nx];
+			next_parm();
 		} else if (c == ')')
 			goto success;
 		else {
@@ -824,16 +1520,14 @@ execute_command(enum iaction cause, char *s, char **np)
 		break;
 	    case ME_P_PARM:
 		if (isspace(c)) {
-			parm[nx++] = '\0';
-			params[++count] = &parm[nx];
+			next_parm();
 			state = ME_P_PARMx;
 		} else if (c == ')') {
 			parm[nx] = '\0';
 			++count;
 			goto success;
 		} else if (c == ',') {
-			parm[nx++] = '\0';
-			params[++count] = &parm[nx];
+			next_parm();
 			state = ME_LPAREN;
 		} else {
 			if (nx < 1024)
@@ -853,8 +1547,7 @@ execute_command(enum iaction cause, char *s, char **np)
 		break;
 	    case ME_P_QPARM:
 		if (c == '"') {
-			parm[nx++] = '\0';
-			params[++count] = &parm[nx];
+			next_parm();
 			state = ME_P_PARMx;
 		} else if (c == '\\') {
 			state = ME_P_BSL;
@@ -873,8 +1566,7 @@ execute_command(enum iaction cause, char *s, char **np)
 		break;
 	    case ME_S_PARM:
 		if (isspace(c)) {
-			parm[nx++] = '\0';
-			params[++count] = &parm[nx];
+			next_parm();
 			state = ME_S_PARMx;
 		} else {
 			if (nx < 1024)
@@ -894,8 +1586,7 @@ execute_command(enum iaction cause, char *s, char **np)
 		break;
 	    case ME_S_QPARM:
 		if (c == '"') {
-			parm[nx++] = '\0';
-			params[++count] = &parm[nx];
+			next_parm();
 			state = ME_S_PARMx;
 		} else if (c == '\\') {
 			state = ME_S_BSL;
@@ -928,8 +1619,7 @@ execute_command(enum iaction cause, char *s, char **np)
 	    case ME_S_PARMx:	/* space after space-style parameter */
 		break;
 	    case ME_S_PARM:	/* mid space-style parameter */
-		parm[nx++] = '\0';
-		params[++count] = &parm[nx];
+		next_parm();
 		break;
 	    default:
 		fail(5);
@@ -964,27 +1654,11 @@ execute_command(enum iaction cause, char *s, char **np)
 		free_params();
 		return EM_ERROR;
 	}
-	any = -1;
-	exact = -1;
-	for (i = 0; i < actioncount; i++) {
-		if (!strcasecmp(aname, actions[i].string)) {
-			exact = any = i;
-			break;
-		}
-	}
-	if (exact < 0) {
-		for (i = 0; i < actioncount; i++) {
-			if (!strncasecmp(aname, actions[i].string,
-			    strlen(aname))) {
-				if (any >= 0) {
-					popup_an_error("Ambiguous action name: "
-					    "%s", aname);
-					free_params();
-					return EM_ERROR;
-				}
-				any = i;
-			}
-		}
+	any = action_lookup(aname);
+	if (any == -2) {
+		popup_an_error("Ambiguous action name: %s", aname);
+		free_params();
+		return EM_ERROR;
 	}
 	if (any >= 0) {
 		sms->accumulated = False;
@@ -994,6 +1668,7 @@ execute_command(enum iaction cause, char *s, char **np)
 			count? params: (String *)NULL, &count);
 		free_params();
 		screen_disp(False);
+		sms_feed_changed();
 	} else {
 		popup_an_error("Unknown action: %s", aname);
 		free_params();
@@ -1013,6 +1688,7 @@ execute_command(enum iaction cause, char *s, char **np)
 	popup_an_error("%s", fail_text[failreason-1]);
 	return EM_ERROR;
 #undef fail
+#undef next_parm
 #undef free_params
 }
 
@@ -1255,17 +1931,34 @@ login_macro(char *s)
 		push_string(s, True, False);
 }
 
-/* Run the first command in the msc[] buffer. */
+/* Returns True if an sms is still on the stack. */
+static Boolean
+sms_on_stack(sms_t *s)
+{
+	sms_t *t;
+
+	for (t = sms; t != SN; t = t->next)
+		if (t == s)
+			return True;
+	return False;
+}
+
+/*
+ * Run the commands in the msc[] buffer.
+ * The buffer is compacted once on the way out, rather than after each command.
+ */
 static void
 run_script(void)
 {
+	sms_t *s = sms;
+	int done = 0;		/* bytes of msc[] already executed */
+
 	trace_dsn("%s[%d] running\n", ST_NAME, sms_depth);
 
 	for (;;) {
 		char *ptr;
 		int cmd_len;
 		char *cmd;
-		sms_t *s;
 		enum em_stat es;
 
 		/* If the script isn't idle, we're done. */
@@ -1279,40 +1972,44 @@ run_script(void)
 		}
 
 		/* If there isn't a pending command, we're done. */
-		if (!sms->msc_len)
+		if (done >= sms->msc_len) {
+#if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
+			/* The shared socket sms takes turns among clients. */
+			if (s == peer_sms && peer_fill(s)) {
+				done = 0;
+				continue;
+			}
+#endif /*]*/
 			break;
+		}
 
 		/* Isolate the command. */
-		ptr = memchr(sms->msc, '\n', sms->msc_len);
+		cmd = sms->msc + done;
+		ptr = memchr(cmd, '\n', sms->msc_len - done);
 		if (!ptr)
 			break;
 		*ptr++ = '\0';
-		cmd_len = ptr - sms->msc;
-		cmd = sms->msc;
+		cmd_len = ptr - cmd;
 
 		/* Execute it. */
 		sms->state = SS_RUNNING;
 		sms->success = True;
 		trace_dsn("%s[%d]: '%s'\n", ST_NAME, sms_depth, cmd);
-		s = sms;
 		s->executing = True;
 		es = execute_command(IA_SCRIPT, cmd, (char **)NULL);
 		s->executing = False;
-
-		/* Move the rest of the buffer over. */
-		if (cmd_len < s->msc_len) {
-			s->msc_len -= cmd_len;
-			(void) memmove(s->msc, ptr, s->msc_len);
-		} else
-			s->msc_len = 0;
+		done += cmd_len;
 
 		/*
 		 * If a new sms was started, we will be resumed
 		 * when it completes.
 		 */
 		if (sms != s) {
+			/* If this sms was popped (by Abort), it's gone. */
+			if (!sms_on_stack(s))
+				return;
 			s->need_prompt = True;
-			return;
+			break;
 		}
 
 		/* Handle what it did. */
@@ -1321,6 +2018,14 @@ run_script(void)
 				sms->state = SS_KBWAIT;
 			script_disable();
 			if (sms->state == SS_CLOSING) {
+#if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
+				/* Close only this client's connection. */
+				if (s == peer_sms) {
+					peer_close_current();
+					sms->state = SS_IDLE;
+					continue;
+				}
+#endif /*]*/
 				sms_pop(False);
 				return;
 			}
@@ -1340,6 +2045,13 @@ run_script(void)
 				    sms_state_name[sms->state]);
 		}
 	}
+
+	/* Move the rest of the buffer over. */
+	if (done < s->msc_len) {
+		s->msc_len -= done;
+		(void) memmove(s->msc, s->msc + done, s->msc_len);
+	} else
+		s->msc_len = 0;
 }
 
 /* Read the next command from a file. */
@@ -1464,15 +2176,25 @@ sms_info(const char *fmt, ...)
 static void
 script_input(void)
 {
-	char buf[128];
+	char buf[sizeof(sms->msc)];
 	int nr;
 	char *ptr;
 	char c;
 
 	trace_dsn("Input for %s[%d] %d\n", ST_NAME, sms_depth, sms->state);
 
-	/* Read in what you can. */
-	nr = read(sms->infd, buf, sizeof(buf));
+	/*
+	 * A command that doesn't fit in the buffer can never be run.  Throw
+	 * it away, up to the end of the line.
+	 */
+	if (sms->msc_len >= (int)sizeof(sms->msc) - 1) {
+		trace_dsn("%s[%d]: command too long\n", ST_NAME, sms_depth);
+		sms->msc_len = 0;
+		sms->discarding = True;
+	}
+
+	/* Read in what you can, up to the space left in the buffer. */
+	nr = read(sms->infd, buf, sizeof(sms->msc) - 1 - sms->msc_len);
 	if (nr < 0) {
 		popup_an_errno(errno, "%s[%d] read", ST_NAME, sms_depth);
 		return;
@@ -1484,11 +2206,23 @@ script_input(void)
 		return;
 	}
 
-	/* Append to the pending command, ignoring returns. */
+	/*
+	 * Append to the pending command, ignoring returns.  A command that was
+	 * thrown away gets a single error reply when its line ends.
+	 */
 	ptr = buf;
-	while (nr--)
-		if ((c = *ptr++) != '\r')
+	while (nr--) {
+		c = *ptr++;
+		if (sms->discarding) {
+			if (c == '\n') {
+				sms->discarding = False;
+				(void) fprintf(sms->outfile,
+				    "data: command too long\n");
+				script_prompt(False);
+			}
+		} else if (c != '\r')
 			sms->msc[sms->msc_len++] = c;
+	}
 
 	/* Run the command(s). */
 	sms->state = SS_INCOMPLETE;
@@ -1501,6 +2235,8 @@ sms_continue(void)
 {
 	static Boolean continuing = False;
 
+	sms_feed_changed();
+
 	if (continuing)
 		return;
 	continuing = True;
@@ -1671,13 +2407,12 @@ dump_range(int first, int len, Boolean in_ascii, struct ea *buf,
     int rel_rows _is_unused, int rel_cols)
 {
 	register int i;
-	Boolean any = False;
+	int n;
 	Boolean is_zero = False;
 	char *linebuf;
 	char *s;
 
-	linebuf = Malloc(maxCOLS * 4 + 1);
-	s = linebuf;
+	linebuf = Malloc(in_ascii? mb_max_len(maxCOLS): maxCOLS * 3 + 1);
 
 	/*
 	 * If the client has looked at the live screen, then if they later
@@ -1690,59 +2425,30 @@ dump_range(int first, int len, Boolean in_ascii, struct ea *buf,
 
 	is_zero = FA_IS_ZERO(get_field_attribute(first));
 
-	for (i = 0; i < len; i++) {
-		if (i && !((first + i) % rel_cols)) {
-			*s = '\0';
-			action_output("%s", linebuf);
-			s = linebuf;
-			any = False;
-		}
+	/* Translate and display a row (or partial row) at a time. */
+	for (i = 0; i < len; i += n) {
+		n = rel_cols - ((first + i) % rel_cols);
+		if (n > len - i)
+			n = len - i;
 		if (in_ascii) {
-			char mb[16];
-			ucs4_t uc;
-			int j;
-			int xlen;
-
-			if (buf[first + i].fa) {
-				is_zero = FA_IS_ZERO(buf[first + i].fa);
-				s += sprintf(s, " ");
-			} else if (is_zero)
-				s += sprintf(s, " ");
-			else
 #if defined(X3270_DBCS) /*[*/
-			if (IS_LEFT(ctlr_dbcs_state(first + i))) {
-
-				xlen = ebcdic_to_multibyte(
-					(buf[first + i].cc << 8) |
-					 buf[first + i + 1].cc,
-					mb, sizeof(mb));
-				for (j = 0; j < xlen - 1; j++) {
-					s += sprintf(s, "%c", mb[j]);
-				}
-			} else if (IS_RIGHT(ctlr_dbcs_state(first + i))) {
-				continue;
-			} else
+			/* A lone right half at the very end shows nothing. */
+			if (i + n == len && n == 1 &&
+			    IS_RIGHT(ctlr_dbcs_state(first + i)))
+				break;
 #endif /*]*/
-			{
-				xlen = ebcdic_to_multibyte_x(
-						       buf[first + i].cc,
-						       buf[first + i].cs,
-						       mb, sizeof(mb),
-						       True,
-						       &uc);
-				for (j = 0; j < xlen - 1; j++) {
-					s += sprintf(s, "%c", mb[j]);
-				}
-			}
+			(void) ebcdic_to_multibyte_row(buf, first + i, n,
+			    &is_zero, linebuf);
 		} else {
-			s += sprintf(s, "%s%02x",
-				i ? " " : "",
-				buf[first + i].cc);
+			int j;
+
+			s = linebuf;
+			for (j = i; j < i + n; j++) {
+				s += sprintf(s, "%s%02x",
+					j ? " " : "",
+					buf[first + j].cc);
+			}
 		}
-		any = True;
-	}
-	if (any) {
-		*s = '\0';
 		action_output("%s", linebuf);
 	}
 	Free(linebuf);
@@ -2055,6 +2761,18 @@ ReadBuffer_action(Widget w _is_unused, XEvent *event _is_unused,
 	do_read_buffer(params, *num_params, ea_buf, -1);
 }
 
+/* Returns the keyboard status, as shown in the status line. */
+static char
+kb_state(void)
+{
+	if (!kybdlock)
+		return 'U';
+	else if (!CONNECTED || KBWAIT)
+		return 'L';
+	else
+		return 'E';
+}
+
 /*
  * The sms prompt is preceeded by a status line with 11 fields:
  *
@@ -2095,12 +2813,7 @@ status_string(void)
 	char s[1024];
 	char *r;
 
-	if (!kybdlock)
-		kb_stat = 'U';
-	else if (!CONNECTED || KBWAIT)
-		kb_stat = 'L';
-	else
-		kb_stat = 'E';
+	kb_stat = kb_state();
 
 	if (formatted)
 		fmt_stat = 'F';
@@ -2165,6 +2878,10 @@ script_prompt(Boolean success)
 	char *s;
 	char timing[64];
 
+	/* Report screen changes before the command's status. */
+	if (feed_id != 0L)
+		feed_report((FILE *)NULL);
+
 	if (sms != SN && sms->accumulated) {
 		(void) sprintf(timing, "%ld.%03ld", sms->msec / 1000L,
 			sms->msec % 1000L);
@@ -2488,6 +3205,8 @@ sms_connect_wait(void)
 void
 sms_host_output(void)
 {
+	sms_feed_changed();
+
 	if (sms != SN) {
 		sms->output_wait_needed = False;
 
@@ -2505,6 +3224,316 @@ sms_host_output(void)
 	}
 }
 
+/*
+ * Screen change feed.
+ *
+ * A script that runs the Subscribe action is sent "event:" lines when the
+ * screen, the cursor, the keyboard lock or the connection state changes, so
+ * it does not have to poll with Wait(Output) and read back the whole screen.
+ * Changes are collected and reported together, from a timeout, or just before
+ * the status line of the next command that completes.
+ */
+
+/*
+ * Send an event to the subscribed scripts, or to just one script.  The event
+ * text is freed.
+ */
+static void
+feed_send(FILE *only, char *line)
+{
+	sms_t *s;
+#if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
+	peer_t *p;
+#endif /*]*/
+
+	if (only != NULL) {
+		(void) fprintf(only, "event: %s\n", line);
+		Free(line);
+		return;
+	}
+	for (s = sms; s != SN; s = s->next)
+		if (s->subscribed)
+			(void) fprintf(s->outfile, "event: %s\n", line);
+#if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
+	for (p = peers; p != NULL; p = p->next)
+		if (p->subscribed)
+			(void) fprintf(p->outfile, "event: %s\n", line);
+#endif /*]*/
+	Free(line);
+}
+
+/* Push out the events sent to the subscribed scripts, or to just one. */
+static void
+feed_sync(FILE *only)
+{
+	sms_t *s;
+#if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
+	peer_t *p;
+#endif /*]*/
+
+	if (only != NULL) {
+		(void) fflush(only);
+		return;
+	}
+	for (s = sms; s != SN; s = s->next)
+		if (s->subscribed)
+			(void) fflush(s->outfile);
+#if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
+	for (p = peers; p != NULL; p = p->next)
+		if (p->subscribed)
+			(void) fflush(p->outfile);
+#endif /*]*/
+}
+
+/*
+ * Report what has changed since the last report to the subscribed scripts,
+ * or everything to one new subscriber.
+ */
+static void
+feed_report(FILE *only)
+{
+	const char *conn;
+	char kb;
+	int row;
+	int start, end;
+	int baddr;
+	Boolean is_zero;
+	char *linebuf = CN;
+	Boolean any = False;
+
+	if (feed_id != 0L) {
+		RemoveTimeOut(feed_id);
+		feed_id = 0L;
+	}
+
+	conn = net_query_connection_state();
+	if (!*conn)
+		conn = "disconnected";
+	if (only != NULL || feed_conn == CN || strcmp(conn, feed_conn)) {
+		feed_send(only, xs_buffer("connection %s", conn));
+		feed_conn = conn;
+		any = True;
+	}
+
+	/* Send the text of each changed span, one row at a time. */
+	for (row = 0; row < ROWS; row++) {
+		if (only != NULL) {
+			start = 0;
+			end = COLS;
+		} else if (!ctlr_span(row, &start, &end))
+			continue;
+#if defined(X3270_DBCS) /*[*/
+		/* Don't split a DBCS character. */
+		baddr = row * COLS;
+		if (start > 0 && IS_RIGHT(ctlr_dbcs_state(baddr + start)))
+			start--;
+		if (end < COLS && IS_LEFT(ctlr_dbcs_state(baddr + end - 1)))
+			end++;
+#endif /*]*/
+		if (linebuf == CN)
+			linebuf = Malloc(mb_max_len(maxCOLS));
+		baddr = (row * COLS) + start;
+		is_zero = FA_IS_ZERO(get_field_attribute(baddr));
+		(void) ebcdic_to_multibyte_row(ea_buf, baddr, end - start,
+		    &is_zero, linebuf);
+		feed_send(only, xs_buffer("change %d %d %d %s", row, start,
+		    end - start, linebuf));
+		any = True;
+	}
+	if (linebuf != CN)
+		Free(linebuf);
+	ctlr_spans_reported();
+
+	if (only != NULL || cursor_addr != feed_cursor) {
+		feed_send(only, xs_buffer("cursor %d %d", cursor_addr / COLS,
+		    cursor_addr % COLS));
+		feed_cursor = cursor_addr;
+		any = True;
+	}
+	kb = kb_state();
+	if (only != NULL || kb != feed_kb) {
+		feed_send(only, xs_buffer("keyboard %c", kb));
+		feed_kb = kb;
+		any = True;
+	}
+
+	if (any)
+		feed_sync(only);
+}
+
+/* Timeout for feed_report. */
+static void
+feed_timeout(void)
+{
+	feed_id = 0L;
+	feed_report((FILE *)NULL);
+}
+
+/*
+ * Something a subscribed script may want to hear about might have changed.
+ * The report is put off until the current burst of activity is over.
+ */
+void
+sms_feed_changed(void)
+{
+	if (feed_count && feed_id == 0L)
+		feed_id = AddTimeOut(1L, feed_timeout);
+}
+
+/* Returns the subscription flag for the script running the current command. */
+static Boolean *
+feed_subscriber(void)
+{
+	if (sms == SN || (sms->type != ST_PEER && sms->type != ST_CHILD))
+		return NULL;
+#if defined(X3270_SCRIPT) && !defined(_WIN32) /*[*/
+	if (sms == peer_sms)
+		return (peer_current != NULL)? &peer_current->subscribed: NULL;
+#endif /*]*/
+	return &sms->subscribed;
+}
+
+/* A subscribed script has unsubscribed or gone away. */
+static void
+feed_drop(void)
+{
+	if (--feed_count > 0)
+		return;
+	ctlr_spans_wanted(False);
+	if (feed_id != 0L) {
+		RemoveTimeOut(feed_id);
+		feed_id = 0L;
+	}
+}
+
+/* Start sending events to the script running the current command. */
+static void
+feed_add(Boolean *subscribed)
+{
+	/* Bring the other subscribers up to date, then start this one off. */
+	if (feed_count)
+		feed_report((FILE *)NULL);
+	feed_report(sms->outfile);
+	*subscribed = True;
+	if (feed_count++ == 0)
+		ctlr_spans_wanted(True);
+}
+
+/* Start sending screen change events to the calling script. */
+void
+Subscribe_action(Widget w _is_unused, XEvent *event _is_unused,
+    String *params _is_unused, Cardinal *num_params)
+{
+	Boolean *subscribed;
+
+	if (check_usage(Subscribe_action, *num_params, 0, 0) < 0)
+		return;
+	if ((subscribed = feed_subscriber()) == NULL) {
+		popup_an_error("%s can only be called from a script",
+		    action_name(Subscribe_action));
+		return;
+	}
+	if (!*subscribed)
+		feed_add(subscribed);
+}
+
+/* Stop sending screen change events to the calling script. */
+void
+Unsubscribe_action(Widget w _is_unused, XEvent *event _is_unused,
+    String *params _is_unused, Cardinal *num_params)
+{
+	Boolean *subscribed;
+
+	if (check_usage(Unsubscribe_action, *num_params, 0, 0) < 0)
+		return;
+	if ((subscribed = feed_subscriber()) == NULL) {
+		popup_an_error("%s can only be called from a script",
+		    action_name(Unsubscribe_action));
+		return;
+	}
+	if (*subscribed) {
+		*subscribed = False;
+		feed_drop();
+	}
+}
+
+#if defined(X3270_SESSIONS) /*[*/
+/*
+ * Make the rest of the commands from a -multisession script connection apply
+ * to a named session.  A session that does not exist yet is made by naming
+ * the connection's own session, or a new one if that already has a name.
+ */
+void
+Session_action(Widget w _is_unused, XEvent *event _is_unused, String *params,
+    Cardinal *num_params)
+{
+	session_t *from = session_current();
+	session_t *to;
+	sms_t *s;
+	Boolean subscribed;
+
+	if (check_usage(Session_action, *num_params, 0, 1) < 0)
+		return;
+	if (*num_params == 0) {
+		if (session_name(from) != CN)
+			action_output("%s", session_name(from));
+		return;
+	}
+	if (!appres.multi_session || sms == SN || sms->type != ST_PEER ||
+	    sms->next != SN) {
+		popup_an_error("%s can only be called from a -multisession "
+		    "script connection", action_name(Session_action));
+		return;
+	}
+	if (!*params[0]) {
+		popup_an_error("%s: Empty name", action_name(Session_action));
+		return;
+	}
+	to = session_find(params[0]);
+	if (to == from)
+		return;
+	if (to == NULL && session_name(from) == CN) {
+		session_set_name(from, params[0]);
+		return;
+	}
+	if (to != NULL && session_in_use(to)) {
+		popup_an_error("%s: Session %s is in use",
+		    action_name(Session_action), params[0]);
+		return;
+	}
+
+	/* Take the script off the old session. */
+	s = sms;
+	subscribed = s->subscribed;
+	if (subscribed) {
+		s->subscribed = False;
+		feed_drop();
+	}
+	script_disable();
+	sms = SN;
+	sms_depth = 0;
+
+	/*
+	 * Finish with the old session, as if the connection had closed.  A
+	 * named one stays connected to its host, for Session() to find again.
+	 */
+	if (PCONNECTED && session_name(from) == CN)
+		host_disconnect(False);
+	session_release(from);
+
+	/* Put it on the new one. */
+	if (to == NULL)
+		session_set_name(session_new(), params[0]);
+	else
+		session_resume(to);
+	sms = s;
+	sms_depth = 1;
+	script_enable();
+	if (subscribed)
+		feed_add(&s->subscribed);
+}
+#endif /*]*/
+
 /* Return whether error pop-ups and acition output should be short-circuited. */
 static sms_t *
 sms_redirect_to(void)
@@ -2539,19 +3568,21 @@ sms_active(void)
 }
 #endif /*]*/
 
-/* Translate an expect string (uses C escape syntax). */
-static void
-expand_expect(char *s)
+/*
+ * Translate an expect string (uses C escape syntax).  Returns the translated
+ * text, which may contain NULs, and its length in *lenp.
+ */
+static char *
+expand_expect(char *s, int *lenp)
 {
 	char *t = Malloc(strlen(s) + 1);
+	char *text = t;
 	char c;
 	enum { XS_BASE, XS_BS, XS_O, XS_X } state = XS_BASE;
 	int n = 0;
 	int nd = 0;
 	static char hexes[] = "0123456789abcdef";
 
-	expect_text = t;
-
 	while ((c = *s++)) {
 		switch (state) {
 		    case XS_BASE:
@@ -2617,47 +3648,200 @@ expand_expect(char *s)
 			break;
 		}
 	}
-	expect_len = t - expect_text;
+	*lenp = t - text;
+	return text;
 }
 
-/* 'mem' version of strstr */
-static char *
-memstr(char *s1, char *s2, int n1, int n2)
+/*
+ * Expect matching.
+ *
+ * The patterns for an Expect are compiled into an Aho-Corasick automaton,
+ * whose state records the longest pattern prefix that the most recent host
+ * data ends with.  The trie keeps only the transitions the patterns spell
+ * out, so it takes space in proportion to their total length; any other
+ * byte follows the failure links back towards the start state, which has a
+ * full table.  Each byte of host data costs a constant amount of work on
+ * average, no matter how much data is buffered or how many patterns there
+ * are.
+ */
+
+/* Free the Expect automaton. */
+static void
+expect_free(void)
 {
-	int i;
+	Replace(expect_nodes, NULL);
+	Replace(expect_root, NULL);
+	expect_state = 0;
+	expect_npatterns = 0;
+}
+
+/* Find the state that byte c leads to from state s. */
+static int
+expect_move(int s, unsigned char c)
+{
+	int t;
 
-	for (i = 0; i <= n1 - n2; i++, s1++)
-		if (*s1 == *s2 && !memcmp(s1, s2, n2))
-			return s1;
-	return CN;
+	for (;;) {
+		if (s == 0)
+			return expect_root[c];
+		for (t = expect_nodes[s].child; t; t = expect_nodes[t].sib)
+			if (expect_nodes[t].c == c)
+				return t;
+		s = expect_nodes[s].fail;
+	}
 }
 
-/* Check for a match against an expect string. */
-static Boolean
+/*
+ * Compile a set of Expect patterns.
+ * Returns 0 for success, -1 (after reporting it) for a pattern that is too
+ * long.
+ */
+static int
+expect_compile(String *patterns, int npatterns)
+{
+	int nstates = 1;
+	int max_states = 1;
+	int *queue;
+	int qh = 0, qt = 0;
+	int i, j, s, t, c;
+	char **text;
+	int *len;
+	expect_node_t *n;
+
+	expect_free();
+	text = (char **)Malloc(npatterns * sizeof(char *));
+	len = (int *)Malloc(npatterns * sizeof(int));
+	for (i = 0; i < npatterns; i++) {
+		text[i] = expand_expect(patterns[i], &len[i]);
+		max_states += len[i];
+	}
+
+	/*
+	 * Text longer than the save buffer could never be found in it, so that
+	 * is the limit.
+	 */
+	for (i = 0; i < npatterns; i++) {
+		if (len[i] > ANSI_SAVE_SIZE) {
+			popup_an_error("%s: Text is longer than %d bytes",
+			    action_name(Expect_action), ANSI_SAVE_SIZE);
+			for (j = 0; j < npatterns; j++)
+				Free(text[j]);
+			Free(text);
+			Free(len);
+			return -1;
+		}
+	}
+
+	expect_nodes = n =
+	    (expect_node_t *)Calloc(max_states, sizeof(expect_node_t));
+	expect_root = (int *)Calloc(256, sizeof(int));
+	queue = (int *)Malloc(max_states * sizeof(int));
+
+	/* Build a trie of the patterns. */
+	for (i = 0; i < npatterns; i++) {
+		s = 0;
+		for (j = 0; j < len[i]; j++) {
+			c = (unsigned char)text[i][j];
+			for (t = n[s].child; t; t = n[t].sib)
+				if (n[t].c == c)
+					break;
+			if (!t) {
+				t = nstates++;
+				n[t].c = c;
+				n[t].sib = n[s].child;
+				n[s].child = t;
+				if (s == 0)
+					expect_root[c] = t;
+			}
+			s = t;
+		}
+		if (!n[s].out)
+			n[s].out = i + 1;
+		Free(text[i]);
+	}
+	Free(text);
+	Free(len);
+
+	/*
+	 * Add the failure links, breadth first.  A state also matches
+	 * whatever its failure state matches; if more than one pattern ends
+	 * at the same place, the one listed first wins.
+	 */
+	for (t = n[0].child; t; t = n[t].sib) {
+		n[t].fail = 0;
+		queue[qt++] = t;
+	}
+	while (qh < qt) {
+		s = queue[qh++];
+		if (n[n[s].fail].out &&
+		    (!n[s].out || n[n[s].fail].out < n[s].out))
+			n[s].out = n[n[s].fail].out;
+		for (t = n[s].child; t; t = n[t].sib) {
+			n[t].fail = expect_move(n[s].fail, n[t].c);
+			queue[qt++] = t;
+		}
+	}
+	Free(queue);
+
+	expect_state = 0;
+	expect_npatterns = npatterns;
+	return 0;
+}
+
+/*
+ * Feed one byte to the Expect automaton.
+ * Returns the number (starting at 1) of the pattern it completes, or 0.
+ */
+static int
+expect_step(unsigned char c)
+{
+	expect_state = expect_move(expect_state, c);
+	return expect_nodes[expect_state].out;
+}
+
+/*
+ * An Expect has matched pattern n.  Tell the script which one, if it gave
+ * more than one.
+ */
+static void
+expect_matched(int n)
+{
+	if (expect_npatterns > 1)
+		action_output("%d", n - 1);
+	expect_free();
+}
+
+/*
+ * Check the buffered host data for a match, discarding everything up to the
+ * end of the match if there is one.
+ */
+static int
 expect_matches(void)
 {
 	int ix, i;
-	unsigned char buf[ANSI_SAVE_SIZE];
-	char *t;
+	int n;
 
+	/* An empty pattern matches right away. */
+	if ((n = expect_nodes[0].out))
+		return n;
 	ix = (ansi_save_ix + ANSI_SAVE_SIZE - ansi_save_cnt) % ANSI_SAVE_SIZE;
 	for (i = 0; i < ansi_save_cnt; i++) {
-		buf[i] = ansi_save_buf[(ix + i) % ANSI_SAVE_SIZE];
+		n = expect_step(ansi_save_buf[(ix + i) % ANSI_SAVE_SIZE]);
+		if (n) {
+			ansi_save_cnt -= i + 1;
+			break;
+		}
 	}
-	t = memstr((char *)buf, expect_text, ansi_save_cnt, expect_len);
-	if (t != CN) {
-		ansi_save_cnt -= ((unsigned char *)t - buf) + expect_len;
-		Free(expect_text);
-		expect_text = CN;
-		return True;
-	} else
-		return False;
+	return n;
 }
 
 /* Store an ANSI character for use by the Ansi action. */
 void
 sms_store(unsigned char c)
 {
+	int n;
+
+	sms_feed_changed();
 	if (sms == SN)
 		return;
 
@@ -2667,10 +3851,17 @@ sms_store(unsigned char c)
 	if (ansi_save_cnt < ANSI_SAVE_SIZE)
 		ansi_save_cnt++;
 
-	/* If a script or macro is waiting to match a string, check now. */
-	if (sms->state == SS_EXPECTING && expect_matches()) {
+	/*
+	 * If a script or macro is waiting to match a string, check now.
+	 * Everything before this byte has already been checked, and a match
+	 * ends here, so there is nothing left to save after it.
+	 */
+	if (sms->state == SS_EXPECTING && (n = expect_step(c))) {
 		RemoveTimeOut(sms->expect_id);
 		sms->expect_id = 0L;
+		ansi_save_cnt = 0;
+		sms->state = SS_RUNNING;	/* so output goes to the script */
+		expect_matched(n);
 		sms->state = SS_INCOMPLETE;
 		sms_continue();
 	}
@@ -2819,8 +4010,7 @@ expect_timed_out(void)
 	if (sms == SN || sms->state != SS_EXPECTING)
 		return;
 
-	Free(expect_text);
-	expect_text = CN;
+	expect_free();
 	popup_an_error("%s: Timed out", action_name(Expect_action));
 	sms->expect_id = 0L;
 	sms->state = SS_INCOMPLETE;
@@ -2851,12 +4041,32 @@ wait_timed_out(void)
 	sms_continue();
 }
 
-/* Wait for a string from the host (ANSI mode only). */
+/*
+ * Returns True if an Expect parameter is a timeout: all digits, optionally
+ * followed by an 's'.
+ */
+static Boolean
+expect_is_timeout(const char *p)
+{
+	const char *d = p;
+
+	while (isdigit((unsigned char)*d))
+		d++;
+	return d > p && (!*d || (*d == 's' && !*(d + 1)));
+}
+
+/*
+ * Wait for one of several strings from the host (ANSI mode only).  With more
+ * than one parameter, the last is the timeout if it looks like one, and a
+ * string to wait for otherwise.
+ */
 void
 Expect_action(Widget w _is_unused, XEvent *event _is_unused, String *params,
     Cardinal *num_params)
 {
 	int tmo;
+	int npatterns;
+	int n;
 
 	/* Verify the environment and parameters. */
 	if (sms == SN || sms->state != SS_RUNNING) {
@@ -2864,29 +4074,36 @@ Expect_action(Widget w _is_unused, XEvent *event _is_unused, String *params,
 		    action_name(Expect_action));
 		return;
 	}
-	if (check_usage(Expect_action, *num_params, 1, 2) < 0)
+	if (*num_params < 1) {
+		popup_an_error("%s requires at least 1 argument",
+		    action_name(Expect_action));
 		return;
+	}
 	if (!IN_ANSI) {
 		popup_an_error("%s is valid only when connected in ANSI mode",
 		    action_name(Expect_action));
 	}
-	if (*num_params == 2) {
-		tmo = atoi(params[1]);
+	npatterns = *num_params;
+	if (npatterns > 1 && expect_is_timeout(params[npatterns - 1])) {
+		npatterns--;
+		tmo = atoi(params[npatterns]);
 		if (tmo < 1 || tmo > 600) {
 			popup_an_error("%s: Invalid timeout: %s",
-			    action_name(Expect_action), params[1]);
+			    action_name(Expect_action), params[npatterns]);
 			return;
 		}
 	} else
 		tmo = 30;
 
 	/* See if the text is there already; if not, wait for it. */
-	expand_expect(params[0]);
-	if (!expect_matches()) {
+	if (expect_compile(params, npatterns) < 0)
+		return;
+	if ((n = expect_matches()))
+		expect_matched(n);
+	else {
 		sms->expect_id = AddTimeOut(tmo * 1000, expect_timed_out);
 		sms->state = SS_EXPECTING;
 	}
-	/* else allow sms to proceed */
 }
 
 
@@ -3131,9 +4348,17 @@ Query_action(Widget w _is_unused, XEvent *event _is_unused, String *params,
 		const char *(*fn)(void);
 	} queries[] = {
 		{ "BindPluName", net_query_bind_plu_name },
+		{ "BufferSizes", net_query_buffer_sizes },
 		{ "ConnectionState", net_query_connection_state },
+#if defined(X3270_FT) /*[*/
+		{ "FileTransfer", ft_query },
+#endif /*]*/
 		{ "Host", net_query_host },
 		{ "LuName", net_query_lu_name },
+#if defined(X3270_SESSIONS) /*[*/
+		{ "Sessions", session_query },
+		{ "Workers", session_query_workers },
+#endif /*]*/
 		{ CN, NULL }
 	};
 	int i;
@@ -3356,6 +4581,7 @@ plugin_start(char *command, char *argv[], Boolean complain)
 		close(inpipe[1]);
 		return;
 	}
+	trace_flush();
 	switch ((plugin_pid = fork())) {
 	case -1:
 		if (complain)
@@ -3616,3 +4842,33 @@ Source_action(Widget w _is_unused, XEvent *event, String *params,
 	}
 	push_file(fd);
 }
+
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+sms_session_vars(void)
+{
+	SESSION_VAR(sms);
+	SESSION_VAR(sms_depth);
+	SESSION_VAR(stdin_id);
+	SESSION_VAR(ansi_save_buf);
+	SESSION_VAR(ansi_save_cnt);
+	SESSION_VAR(ansi_save_ix);
+	SESSION_VAR(expect_nodes);
+	SESSION_VAR(expect_root);
+	SESSION_VAR(expect_state);
+	SESSION_VAR(expect_npatterns);
+	SESSION_VAR(feed_count);
+	SESSION_VAR(feed_id);
+	SESSION_VAR(feed_conn);
+	SESSION_VAR(feed_cursor);
+	SESSION_VAR(feed_kb);
+	SESSION_VAR(snap_status);
+	SESSION_VAR(snap_buf);
+	SESSION_VAR(snap_rows);
+	SESSION_VAR(snap_cols);
+	SESSION_VAR(snap_field_start);
+	SESSION_VAR(snap_field_length);
+	SESSION_VAR(snap_caddr);
+}
+#endif /*]*/
@@ -100,6 +100,10 @@ extern void ReadBuffer_action(Widget w, XEvent *event, String *params,
     Cardinal *num_params);
 extern void Script_action(Widget w, XEvent *event, String *params,
     Cardinal *num_params);
+#if defined(X3270_SESSIONS) /*[*/
+extern void Session_action(Widget w, XEvent *event, String *params,
+    Cardinal *num_params);
+#endif /*]*/
 #if defined(X3270_SCRIPT) /*[*/
 extern void sms_accumulate_time(struct timeval *, struct timeval *);
 #else /*][*/
@@ -109,11 +113,15 @@ extern Boolean sms_active(void);
 extern void sms_connect_wait(void);
 extern void sms_continue(void);
 extern void sms_error(const char *msg);
+extern void sms_feed_changed(void);
 extern void sms_host_output(void);
 extern void sms_info(const char *fmt, ...) printflike(1, 2);
 extern void sms_init(void);
 extern Boolean sms_in_macro(void);
 extern Boolean sms_redirect(void);
+#if defined(X3270_SESSIONS) /*[*/
+extern void sms_session_vars(void);
+#endif /*]*/
 extern void sms_store(unsigned char c);
 #if defined(X3270_SCRIPT) || defined(TCL3270) || defined(S3270) /*[*/
 extern void Snap_action(Widget w, XEvent *event, String *params,
@@ -125,5 +133,9 @@ extern void Status_action(Widget w, XEvent *event, String *params,
 #endif /*]*/
 extern void Source_action(Widget w, XEvent *event, String *params,
     Cardinal *num_params);
+extern void Subscribe_action(Widget w, XEvent *event, String *params,
+    Cardinal *num_params);
+extern void Unsubscribe_action(Widget w, XEvent *event, String *params,
+    Cardinal *num_params);
 extern void Wait_action(Widget w, XEvent *event, String *params,
     Cardinal *num_params);
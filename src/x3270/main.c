@@ -145,10 +145,13 @@ XrmOptionDescRec options[]= {
 	{ OptScrollBar,	DotScrollBar,	XrmoptionNoArg,		ResTrue },
 	{ OptSet,	".xxx",		XrmoptionSkipArg,	NULL },
 #if defined(X3270_SCRIPT) /*[*/
+	{ OptScriptPort,DotScriptPort,	XrmoptionSepArg,	NULL },
 	{ OptSocket,	DotSocket,	XrmoptionNoArg,		ResTrue },
+	{ OptSocketPath,DotSocketPath,	XrmoptionSepArg,	NULL },
 #endif /*]*/
 	{ OptTermName,	DotTermName,	XrmoptionSepArg,	NULL },
 #if defined(X3270_TRACE) /*[*/
+	{ OptTraceBinary,DotTraceBinary,XrmoptionNoArg,		ResTrue },
 	{ OptTraceFile,	DotTraceFile,	XrmoptionSepArg,	NULL },
 	{ OptTraceFileSize,DotTraceFileSize,XrmoptionSepArg,	NULL },
 #endif /*]*/
@@ -327,6 +327,7 @@ printer_start(const char *lu)
 
 	/* Fork and exec the printer session. */
 	trace_dsn("Printer command line: %s\n", cmd_text);
+	trace_flush();
 	switch (printer_pid = fork()) {
 	    case 0:	/* child process */
 		(void) dup2(stdout_pipe[1], 1);
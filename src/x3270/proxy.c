@@ -45,6 +45,7 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <errno.h>
 #if defined(HAVE_SYS_SELECT_H) /*[*/
 #include <sys/select.h>		/* fd_set declaration */
 #endif /*]*/
@@ -115,13 +116,70 @@ char *type_name[] = {
 #define PROXY_SOCKS5D	"socks5d"
 #define PORT_SOCKS5D	"1080"
 
+#define PROXY_STEP_SECS	15	/* time allowed for each exchange */
+#define PROXY_RBUF	1024	/* longest reply */
+
+/* Internal return from a protocol handler: more to do. */
+#define PX_MORE		3
+
+#if defined(_WIN32) /*[*/
+#define socket_errno()	WSAGetLastError()
+#define SE_EWOULDBLOCK	WSAEWOULDBLOCK
+#define SE_EINTR	WSAEINTR
+#else /*][*/
+#define socket_errno()	errno
+#define SE_EWOULDBLOCK	EWOULDBLOCK
+#define SE_EINTR	EINTR
+#endif /*]*/
+
+/* Never wait in send() or recv(), if the system allows it. */
+#if defined(MSG_DONTWAIT) /*[*/
+#define PX_FLAGS	MSG_DONTWAIT
+#else /*][*/
+#define PX_FLAGS	0
+#endif /*]*/
+
+/*
+ * Negotiation state.
+ *
+ * Each protocol is a handler that is called once to start, and again each
+ * time the data it queued has been sent and the reply it asked for has
+ * arrived.  'phase' says how far it has got.
+ */
+struct proxy_state {
+	int fd;				/* socket */
+	char *host;			/* target host */
+	unsigned short port;		/* target port */
+	const char *name;		/* protocol name, for messages */
+	int (*proto)(proxy_state_t *);	/* protocol handler */
+	int phase;			/* step within the protocol */
+	int force;			/* force 4A or domain name */
+	char *obuf;			/* request being sent */
+	size_t olen;			/* its length */
+	size_t osent;			/* how much has been sent */
+	unsigned char rbuf[PROXY_RBUF];	/* reply */
+	size_t nread;			/* bytes in rbuf */
+	size_t need;			/* bytes wanted in rbuf */
+	Boolean line;			/* reading a line, not 'need' bytes */
+	time_t deadline;		/* when the current exchange times out */
+	union {				/* SOCKS target address */
+	    	struct sockaddr sa;
+		struct sockaddr_in sin;
+#if defined(AF_INET6) /*[*/
+		struct sockaddr_in6 sin6;
+#endif /*]*/
+	} ha;
+	socklen_t ha_len;		/* its length, 0 if unknown */
+	Boolean use_name;		/* SOCKS5: send the name */
+};
+
 static int parse_host_port(char *s, char **phost, char **pport);
 
-static int proxy_passthru(int fd, char *host, unsigned short port);
-static int proxy_http(int fd, char *host, unsigned short port);
-static int proxy_telnet(int fd, char *host, unsigned short port);
-static int proxy_socks4(int fd, char *host, unsigned short port, int force_a);
-static int proxy_socks5(int fd, char *host, unsigned short port, int force_d);
+static int proxy_passthru(proxy_state_t *ps);
+static int proxy_http(proxy_state_t *ps);
+static int proxy_telnet(proxy_state_t *ps);
+static int proxy_socks4(proxy_state_t *ps);
+static int proxy_socks5(proxy_state_t *ps);
 
 
 char *
@@ -285,237 +343,419 @@ parse_host_port(char *s, char **phost, char **pport)
 }
 
 /*
- * Negotiate with the proxy server.
- * Returns -1 for failure, 0 for success.
+ * Start negotiating with the proxy server.
+ * Nothing is sent until the first call to proxy_continue().
+ * Returns NULL for failure.
  */
-int
-proxy_negotiate(int type, int fd, char *host, unsigned short port)
+proxy_state_t *
+proxy_start(int type, int fd, char *host, unsigned short port)
 {
+	proxy_state_t *ps;
+
+	ps = (proxy_state_t *)Calloc(1, sizeof(proxy_state_t));
 	switch (type) {
-	case PT_NONE:
-	    	return 0;
 	case PT_PASSTHRU:
-		return proxy_passthru(fd, host, port);
+		ps->name = "Passthru";
+		ps->proto = proxy_passthru;
+		break;
 	case PT_HTTP:
-		return proxy_http(fd, host, port);
+		ps->name = "HTTP";
+		ps->proto = proxy_http;
+		break;
 	case PT_TELNET:
-		return proxy_telnet(fd, host, port);
-	case PT_SOCKS4:
-		return proxy_socks4(fd, host, port, 0);
+		ps->name = "TELNET";
+		ps->proto = proxy_telnet;
+		break;
 	case PT_SOCKS4A:
-		return proxy_socks4(fd, host, port, 1);
-	case PT_SOCKS5:
-		return proxy_socks5(fd, host, port, 0);
+		ps->force = 1;
+		/* fall through... */
+	case PT_SOCKS4:
+		ps->name = "SOCKS4";
+		ps->proto = proxy_socks4;
+		break;
 	case PT_SOCKS5D:
-		return proxy_socks5(fd, host, port, 1);
+		ps->force = 1;
+		/* fall through... */
+	case PT_SOCKS5:
+		ps->name = "SOCKS5";
+		ps->proto = proxy_socks5;
+		break;
 	default:
-		return -1;
+		Free(ps);
+		return NULL;
 	}
+	ps->fd = fd;
+	ps->host = NewString(host);
+	ps->port = port;
+	ps->deadline = time(NULL) + PROXY_STEP_SECS;
+	return ps;
 }
 
-/* Sun PASSTHRU proxy. */
-static int
-proxy_passthru(int fd, char *host, unsigned short port)
+/*
+ * Whether the target host's address should be looked up and passed to
+ * proxy_set_addr() before the first call to proxy_continue().  Only plain
+ * SOCKS4 and SOCKS5 send an address; without one, they send the name.
+ */
+Boolean
+proxy_wants_addr(proxy_state_t *ps)
 {
-	char *buf;
+	return !ps->force &&
+	    (ps->proto == proxy_socks4 || ps->proto == proxy_socks5);
+}
 
-	buf = Malloc(strlen(host) + 32);
-	(void) sprintf(buf, "%s %u\r\n", host, port);
+/*
+ * Supply an address for the target host.  May be called for each address
+ * found, or with a NULL 'sa' if there are none; the first one the protocol
+ * can use is kept.  The time allowed for the first exchange starts again.
+ */
+void
+proxy_set_addr(proxy_state_t *ps, struct sockaddr *sa, socklen_t len)
+{
+	ps->deadline = time(NULL) + PROXY_STEP_SECS;
+	if (sa == NULL || ps->ha_len || len > sizeof(ps->ha))
+	    	return;
+	if (ps->proto == proxy_socks4 && sa->sa_family != AF_INET)
+	    	return;
+	(void) memcpy(&ps->ha, sa, len);
+	ps->ha_len = len;
+}
 
+/*
+ * Look up the target host's address for proxy_set_addr(), waiting for the
+ * answer.  For callers that cannot look it up in the background.
+ */
+void
+proxy_resolve(proxy_state_t *ps)
+{
+	rhaddrs_t r;
+	char portname[16];
+	char errmsg[1024];
+	int i;
+
+	if (!proxy_wants_addr(ps))
+	    	return;
+	(void) snprintf(portname, sizeof(portname), "%u", ps->port);
+	if (!resolve_cache_lookup(ps->host, portname, &r) &&
+		resolve_host_and_port_all(ps->host, portname, &r, errmsg,
+		    sizeof(errmsg)) < 0) {
 #if defined(X3270_TRACE) /*[*/
-	trace_dsn("Passthru Proxy: xmit '%.*s'", (int)(strlen(buf) - 2), buf);
-	trace_netdata('>', (unsigned char *)buf, strlen(buf));
+		trace_dsn("%s Proxy: %s, sending the name\n", ps->name,
+			errmsg);
 #endif /*]*/
-
-	if (send(fd, buf, strlen(buf), 0) < 0) {
-	    	popup_a_sockerr("Passthru Proxy: send error");
-		Free(buf);
-		return -1;
+		r.n = 0;
 	}
-	Free(buf);
+	for (i = 0; i < r.n; i++)
+	    	proxy_set_addr(ps, &r.addr[i].sa, r.len[i]);
+	proxy_set_addr(ps, NULL, 0);
+}
 
-    	return 0;
+/* Give up on a negotiation. */
+void
+proxy_abort(proxy_state_t *ps)
+{
+	if (ps == NULL)
+		return;
+	Free(ps->obuf);
+	Free(ps->host);
+	Free(ps);
 }
 
-/* HTTP (RFC 2817 CONNECT tunnel) proxy. */
-static int
-proxy_http(int fd, char *host, unsigned short port)
+/*
+ * How long proxy_continue() can be left waiting before the current exchange
+ * times out, in milliseconds.
+ */
+unsigned long
+proxy_timeout_ms(proxy_state_t *ps)
 {
-    	char *buf;
-	char *colon;
-	char rbuf[1024];
-	int nr;
-	int nread = 0;
-	char *space;
+	time_t now = time(NULL);
 
-	/* Send the CONNECT request. */
-	buf = Malloc(64 + strlen(host));
-	colon = strchr(host, ':');
-	sprintf(buf, "CONNECT %s%s%s:%u HTTP/1.1\r\n",
-		(colon? "[": ""),
-		host,
-		(colon? "]": ""),
-		port);
+	if (now >= ps->deadline)
+	    	return 0L;
+	return (unsigned long)(ps->deadline - now) * 1000L;
+}
+
+/* Queue a request to send.  'buf' is taken over. */
+static void
+px_send(proxy_state_t *ps, char *buf, size_t len)
+{
+	Free(ps->obuf);
+	ps->obuf = buf;
+	ps->olen = len;
+	ps->osent = 0;
+	ps->nread = 0;
+}
 
+/* Trace the part of a reply that has arrived. */
+static void
+px_trace_partial(proxy_state_t *ps)
+{
 #if defined(X3270_TRACE) /*[*/
-	trace_dsn("HTTP Proxy: xmit '%.*s'\n", (int)(strlen(buf) - 2), buf);
-	trace_netdata('>', (unsigned char *)buf, strlen(buf));
+	if (ps->nread)
+		trace_netdata('<', ps->rbuf, ps->nread);
 #endif /*]*/
+}
 
-	if (send(fd, buf, strlen(buf), 0) < 0) {
-	    	popup_a_sockerr("HTTP Proxy: send error");
-		Free(buf);
-		return -1;
+/*
+ * Move the negotiation along as far as it can go without blocking.
+ * Called at first, when the socket is ready, and when the time from
+ * proxy_timeout_ms() has passed.
+ *
+ * Returns PX_SUCCESS when the tunnel is open, PX_FAILURE (after reporting
+ * the error) if it cannot be, or PX_WANTREAD or PX_WANTWRITE if the socket
+ * needs to be readable or writable before going on.  'ps' is freed when
+ * PX_SUCCESS or PX_FAILURE is returned.
+ */
+int
+proxy_continue(proxy_state_t *ps)
+{
+	int nw, nr, rv;
+
+	if (time(NULL) >= ps->deadline) {
+	    	popup_an_error("%s Proxy: server timeout", ps->name);
+		px_trace_partial(ps);
+		goto fail;
 	}
 
-	sprintf(buf, "Host: %s%s%s:%u\r\n",
-		(colon? "[": ""),
-		host,
-		(colon? "]": ""),
-		port);
+	for (;;) {
+		/* Send the request. */
+		while (ps->osent < ps->olen) {
+			nw = send(ps->fd, ps->obuf + ps->osent,
+				ps->olen - ps->osent, PX_FLAGS);
+			if (nw < 0) {
+				if (socket_errno() == SE_EWOULDBLOCK)
+				    	return PX_WANTWRITE;
+				if (socket_errno() == SE_EINTR)
+				    	continue;
+				popup_a_sockerr("%s Proxy: send error",
+					ps->name);
+				goto fail;
+			}
+			ps->osent += nw;
+		}
 
-#if defined(X3270_TRACE) /*[*/
-	trace_dsn("HTTP Proxy: xmit '%.*s'\n", (int)(strlen(buf) - 2), buf);
-	trace_netdata('>', (unsigned char *)buf, strlen(buf));
-#endif /*]*/
+		/* Collect the reply. */
+		while (ps->line || ps->nread < ps->need) {
+			nr = recv(ps->fd, (char *)&ps->rbuf[ps->nread],
+				ps->line? 1: ps->need - ps->nread, PX_FLAGS);
+			if (nr < 0) {
+				if (socket_errno() == SE_EWOULDBLOCK)
+				    	return PX_WANTREAD;
+				if (socket_errno() == SE_EINTR)
+				    	continue;
+				popup_a_sockerr("%s Proxy: receive error",
+					ps->name);
+				px_trace_partial(ps);
+				goto fail;
+			}
+			if (nr == 0) {
+				px_trace_partial(ps);
+				popup_an_error("%s Proxy: unexpected EOF",
+					ps->name);
+				goto fail;
+			}
+			if (!ps->line) {
+			    	ps->nread += nr;
+				continue;
+			}
 
-	if (send(fd, buf, strlen(buf), 0) < 0) {
-	    	popup_a_sockerr("HTTP Proxy: send error");
-		Free(buf);
-		return -1;
+			/* Read a line a byte at a time, up to \n. */
+			if (ps->rbuf[ps->nread] == '\r')
+			    	continue;
+			if (ps->rbuf[ps->nread] == '\n' ||
+				++ps->nread >= sizeof(ps->rbuf) - 1) {
+			    	ps->rbuf[ps->nread] = '\0';
+				ps->line = False;
+			}
+		}
+
+		/* On to the next step. */
+		switch (rv = (*ps->proto)(ps)) {
+		case PX_SUCCESS:
+			proxy_abort(ps);
+			return rv;
+		case PX_FAILURE:
+			goto fail;
+		default:
+			ps->deadline = time(NULL) + PROXY_STEP_SECS;
+			break;
+		}
 	}
 
-	strcpy(buf, "\r\n");
+    fail:
+	proxy_abort(ps);
+	return PX_FAILURE;
+}
+
+/*
+ * Negotiate with the proxy server, waiting for each step.
+ * Returns -1 for failure, 0 for success.
+ */
+int
+proxy_negotiate(int type, int fd, char *host, unsigned short port)
+{
+	proxy_state_t *ps;
+	int rv;
+
+	if (type == PT_NONE)
+	    	return 0;
+	if ((ps = proxy_start(type, fd, host, port)) == NULL)
+	    	return -1;
+	proxy_resolve(ps);
+	while ((rv = proxy_continue(ps)) == PX_WANTREAD ||
+		rv == PX_WANTWRITE) {
+	    	fd_set fds;
+		struct timeval tv;
+		unsigned long ms = proxy_timeout_ms(ps);
+
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		tv.tv_sec = ms / 1000L;
+		tv.tv_usec = (ms % 1000L) * 1000L;
+		(void) select(fd + 1,
+			(rv == PX_WANTREAD)? &fds: NULL,
+			(rv == PX_WANTWRITE)? &fds: NULL,
+			NULL, &tv);
+	}
+	return (rv == PX_SUCCESS)? 0: -1;
+}
+
+/* Sun PASSTHRU proxy. */
+static int
+proxy_passthru(proxy_state_t *ps)
+{
+	char *buf;
+
+	if (ps->phase++)
+	    	return PX_SUCCESS;
+
+	buf = Malloc(strlen(ps->host) + 32);
+	(void) sprintf(buf, "%s %u\r\n", ps->host, ps->port);
+
 #if defined(X3270_TRACE) /*[*/
-	trace_dsn("HTTP Proxy: xmit ''\n");
+	trace_dsn("Passthru Proxy: xmit '%.*s'", (int)(strlen(buf) - 2), buf);
 	trace_netdata('>', (unsigned char *)buf, strlen(buf));
 #endif /*]*/
 
-	if (send(fd, buf, strlen(buf), 0) < 0) {
-	    	popup_a_sockerr("HTTP Proxy: send error");
-		Free(buf);
-		return -1;
-	}
-	Free(buf);
+	px_send(ps, buf, strlen(buf));
+	return PX_MORE;
+}
 
-	/*
-	 * Process the reply.
-	 * Read a byte at a time until \n or EOF.
-	 */
-	for (;;) {
-	    	fd_set rfds;
-		struct timeval tv;
+/* HTTP (RFC 2817 CONNECT tunnel) proxy. */
+static int
+proxy_http(proxy_state_t *ps)
+{
+    	char *buf;
+	char *s;
+	char *hdr;
+	char *colon;
+	char *space;
+	char *rbuf = (char *)ps->rbuf;
 
-		FD_ZERO(&rfds);
-		FD_SET(fd, &rfds);
-		tv.tv_sec = 15;
-		tv.tv_usec = 0;
-		if (select(fd + 1, &rfds, NULL, NULL, &tv) < 0) {
-		    	popup_an_error("HTTP Proxy: server timeout");
+	if (ps->phase++ == 0) {
+		/* Send the CONNECT request, a Host header and a blank line. */
+		buf = Malloc(128 + 2 * strlen(ps->host));
+		colon = strchr(ps->host, ':');
+		s = buf;
+		s += sprintf(s, "CONNECT %s%s%s:%u HTTP/1.1\r\n",
+			(colon? "[": ""),
+			ps->host,
+			(colon? "]": ""),
+			ps->port);
 #if defined(X3270_TRACE) /*[*/
-		    	if (nread)
-				trace_netdata('<', (unsigned char *)rbuf, nread);
+		trace_dsn("HTTP Proxy: xmit '%.*s'\n", (int)(s - buf - 2),
+			buf);
 #endif /*]*/
-			return -1;
-		}
-
-	    	nr = recv(fd, &rbuf[nread], 1, 0);
-		if (nr < 0) {
-			popup_a_sockerr("HTTP Proxy: receive error");
+		hdr = s;
+		s += sprintf(s, "Host: %s%s%s:%u\r\n",
+			(colon? "[": ""),
+			ps->host,
+			(colon? "]": ""),
+			ps->port);
 #if defined(X3270_TRACE) /*[*/
-		    	if (nread)
-				trace_netdata('<', (unsigned char *)rbuf, nread);
+		trace_dsn("HTTP Proxy: xmit '%.*s'\n", (int)(s - hdr - 2), hdr);
+		trace_dsn("HTTP Proxy: xmit ''\n");
 #endif /*]*/
-			return -1;
-		}
-		if (nr == 0) {
+		s += sprintf(s, "\r\n");
 #if defined(X3270_TRACE) /*[*/
-		    	if (nread)
-				trace_netdata('<', (unsigned char *)rbuf, nread);
+		trace_netdata('>', (unsigned char *)buf, s - buf);
 #endif /*]*/
-			popup_an_error("HTTP Proxy: unexpected EOF");
-			return -1;
-		}
-		if (rbuf[nread] == '\r')
-		    	continue;
-		if (rbuf[nread] == '\n')
-		    	break;
-		if ((size_t)++nread >= sizeof(rbuf)) {
-			nread = sizeof(rbuf) - 1;
-		    	break;
-		}
+
+		px_send(ps, buf, s - buf);
+		ps->line = True;
+		return PX_MORE;
 	}
-	rbuf[nread] = '\0';
 
+	/* Process the reply. */
 #if defined(X3270_TRACE) /*[*/
-	trace_netdata('<', (unsigned char *)rbuf, nread);
+	trace_netdata('<', ps->rbuf, ps->nread);
 	trace_dsn("HTTP Proxy: recv '%s'\n", rbuf);
 #endif /*]*/
 
+	if (ps->phase > 2) {
+		/* Skip header lines, up to the blank one. */
+		if (!*rbuf)
+		    	return PX_SUCCESS;
+		ps->nread = 0;
+		ps->line = True;
+		return PX_MORE;
+	}
+
 	if (strncmp(rbuf, "HTTP/", 5) || (space = strchr(rbuf, ' ')) == CN) {
 	    	popup_an_error("HTTP Proxy: unrecognized reply");
-		return -1;
+		return PX_FAILURE;
 	}
 	if (*(space + 1) != '2') {
 	    	popup_an_error("HTTP Proxy: CONNECT failed:\n%s", rbuf);
-		return -1;
+		return PX_FAILURE;
 	}
 
-    	return 0;
+	/* Read the headers that follow. */
+	ps->nread = 0;
+	ps->line = True;
+    	return PX_MORE;
 }
 
 /* TELNET proxy. */
 static int
-proxy_telnet(int fd, char *host, unsigned short port)
+proxy_telnet(proxy_state_t *ps)
 {
 	char *buf;
 
-	buf = Malloc(strlen(host) + 32);
-	(void) sprintf(buf, "connect %s %u\r\n", host, port);
+	if (ps->phase++)
+	    	return PX_SUCCESS;
+
+	buf = Malloc(strlen(ps->host) + 32);
+	(void) sprintf(buf, "connect %s %u\r\n", ps->host, ps->port);
 
 #if defined(X3270_TRACE) /*[*/
 	trace_dsn("TELNET Proxy: xmit '%.*s'", (int)(strlen(buf) - 2), buf);
 	trace_netdata('>', (unsigned char *)buf, strlen(buf));
 #endif /*]*/
 
-	if (send(fd, buf, strlen(buf), 0) < 0) {
-	    	popup_a_sockerr("TELNET Proxy: send error");
-		Free(buf);
-		return -1;
-	}
-	Free(buf);
-
-    	return 0;
+	px_send(ps, buf, strlen(buf));
+	return PX_MORE;
 }
 
 /* SOCKS version 4 proxy. */
 static int
-proxy_socks4(int fd, char *host, unsigned short port, int force_a)
+proxy_socks4(proxy_state_t *ps)
 {
-    	struct hostent *hp;
-	struct in_addr ipaddr;
-	int use_4a = 0;
 	char *user;
     	char *buf;
 	char *s;
-	char rbuf[8];
-	int nr;
-	int nread = 0;
+	unsigned char *rbuf = ps->rbuf;
+	char *host = ps->host;
+	unsigned short port = ps->port;
+#if defined(X3270_TRACE) /*[*/
 	unsigned short rport;
+#endif /*]*/
 
-	/* Resolve the hostname to an IPv4 address. */
-	if (force_a)
-	    	use_4a = 1;
-	else {
-		hp = gethostbyname(host);
-		if (hp != NULL) {
-			memcpy(&ipaddr, hp->h_addr, hp->h_length);
-		} else {
-			ipaddr.s_addr = inet_addr(host);
-			if (ipaddr.s_addr == (in_addr_t)-1)
-				use_4a = 1;
-		}
-	}
+	if (ps->phase++)
+	    	goto reply;
+
+	/* Use the IPv4 address, or send the name (4A) if there is none. */
+	if (!ps->ha_len)
+	    	ps->force = 1;
 
 	/* Resolve the username. */
 	user = getenv("USER");
@@ -523,7 +763,7 @@ proxy_socks4(int fd, char *host, unsigned short port, int force_a)
 	    	user = "nobody";
 
 	/* Send the request to the server. */
-	if (use_4a) {
+	if (ps->force) {
 	    	buf = Malloc(32 + strlen(user) + strlen(host));
 		s = buf;
 		*s++ = 0x04;
@@ -541,13 +781,6 @@ proxy_socks4(int fd, char *host, unsigned short port, int force_a)
 			port, user, host);
 		trace_netdata('>', (unsigned char *)buf, s - buf);
 #endif /*]*/
-
-		if (send(fd, buf, s - buf, 0) < 0) {
-		    	popup_a_sockerr("SOCKS4 Proxy: send error");
-			Free(buf);
-			return -1;
-		}
-		Free(buf);
 	} else {
 	    	unsigned long u;
 
@@ -556,7 +789,7 @@ proxy_socks4(int fd, char *host, unsigned short port, int force_a)
 		*s++ = 0x04;
 		*s++ = 0x01;
 		SET16(s, port);
-		u = ntohl(ipaddr.s_addr);
+		u = ntohl(ps->ha.sin.sin_addr.s_addr);
 		SET32(s, u);
 		strcpy(s, user);
 		s += strlen(user) + 1;
@@ -564,49 +797,20 @@ proxy_socks4(int fd, char *host, unsigned short port, int force_a)
 #if defined(X3270_TRACE) /*[*/
 		trace_dsn("SOCKS4 Proxy: xmit version 4 connect port %u "
 			"address %s user '%s'\n",
-			port, inet_ntoa(ipaddr), user);
+			port, inet_ntoa(ps->ha.sin.sin_addr), user);
 		trace_netdata('>', (unsigned char *)buf, s - buf);
 #endif /*]*/
-
-		if (send(fd, buf, s - buf, 0) < 0) {
-			Free(buf);
-		    	popup_a_sockerr("SOCKS4 Proxy: send error");
-			return -1;
-		}
-		Free(buf);
 	}
+	px_send(ps, buf, s - buf);
 
-	/*
-	 * Process the reply.
-	 * Read 8 bytes of response.
-	 */
-	for (;;) {
-	    	fd_set rfds;
-		struct timeval tv;
-
-		FD_ZERO(&rfds);
-		FD_SET(fd, &rfds);
-		tv.tv_sec = 15;
-		tv.tv_usec = 0;
-		if (select(fd + 1, &rfds, NULL, NULL, &tv) < 0) {
-		    	popup_an_error("SOCKS4 Proxy: server timeout");
-			return -1;
-		}
-
-	    	nr = recv(fd, &rbuf[nread], 1, 0);
-		if (nr < 0) {
-			popup_a_sockerr("SOCKS4 Proxy: receive error");
-			return -1;
-		}
-		if (nr == 0)
-		    	break;
-		if ((size_t)++nread >= sizeof(rbuf))
-		    	break;
-	}
+	/* Read 8 bytes of response. */
+	ps->need = 8;
+	return PX_MORE;
 
+    reply:
 #if defined(X3270_TRACE) /*[*/
-	trace_netdata('<', (unsigned char *)rbuf, nread);
-	if (use_4a) {
+	trace_netdata('<', rbuf, ps->nread);
+	if (ps->force) {
 	    	struct in_addr a;
 
 	    	rport = (rbuf[2] << 8) | rbuf[3];
@@ -625,43 +829,32 @@ proxy_socks4(int fd, char *host, unsigned short port, int force_a)
 	    	break;
 	case 0x5b:
 		popup_an_error("SOCKS4 Proxy: request rejected or failed");
-		return -1;
+		return PX_FAILURE;
 	case 0x5c:
 		popup_an_error("SOCKS4 Proxy: client is not reachable");
-		return -1;
+		return PX_FAILURE;
 	case 0x5d:
 		popup_an_error("SOCKS4 Proxy: userid error");
-		return -1;
+		return PX_FAILURE;
 	default:
 		popup_an_error("SOCKS4 Proxy: unknown status 0x%02x",
 			rbuf[1]);
-		return -1;
+		return PX_FAILURE;
 	}
 
-    	return 0;
+    	return PX_SUCCESS;
 }
 
 /* SOCKS version 5 (RFC 1928) proxy. */
 static int
-proxy_socks5(int fd, char *host, unsigned short port, int force_d)
+proxy_socks5(proxy_state_t *ps)
 {
-	union {
-	    	struct sockaddr sa;
-		struct sockaddr_in sin;
-#if defined(AF_INET6) /*[*/
-		struct sockaddr_in6 sin6;
-#endif /*]*/
-	} ha;
-	socklen_t ha_len = 0;
-	int use_name = 0;
     	char *buf;
 	char *s;
-	unsigned char rbuf[8];
-	int nr;
-	int nread = 0;
-	int n2read = 0;
+	unsigned char *rbuf = ps->rbuf;
+	char *host = ps->host;
+	unsigned short port = ps->port;
 	char nbuf[256];
-	int done = 0;
 #if defined(X3270_TRACE) /*[*/
 	char *atype_name[] = {
 	    "",
@@ -671,88 +864,46 @@ proxy_socks5(int fd, char *host, unsigned short port, int force_d)
 	    "IPv6"
 	};
 	unsigned char *portp;
-	unsigned short rport;
 #endif /*]*/
+	unsigned short rport;
 
-	if (force_d)
-	    	use_name = 1;
-	else {
-	    	char errmsg[1024];
-		int rv;
-
-		/* Resolve the hostname. */
-		rv = resolve_host_and_port(host, CN, &rport, &ha.sa, &ha_len,
-			errmsg, sizeof(errmsg));
-		if (rv == -2)
-		    	use_name = 1;
-		else if (rv < 0) {
-			popup_an_error("SOCKS5 proxy: %s/%u: %s", host, port,
-				errmsg);
-			return -1;
-		}
+	switch (ps->phase++) {
+	case 0:
+		break;
+	case 1:
+		goto auth_reply;
+	case 2:
+		goto reply_status;
+	case 3:
+		goto reply_type;
+	default:
+		goto reply_done;
 	}
 
+	/* Send the address, or the name if there is none. */
+	if (ps->force || !ps->ha_len)
+	    	ps->use_name = True;
+
 	/* Send the authentication request to the server. */
-	strcpy((char *)rbuf, "\005\001\000");
+	buf = NewString("\005\001\000");
 #if defined(X3270_TRACE) /*[*/
 	trace_dsn("SOCKS5 Proxy: xmit version 5 nmethods 1 (no auth)\n");
-	trace_netdata('>', rbuf, 3);
+	trace_netdata('>', (unsigned char *)buf, 3);
 #endif /*]*/
-	if (send(fd, rbuf, 3, 0) < 0) {
-		popup_a_sockerr("SOCKS5 Proxy: send error");
-		return -1;
-	}
+	px_send(ps, buf, 3);
 
-	/*
-	 * Wait for the server reply.
-	 * Read 2 bytes of response.
-	 */
-	nread = 0;
-	for (;;) {
-	    	fd_set rfds;
-		struct timeval tv;
+	/* Wait for the server reply: 2 bytes. */
+	ps->need = 2;
+	return PX_MORE;
 
-		FD_ZERO(&rfds);
-		FD_SET(fd, &rfds);
-		tv.tv_sec = 15;
-		tv.tv_usec = 0;
-		if (select(fd + 1, &rfds, NULL, NULL, &tv) < 0) {
-		    	popup_an_error("SOCKS5 Proxy: server timeout");
+    auth_reply:
 #if defined(X3270_TRACE) /*[*/
-		    	if (nread)
-				trace_netdata('<', rbuf, nread);
-#endif /*]*/
-			return -1;
-		}
-
-	    	nr = recv(fd, &rbuf[nread], 1, 0);
-		if (nr < 0) {
-			popup_a_sockerr("SOCKS5 Proxy: receive error");
-#if defined(X3270_TRACE) /*[*/
-		    	if (nread)
-				trace_netdata('<', rbuf, nread);
-#endif /*]*/
-			return -1;
-		}
-		if (nr == 0) {
-			popup_a_sockerr("SOCKS5 Proxy: unexpected EOF");
-#if defined(X3270_TRACE) /*[*/
-		    	if (nread)
-				trace_netdata('<', rbuf, nread);
-#endif /*]*/
-			return -1;
-		}
-		if (++nread >= 2)
-		    	break;
-	}
-
-#if defined(X3270_TRACE) /*[*/
-	trace_netdata('<', rbuf, nread);
+	trace_netdata('<', rbuf, ps->nread);
 #endif /*]*/
 
 	if (rbuf[0] != 0x05 || (rbuf[1] != 0 && rbuf[1] != 0xff)) {
 	    	popup_an_error("SOCKS5 Proxy: bad authentication response");
-		return -1;
+		return PX_FAILURE;
 	}
 
 #if defined(X3270_TRACE) /*[*/
@@ -762,7 +913,7 @@ proxy_socks5(int fd, char *host, unsigned short port, int force_d)
 
 	if (rbuf[1] == 0xff) {
 	    	popup_an_error("SOCKS5 Proxy: authentication failure");
-		return -1;
+		return PX_FAILURE;
 	}
 
 	/* Send the request to the server. */
@@ -771,22 +922,22 @@ proxy_socks5(int fd, char *host, unsigned short port, int force_d)
 	*s++ = 0x05;		/* protocol version 5 */
 	*s++ = 0x01;		/* CONNECT */
 	*s++ = 0x00;		/* reserved */
-	if (use_name) {
+	if (ps->use_name) {
 	    	*s++ = 0x03;	/* domain name */
 		*s++ = strlen(host);
 		strcpy(s, host);
 		s += strlen(host);
-	} else if (ha.sa.sa_family == AF_INET) {
+	} else if (ps->ha.sa.sa_family == AF_INET) {
 	    	*s++ = 0x01;	/* IPv4 */
-		memcpy(s, &ha.sin.sin_addr, 4);
+		memcpy(s, &ps->ha.sin.sin_addr, 4);
 		s += 4;
-		strcpy(nbuf, inet_ntoa(ha.sin.sin_addr));
+		strcpy(nbuf, inet_ntoa(ps->ha.sin.sin_addr));
 #if defined(AF_INET6) /*[*/
 	} else {
 	    	*s++ = 0x04;	/* IPv6 */
-		memcpy(s, &ha.sin6.sin6_addr, sizeof(struct in6_addr));
+		memcpy(s, &ps->ha.sin6.sin6_addr, sizeof(struct in6_addr));
 		s += sizeof(struct in6_addr);
-		(void) inet_ntop(AF_INET6, &ha.sin6.sin6_addr, nbuf,
+		(void) inet_ntop(AF_INET6, &ps->ha.sin6.sin6_addr, nbuf,
 				 sizeof(nbuf));
 #endif /*]*/
 	}
@@ -794,189 +945,132 @@ proxy_socks5(int fd, char *host, unsigned short port, int force_d)
 
 #if defined(X3270_TRACE) /*[*/
 	trace_dsn("SOCKS5 Proxy: xmit version 5 connect %s %s port %u\n",
-		use_name? "domainname":
-			  ((ha.sa.sa_family == AF_INET)? "IPv4": "IPv6"),
-		use_name? host: nbuf,
+		ps->use_name? "domainname":
+			  ((ps->ha.sa.sa_family == AF_INET)? "IPv4": "IPv6"),
+		ps->use_name? host: nbuf,
 		port);
 	trace_netdata('>', (unsigned char *)buf, s - buf);
 #endif /*]*/
-
-	if (send(fd, buf, s - buf, 0) < 0) {
-		popup_a_sockerr("SOCKS5 Proxy: send error");
-		Free(buf);
-		return -1;
-	}
-	Free(buf);
+	px_send(ps, buf, s - buf);
 
 	/*
 	 * Process the reply.
-	 * Only the first two bytes of the response are interesting;
-	 * skip the rest.
+	 * Only the first two bytes of the response are interesting; the
+	 * rest is read and skipped.
 	 */
-	nread = 0;
-	done = 0;
-	buf = NULL;
-	while (!done) {
-	    	fd_set rfds;
-		struct timeval tv;
-		unsigned char r;
-
-		FD_ZERO(&rfds);
-		FD_SET(fd, &rfds);
-		tv.tv_sec = 15;
-		tv.tv_usec = 0;
-		if (select(fd + 1, &rfds, NULL, NULL, &tv) < 0) {
-		    	popup_an_error("SOCKS5 Proxy: server timeout");
-			return -1;
-		}
+	ps->need = 2;
+	return PX_MORE;
 
-	    	nr = recv(fd, &r, 1, 0);
-		if (nr < 0) {
-			popup_a_sockerr("SOCKS5 Proxy: receive error");
+    reply_status:
+	if (rbuf[0] != 0x05) {
+		popup_an_error("SOCKS5 Proxy: incorrect reply version 0x%02x",
+			rbuf[0]);
 #if defined(X3270_TRACE) /*[*/
-		    	if (nread)
-				trace_netdata('<', (unsigned char *)buf, nread);
+		trace_netdata('<', rbuf, ps->nread);
 #endif /*]*/
-			return -1;
-		}
-		if (nr == 0) {
-			popup_an_error("SOCKS5 Proxy: unexpected EOF");
+		return PX_FAILURE;
+	}
 #if defined(X3270_TRACE) /*[*/
-		    	if (nread)
-				trace_netdata('<', (unsigned char *)buf, nread);
+	if (rbuf[1] != 0x00)
+		trace_netdata('<', rbuf, ps->nread);
 #endif /*]*/
-			return -1;
-		}
+	switch (rbuf[1]) {
+	case 0x00:
+		break;
+	case 0x01:
+		popup_an_error("SOCKS5 Proxy: server failure");
+		return PX_FAILURE;
+	case 0x02:
+		popup_an_error("SOCKS5 Proxy: connection not allowed");
+		return PX_FAILURE;
+	case 0x03:
+		popup_an_error("SOCKS5 Proxy: network unreachable");
+		return PX_FAILURE;
+	case 0x04:
+		popup_an_error("SOCKS5 Proxy: host unreachable");
+		return PX_FAILURE;
+	case 0x05:
+		popup_an_error("SOCKS5 Proxy: connection refused");
+		return PX_FAILURE;
+	case 0x06:
+		popup_an_error("SOCKS5 Proxy: ttl expired");
+		return PX_FAILURE;
+	case 0x07:
+		popup_an_error("SOCKS5 Proxy: command not supported");
+		return PX_FAILURE;
+	case 0x08:
+		popup_an_error("SOCKS5 Proxy: address type not supported");
+		return PX_FAILURE;
+	default:
+		popup_an_error("SOCKS5 Proxy: unknown server error 0x%02x",
+			rbuf[1]);
+		return PX_FAILURE;
+	}
 
-		buf = Realloc(buf, nread + 1);
-		buf[nread] = r;
+	/* Read the address type and the first byte of the address. */
+	ps->need = 5;
+	return PX_MORE;
 
-		switch (nread++) {
-		case 0:
-		    	if (r != 0x05) {
-			    	popup_an_error("SOCKS5 Proxy: incorrect "
-					"reply version 0x%02x", r);
-#if defined(X3270_TRACE) /*[*/
-				if (nread)
-					trace_netdata('<', (unsigned char *)buf, nread);
-#endif /*]*/
-				return -1;
-			}
-			break;
-		case 1:
-#if defined(X3270_TRACE) /*[*/
-			if (r != 0x00)
-				trace_netdata('<', (unsigned char *)buf, nread);
-#endif /*]*/
-		    	switch (r) {
-			case 0x00:
-			    	break;
-			case 0x01:
-			    	popup_an_error("SOCKS5 Proxy: server failure");
-				return -1;
-			case 0x02:
-			    	popup_an_error("SOCKS5 Proxy: connection not "
-					"allowed");
-				return -1;
-			case 0x03:
-			    	popup_an_error("SOCKS5 Proxy: network "
-					"unreachable");
-				return -1;
-			case 0x04:
-			    	popup_an_error("SOCKS5 Proxy: host "
-					"unreachable");
-				return -1;
-			case 0x05:
-			    	popup_an_error("SOCKS5 Proxy: connection "
-					"refused");
-				return -1;
-			case 0x06:
-			    	popup_an_error("SOCKS5 Proxy: ttl expired");
-				return -1;
-			case 0x07:
-			    	popup_an_error("SOCKS5 Proxy: command not "
-					"supported");
-				return -1;
-			case 0x08:
-			    	popup_an_error("SOCKS5 Proxy: address type "
-					"not supported");
-				return -1;
-			default:
-				popup_an_error("SOCKS5 Proxy: unknown server "
-					"error 0x%02x", r);
-				return -1;
-			}
-			break;
-		case 2:
-			break;
-		case 3:
-			switch (r) {
-			case 0x01:
-			    	n2read = 6;
-				break;
-			case 0x03:
-				n2read = -1;
-				break;
+    reply_type:
+	switch (rbuf[3]) {
+	case 0x01:
+		ps->need = 4 + 4 + 2;
+		break;
+	case 0x03:
+		ps->need = 5 + rbuf[4] + 2;
+		break;
 #if defined(AF_INET6) /*[*/
-			case 0x04:
-				n2read = sizeof(struct in6_addr) + 2;
-				break;
+	case 0x04:
+		ps->need = 4 + sizeof(struct in6_addr) + 2;
+		break;
 #endif /*]*/
-			default:
-				popup_an_error("SOCKS5 Proxy: unknown server "
-					"address type 0x%02x", r);
+	default:
+		popup_an_error("SOCKS5 Proxy: unknown server address type "
+			"0x%02x", rbuf[3]);
 #if defined(X3270_TRACE) /*[*/
-				if (nread)
-					trace_netdata('<', (unsigned char *)buf, nread);
+		trace_netdata('<', rbuf, ps->nread);
 #endif /*]*/
-				return -1;
-			}
-			break;
-		default:
-			if (n2read == -1)
-			    	n2read = r + 2;
-			else if (!--n2read)
-			    	done = 1;
-			break;
-		}
+		return PX_FAILURE;
 	}
+	return PX_MORE;
 
+    reply_done:
 #if defined(X3270_TRACE) /*[*/
-	trace_netdata('<', (unsigned char *)buf, nread);
-	switch (buf[3]) {
+	trace_netdata('<', rbuf, ps->nread);
+	switch (rbuf[3]) {
 	case 0x01: /* IPv4 */
-	    	memcpy(&ha.sin.sin_addr, &buf[4], 4);
-		strcpy(nbuf, inet_ntoa(ha.sin.sin_addr));
-		portp = (unsigned char *)&buf[4 + 4];
+	    	memcpy(&ps->ha.sin.sin_addr, &rbuf[4], 4);
+		strcpy(nbuf, inet_ntoa(ps->ha.sin.sin_addr));
+		portp = &rbuf[4 + 4];
 		break;
 	case 0x03: /* domainname */
-	    	strncpy(nbuf, &buf[5], buf[4]);
-		nbuf[(unsigned char)buf[4]] = '\0';
-		portp = (unsigned char *)&buf[5 + (unsigned char)buf[4]];
+	    	strncpy(nbuf, (char *)&rbuf[5], rbuf[4]);
+		nbuf[rbuf[4]] = '\0';
+		portp = &rbuf[5 + rbuf[4]];
 		break;
 #if defined(AF_INET6) /*[*/
 	case 0x04: /* IPv6 */
-	    	memcpy(&ha.sin6.sin6_addr, &buf[4], sizeof(struct in6_addr));
-		(void) inet_ntop(AF_INET6, &ha.sin6.sin6_addr, nbuf,
+	    	memcpy(&ps->ha.sin6.sin6_addr, &rbuf[4],
+			sizeof(struct in6_addr));
+		(void) inet_ntop(AF_INET6, &ps->ha.sin6.sin6_addr, nbuf,
 				 sizeof(nbuf));
-		portp = (unsigned char *)&buf[4 + sizeof(struct in6_addr)];
+		portp = &rbuf[4 + sizeof(struct in6_addr)];
 		break;
 #endif /*]*/
 	default:
 		/* can't happen */
 		nbuf[0] = '\0';
-		portp = (unsigned char *)buf;
+		portp = rbuf;
 		break;
 	}
 	rport = (*portp << 8) + *(portp + 1);
 	trace_dsn("SOCKS5 Proxy: recv version %d status 0x%02x address %s %s "
 		"port %u\n",
-		buf[0], buf[1],
-		atype_name[(unsigned char)buf[3]],
+		rbuf[0], rbuf[1],
+		atype_name[rbuf[3]],
 		nbuf,
 		rport);
 #endif /*]*/
-	Free(buf);
 
-    	return 0;
+    	return PX_SUCCESS;
 }
@@ -30,6 +30,23 @@
  *		Declarations for proxy.c.
  */
 
+/* proxy_continue() return values. */
+#define PX_FAILURE	(-1)	/* failed, error reported */
+#define PX_SUCCESS	0	/* tunnel is open */
+#define PX_WANTREAD	1	/* wait for the socket to be readable */
+#define PX_WANTWRITE	2	/* wait for the socket to be writable */
+
+typedef struct proxy_state proxy_state_t;
+
 extern int proxy_setup(char **phost, char **pport);
 extern int proxy_negotiate(int type, int fd, char *host, unsigned short port);
+extern proxy_state_t *proxy_start(int type, int fd, char *host,
+    unsigned short port);
+extern Boolean proxy_wants_addr(proxy_state_t *ps);
+extern void proxy_set_addr(proxy_state_t *ps, struct sockaddr *sa,
+    socklen_t len);
+extern void proxy_resolve(proxy_state_t *ps);
+extern int proxy_continue(proxy_state_t *ps);
+extern unsigned long proxy_timeout_ms(proxy_state_t *ps);
+extern void proxy_abort(proxy_state_t *ps);
 extern char *proxy_type_name(int type);
@@ -34,10 +34,11 @@
  * This file is compiled three different ways:
  *
  * - With no special #defines, it defines hostname resolution for the main
- *   program: resolve_host_and_port().  On non-Windows platforms, the name
- *   look-up is directly in the function.  On Windows platforms, the name
- *   look-up is done by the function dresolve_host_and_port() in an
- *   OS-specific DLL.
+ *   program: resolve_host_and_port(), and resolve_host_and_port_all() for
+ *   callers that want every address, through a cache.  On non-Windows
+ *   platforms, the name look-up is directly in the function.  On Windows
+ *   platforms, the name look-up is done by the function
+ *   dresolve_host_and_port() in an OS-specific DLL.
  *
  * - With W3N4 #defined, it defines dresolve_host_and_port() as IPv4-only
  *   hostname resolution for a Windows DLL.  This is for Windows 2000 or
@@ -76,6 +77,7 @@
 #endif /*]*/
 
 #include <stdio.h>
+#include <time.h>
 #include "resolverc.h"
 #include "w3miscc.h"
 
@@ -239,3 +241,181 @@ dresolve_host_and_port(const char *host, char *portname, unsigned short *pport,
 
 	return 0;
 }
+
+#if !defined(ISDLL) /*[*/
+/* Cached look-ups. */
+typedef struct rhcache {
+	struct rhcache *next;
+	char *host;
+	char *portname;
+	time_t expires;
+	rhaddrs_t addrs;
+} rhcache_t;
+static rhcache_t *rh_cache = NULL;
+
+/*
+ * How long a cached look-up is used, in seconds.  getaddrinfo() does not
+ * report the DNS TTL, so this stands in for it; 0 disables the cache.
+ */
+int resolve_cache_ttl = 300;
+
+/* Find a cache entry, discarding it if it has expired. */
+static rhcache_t *
+rh_cache_find(const char *host, const char *portname, rhcache_t ***prevp)
+{
+	rhcache_t **prev;
+	rhcache_t *c;
+
+	for (prev = &rh_cache; (c = *prev) != NULL; prev = &c->next) {
+		if (!strcmp(c->host, host) && !strcmp(c->portname, portname))
+			break;
+	}
+	if (prevp != NULL)
+		*prevp = prev;
+	if (c != NULL && time(NULL) >= c->expires) {
+		*prev = c->next;
+		Free(c->host);
+		Free(c->portname);
+		Free(c);
+		c = NULL;
+	}
+	return c;
+}
+
+/* Look up a host and port in the cache.  Returns 1 if found, else 0. */
+int
+resolve_cache_lookup(const char *host, const char *portname, rhaddrs_t *r)
+{
+	rhcache_t *c;
+
+	if ((c = rh_cache_find(host, portname, NULL)) == NULL)
+		return 0;
+	*r = c->addrs;
+	return 1;
+}
+
+/* Remember a look-up. */
+void
+resolve_cache_add(const char *host, const char *portname, rhaddrs_t *r)
+{
+	rhcache_t *c;
+
+	if (resolve_cache_ttl <= 0)
+		return;
+	resolve_cache_flush(host, portname);
+	c = (rhcache_t *)Malloc(sizeof(rhcache_t));
+	c->host = NewString(host);
+	c->portname = NewString(portname);
+	c->expires = time(NULL) + resolve_cache_ttl;
+	c->addrs = *r;
+	c->next = rh_cache;
+	rh_cache = c;
+}
+
+/*
+ * Forget a cached look-up.  Called when none of the addresses answered, so
+ * the next attempt asks again.
+ */
+void
+resolve_cache_flush(const char *host, const char *portname)
+{
+	rhcache_t **prev;
+	rhcache_t *c;
+
+	if ((c = rh_cache_find(host, portname, &prev)) != NULL) {
+		*prev = c->next;
+		Free(c->host);
+		Free(c->portname);
+		Free(c);
+	}
+}
+
+/*
+ * Resolve a hostname and port to every address it has.
+ * The address families are interleaved, starting with the one the resolver
+ * put first, so a caller trying them in order alternates between IPv6 and
+ * IPv4.
+ * Returns 0 for success, -1 for fatal error (name resolution impossible),
+ *  -2 for simple error (cannot resolve the name).
+ */
+int
+resolve_host_and_port_all(const char *host, char *portname, rhaddrs_t *r,
+	char *errmsg, int em_len)
+{
+	int rc;
+#if !defined(_WIN32) && defined(AF_INET6) /*[*/
+	struct addrinfo	 hints, *res, *rp;
+	struct addrinfo	*fam[2][RH_MAX_ADDRS];
+	int		 nfam[2] = { 0, 0 };
+	int		 first = -1;
+	int		 f, i;
+#endif /*]*/
+
+	if (resolve_cache_lookup(host, portname, r))
+		return 0;
+
+	(void) memset(r, '\0', sizeof(*r));
+#if !defined(_WIN32) && defined(AF_INET6) /*[*/
+	(void) memset(&hints, '\0', sizeof(struct addrinfo));
+	hints.ai_flags = 0;
+	hints.ai_family = PF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	rc = getaddrinfo(host, portname, &hints, &res);
+	if (rc != 0) {
+		snprintf(errmsg, em_len, "%s/%s: %s", host, portname,
+				gai_strerror(rc));
+		return -2;
+	}
+
+	/* Sort the addresses by family. */
+	for (rp = res; rp != NULL; rp = rp->ai_next) {
+		if (rp->ai_family == AF_INET6)
+			f = 0;
+		else if (rp->ai_family == AF_INET)
+			f = 1;
+		else
+			continue;
+		if (rp->ai_addrlen > sizeof(r->addr[0]) ||
+		    nfam[f] >= RH_MAX_ADDRS)
+			continue;
+		if (first < 0)
+			first = f;
+		fam[f][nfam[f]++] = rp;
+	}
+	if (first < 0) {
+		snprintf(errmsg, em_len, "%s: unknown family %d", host,
+			res->ai_family);
+		freeaddrinfo(res);
+		return -1;
+	}
+
+	/* Interleave them. */
+	for (i = 0; r->n < RH_MAX_ADDRS && i < RH_MAX_ADDRS; i++) {
+		for (f = first; f < first + 2 && r->n < RH_MAX_ADDRS; f++) {
+			if (i < nfam[f % 2]) {
+				rp = fam[f % 2][i];
+				(void) memcpy(&r->addr[r->n], rp->ai_addr,
+				    rp->ai_addrlen);
+				r->len[r->n++] = rp->ai_addrlen;
+			}
+		}
+	}
+	r->port = (r->addr[0].sa.sa_family == AF_INET6)?
+	    ntohs(r->addr[0].sin6.sin6_port):
+	    ntohs(r->addr[0].sin.sin_port);
+	freeaddrinfo(res);
+#else /*][*/
+	/* Only one address is available. */
+	r->len[0] = sizeof(r->addr[0]);
+	rc = resolve_host_and_port(host, portname, &r->port, &r->addr[0].sa,
+		&r->len[0], errmsg, em_len);
+	if (rc < 0)
+		return rc;
+	r->n = 1;
+#endif /*]*/
+
+	resolve_cache_add(host, portname, r);
+	return 0;
+}
+#endif /*]*/
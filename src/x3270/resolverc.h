@@ -33,3 +33,36 @@
 extern int
 resolve_host_and_port(const char *host, char *portname, unsigned short *pport,
 	struct sockaddr *sa, socklen_t *sa_len, char *errmsg, int em_size);
+
+/* Every address for a host, in the order they should be tried. */
+#define RH_MAX_ADDRS	8
+typedef struct {
+	int n;				/* number of addresses */
+	unsigned short port;		/* port, in host order */
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in sin;
+#if defined(AF_INET6) /*[*/
+		struct sockaddr_in6 sin6;
+#endif /*]*/
+	} addr[RH_MAX_ADDRS];
+	socklen_t len[RH_MAX_ADDRS];
+} rhaddrs_t;
+
+/* What a resolver process sends back. */
+typedef struct {
+	int rc;				/* resolve_host_and_port_all() result */
+	rhaddrs_t addrs;		/* addresses */
+	char errmsg[512];		/* error message */
+} rhresult_t;
+
+extern int resolve_cache_ttl;
+
+extern int
+resolve_host_and_port_all(const char *host, char *portname, rhaddrs_t *r,
+	char *errmsg, int em_size);
+extern void resolve_cache_add(const char *host, const char *portname,
+	rhaddrs_t *r);
+extern void resolve_cache_flush(const char *host, const char *portname);
+extern int resolve_cache_lookup(const char *host, const char *portname,
+	rhaddrs_t *r);
@@ -113,6 +113,10 @@ XtResource resources[] = {
 	  offset(socket), XtRString, ResFalse },
 	{ ResPluginCommand, ClsPluginCommand, XtRString, sizeof(String),
 	  offset(plugin_command), XtRString, "x3270hist.pl" },
+	{ ResSocketPath, ClsSocketPath, XtRString, sizeof(String),
+	  offset(socket_path), XtRString, 0 },
+	{ ResScriptPort, ClsScriptPort, XtRString, sizeof(String),
+	  offset(script_port), XtRString, 0 },
 #endif /*]*/
 	{ ResUseCursorColor, ClsUseCursorColor, XtRBoolean, sizeof(Boolean),
 	  offset(use_cursor_color), XtRString, ResFalse },
@@ -203,6 +207,8 @@ XtResource resources[] = {
 	  offset(trace_file), XtRString, 0 },
 	{ ResTraceFileSize, ClsTraceFileSize, XtRString, sizeof(char *),
 	  offset(trace_file_size), XtRString, 0 },
+	{ ResTraceBinary, ClsTraceBinary, XtRBoolean, sizeof(Boolean),
+	  offset(trace_binary), XtRString, ResFalse },
 	{ ResTraceMonitor, ClsTraceMonitor, XtRBoolean, sizeof(Boolean),
 	  offset(trace_monitor), XtRString, ResTrue },
 	{ ResScreenTraceFile, ClsScreenTraceFile, XtRString, sizeof(char *),
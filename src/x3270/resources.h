@@ -126,6 +126,7 @@
 #define ResModifiedSelColor	"modifiedSelColor"
 #define ResMono			"mono"
 #define ResMonoCase		"monoCase"
+#define ResMultiSession		"multiSession"
 #define ResNoOther		"noOther"
 #define ResNoPrompt		"noPrompt"
 #define ResNormalColor		"normalColor"
@@ -152,6 +153,7 @@
 #define ResSchemeList		"schemeList"
 #define ResScreenTrace		"screenTrace"
 #define ResScreenTraceFile	"screenTraceFile"
+#define ResScriptPort		"scriptPort"
 #define ResScripted		"scripted"
 #define ResScrollBar		"scrollBar"
 #define ResSecure		"secure"
@@ -159,6 +161,7 @@
 #define ResSbcsCgcsgid		"sbcsCgcsgid"
 #define ResShowTiming		"showTiming"
 #define ResSocket		"socket"
+#define ResSocketPath		"socketPath"
 #define ResSuppressActions	"suppressActions"
 #define ResSuppressHost		"suppressHost"
 #define ResSuppressFontMenu	"suppressFontMenu"
@@ -166,6 +169,7 @@
 #define ResTermName		"termName"
 #define ResTitle		"title"
 #define ResTraceDir		"traceDir"
+#define ResTraceBinary		"traceBinary"
 #define ResTraceFile		"traceFile"
 #define ResTraceFileSize	"traceFileSize"
 #define ResTraceMonitor		"traceMonitor"
@@ -180,6 +184,7 @@
 #define ResVisualSelect		"visualSelect"
 #define ResVisualSelectColor	"visualSelectColor"
 #define ResWaitCursor		"waitCursor"
+#define ResWorkers		"workers"
 #define ResWerase		"werase"
 
 /* Dotted resource names. */
@@ -209,9 +214,12 @@
 #define DotSaveLines		"." ResSaveLines
 #define DotScripted		"." ResScripted
 #define DotScrollBar		"." ResScrollBar
+#define DotScriptPort		"." ResScriptPort
 #define DotSocket		"." ResSocket
+#define DotSocketPath		"." ResSocketPath
 #define DotTermName		"." ResTermName
 #define DotTitle		"." ResTitle
+#define DotTraceBinary		"." ResTraceBinary
 #define DotTraceFile		"." ResTraceFile
 #define DotTraceFileSize	"." ResTraceFileSize
 #define DotV			"." ResV
@@ -310,16 +318,19 @@
 #define ClsSbcsCgcsgid		"SbcsSgcsgid"
 #define ClsScreenTrace		"ScreenTrace"
 #define ClsScreenTraceFile	"ScreenTraceFile"
+#define ClsScriptPort		"ScriptPort"
 #define ClsScripted		"Scripted"
 #define ClsScrollBar		"ScrollBar"
 #define ClsSecure		"Secure"
 #define ClsSelectBackground	"SelectBackground"
 #define ClsShowTiming		"ShowTiming"
 #define ClsSocket		"Socket"
+#define ClsSocketPath		"SocketPath"
 #define ClsSuppressHost		"SuppressHost"
 #define ClsSuppressFontMenu	"SuppressFontMenu"
 #define ClsTermName		"TermName"
 #define ClsTraceDir		"TraceDir"
+#define ClsTraceBinary		"TraceBinary"
 #define ClsTraceFile		"TraceFile"
 #define ClsTraceFileSize	"TraceFileSize"
 #define ClsTraceMonitor		"TraceMonitor"
@@ -361,6 +372,7 @@
 #define OptM3279		"-color"
 #define OptModel		"-model"
 #define OptMono			"-mono"
+#define OptMultiSession		"-multisession"
 #define OptNoPrompt		"-noprompt"
 #define OptNoScrollBar		"+sb"
 #define OptOnce			"-once"
@@ -372,16 +384,20 @@
 #define OptReconnect		"-reconnect"
 #define OptSaveLines		"-sl"
 #define OptSecure		"-secure"
+#define OptScriptPort		"-scriptport"
 #define OptScripted		"-script"
 #define OptScrollBar		"-sb"
 #define OptSet			"-set"
 #define OptSocket		"-socket"
+#define OptSocketPath		"-socketpath"
 #define OptTermName		"-tn"
 #define OptTitle		"-title"
+#define OptTraceBinary		"-tracebinary"
 #define OptTraceFile		"-tracefile"
 #define OptTraceFileSize	"-tracefilesize"
 #define OptV			"-v"
 #define OptVersion		"--version"
+#define OptWorkers		"-workers"
 
 /* Miscellaneous values. */
 #define ResTrue			"true"
@@ -124,16 +124,9 @@ scroll_save(int n, Boolean trim_blanks)
 	/* Trim trailing blank lines from 'n', if requested */
 	if (trim_blanks) {
 		while (n) {
-			int i;
-
-			for (i = 0; i < COLS; i++) {
-				if (ea_buf[(n-1)*COLS + i].cc)
-					break;
-			}
-			if (i < COLS)
+			if (!ctlr_blank_area(ea_buf + (n-1)*COLS, COLS, True))
 				break;
-			else
-				n--;
+			n--;
 		}
 		if (!n)
 			return;
@@ -291,6 +284,7 @@ sync_scroll(int sb)
 				    ea_save[appres.save_lines+i-sb],
 				    COLS*sizeof(struct ea));
 		}
+	ctlr_fa_changed();
 
 	/* Disable the cursor if we're scrolled back, enable it if not. */
 	enable_cursor(sb == 0);
@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2009, Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ *	session.c
+ *		Multiple host sessions in one process.
+ *
+ *		The emulator core keeps its state in file-scope variables.
+ *		Each module registers those variables here, and a session is
+ *		a private copy of all of them.  Switching sessions saves the
+ *		registered variables into the outgoing session's context and
+ *		loads them from the incoming one.  The event loop switches to
+ *		the session that owns an input or timeout before calling it,
+ *		so the rest of the code never needs to know about sessions.
+ *
+ *		The sessions can also be spread across several worker
+ *		processes, each with its own event loop, all accepting
+ *		connections on the same script socket.
+ */
+
+#include "globals.h"
+
+#if defined(X3270_SESSIONS) /*[*/
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include "appres.h"
+#include "ctlr.h"
+
+#include "ansic.h"
+#include "ctlrc.h"
+#include "ft_cutc.h"
+#include "ft_dftc.h"
+#include "ftc.h"
+#include "gluec.h"
+#include "hostc.h"
+#include "idlec.h"
+#include "kybdc.h"
+#include "macrosc.h"
+#include "popupsc.h"
+#include "sessionc.h"
+#include "sfc.h"
+#include "telnetc.h"
+#include "trace_dsc.h"
+#include "utilc.h"
+#include "xioc.h"
+
+struct session {
+	struct session *next;	/* next in the list of all sessions */
+	int	 id;		/* session number, for Query */
+	Boolean	 in_use;	/* False if idle and available for reuse */
+	char	*name;		/* name given by Session(), or NULL */
+	unsigned char *context;	/* saved copies of the registered variables */
+};
+
+static session_t *sessions = NULL;	/* all sessions, newest first */
+static session_t *current = NULL;	/* session whose state is loaded */
+static unsigned char *pristine = NULL;	/* state before any session ran */
+static int n_sessions = 0;
+static int n_active = 0;
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON) /*[*/
+#define MAP_ANONYMOUS	MAP_ANON
+#endif /*]*/
+
+/*
+ * Worker statistics.  With more than one worker, the array lives in memory
+ * shared by all of the workers, and each one updates only its own slot.
+ */
+typedef struct {
+	pid_t	pid;
+	int	sessions;		/* sessions in use by connections */
+	unsigned long bytes;		/* bytes sent and received */
+	unsigned long records;		/* 3270 records sent and received */
+	unsigned long bytes_per_sec;	/* bytes in the last second */
+	unsigned long records_per_sec;	/* records in the last second */
+} worker_t;
+
+static worker_t solo;			/* the only worker */
+static worker_t *workers = &solo;
+static worker_t *me = &solo;		/* this process's slot */
+static int n_workers = 1;
+static pid_t parent_pid = 0;		/* worker 0, as seen by the others */
+static unsigned long last_bytes = 0;
+static unsigned long last_records = 0;
+
+/*
+ * One-time initialization.
+ *
+ * Must be called before any per-session storage (the screen buffers) is
+ * allocated, so that the pristine state does not refer to it.  The current
+ * state becomes the first session.
+ */
+void
+session_init(void)
+{
+#if defined(X3270_ANSI) /*[*/
+	ansi_session_vars();
+#endif /*]*/
+	ctlr_session_vars();
+#if defined(X3270_FT) /*[*/
+	ft_session_vars();
+	ft_cut_session_vars();
+	ft_dft_session_vars();
+#endif /*]*/
+	host_session_vars();
+	idle_session_vars();
+	kybd_session_vars();
+	sms_session_vars();
+	sf_session_vars();
+	net_session_vars();
+	trace_ds_session_vars();
+	xio_session_vars();
+
+	pristine = (unsigned char *)Malloc(session_context_size());
+	session_save(pristine);
+
+	current = (session_t *)Calloc(1, sizeof(session_t));
+	current->id = n_sessions++;
+	current->in_use = True;
+	current->context = (unsigned char *)Malloc(session_context_size());
+	sessions = current;
+	n_active = 1;
+
+	solo.pid = getpid();
+}
+
+/* Return the session whose state is loaded. */
+session_t *
+session_current(void)
+{
+	return current;
+}
+
+/* Make a session current. */
+void
+session_switch(session_t *s)
+{
+	if (s == current || s == NULL)
+		return;
+	session_save(current->context);
+	session_load(s->context);
+	current = s;
+}
+
+/* Make an idle session active again, and current. */
+void
+session_resume(session_t *s)
+{
+	s->in_use = True;
+	n_active++;
+	me->sessions++;
+	session_switch(s);
+	trace_dsn("Reusing session %d\n", s->id);
+}
+
+/*
+ * Create a new session, or recycle an idle one, and make it current.
+ *
+ * A recycled session keeps its screen buffers; everything it needs to reset
+ * is reset when it next connects.  Idle sessions with names are kept for
+ * Session() to find.
+ */
+session_t *
+session_new(void)
+{
+	session_t *s;
+
+	for (s = sessions; s != NULL; s = s->next) {
+		if (!s->in_use && s->name == CN)
+			break;
+	}
+	if (s != NULL) {
+		session_resume(s);
+		return s;
+	}
+
+	s = (session_t *)Calloc(1, sizeof(session_t));
+	s->id = n_sessions++;
+	s->in_use = True;
+	s->context = (unsigned char *)Malloc(session_context_size());
+	(void) memcpy(s->context, pristine, session_context_size());
+	s->next = sessions;
+	sessions = s;
+	n_active++;
+	me->sessions++;
+
+	session_switch(s);
+	ctlr_reinit(MODEL_CHANGE);
+	trace_dsn("New session %d\n", s->id);
+	return s;
+}
+
+/* Find a session by name. */
+session_t *
+session_find(const char *name)
+{
+	session_t *s;
+
+	for (s = sessions; s != NULL; s = s->next) {
+		if (s->name != CN && !strcmp(s->name, name))
+			break;
+	}
+	return s;
+}
+
+/* Name a session. */
+void
+session_set_name(session_t *s, const char *name)
+{
+	Replace(s->name, NewString(name));
+	trace_dsn("Session %d is named %s\n", s->id, name);
+}
+
+/* Return a session's name, or NULL. */
+const char *
+session_name(session_t *s)
+{
+	return s->name;
+}
+
+/* Return whether a session is in use by a script connection. */
+Boolean
+session_in_use(session_t *s)
+{
+	return s->in_use;
+}
+
+/*
+ * Mark a session as idle.  The caller is expected to have disconnected it
+ * from its host already.
+ */
+void
+session_release(session_t *s)
+{
+	if (s == NULL || !s->in_use)
+		return;
+	s->in_use = False;
+	n_active--;
+	me->sessions--;
+	trace_dsn("Session %d is idle\n", s->id);
+}
+
+/* Query the session list. */
+const char *
+session_query(void)
+{
+	static char buf[64];
+
+	(void) sprintf(buf, "%d active %d idle current %d",
+	    n_active, n_sessions - n_active, current? current->id: 0);
+	return buf;
+}
+
+/* Count network traffic for the worker statistics. */
+void
+session_count(int bytes, int records)
+{
+	me->bytes += bytes;
+	me->records += records;
+}
+
+/*
+ * Once a second, work out the traffic rates.  The other workers also check
+ * that worker 0 is still there, and exit if it is not.
+ */
+static void
+worker_tick(void)
+{
+	if (parent_pid && getppid() != parent_pid)
+		x3270_exit(0);
+	me->bytes_per_sec = me->bytes - last_bytes;
+	me->records_per_sec = me->records - last_records;
+	last_bytes = me->bytes;
+	last_records = me->records;
+	(void) AddTimeOut(1000L, worker_tick);
+}
+
+/* Stop the other workers when the first one exits. */
+static void
+workers_exit(Boolean b _is_unused)
+{
+	int i;
+
+	for (i = 1; i < n_workers; i++) {
+		if (workers[i].pid > 0)
+			(void) kill(workers[i].pid, SIGTERM);
+	}
+}
+
+/*
+ * Start the worker processes.
+ *
+ * Called once the script socket is listening.  The calling process becomes
+ * worker 0; the others are forked from it and inherit the socket, and the
+ * kernel hands each new connection to one of them.  A session stays in the
+ * worker that accepted its connection.
+ */
+void
+session_start_workers(int n)
+{
+	worker_t *w;
+	int i;
+
+	if (n > 1 && PCONNECTED) {
+		popup_an_error("Cannot start workers with a host connected");
+		n = 1;
+	}
+	if (n > 1) {
+		w = (worker_t *)mmap(NULL, n * sizeof(worker_t),
+		    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (w == (worker_t *)MAP_FAILED) {
+			popup_an_errno(errno, "mmap");
+			n = 1;
+		} else {
+			(void) memset(w, '\0', n * sizeof(worker_t));
+			w[0] = solo;
+			workers = me = w;
+			n_workers = n;
+		}
+	}
+
+	for (i = 1; i < n_workers; i++) {
+		pid_t pid;
+
+		trace_flush();
+		pid = fork();
+		if (pid < 0) {
+			popup_an_errno(errno, "fork");
+			n_workers = i;
+			break;
+		}
+		if (pid == 0) {
+			/* The new worker. */
+			process_events_fork();
+			me = &workers[i];
+			me->pid = getpid();
+			last_bytes = last_records = 0;
+			children = 0;
+			parent_pid = getppid();
+			trace_worker();
+			break;
+		}
+		workers[i].pid = pid;
+		++children;
+	}
+	if (me == workers && n_workers > 1)
+		register_schange(ST_EXITING, workers_exit);
+
+	(void) AddTimeOut(1000L, worker_tick);
+}
+
+/*
+ * Decide whether this worker should accept a new connection.  Every worker
+ * is woken for it; only the least busy ones take it, so that the sessions
+ * stay evenly spread.
+ */
+Boolean
+session_accept_ok(void)
+{
+	int i;
+
+	for (i = 0; i < n_workers; i++) {
+		worker_t *w = &workers[i];
+
+		if (w != me && w->sessions < me->sessions && w->pid > 0 &&
+		    kill(w->pid, 0) == 0)
+			return False;
+	}
+	return True;
+}
+
+/* Query the workers. */
+const char *
+session_query_workers(void)
+{
+	static char *buf = NULL;
+	char *s;
+	int i;
+
+	Replace(buf, Malloc(n_workers * 128));
+	s = buf;
+	for (i = 0; i < n_workers; i++) {
+		worker_t *w = &workers[i];
+
+		s += sprintf(s, "%sworker %d pid %d sessions %d "
+		    "bytes/s %lu records/s %lu", i? "\n": "", i,
+		    (int)w->pid, w->sessions, w->bytes_per_sec,
+		    w->records_per_sec);
+	}
+	return buf;
+}
+
+#endif /*]*/
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2009, Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ *	sessionc.h
+ *		Global declarations for session.c.
+ */
+
+#if defined(X3270_SESSIONS) /*[*/
+typedef struct session session_t;
+
+extern Boolean session_accept_ok(void);
+extern void session_count(int bytes, int records);
+extern session_t *session_current(void);
+extern session_t *session_find(const char *name);
+extern Boolean session_in_use(session_t *s);
+extern void session_init(void);
+extern const char *session_name(session_t *s);
+extern session_t *session_new(void);
+extern const char *session_query(void);
+extern const char *session_query_workers(void);
+extern size_t session_context_size(void);
+extern void session_load(const unsigned char *context);
+extern void session_register(void *addr, size_t len);
+extern void session_save(unsigned char *context);
+extern void session_release(session_t *s);
+extern void session_resume(session_t *s);
+extern void session_set_name(session_t *s, const char *name);
+extern void session_start_workers(int n);
+extern void session_switch(session_t *s);
+
+#define SESSION_VAR(v)	session_register((void *)&(v), sizeof(v))
+#else /*][*/
+#define session_count(b, r)
+#endif /*]*/
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2009, Paul Mattes.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the names of Paul Mattes nor the names of his contributors
+ *       may be used to endorse or promote products derived from this software
+ *       without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY PAUL MATTES "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+ * EVENT SHALL PAUL MATTES BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ *	sessvars.c
+ *		Session variables.
+ *
+ *		A session is a private copy of the file-scope variables that
+ *		each module registers with SESSION_VAR().  This is the part of
+ *		the session machinery shared by the emulators and pr3287: it
+ *		keeps the list of registered variables, and copies them to and
+ *		from a saved context.
+ */
+
+#include "globals.h"
+
+#if defined(X3270_SESSIONS) /*[*/
+
+#include "sessionc.h"
+
+/* A registered variable, or a run of them that are next to each other. */
+typedef struct {
+	void	*addr;		/* where it lives */
+	size_t	 len;		/* how big it is */
+	size_t	 offset;	/* where it goes in a context */
+} svar_t;
+
+static svar_t *svars = NULL;
+static int n_svars = 0;
+static int max_svars = 0;
+static size_t context_size = 0;
+static Boolean merged = False;
+
+/*
+ * Add a variable to the set that makes up a session.  Every variable must
+ * be registered before the first call to session_context_size().
+ */
+void
+session_register(void *addr, size_t len)
+{
+	if (n_svars >= max_svars) {
+		max_svars = max_svars? 2 * max_svars: 128;
+		svars = (svar_t *)Realloc(svars, max_svars * sizeof(svar_t));
+	}
+	svars[n_svars].addr = addr;
+	svars[n_svars].len = len;
+	n_svars++;
+}
+
+/* Order variables by address. */
+static int
+svar_cmp(const void *a, const void *b)
+{
+	const char *aa = (const char *)((const svar_t *)a)->addr;
+	const char *ba = (const char *)((const svar_t *)b)->addr;
+
+	return (aa < ba)? -1: ((aa > ba)? 1: 0);
+}
+
+/*
+ * Merge variables that sit next to each other in memory, so a switch copies
+ * a few long runs instead of many small variables, and lay out a context.
+ */
+static void
+svars_merge(void)
+{
+	int i, n = 0;
+	char *a, *end;
+
+	qsort(svars, n_svars, sizeof(svar_t), svar_cmp);
+	for (i = 0; i < n_svars; i++) {
+		a = (char *)svars[i].addr;
+		if (n > 0) {
+			end = (char *)svars[n - 1].addr + svars[n - 1].len;
+			if (a <= end) {
+				if (a + svars[i].len > end)
+					svars[n - 1].len += (a + svars[i].len) -
+					    end;
+				continue;
+			}
+		}
+		svars[n++] = svars[i];
+	}
+	n_svars = n;
+
+	/* Keep every copy aligned. */
+	for (i = 0; i < n_svars; i++) {
+		svars[i].offset = context_size;
+		context_size += (svars[i].len + sizeof(double) - 1) &
+		    ~(sizeof(double) - 1);
+	}
+	merged = True;
+}
+
+/* Returns the size of a context. */
+size_t
+session_context_size(void)
+{
+	if (!merged)
+		svars_merge();
+	return context_size;
+}
+
+/* Save the loaded state into a context. */
+void
+session_save(unsigned char *context)
+{
+	int i;
+
+	for (i = 0; i < n_svars; i++)
+		(void) memcpy(context + svars[i].offset, svars[i].addr,
+		    svars[i].len);
+}
+
+/* Load the state from a context. */
+void
+session_load(const unsigned char *context)
+{
+	int i;
+
+	for (i = 0; i < n_svars; i++)
+		(void) memcpy(svars[i].addr, context + svars[i].offset,
+		    svars[i].len);
+}
+
+#endif /*]*/
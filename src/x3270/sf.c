@@ -53,6 +53,7 @@
 #include "kybdc.h"
 #include "screenc.h"
 #include "seec.h"
+#include "sessionc.h"
 #include "sfc.h"
 #include "tablesc.h"
 #include "telnetc.h"
@@ -954,3 +955,12 @@ query_reply_end(void)
 	net_output();
 	kybd_inhibit(True);
 }
+
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+sf_session_vars(void)
+{
+	SESSION_VAR(qr_in_progress);
+}
+#endif /*]*/
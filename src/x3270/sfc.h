@@ -31,3 +31,6 @@
  */
 
 extern enum pds write_structured_field(unsigned char buf[], int buflen);
+#if defined(X3270_SESSIONS) /*[*/
+extern void sf_session_vars(void);
+#endif /*]*/
@@ -56,7 +56,9 @@
 #include <fcntl.h>
 #if !defined(_WIN32) /*[*/
 #include <netdb.h>
+#include <sys/wait.h>
 #endif /*]*/
+#include <signal.h>
 #include <stdarg.h>
 #if defined(HAVE_LIBSSL) /*[*/
 #include <openssl/ssl.h>
@@ -75,6 +77,7 @@
 #include "popupsc.h"
 #include "proxyc.h"
 #include "resolverc.h"
+#include "sessionc.h"
 #include "statusc.h"
 #include "tablesc.h"
 #include "telnetc.h"
@@ -129,6 +132,8 @@ static unsigned char *ibptr;
 static int      ibuf_size = 0;	/* size of ibuf */
 static unsigned char *obuf_base = (unsigned char *)NULL;
 static int	obuf_size = 0;
+static int	ibuf_hwm = 0;	/* high-water mark for ibuf */
+static int	obuf_hwm = 0;	/* high-water mark for obuf_base */
 static unsigned char *netrbuf = (unsigned char *)NULL;
 			/* network input buffer */
 static unsigned char *sbbuf = (unsigned char *)NULL;
@@ -138,6 +143,9 @@ static unsigned char telnet_state;
 static int      syncing;
 #if !defined(_WIN32) /*[*/
 static unsigned long output_id = 0L;
+static proxy_state_t *proxy_ps = NULL;	/* proxy negotiation in progress */
+static unsigned long proxy_output_id = 0L;
+static unsigned long proxy_timeout_id = 0L;
 #endif /*]*/
 static char     ttype_tmpval[13];
 
@@ -146,6 +154,9 @@ static unsigned long e_funcs;	/* negotiated TN3270E functions */
 #define E_OPT(n)	(1 << (n))
 static unsigned short e_xmit_seq; /* transmit sequence number */
 static int response_required;
+#define LU_MAX	32
+static char	reported_lu[LU_MAX+1];	/* LU name from the host */
+static char	reported_type[LU_MAX+1];	/* device type from the host */
 #endif /*]*/
 
 #if defined(X3270_ANSI) /*[*/
@@ -192,9 +203,12 @@ static int telnet_fsm(unsigned char c);
 static void net_rawout(unsigned const char *buf, int len);
 static void check_in3270(void);
 static void store3270in(unsigned char c);
+static void store3270in_run(const unsigned char *buf, int len);
+static unsigned char *grow3270buf(unsigned char *buf, int *size, int need);
 static void check_linemode(Boolean init);
 static int non_blocking(Boolean on);
 static void net_connected(void);
+static void net_connected_host(void);
 #if defined(X3270_TN3270E) /*[*/
 static int tn3270e_negotiate(void);
 #endif /*]*/
@@ -322,10 +336,17 @@ static void continue_tls(unsigned char *sbbuf, int len);
 
 #if !defined(_WIN32) /*[*/
 static void output_possible(void);
+static void net_proxy_continue(void);
+static void net_connect_next(int e);
+static void net_resolved(void);
+static Boolean net_proxy_resolve(void);
+static void net_proxy_resolved(void);
+static void net_proxy_resolve_timeout(void);
 #endif /*]*/
 
 #if defined(_WIN32) /*[*/
 #define socket_errno()	WSAGetLastError()
+#define set_socket_errno(e)	WSASetLastError(e)
 #define SE_EWOULDBLOCK	WSAEWOULDBLOCK
 #define SE_ECONNRESET	WSAECONNRESET
 #define SE_EINTR	WSAEINTR
@@ -336,6 +357,7 @@ static void output_possible(void);
 #define SOCK_IOCTL(s, f, v)	ioctlsocket(s, f, (DWORD *)v)
 #else /*][*/
 #define socket_errno()	errno
+#define set_socket_errno(e)	(errno = (e))
 #define SE_EWOULDBLOCK	EWOULDBLOCK
 #define SE_ECONNRESET	ECONNRESET
 #define SE_EINTR	EINTR
@@ -386,6 +408,15 @@ static union {
 #endif /*]*/
 } haddr;
 socklen_t ha_len = sizeof(haddr);
+static rhaddrs_t haddrs;		/* every address for the host */
+static int haddr_ix = 0;		/* the one being tried */
+static char *rh_host = CN;		/* the name haddrs came from */
+static char *rh_port = CN;		/* the port name haddrs came from */
+#if !defined(_WIN32) /*[*/
+static pid_t resolver_pid = 0;		/* asynchronous resolver process */
+static int resolver_fd = -1;		/* pipe from it */
+static unsigned long resolver_id = 0L;
+#endif /*]*/
 
 #if defined(_WIN32) /*[*/
 void
@@ -413,11 +444,335 @@ popup_a_sockerr(char *fmt, ...)
 }
 #endif /*]*/
 
+#if !defined(_WIN32) /*[*/
+/* Stop waiting for the resolver process. */
+static void
+net_resolve_cancel(void)
+{
+	if (resolver_id) {
+		RemoveInput(resolver_id);
+		resolver_id = 0L;
+	}
+	if (resolver_fd >= 0) {
+		(void) close(resolver_fd);
+		resolver_fd = -1;
+	}
+	if (resolver_pid > 0) {
+		/* It will be reaped with the other children. */
+		(void) kill(resolver_pid, SIGKILL);
+		resolver_pid = 0;
+	}
+}
+#endif /*]*/
+
+#if !defined(_WIN32) /*[*/
+/*
+ * Start a resolver process to look up a host name and port.  'fn' is called
+ * when the answer can be read with resolver_read().
+ * Returns 0 for success, -1 for failure.
+ */
+static int
+resolver_start(const char *host, char *portname, void (*fn)(void))
+{
+	int fds[2];
+	rhresult_t res;
+
+	net_resolve_cancel();
+	if (pipe(fds) < 0) {
+		popup_an_errno(errno, "pipe");
+		return -1;
+	}
+	trace_flush();
+	switch (resolver_pid = fork()) {
+	case -1:
+		popup_an_errno(errno, "fork");
+		(void) close(fds[0]);
+		(void) close(fds[1]);
+		resolver_pid = 0;
+		return -1;
+	case 0:
+		/* Child: look it up and report back. */
+		(void) close(fds[0]);
+		(void) memset(&res, '\0', sizeof(res));
+		res.rc = resolve_host_and_port_all(host, portname, &res.addrs,
+		    res.errmsg, sizeof(res.errmsg));
+		(void) write(fds[1], &res, sizeof(res));
+		_exit(0);
+		break;
+	default:
+		break;
+	}
+	++children;
+	(void) close(fds[1]);
+	(void) fcntl(fds[0], F_SETFD, 1);
+	resolver_fd = fds[0];
+	resolver_id = AddInput(resolver_fd, fn);
+	trace_dsn("Resolving %s/%s.\n", host, portname);
+	return 0;
+}
+
+/*
+ * Read the resolver process's answer into *res, and stop waiting for it.
+ * Returns the look-up result.
+ */
+static int
+resolver_read(const char *host, char *portname, rhresult_t *res)
+{
+	ssize_t nr;
+
+	nr = read(resolver_fd, res, sizeof(*res));
+	resolver_pid = 0;
+	net_resolve_cancel();
+	if (nr != sizeof(*res)) {
+		res->rc = -1;
+		(void) snprintf(res->errmsg, sizeof(res->errmsg),
+		    "%s/%s: Resolver failed", host, portname);
+	}
+	if (res->rc == 0)
+		resolve_cache_add(host, portname, &res->addrs);
+	return res->rc;
+}
+#endif /*]*/
+
+/*
+ * Look up a host name and port, filling in haddrs.
+ *
+ * A cached answer is used at once.  Otherwise (except on Windows) the
+ * look-up runs in a child process, so a slow or unreachable name server
+ * cannot stall the event loop; *resolving is set, and the connection
+ * continues in net_resolved() when the answer arrives.
+ *
+ * Returns 0 for success, -1 for failure.
+ */
+static int
+net_resolve(const char *host, char *portname, Boolean *resolving)
+{
+#if defined(_WIN32) /*[*/
+	char errmsg[1024];
+#endif /*]*/
+
+	Replace(rh_host, NewString(host));
+	Replace(rh_port, NewString(portname));
+	haddr_ix = 0;
+	if (resolve_cache_lookup(host, portname, &haddrs)) {
+		trace_dsn("Using cached address for %s/%s.\n", host, portname);
+		return 0;
+	}
+
+#if !defined(_WIN32) /*[*/
+	if (resolver_start(host, portname, net_resolved) < 0)
+		return -1;
+	*resolving = True;
+	return 0;
+#else /*][*/
+	if (resolve_host_and_port_all(host, portname, &haddrs, errmsg,
+		    sizeof(errmsg)) < 0) {
+		popup_an_error("%s", errmsg);
+		return -1;
+	}
+	return 0;
+#endif /*]*/
+}
+
+/*
+ * Start connecting to haddrs.addr[haddr_ix].
+ * Returns 0 for success (connected, or *pending set), 1 if the connect
+ * failed and the next address is worth trying, -1 for a fatal error (which
+ * has been reported).
+ */
+static int
+net_connect_addr(Boolean *pending)
+{
+	int			on = 1;
+#if defined(OMTU) /*[*/
+	int			mtu = OMTU;
+#endif /*]*/
+
+#	define close_fail	{ (void) SOCK_CLOSE(sock); sock = -1; return -1; }
+
+	(void) memcpy(&haddr, &haddrs.addr[haddr_ix], haddrs.len[haddr_ix]);
+	ha_len = haddrs.len[haddr_ix];
+
+	/* create the socket */
+	if ((sock = socket(haddr.sa.sa_family, SOCK_STREAM, 0)) == -1) {
+		popup_a_sockerr("socket");
+		return -1;
+	}
+
+	/* set options for inline out-of-band data and keepalives */
+	if (setsockopt(sock, SOL_SOCKET, SO_OOBINLINE, (char *)&on,
+		    sizeof(on)) < 0) {
+		popup_a_sockerr("setsockopt(SO_OOBINLINE)");
+		close_fail;
+	}
+	if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (char *)&on,
+		    sizeof(on)) < 0) {
+		popup_a_sockerr("setsockopt(SO_KEEPALIVE)");
+		close_fail;
+	}
+#if defined(OMTU) /*[*/
+	if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char *)&mtu,
+		    sizeof(mtu)) < 0) {
+		popup_a_sockerr("setsockopt(SO_SNDBUF)");
+		close_fail;
+	}
+#endif /*]*/
+
+	/* set the socket to be non-delaying */
+#if defined(_WIN32) /*[*/
+	if (non_blocking(False) < 0)
+#else /*][*/
+	if (non_blocking(True) < 0)
+#endif /*]*/
+		close_fail;
+
+#if !defined(_WIN32) /*[*/
+	/* don't share the socket with our children */
+	(void) fcntl(sock, F_SETFD, 1);
+#endif /*]*/
+
+	/* init ssl */
+#if defined(HAVE_LIBSSL) /*[*/
+	if (ssl_host)
+		ssl_init();
+#endif /*]*/
+
+	/* connect */
+	if (connect(sock, &haddr.sa, ha_len) == -1) {
+		if (socket_errno() == SE_EWOULDBLOCK
+#if defined(SE_EINPROGRESS) /*[*/
+		    || socket_errno() == SE_EINPROGRESS
+#endif /*]*/
+					   ) {
+			trace_dsn("Connection pending.\n");
+			*pending = True;
+#if !defined(_WIN32) /*[*/
+			output_id = AddOutput(sock, output_possible);
+#endif /*]*/
+		} else {
+			int e = socket_errno();
+
+			trace_dsn("Connect to address %d of %d failed.\n",
+			    haddr_ix + 1, haddrs.n);
+			(void) SOCK_CLOSE(sock);
+			sock = -1;
+			set_socket_errno(e);
+			return 1;
+		}
+	} else {
+		if (non_blocking(False) < 0)
+			close_fail;
+	}
+	return 0;
+}
+#undef close_fail
+
+/*
+ * None of the addresses answered.  Report the last error, and forget the
+ * cached look-up, in case the host has moved.
+ */
+static void
+net_connect_failed(void)
+{
+	popup_a_sockerr("Connect to %s, port %d", hostname, current_port);
+	if (rh_host != CN)
+		resolve_cache_flush(rh_host, rh_port);
+}
+
+/*
+ * Connect to the host, once haddrs has been filled in.
+ * Returns the file descriptor of the socket, or -1.
+ */
+static int
+net_connect_resolved(Boolean *pending)
+{
+	int rv;
+
+	if (!passthru_host) {
+		if (proxy_type > 0)
+			proxy_port = haddrs.port;
+		else
+			current_port = haddrs.port;
+	}
+
+	/* Try each address until one does not fail at once. */
+	while ((rv = net_connect_addr(pending)) > 0) {
+		if (++haddr_ix >= haddrs.n) {
+			net_connect_failed();
+			return -1;
+		}
+	}
+	if (rv < 0)
+		return -1;
+	if (!*pending) {
+		net_connected();
+#if !defined(_WIN32) /*[*/
+		/* The host is not connected until the proxy says so. */
+		if (proxy_ps != NULL)
+			*pending = True;
+#endif /*]*/
+	}
+
+	/* all done */
+#if defined(_WIN32) /*[*/
+	if (sock_handle == NULL) {
+		char ename[256];
+
+		sprintf(ename, "wc3270-%d", getpid());
+
+		sock_handle = CreateEvent(NULL, TRUE, FALSE, ename);
+		if (sock_handle == NULL) {
+			fprintf(stderr, "Cannot create socket handle: %s\n",
+			    win32_strerror(GetLastError()));
+			x3270_exit(1);
+		}
+	}
+	if (WSAEventSelect(sock, sock_handle, FD_READ | FD_CONNECT | FD_CLOSE)
+		    != 0) {
+		fprintf(stderr, "WSAEventSelect failed: %s\n",
+		    win32_strerror(GetLastError()));
+		x3270_exit(1);
+	}
+
+	return (int)sock_handle;
+#else /*][*/
+	return sock;
+#endif /*]*/
+}
+
+#if !defined(_WIN32) /*[*/
+/*
+ * net_resolved
+ *	The resolver process has answered.  Carry on connecting.
+ */
+static void
+net_resolved(void)
+{
+	rhresult_t res;
+	int s;
+	Boolean pending = False;
+
+	if (resolver_read(rh_host, rh_port, &res) < 0) {
+		popup_an_error("%s", res.errmsg);
+		host_resolved(-1, False);
+		return;
+	}
+	trace_dsn("Resolved %s/%s, %d address%s.\n", rh_host, rh_port,
+	    res.addrs.n, (res.addrs.n == 1)? "": "es");
+	haddrs = res.addrs;
+	haddr_ix = 0;
+	s = net_connect_resolved(&pending);
+	host_resolved(s, pending);
+}
+#endif /*]*/
+
 /*
  * net_connect
  *	Establish a telnet socket to the given host passed as an argument.
  *	Called only once and is responsible for setting up the telnet
  *	variables.  Returns the file descriptor of the connected socket.
+ *	If the host name is still being looked up, returns -1 and sets
+ *	*resolving; host_resolved() is called when the look-up is complete.
  */
 int
 net_connect(const char *host, char *portname, Boolean ls, Boolean *resolving,
@@ -428,13 +783,6 @@ net_connect(const char *host, char *portname, Boolean ls, Boolean *resolving,
 	char	        	passthru_haddr[8];
 	int			passthru_len = 0;
 	unsigned short		passthru_port = 0;
-	int			on = 1;
-	char			errmsg[1024];
-#if defined(OMTU) /*[*/
-	int			mtu = OMTU;
-#endif /*]*/
-
-#	define close_fail	{ (void) SOCK_CLOSE(sock); sock = -1; return -1; }
 
 #if defined(_WIN32) /*[*/
 	sockstart();
@@ -462,6 +810,13 @@ net_connect(const char *host, char *portname, Boolean ls, Boolean *resolving,
 
 	Replace(hostname, NewString(host));
 
+	/* set up temporary termtype */
+	if (appres.termname == CN && std_ds_host) {
+		(void) sprintf(ttype_tmpval, "IBM-327%c-%d",
+		    appres.m3279 ? '9' : '8', model_num);
+		termtype = ttype_tmpval;
+	}
+
 	/* get the passthru host and port number */
 	if (passthru_host) {
 		const char *hn;
@@ -506,21 +861,20 @@ net_connect(const char *host, char *portname, Boolean ls, Boolean *resolving,
 		    	return -1;
 	}
 
-	/* fill in the socket address of the given host */
-	(void) memset((char *) &haddr, 0, sizeof(haddr));
+	/* fill in the socket addresses of the given host */
+	(void) memset((char *) &haddrs, 0, sizeof(haddrs));
+	haddr_ix = 0;
 	if (passthru_host) {
-		haddr.sin.sin_family = AF_INET;
-		(void) memmove(&haddr.sin.sin_addr, passthru_haddr,
+		haddrs.addr[0].sin.sin_family = AF_INET;
+		(void) memmove(&haddrs.addr[0].sin.sin_addr, passthru_haddr,
 			       passthru_len);
-		haddr.sin.sin_port = passthru_port;
-		ha_len = sizeof(struct sockaddr_in);
+		haddrs.addr[0].sin.sin_port = passthru_port;
+		haddrs.len[0] = sizeof(struct sockaddr_in);
+		haddrs.n = 1;
+		Replace(rh_host, CN);
 	} else if (proxy_type > 0) {
-	    	if (resolve_host_and_port(proxy_host, proxy_portname,
-			    &proxy_port, &haddr.sa, &ha_len, errmsg,
-			    sizeof(errmsg)) < 0) {
-		    	popup_an_error("%s", errmsg);
+		if (net_resolve(proxy_host, proxy_portname, resolving) < 0)
 		    	return -1;
-		}
 	} else {
 #if defined(LOCAL_PROCESS) /*[*/
 		if (ls) {
@@ -530,17 +884,15 @@ net_connect(const char *host, char *portname, Boolean ls, Boolean *resolving,
 #if defined(LOCAL_PROCESS) /*[*/
 			local_process = False;
 #endif /*]*/
-			if (resolve_host_and_port(host, portname,
-				    &current_port, &haddr.sa, &ha_len,
-				    errmsg, sizeof(errmsg)) < 0) {
-			    	popup_an_error("%s", errmsg);
+			if (net_resolve(host, portname, resolving) < 0)
 			    	return -1;
-			}
 #if defined(LOCAL_PROCESS) /*[*/
 		}
 #endif /*]*/
 
 	}
+	if (*resolving)
+		return -1;
 
 #if defined(LOCAL_PROCESS) /*[*/
 	if (local_process) {
@@ -555,7 +907,7 @@ net_connect(const char *host, char *portname, Boolean ls, Boolean *resolving,
 		switch (forkpty(&amaster, NULL, NULL, &w)) {
 		    case -1:	/* failed */
 			popup_an_errno(errno, "forkpty");
-			close_fail;
+			return -1;
 		    case 0:	/* child */
 			putenv("TERM=xterm");
 			if (strchr(host, ' ') != CN) {
@@ -581,112 +933,12 @@ net_connect(const char *host, char *portname, Boolean ls, Boolean *resolving,
 			host_in3270(CONNECTED_ANSI);
 			break;
 		}
-	} else {
-#endif /*]*/
-		/* create the socket */
-		if ((sock = socket(haddr.sa.sa_family, SOCK_STREAM, 0)) == -1) {
-			popup_a_sockerr("socket");
-			return -1;
-		}
-
-		/* set options for inline out-of-band data and keepalives */
-		if (setsockopt(sock, SOL_SOCKET, SO_OOBINLINE, (char *)&on,
-			    sizeof(on)) < 0) {
-			popup_a_sockerr("setsockopt(SO_OOBINLINE)");
-			close_fail;
-		}
-		if (setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, (char *)&on,
-			    sizeof(on)) < 0) {
-			popup_a_sockerr("setsockopt(SO_KEEPALIVE)");
-			close_fail;
-		}
-#if defined(OMTU) /*[*/
-		if (setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char *)&mtu,
-			    sizeof(mtu)) < 0) {
-			popup_a_sockerr("setsockopt(SO_SNDBUF)");
-			close_fail;
-		}
-#endif /*]*/
-
-		/* set the socket to be non-delaying */
-#if defined(_WIN32) /*[*/
-		if (non_blocking(False) < 0)
-#else /*][*/
-		if (non_blocking(True) < 0)
-#endif /*]*/
-			close_fail;
-
-#if !defined(_WIN32) /*[*/
-		/* don't share the socket with our children */
-		(void) fcntl(sock, F_SETFD, 1);
-#endif /*]*/
-
-		/* init ssl */
-#if defined(HAVE_LIBSSL) /*[*/
-		if (ssl_host)
-			ssl_init();
-#endif /*]*/
-
-		/* connect */
-		if (connect(sock, &haddr.sa, ha_len) == -1) {
-			if (socket_errno() == SE_EWOULDBLOCK
-#if defined(SE_EINPROGRESS) /*[*/
-			    || socket_errno() == SE_EINPROGRESS
-#endif /*]*/
-						   ) {
-				trace_dsn("Connection pending.\n");
-				*pending = True;
-#if !defined(_WIN32) /*[*/
-				output_id = AddOutput(sock, output_possible);
-#endif /*]*/
-			} else {
-				popup_a_sockerr("Connect to %s, port %d",
-				    hostname, current_port);
-				close_fail;
-			}
-		} else {
-			if (non_blocking(False) < 0)
-				close_fail;
-			net_connected();
-		}
-#if defined(LOCAL_PROCESS) /*[*/
+		return sock;
 	}
 #endif /*]*/
 
-	/* set up temporary termtype */
-	if (appres.termname == CN && std_ds_host) {
-		(void) sprintf(ttype_tmpval, "IBM-327%c-%d",
-		    appres.m3279 ? '9' : '8', model_num);
-		termtype = ttype_tmpval;
-	}
-
-	/* all done */
-#if defined(_WIN32) /*[*/
-	if (sock_handle == NULL) {
-		char ename[256];
-
-		sprintf(ename, "wc3270-%d", getpid());
-
-		sock_handle = CreateEvent(NULL, TRUE, FALSE, ename);
-		if (sock_handle == NULL) {
-			fprintf(stderr, "Cannot create socket handle: %s\n",
-			    win32_strerror(GetLastError()));
-			x3270_exit(1);
-		}
-	}
-	if (WSAEventSelect(sock, sock_handle, FD_READ | FD_CONNECT | FD_CLOSE)
-		    != 0) {
-		fprintf(stderr, "WSAEventSelect failed: %s\n",
-		    win32_strerror(GetLastError()));
-		x3270_exit(1);
-	}
-
-	return (int)sock_handle;
-#else /*][*/
-	return sock;
-#endif /*]*/
+	return net_connect_resolved(pending);
 }
-#undef close_fail
 
 /* Set up the LU list. */
 static void
@@ -750,15 +1002,47 @@ net_connected(void)
 	    	trace_dsn("Connected to proxy server %s, port %u.\n",
 			proxy_host, proxy_port);
 
+#if !defined(_WIN32) /*[*/
+		/*
+		 * Let the event loop run while the proxy answers.
+		 * net_proxy_continue() carries on from here.
+		 */
+		proxy_ps = proxy_start(proxy_type, sock, hostname,
+			current_port);
+		if (proxy_ps == NULL) {
+		    	host_disconnect(True);
+			return;
+		}
+		if (!net_proxy_resolve())
+			net_proxy_continue();
+		return;
+#else /*][*/
 	    	if (proxy_negotiate(proxy_type, sock, hostname,
 			    current_port) < 0) {
 		    	host_disconnect(True);
 			return;
 		}
+#endif /*]*/
 	}
 
+	net_connected_host();
+}
+
+/*
+ * net_connected_host
+ *	We have a connection to the host itself, possibly through a proxy.
+ *	Tell the world, if the connection was pending, and set up SSL and the
+ *	telnet state.  A connection through a proxy stays pending until
+ *	here, so scripts and the status line do not report it as connected
+ *	before the proxy has agreed to it.
+ */
+static void
+net_connected_host(void)
+{
 	trace_dsn("Connected to %s, port %u%s.\n", hostname, current_port,
 	    ssl_host? " via SSL": "");
+	if (cstate == PENDING)
+		host_connected();
 
 #if defined(HAVE_LIBSSL) /*[*/
 	/* Set up SSL. */
@@ -840,11 +1124,126 @@ connection_complete(void)
 		return;
 	}
 #endif /*]*/
-	host_connected();
 	net_connected();
 }
 
 #if !defined(_WIN32) /*[*/
+/* Stop waiting for the proxy socket, the proxy timeout or a look-up. */
+static void
+net_proxy_wait_cancel(void)
+{
+	net_resolve_cancel();
+	if (proxy_output_id) {
+		RemoveInput(proxy_output_id);
+		proxy_output_id = 0L;
+	}
+	if (proxy_timeout_id) {
+		RemoveTimeOut(proxy_timeout_id);
+		proxy_timeout_id = 0L;
+	}
+}
+
+/* The proxy has taken too long over a step. */
+static void
+net_proxy_timeout(void)
+{
+	proxy_timeout_id = 0L;
+	net_proxy_continue();
+}
+
+/*
+ * net_proxy_resolve
+ *	Look up the host's address for a SOCKS proxy to connect to.  A cached
+ *	answer is used at once; otherwise the resolver process looks it up,
+ *	net_proxy_resolved() carries on, and True is returned.
+ */
+static Boolean
+net_proxy_resolve(void)
+{
+	char portname[16];
+	rhaddrs_t r;
+	int i;
+
+	if (!proxy_wants_addr(proxy_ps))
+		return False;
+	(void) snprintf(portname, sizeof(portname), "%u", current_port);
+	if (resolve_cache_lookup(hostname, portname, &r)) {
+		for (i = 0; i < r.n; i++)
+			proxy_set_addr(proxy_ps, &r.addr[i].sa, r.len[i]);
+		return False;
+	}
+	if (resolver_start(hostname, portname, net_proxy_resolved) < 0)
+		return False;
+	proxy_timeout_id = AddTimeOut(proxy_timeout_ms(proxy_ps) + 1L,
+		net_proxy_resolve_timeout);
+	return True;
+}
+
+/*
+ * net_proxy_resolved
+ *	The resolver process has answered for the proxy.  If the name could
+ *	not be looked up, the proxy is sent the name instead.
+ */
+static void
+net_proxy_resolved(void)
+{
+	char portname[16];
+	rhresult_t res;
+	int i;
+
+	(void) snprintf(portname, sizeof(portname), "%u", current_port);
+	if (resolver_read(hostname, portname, &res) < 0) {
+		trace_dsn("%s; sending the name to the proxy.\n",
+		    res.errmsg);
+		res.addrs.n = 0;
+	}
+	for (i = 0; i < res.addrs.n; i++)
+		proxy_set_addr(proxy_ps, &res.addrs.addr[i].sa,
+		    res.addrs.len[i]);
+	proxy_set_addr(proxy_ps, NULL, 0);
+	net_proxy_continue();
+}
+
+/* The host's address for the proxy is taking too long to look up. */
+static void
+net_proxy_resolve_timeout(void)
+{
+	proxy_timeout_id = 0L;
+	trace_dsn("Timed out resolving %s; sending the name to the proxy.\n",
+	    hostname);
+	proxy_set_addr(proxy_ps, NULL, 0);
+	net_proxy_continue();
+}
+
+/*
+ * net_proxy_continue
+ *	Move proxy negotiation along, then wait for whatever it needs next.
+ *	Input is picked up by net_input(); output space and the time limit
+ *	are waited for here.
+ */
+static void
+net_proxy_continue(void)
+{
+	net_proxy_wait_cancel();
+	switch (proxy_continue(proxy_ps)) {
+	case PX_WANTWRITE:
+		proxy_output_id = AddOutput(sock, net_proxy_continue);
+		/* fall through... */
+	case PX_WANTREAD:
+		proxy_timeout_id = AddTimeOut(proxy_timeout_ms(proxy_ps) + 1L,
+			net_proxy_timeout);
+		break;
+	case PX_SUCCESS:
+		proxy_ps = NULL;
+		net_connected_host();
+		break;
+	default:
+		proxy_ps = NULL;
+		host_disconnect(True);
+		break;
+	}
+}
+
 /*
  * output_possible
  *	Output is possible on the socket.  Used only when a connection is
@@ -853,13 +1252,57 @@ connection_complete(void)
 static void
 output_possible(void)
 {
+	if (output_id) {
+		RemoveInput(output_id);
+		output_id = 0L;
+	}
 	if (HALF_CONNECTED) {
+		int e = 0;
+		socklen_t len = sizeof(e);
+
+		if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *)&e,
+			    &len) == 0 && e != 0) {
+			/* That address did not answer. */
+			net_connect_next(e);
+			return;
+		}
 		connection_complete();
 	}
+}
+
+/*
+ * net_connect_next
+ *	A pending connection failed.  Move on to the host's next address.
+ */
+static void
+net_connect_next(int e)
+{
+	Boolean pending = False;
+	int rv = 1;
+
+	trace_dsn("Connect to address %d of %d failed.\n", haddr_ix + 1,
+	    haddrs.n);
+	x_remove_input();
 	if (output_id) {
 		RemoveInput(output_id);
 		output_id = 0L;
 	}
+	(void) SOCK_CLOSE(sock);
+	sock = -1;
+	errno = e;
+
+	while (rv > 0 && ++haddr_ix < haddrs.n)
+		rv = net_connect_addr(&pending);
+	if (rv > 0)
+		net_connect_failed();
+	if (rv) {
+		host_disconnect(True);
+		return;
+	}
+
+	x_add_input(sock);
+	if (!pending)
+		connection_complete();
 }
 #endif /*]*/
 
@@ -897,6 +1340,14 @@ net_disconnect(void)
 		RemoveInput(output_id);
 		output_id = 0L;
 	}
+
+	/* Nor in the answer to a look-up, or the proxy. */
+	net_resolve_cancel();
+	net_proxy_wait_cancel();
+	if (proxy_ps != NULL) {
+		proxy_abort(proxy_ps);
+		proxy_ps = NULL;
+	}
 #endif /*]*/
 }
 
@@ -920,6 +1371,14 @@ net_input(void)
 		if (sock < 0)
 			return;
 
+#if !defined(_WIN32) /*[*/
+		/* Input from the proxy belongs to the negotiation. */
+		if (proxy_ps != NULL) {
+			net_proxy_continue();
+			return;
+		}
+#endif /*]*/
+
 #if defined(_WIN32) /*[*/
 		if (HALF_CONNECTED) {
 			if (connect(sock, &haddr.sa, sizeof(haddr)) < 0) {
@@ -1004,6 +1463,13 @@ net_input(void)
 				win32_strerror(GetLastError())
 #endif /*]*/
 				);
+#if !defined(_WIN32) /*[*/
+			if (HALF_CONNECTED) {
+				/* Try the next address, if there is one. */
+				net_connect_next(errno);
+				return;
+			}
+#endif /*]*/
 			if (HALF_CONNECTED) {
 				popup_a_sockerr("Connect to %s, port %d",
 				    hostname, current_port);
@@ -1026,7 +1492,6 @@ net_input(void)
 				host_disconnect(True);
 				return;
 			}
-			host_connected();
 			net_connected();
 		}
 
@@ -1035,7 +1500,35 @@ net_input(void)
 #endif /*]*/
 
 		ns_brcvd += nr;
+		session_count(nr, 0);
 		for (cp = netrbuf; cp < (netrbuf + nr); cp++) {
+			/*
+			 * Test builds define X3270_TEST_BYTEWISE to send every
+			 * byte through telnet_fsm, so the fast path can be
+			 * checked against it.
+			 */
+#if !defined(X3270_TEST_BYTEWISE) /*[*/
+#if defined(LOCAL_PROCESS) /*[*/
+			if (!local_process)
+#endif /*]*/
+			if (telnet_state == TNS_DATA &&
+			    *cp != IAC && !IN_NEITHER && !(IN_ANSI && !IN_E)) {
+				unsigned char *iac;
+
+				/*
+				 * Fast path for 3270 data: copy everything
+				 * up to the next IAC directly into ibuf.
+				 * Only IAC sequences go through telnet_fsm.
+				 */
+				iac = (unsigned char *)memchr(cp, IAC,
+				    (netrbuf + nr) - cp);
+				if (iac == (unsigned char *)NULL)
+					iac = netrbuf + nr;
+				store3270in_run(cp, iac - cp);
+				cp = iac - 1;
+				continue;
+			}
+#endif /*]*/
 #if defined(LOCAL_PROCESS) /*[*/
 			if (local_process) {
 				/* More to do here, probably. */
@@ -1217,8 +1710,11 @@ telnet_fsm(unsigned char c)
 			telnet_state = TNS_DATA;
 			break;
 		    case EOR:	/* eor, process accumulated input */
+			if (ibptr - ibuf > ibuf_hwm)
+				ibuf_hwm = ibptr - ibuf;
 			if (IN_3270 || (IN_E && tn3270e_negotiated)) {
 				ns_rrcvd++;
+				session_count(0, 1);
 				if (process_eor())
 					return -1;
 			} else
@@ -1540,9 +2036,6 @@ backoff_tn3270e(const char *why)
 static int
 tn3270e_negotiate(void)
 {
-#define LU_MAX	32
-	static char reported_lu[LU_MAX+1];
-	static char reported_type[LU_MAX+1];
 	int sblen;
 	unsigned long e_rcvd;
 
@@ -2100,6 +2593,7 @@ net_rawout(unsigned const char *buf, int len)
 			}
 		}
 		ns_bsent += nw;
+		session_count(nw, 0);
 		len -= nw;
 		buf += nw;
 	    bot:
@@ -2547,6 +3041,28 @@ check_in3270(void)
 	}
 }
 
+/*
+ * grow3270buf
+ *	Grow a 3270 I/O buffer so that it can hold at least <need> bytes.
+ *	The buffer is doubled each time, so a large record costs only a
+ *	few reallocations, and is never shrunk, so it is reused for the
+ *	rest of the session.
+ *	Returns the (possibly moved) buffer and updates *size.
+ */
+static unsigned char *
+grow3270buf(unsigned char *buf, int *size, int need)
+{
+	int new_size = *size? *size: BUFSIZ;
+
+	while (new_size < need)
+		new_size *= 2;
+	if (new_size != *size) {
+		buf = (unsigned char *)Realloc((char *)buf, new_size);
+		*size = new_size;
+	}
+	return buf;
+}
+
 /*
  * store3270in
  *	Store a character in the 3270 input buffer, checking for buffer
@@ -2556,42 +3072,54 @@ static void
 store3270in(unsigned char c)
 {
 	if (ibptr - ibuf >= ibuf_size) {
-		ibuf_size += BUFSIZ;
-		ibuf = (unsigned char *)Realloc((char *)ibuf, ibuf_size);
-		ibptr = ibuf + ibuf_size - BUFSIZ;
+		int nc = ibptr - ibuf;
+
+		ibuf = grow3270buf(ibuf, &ibuf_size, nc + 1);
+		ibptr = ibuf + nc;
 	}
 	*ibptr++ = c;
 }
 
+/*
+ * store3270in_run
+ *	Store a run of characters (which contains no IACs) in the 3270 input
+ *	buffer, reallocating ibuf if necessary.
+ */
+static void
+store3270in_run(const unsigned char *buf, int len)
+{
+	int nc = ibptr - ibuf;
+
+	if (nc + len > ibuf_size) {
+		ibuf = grow3270buf(ibuf, &ibuf_size, nc + len);
+		ibptr = ibuf + nc;
+	}
+	(void) memcpy(ibptr, buf, len);
+	ibptr += len;
+}
+
 /*
  * space3270out
  *	Ensure that <n> more characters will fit in the 3270 output buffer.
- *	Allocates the buffer in BUFSIZ chunks.
  *	Allocates hidden space at the front of the buffer for TN3270E.
  */
 void
 space3270out(int n)
 {
 	unsigned nc = 0;	/* amount of data currently in obuf */
-	unsigned more = 0;
 
 	if (obuf_size)
 		nc = obptr - obuf;
 
-	while ((nc + n + EH_SIZE) > (obuf_size + more)) {
-		more += BUFSIZ;
-	}
-
-	if (more) {
-		obuf_size += more;
-		obuf_base = (unsigned char *)Realloc((char *)obuf_base,
-			obuf_size);
+	if ((int)(nc + n + EH_SIZE) > obuf_size) {
+		obuf_base = grow3270buf(obuf_base, &obuf_size,
+			nc + n + EH_SIZE);
 		obuf = obuf_base + EH_SIZE;
 		obptr = obuf + nc;
 	}
 }
 
-
+
 /*
  * check_linemode
  *	Set the global variable 'linemode', which says whether we are in
@@ -2682,30 +3210,47 @@ opt(unsigned char c)
 
 
 #define LINEDUMP_MAX	32
+#define LINEDUMP_LEN	(2 * LINEDUMP_MAX + 32)	/* longest formatted line */
 
 void
 trace_netdata(char direction, unsigned const char *buf, int len)
 {
+	static const char hexdigit[] = "0123456789abcdef";
 	int offset;
 	struct timeval ts;
 	double tdiff;
+	char dbuf[64 * LINEDUMP_LEN];
+	char *dp = dbuf;
 
 	if (!toggled(DS_TRACE))
 		return;
 	(void) gettimeofday(&ts, (struct timezone *)NULL);
+	if (trace_netdata_binary(direction, buf, len, &ts, IN_3270)) {
+		ds_ts = ts;
+		return;
+	}
 	if (IN_3270) {
 		tdiff = ((1.0e6 * (double)(ts.tv_sec - ds_ts.tv_sec)) +
 			(double)(ts.tv_usec - ds_ts.tv_usec)) / 1.0e6;
 		trace_dsn("%c +%gs\n", direction, tdiff);
 	}
 	ds_ts = ts;
+
+	/* Format the dump a block of lines at a time. */
 	for (offset = 0; offset < len; offset++) {
-		if (!(offset % LINEDUMP_MAX))
-			trace_dsn("%s%c 0x%-3x ",
+		if (!(offset % LINEDUMP_MAX)) {
+			if (dp - dbuf > (int)sizeof(dbuf) - LINEDUMP_LEN) {
+				trace_dsn_text(dbuf, dp - dbuf);
+				dp = dbuf;
+			}
+			dp += sprintf(dp, "%s%c 0x%-3x ",
 			    (offset ? "\n" : ""), direction, offset);
-		trace_dsn("%02x", buf[offset]);
+		}
+		*dp++ = hexdigit[buf[offset] >> 4];
+		*dp++ = hexdigit[buf[offset] & 0x0f];
 	}
-	trace_dsn("\n");
+	*dp++ = '\n';
+	trace_dsn_text(dbuf, dp - dbuf);
 }
 #endif /*]*/
 
@@ -2716,14 +3261,15 @@ trace_netdata(char direction, unsigned const char *buf, int len)
  *	- Prepend TN3270E header
  *	- Expand IAC to IAC IAC
  *	- Append IAC EOR
+ *	The IACs are expanded in place, so the contents of obuf are not
+ *	preserved.
  */
 void
 net_output(void)
 {
-	static unsigned char *xobuf = NULL;
-	static int xobuf_len = 0;
-	int need_resize = 0;
-	unsigned char *nxoptr, *xoptr;
+	unsigned char *iac, *src, *dst;
+	int n_iac = 0;
+	int len;
 
 #if defined(X3270_TN3270E) /*[*/
 #define BSTART	((IN_TN3270E || IN_SSCP) ? obuf_base : obuf)
@@ -2757,31 +3303,38 @@ net_output(void)
 	}
 #endif /*]*/
 
-	/* Reallocate the expanded output buffer. */
-	while (xobuf_len <  (obptr - BSTART + 1) * 2) {
-		xobuf_len += BUFSZ;
-		need_resize++;
-	}
-	if (need_resize) {
-		Replace(xobuf, (unsigned char *)Malloc(xobuf_len));
+	/* Count the IACs. */
+	src = BSTART;
+	while (src < obptr &&
+	       (iac = (unsigned char *)memchr(src, IAC, obptr - src)) != NULL) {
+		n_iac++;
+		src = iac + 1;
 	}
 
-	/* Copy and expand IACs. */
-	xoptr = xobuf;
-	nxoptr = BSTART;
-	while (nxoptr < obptr) {
-		if ((*xoptr++ = *nxoptr++) == IAC) {
-			*xoptr++ = IAC;
-		}
+	/* Make room for the expansion and the IAC EOR. */
+	space3270out(n_iac + 2);
+	len = (obptr - BSTART) + n_iac;
+
+	/* Expand IACs in place, working from the end. */
+	src = obptr;
+	dst = obptr + n_iac;
+	while (dst != src) {
+		if ((*--dst = *--src) == IAC)
+			*--dst = IAC;
 	}
 
 	/* Append the IAC EOR and transmit. */
-	*xoptr++ = IAC;
-	*xoptr++ = EOR;
-	net_rawout(xobuf, xoptr - xobuf);
+	dst = BSTART + len;
+	*dst++ = IAC;
+	*dst++ = EOR;
+	len += 2;
+	if (len > obuf_hwm)
+		obuf_hwm = len;
+	net_rawout(BSTART, len);
 
 	trace_dsn("SENT EOR\n");
 	ns_rsent++;
+	session_count(0, 1);
 #undef BSTART
 }
 
@@ -3525,6 +4078,21 @@ net_query_host(void)
 		return "";
 }
 
+/*
+ * Return the sizes and high-water marks of the 3270 input and output
+ * buffers.
+ */
+const char *
+net_query_buffer_sizes(void)
+{
+	static char *s = CN;
+
+	Free(s);
+	s = xs_buffer("input %d %d output %d %d",
+	    ibuf_size, ibuf_hwm, obuf_size, obuf_hwm);
+	return s;
+}
+
 /* Return the local address for the socket. */
 int
 net_getsockname(void *buf, int *len)
@@ -3570,3 +4138,105 @@ net_bound(void)
 {
     	return (IN_E && tn3270e_bound);
 }
+
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+net_session_vars(void)
+{
+	SESSION_VAR(hostname);
+	SESSION_VAR(haddrs);
+	SESSION_VAR(haddr_ix);
+	SESSION_VAR(rh_host);
+	SESSION_VAR(rh_port);
+#if !defined(_WIN32) /*[*/
+	SESSION_VAR(resolver_pid);
+	SESSION_VAR(resolver_fd);
+	SESSION_VAR(resolver_id);
+	SESSION_VAR(proxy_ps);
+	SESSION_VAR(proxy_output_id);
+	SESSION_VAR(proxy_timeout_id);
+#endif /*]*/
+	SESSION_VAR(ns_time);
+	SESSION_VAR(ns_brcvd);
+	SESSION_VAR(ns_rrcvd);
+	SESSION_VAR(ns_bsent);
+	SESSION_VAR(ns_rsent);
+	SESSION_VAR(obuf);
+	SESSION_VAR(obptr);
+	SESSION_VAR(linemode);
+#if defined(LOCAL_PROCESS) /*[*/
+	SESSION_VAR(local_process);
+#endif /*]*/
+	SESSION_VAR(termtype);
+	SESSION_VAR(sock);
+	SESSION_VAR(myopts);
+	SESSION_VAR(hisopts);
+	SESSION_VAR(ibuf);
+	SESSION_VAR(ibptr);
+	SESSION_VAR(ibuf_size);
+	SESSION_VAR(obuf_base);
+	SESSION_VAR(obuf_size);
+	SESSION_VAR(ibuf_hwm);
+	SESSION_VAR(obuf_hwm);
+	SESSION_VAR(netrbuf);
+	SESSION_VAR(sbbuf);
+	SESSION_VAR(sbptr);
+	SESSION_VAR(telnet_state);
+	SESSION_VAR(syncing);
+#if !defined(_WIN32) /*[*/
+	SESSION_VAR(output_id);
+#endif /*]*/
+	SESSION_VAR(ttype_tmpval);
+#if defined(X3270_TN3270E) /*[*/
+	SESSION_VAR(e_funcs);
+	SESSION_VAR(e_xmit_seq);
+	SESSION_VAR(response_required);
+	SESSION_VAR(reported_lu);
+	SESSION_VAR(reported_type);
+#endif /*]*/
+#if defined(X3270_ANSI) /*[*/
+	SESSION_VAR(ansi_data);
+	SESSION_VAR(lbuf);
+	SESSION_VAR(lbptr);
+	SESSION_VAR(lnext);
+	SESSION_VAR(backslashed);
+	SESSION_VAR(t_valid);
+	SESSION_VAR(vintr);
+	SESSION_VAR(vquit);
+	SESSION_VAR(verase);
+	SESSION_VAR(vkill);
+	SESSION_VAR(veof);
+	SESSION_VAR(vwerase);
+	SESSION_VAR(vrprnt);
+	SESSION_VAR(vlnext);
+#endif /*]*/
+	SESSION_VAR(tn3270e_negotiated);
+	SESSION_VAR(tn3270e_submode);
+	SESSION_VAR(tn3270e_bound);
+	SESSION_VAR(bind_image);
+	SESSION_VAR(bind_image_len);
+	SESSION_VAR(plu_name);
+	SESSION_VAR(maxru_sec);
+	SESSION_VAR(maxru_pri);
+	SESSION_VAR(bind_ss);
+	SESSION_VAR(bind_rd);
+	SESSION_VAR(bind_cd);
+	SESSION_VAR(bind_ra);
+	SESSION_VAR(bind_ca);
+	SESSION_VAR(lus);
+	SESSION_VAR(curr_lu);
+	SESSION_VAR(try_lu);
+	SESSION_VAR(proxy_type);
+	SESSION_VAR(proxy_host);
+	SESSION_VAR(proxy_portname);
+	SESSION_VAR(proxy_port);
+	SESSION_VAR(haddr);
+	SESSION_VAR(ha_len);
+#if defined(HAVE_LIBSSL) /*[*/
+	SESSION_VAR(secure_connection);
+	SESSION_VAR(ssl_con);
+	SESSION_VAR(need_tls_follows);
+#endif /*]*/
+}
+#endif /*]*/
@@ -57,6 +57,7 @@ extern void net_linemode(void);
 extern struct ctl_char *net_linemode_chars(void);
 extern void net_output(void);
 extern const char *net_query_bind_plu_name(void);
+extern const char *net_query_buffer_sizes(void);
 extern const char *net_query_connection_state(void);
 extern const char *net_query_host(void);
 extern const char *net_query_lu_name(void);
@@ -65,6 +66,9 @@ extern void net_sends(const char *s);
 extern void net_send_erase(void);
 extern void net_send_kill(void);
 extern void net_send_werase(void);
+#if defined(X3270_SESSIONS) /*[*/
+extern void net_session_vars(void);
+#endif /*]*/
 extern Boolean net_snap_options(void);
 extern void space3270out(int n);
 extern const char *tn3270e_current_opts(void);
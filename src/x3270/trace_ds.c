@@ -48,6 +48,7 @@
 #include <fcntl.h>
 #include "3270ds.h"
 #include "appres.h"
+#include "bintrace.h"
 #include "objects.h"
 #include "resources.h"
 #include "ctlr.h"
@@ -60,6 +61,7 @@
 #include "popupsc.h"
 #include "printc.h"
 #include "savec.h"
+#include "sessionc.h"
 #include "tablesc.h"
 #include "telnetc.h"
 #include "trace_dsc.h"
@@ -74,6 +76,10 @@
 /* Maximum size of a tracefile header. */
 #define MAX_HEADER_SIZE		(10*1024)
 
+/* Size of the trace output buffer, and how long data may sit in it. */
+#define TRACE_BUFSIZE		(64*1024)
+#define TRACE_FLUSH_MS		250
+
 /* Minimum size of a trace file. */
 #define MIN_TRACEFILE_SIZE	(64*1024)
 #define MIN_TRACEFILE_SIZE_NAME	"64K"
@@ -98,8 +104,17 @@ static off_t	tracef_size = 0;
 static off_t	tracef_max = 0;
 static char    *tracef_midpoint_header = CN;
 static off_t	tracef_midpoint = 0;
+static char    *tracef_obuf = CN;
+static size_t	tracef_olen = 0;
+static unsigned long tracef_flush_id = 0L;
+static Boolean	tracef_atexit = False;
+static Boolean	tracef_binary = False;	/* writing BT_ frames */
+static int	tracef_text_type = BT_TEXT; /* frame type for trace text */
 static void	vwtrace(const char *fmt, va_list args);
 static void	wtrace(const char *fmt, ...);
+static void	trace_write(const char *s, size_t len);
+static void	trace_frame(int type, int direction, int flags,
+		    struct timeval *ts, const char *buf, size_t len);
 static char    *create_tracefile_header(const char *mode);
 static void	stop_tracing(void);
 
@@ -166,6 +181,9 @@ trace_ds_s(char *s, Boolean can_break)
 		nl = True;
 	}
 
+	/* In a binary trace, this text goes in its own frames. */
+	tracef_text_type = BT_DECODE;
+
 	if (!can_break && dscnt + wlen >= 75) {
 		wtrace("...\n... ");
 		dscnt = 0;
@@ -206,6 +224,7 @@ trace_ds_s(char *s, Boolean can_break)
 		wtrace("\n");
 		dscnt = 0;
 	}
+	tracef_text_type = BT_TEXT;
 	Free(mb_chunk);
 	Free(w_buf);
 	Free(w_chunk);
@@ -281,10 +300,73 @@ trace_dsn(const char *fmt, ...)
 	va_end(args);
 }
 
+/*
+ * Write a block of text to the trace file, with no formatting.
+ * Used for bulk output such as hex dumps.
+ */
+void
+trace_dsn_text(const char *s, size_t len)
+{
+	if (!toggled(DS_TRACE) || tracef == NULL)
+		return;
+	if (tracef_bufptr != CN) {
+		(void) memcpy(tracef_bufptr, s, len);
+		tracef_bufptr += len;
+		*tracef_bufptr = '\0';
+	} else if (tracef_binary)
+		trace_frame(BT_TEXT, 0, 0, NULL, s, len);
+	else
+		trace_write(s, len);
+}
+
+/*
+ * Record network data in a binary trace.
+ * Returns True if the trace is binary (and the data has been recorded),
+ * False if the caller should format it as text.
+ */
+Boolean
+trace_netdata_binary(char direction, const unsigned char *buf, int len,
+    struct timeval *ts, Boolean in3270)
+{
+	if (!tracef_binary)
+		return False;
+	if (toggled(DS_TRACE) && tracef != NULL)
+		trace_frame(BT_DATA, direction, in3270? BTF_3270: 0, ts,
+		    (const char *)buf, len);
+	return True;
+}
+
+/* Write a binary trace frame. */
+static void
+trace_frame(int type, int direction, int flags, struct timeval *ts,
+    const char *buf, size_t len)
+{
+	unsigned char hdr[BT_HDR_LEN];
+	struct timeval now;
+
+	if (ts == NULL) {
+		(void) gettimeofday(&now, (struct timezone *)NULL);
+		ts = &now;
+	}
+	hdr[0] = type;
+	hdr[1] = direction;
+	hdr[2] = flags;
+	hdr[3] = 0;
+	BT_PUT32(hdr + 4, (unsigned long)len);
+	BT_PUT64(hdr + 8, (unsigned long)ts->tv_sec);
+	BT_PUT32(hdr + 16, (unsigned long)ts->tv_usec);
+
+	/* Keep frames whole in the buffer, so flushes end on a frame. */
+	if (tracef_olen + BT_HDR_LEN + len > TRACE_BUFSIZE)
+		trace_flush();
+	trace_write((char *)hdr, BT_HDR_LEN);
+	trace_write(buf, len);
+}
+
 /*
  * Write to the trace file, varargs style.
- * This is the only function that actually does output to the trace file --
- * all others are wrappers around this function.
+ * This is the only function that actually formats output to the trace file
+ * -- all others are wrappers around this function.
  */
 static void
 vwtrace(const char *fmt, va_list args)
@@ -292,39 +374,149 @@ vwtrace(const char *fmt, va_list args)
 	if (tracef_bufptr != CN) {
 		tracef_bufptr += vsprintf(tracef_bufptr, fmt, args);
 	} else if (tracef != NULL) {
-		int n2w, nw;
 		char buf[16384];
 
 		buf[0] = 0;
 		(void) vsnprintf(buf, sizeof(buf), fmt, args);
 		buf[sizeof(buf) - 1] = '\0';
-		n2w = strlen(buf);
+		if (tracef_binary)
+			trace_frame(tracef_text_type, 0, 0, NULL, buf,
+			    strlen(buf));
+		else
+			trace_write(buf, strlen(buf));
+	}
+}
 
-		nw = fwrite(buf, n2w, 1, tracef);
-		if (nw == 1) {
-			tracef_size += nw;
-			fflush(tracef);
-		} else {
-			if (errno != EPIPE
+/* The flush timer has expired. */
+static void
+trace_flush_timeout(void)
+{
+	tracef_flush_id = 0L;
+	trace_flush();
+}
+
+/* Flush the trace buffer at exit, however we got there. */
+static void
+trace_exit(void)
+{
+	trace_flush();
+	if (tracef != NULL)
+		(void) fflush(tracef);
+}
+
+#if !defined(_WIN32) /*[*/
+/*
+ * Write out the trace buffer on a fatal signal, then die of the signal.
+ * Only write() is safe here; trace_flush() writes through stdio and never
+ * leaves anything buffered there, so the buffer is all that is pending.
+ */
+static void
+trace_fatal_signal(int sig)
+{
+	if (tracef != NULL && tracef_obuf != CN && tracef_olen)
+		(void) write(fileno(tracef), tracef_obuf, tracef_olen);
+	tracef_olen = 0;
+	(void) signal(sig, SIG_DFL);
+	(void) raise(sig);
+}
+
+/* Catch the fatal signals that the application doesn't handle itself. */
+static void
+trace_catch_signals(void)
+{
+	static int sigs[] = { SIGTERM, SIGHUP, SIGSEGV, SIGBUS, SIGFPE,
+			      SIGILL, SIGABRT };
+	void (*old)(int);
+	unsigned i;
+
+	for (i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i++) {
+		old = signal(sigs[i], trace_fatal_signal);
+		if (old != SIG_DFL && old != trace_fatal_signal)
+			(void) signal(sigs[i], old);
+	}
+}
+#endif /*]*/
+
+/*
+ * Append text to the trace buffer.  The buffer is written out when it
+ * fills, TRACE_FLUSH_MS after the first data is added to it, and when
+ * tracing stops.
+ */
+static void
+trace_write(const char *s, size_t len)
+{
+	if (tracef == NULL)
+		return;
+	if (tracef_obuf == CN)
+		tracef_obuf = Malloc(TRACE_BUFSIZE);
+	if (tracef_olen + len > TRACE_BUFSIZE) {
+		trace_flush();
+		if (tracef == NULL)
+			return;
+	}
+	if (len > TRACE_BUFSIZE) {
+		/* Too big to buffer. */
+		char *save = tracef_obuf;
+
+		tracef_obuf = (char *)s;
+		tracef_olen = len;
+		trace_flush();
+		tracef_obuf = save;
+		tracef_size += len;
+		return;
+	}
+	(void) memcpy(tracef_obuf + tracef_olen, s, len);
+	tracef_olen += len;
+	tracef_size += len;
+	if (!tracef_flush_id)
+		tracef_flush_id = AddTimeOut(TRACE_FLUSH_MS,
+		    trace_flush_timeout);
+}
+
+/*
+ * Write out the trace buffer.  Also called before fork(), so a child process
+ * does not inherit unwritten trace data and write it again.
+ */
+void
+trace_flush(void)
+{
+	size_t n2w = tracef_olen;
+	int nw;
+
+	if (tracef_flush_id) {
+		RemoveTimeOut(tracef_flush_id);
+		tracef_flush_id = 0L;
+	}
+	tracef_olen = 0;
+	if (!n2w || tracef == NULL)
+		return;
+
+	nw = fwrite(tracef_obuf, n2w, 1, tracef);
+	if (nw == 1) {
+		fflush(tracef);
+	} else {
+		if (errno != EPIPE
 #if defined(EILSEQ) /*[*/
-					   && errno != EILSEQ
+				   && errno != EILSEQ
 #endif /*]*/
-					                     )
-				popup_an_errno(errno,
-				    "Write to trace file failed");
+						     )
+			popup_an_errno(errno,
+			    "Write to trace file failed");
 #if defined(EILSEQ) /*[*/
-			if (errno != EILSEQ)
+		if (errno != EILSEQ)
 #endif /*]*/
-				stop_tracing();
+		{
+			stop_tracing();
+			return;
 		}
-		if (tracef_pipe != NULL) {
-			nw = fwrite(buf, n2w, 1, tracef_pipe);
-			if (nw != 1) {
-				(void) fclose(tracef_pipe);
-				tracef_pipe = NULL;
-			} else {
-			    	fflush(tracef_pipe);
-			}
+	}
+	if (tracef_pipe != NULL && !tracef_binary) {
+		nw = fwrite(tracef_obuf, n2w, 1, tracef_pipe);
+		if (nw != 1) {
+			(void) fclose(tracef_pipe);
+			tracef_pipe = NULL;
+		} else {
+			fflush(tracef_pipe);
 		}
 	}
 }
@@ -345,9 +537,11 @@ wtrace(const char *fmt, ...)
 static void
 stop_tracing(void)
 {
+	trace_flush();
 	if (tracef != NULL && tracef != stdout)
 		(void) fclose(tracef);
 	tracef = NULL;
+	tracef_binary = False;
 	if (tracef_pipe != NULL) {
 		(void) fclose(tracef_pipe);
 		tracef_pipe = NULL;
@@ -372,6 +566,9 @@ trace_rollover_check(void)
 	/* See if we've reached the midpoint. */
 	if (!tracef_midpoint) {
 		if (tracef_size >= tracef_max / 2) {
+			trace_flush();
+			if (tracef == NULL)
+				return;
 			tracef_midpoint = ftello(tracef);
 #if defined(ROLLOVER_DEBUG) /*[*/
 			printf("midpoint is %lld\n", tracef_midpoint);
@@ -390,6 +587,9 @@ trace_rollover_check(void)
 
 		if (!tracef_midpoint)
 			Error("Tracefile rollover logic error");
+		trace_flush();
+		if (tracef == NULL)
+			return;
 #if defined(ROLLOVER_DEBUG) /*[*/
 		printf("rolling over at %lld\n", tracef_size);
 #endif /*]*/
@@ -402,7 +602,12 @@ trace_rollover_check(void)
 			stop_tracing();
 			return;
 		}
+		if (tracef_binary)
+			trace_write(BT_MAGIC, BT_MAGIC_LEN);
 		wtrace("%s", tracef_midpoint_header);
+		trace_flush();
+		if (tracef == NULL)
+			return;
 		wpos = ftello(tracef);
 		if (wpos < 0) {
 			popup_an_errno(errno, "trace file ftello() failed");
@@ -769,7 +974,9 @@ tracefile_callback(Widget w, XtPointer client_data, XtPointer call_data _is_unus
 			if ((devfd = get_devfd(tfn)) >= 0)
 				tracef = fdopen(dup(devfd), "a");
 			else
-				tracef = fopen(tfn, tracef_max? "w+": "a");
+				tracef = fopen(tfn, appres.trace_binary?
+				    (tracef_max? "w+b": "ab"):
+				    (tracef_max? "w+": "a"));
 			if (tracef == (FILE *)NULL) {
 				popup_an_errno(errno, "%s", tfn);
 #if defined(X3270_DISPLAY) /*[*/
@@ -781,7 +988,6 @@ tracefile_callback(Widget w, XtPointer client_data, XtPointer call_data _is_unus
 				return;
 			}
 			Replace(tracefile_name, NewString(tfn));
-			(void) SETLINEBUF(tracef);
 #if !defined(_WIN32) /*[*/
 			(void) fcntl(fileno(tracef), F_SETFD, 1);
 #endif /*]*/
@@ -861,11 +1067,36 @@ tracefile_callback(Widget w, XtPointer client_data, XtPointer call_data _is_unus
 	appres.toggle[trace_reason].changed = True;
 	menubar_retoggle(&appres.toggle[trace_reason]);
 
+	/*
+	 * A binary trace goes only to a real file, and starts with a magic
+	 * number (unless we are appending to one that already has it).
+	 */
+	tracef_binary = False;
+	if (appres.trace_binary && tracef != stdout
+#if defined(X3270_DISPLAY) /*[*/
+			&& !just_piped
+#endif /*]*/
+			) {
+		tracef_binary = True;
+		(void) fseeko(tracef, 0, SEEK_END);
+		if (ftello(tracef) == 0)
+			trace_write(BT_MAGIC, BT_MAGIC_LEN);
+	}
+
 	/* Display current status. */
 	buf = create_tracefile_header("started");
 	wtrace("%s", buf);
 	Free(buf);
 
+	/* Don't lose buffered trace data if we exit abruptly. */
+	if (!tracef_atexit) {
+		(void) atexit(trace_exit);
+#if !defined(_WIN32) /*[*/
+		trace_catch_signals();
+#endif /*]*/
+		tracef_atexit = True;
+	}
+
 #if defined(X3270_DISPLAY) /*[*/
 	if (w)
 		XtPopdown(trace_shell);
@@ -903,11 +1134,11 @@ tracefile_on(int reason, enum toggle_type tt)
 		tracefile = appres.trace_file;
 	else {
 #if defined(_WIN32) /*[*/
-		tracefile_buf = xs_buffer("%sx3trc.%u.txt", myappdata,
-			getpid());
+		tracefile_buf = xs_buffer("%sx3trc.%u.%s", myappdata,
+			getpid(), appres.trace_binary? "bin": "txt");
 #else /*][*/
-		tracefile_buf = xs_buffer("%s/x3trc.%u", appres.trace_dir,
-			getpid());
+		tracefile_buf = xs_buffer("%s/x3trc.%u%s", appres.trace_dir,
+			getpid(), appres.trace_binary? ".bin": "");
 #endif /*]*/
 		tracefile = tracefile_buf;
 	}
@@ -966,6 +1197,27 @@ tracefile_off(void)
 	stop_tracing();
 }
 
+/*
+ * Give a newly forked worker process a trace file of its own, named after
+ * the one it inherited with ".<pid>" appended, so the workers' traces are
+ * not interleaved.  The inherited file was flushed before the fork.
+ */
+void
+trace_worker(void)
+{
+	char *tfn;
+
+	if (tracef == NULL || tracef == stdout || tracefile_name == CN)
+		return;
+	tfn = xs_buffer("%s.%d", tracefile_name, (int)getpid());
+	tracef_olen = 0;
+	(void) fclose(tracef);
+	tracef = NULL;
+	tracef_binary = False;
+	tracefile_callback((Widget)NULL, tfn, PN);
+	Free(tfn);
+}
+
 void
 toggle_dsTrace(struct toggle *t _is_unused, enum toggle_type tt)
 {
@@ -1173,4 +1425,15 @@ toggle_screenTrace(struct toggle *t _is_unused, enum toggle_type tt)
 		Free(tracefile_buf);
 }
 
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+trace_ds_session_vars(void)
+{
+	SESSION_VAR(dscnt);
+	SESSION_VAR(ds_ts);
+	SESSION_VAR(trace_skipping);
+}
+#endif /*]*/
+
 #endif /*]*/
@@ -44,22 +44,37 @@ void trace_char(char c);
 void trace_ds(const char *fmt, ...) printflike(1, 2);
 void trace_ds_nb(const char *fmt, ...) printflike(1, 2);
 void trace_dsn(const char *fmt, ...) printflike(1, 2);
+void trace_dsn_text(const char *s, size_t len);
+Boolean trace_netdata_binary(char direction, const unsigned char *buf, int len,
+    struct timeval *ts, Boolean in3270);
 void trace_event(const char *fmt, ...) printflike(1, 2);
+void trace_flush(void);
 void trace_screen(void);
 void trace_rollover_check(void);
+void trace_worker(void);
+#if defined(X3270_SESSIONS) /*[*/
+void trace_ds_session_vars(void);
+#endif /*]*/
 
 #else /*][*/
 
 #define rcba 0 &&
+#define trace_flush()
+#define trace_worker()
+#define trace_ds_session_vars()
 #if defined(__GNUC__) /*[*/
 #define trace_ds(format, args...)
 #define trace_dsn(format, args...)
+#define trace_dsn_text(s, len)
+#define trace_netdata_binary(d, b, l, t, i)	False
 #define trace_ds_nb(format, args...)
 #define trace_event(format, args...)
 #else /*][*/
 #define trace_ds 0 &&
 #define trace_ds_nb 0 &&
 #define trace_dsn 0 &&
+#define trace_dsn_text 0 &&
+#define trace_netdata_binary(d, b, l, t, i)	False
 #define trace_event 0 &&
 #define rcba 0 &&
 #endif /*]*/
@@ -39,6 +39,7 @@
 #include "3270ds.h"
 #if !defined(PR3287) /*[*/
 #include "appres.h"
+#include "ctlrc.h"
 #endif /*]*/
 #include "unicodec.h"
 #include "unicode_dbcsc.h"
@@ -235,6 +236,41 @@ cpalias_t cpaliases[] = {
 
 static uni_t *cur_uni = NULL;
 
+/*
+ * Unicode-to-EBCDIC index for the current SBCS code page, built by set_uni().
+ * The high byte of a UCS-2 value selects a row, which is only allocated if
+ * the code page (or the GE set) has a character in it.  Zero entries mean
+ * no translation.
+ */
+typedef struct {
+    unsigned char base[256];	/* base character set */
+    unsigned char ge[256];	/* GE (APL) character set */
+} u2ebc_row_t;
+static u2ebc_row_t *u2ebc[256];
+
+/*
+ * EBCDIC-to-multibyte table for the current code page and locale, built by
+ * set_uni().  Each entry is what ebcdic_to_multibyte_x() returns for an SBCS
+ * character with 'blank_undef' set, without the terminating NULL.  The first
+ * index is the character set class: base, APL/GE, line-drawing, or anything
+ * else (which has no translation).
+ */
+#define E2MB_MAX	8		/* longest cached translation */
+#define E2MB_SLOW	0xff		/* len: not cached, translate it */
+typedef struct {
+    unsigned char len;		/* number of bytes in mb[] */
+    Boolean undef;		/* no Unicode translation ('mb' is a blank) */
+    ucs4_t uc;			/* Unicode translation */
+    char mb[E2MB_MAX];		/* multi-byte translation */
+} e2mb_t;
+static e2mb_t e2mb[4][256];
+static Boolean e2mb_valid = False;
+
+#define E2MB_SET(cs) \
+    ((((cs) & CS_GE) || ((cs) & CS_MASK) == CS_APL)? 1: \
+     ((cs) == CS_LINEDRAW)? 2: \
+     ((cs) == CS_BASE)? 0: 3)
+
 void
 charset_list(void)
 {
@@ -373,7 +409,6 @@ ebcdic_base_to_unicode(ebc_t c, Boolean blank_undef,
 ebc_t
 unicode_to_ebcdic(ucs4_t u)
 {
-    int i;
 #if defined(X3270_DBCS) /*[*/
     ebc_t d;
 #endif /*]*/
@@ -383,11 +418,8 @@ unicode_to_ebcdic(ucs4_t u)
     if (u == 0x0020)
 	return 0x40;
 
-    for (i = 0; i < UT_SIZE; i++) {
-	if (cur_uni->code[i] == u) {
-	    return UT_OFFSET + i;
-	}
-    }
+    if (u <= 0xffff && u2ebc[u >> 8] != NULL && u2ebc[u >> 8]->base[u & 0xff])
+	return u2ebc[u >> 8]->base[u & 0xff];
 #if defined(X3270_DBCS) /*[*/
     /* See if it's DBCS. */
     d = unicode_to_ebcdic_dbcs(u);
@@ -413,17 +445,87 @@ unicode_to_ebcdic_ge(ucs4_t u, Boolean *ge)
     if (e)
 	return e;
 
-    /* Handle GEs.  Yes, this is slow, but I'm lazy. */
-    for (e = 0x70; e <= 0xfe; e++) {
-	if ((ucs4_t)apl_to_unicode(e) == u) {
-	    *ge = True;
-	    return e;
-	}
+    /* Handle GEs. */
+    if (u <= 0xffff && u2ebc[u >> 8] != NULL && u2ebc[u >> 8]->ge[u & 0xff]) {
+	*ge = True;
+	return u2ebc[u >> 8]->ge[u & 0xff];
     }
 
     return 0;
 }
 
+/* Add a character to the Unicode-to-EBCDIC index. */
+static void
+u2ebc_add(ucs4_t u, ebc_t e, Boolean ge)
+{
+    unsigned char *slot;
+
+    if (!u || u > 0xffff)
+	return;
+    if (u2ebc[u >> 8] == NULL)
+	u2ebc[u >> 8] = (u2ebc_row_t *)Calloc(1, sizeof(u2ebc_row_t));
+    slot = ge? &u2ebc[u >> 8]->ge[u & 0xff]: &u2ebc[u >> 8]->base[u & 0xff];
+
+    /* If a character appears more than once, the lowest code wins. */
+    if (!*slot)
+	*slot = (unsigned char)e;
+}
+
+/* Rebuild the Unicode-to-EBCDIC index for the current code page. */
+static void
+set_u2ebc(void)
+{
+    int i;
+    ebc_t e;
+
+    for (i = 0; i < 256; i++) {
+	if (u2ebc[i] != NULL) {
+	    Free(u2ebc[i]);
+	    u2ebc[i] = NULL;
+	}
+    }
+    for (i = 0; i < UT_SIZE; i++)
+	u2ebc_add(cur_uni->code[i], UT_OFFSET + i, False);
+    for (e = 0x70; e <= 0xfe; e++) {
+	int u = apl_to_unicode(e);
+
+	if (u != -1)
+	    u2ebc_add(u, e, True);
+    }
+}
+
+/*
+ * Build the EBCDIC-to-multibyte table for the current code page and locale.
+ * Translations that fail or are too long are left to be done each time.
+ */
+static void
+set_e2mb(void)
+{
+    static unsigned char set_cs[4] = {
+	CS_BASE, CS_APL, CS_LINEDRAW, CS_DBCS
+    };
+    int i, c;
+
+    e2mb_valid = False;
+    for (i = 0; i < 4; i++) {
+	for (c = 0; c < 256; c++) {
+	    e2mb_t *e = &e2mb[i][c];
+	    char mb[16];
+	    int len;
+
+	    len = ebcdic_to_multibyte_x(c, set_cs[i], mb, sizeof(mb), True,
+		    &e->uc);
+	    e->undef = (e->uc == 0);
+	    if (len > 0 && len - 1 <= E2MB_MAX) {
+		e->len = len - 1;
+		memcpy(e->mb, mb, e->len);
+	    } else
+		e->len = E2MB_SLOW;
+	}
+    }
+    e2mb_valid = True;
+}
+
 /*
  * Set the SBCS EBCDIC-to-Unicode translation table.
  * Returns 0 for success, -1 for failure.
@@ -453,6 +555,7 @@ set_uni(const char *csname, const char **host_codepage,
 			*host_codepage = uni[i].host_codepage;
 			*cgcsgid = uni[i].cgcsgid;
 			*display_charsets = uni[i].display_charset;
+			set_u2ebc();
 			rc = 0;
 			break;
 		}
@@ -485,6 +588,11 @@ set_uni(const char *csname, const char **host_codepage,
 	}
 #endif /*]*/
 
+	if (rc == 0)
+		set_e2mb();
+	else
+		e2mb_valid = False;
+
 	return rc;
 }
 
@@ -641,6 +749,20 @@ ebcdic_to_multibyte_x(ebc_t ebc, unsigned char cs, char mb[],
     size_t nc;
 #endif /*]*/
 
+    /* Use the table if we can. */
+    if (e2mb_valid && !(ebc & 0xff00)) {
+	e2mb_t *e = &e2mb[E2MB_SET(cs)][ebc];
+
+	if (e->len != E2MB_SLOW && e->len < mb_len) {
+	    *ucp = e->uc;
+	    if (e->undef && !blank_undef)
+		return 0;
+	    memcpy(mb, e->mb, e->len);
+	    mb[e->len] = '\0';
+	    return e->len + 1;
+	}
+    }
+
     /* Translate from EBCDIC to Unicode. */
     uc = ebcdic_to_unicode(ebc, cs, False);
     *ucp = uc;
@@ -742,6 +864,73 @@ ebcdic_to_multibyte_x(ebc_t ebc, unsigned char cs, char mb[],
 #endif /*]*/
 }
 
+#if !defined(PR3287) /*[*/
+/*
+ * Translate 'len' screen buffer cells starting at 'buf[baddr]' to the current
+ * locale's multi-byte representation, as the Ascii() action shows them:
+ * field attributes and characters in non-display fields are blanks, DBCS
+ * characters are translated at their left halves, and undisplayable
+ * characters are blanks.  SBCS characters come straight from the table built
+ * by set_uni().
+ *
+ * '*is_zero' says whether the field containing 'baddr' is non-display, and is
+ * updated as field attributes are passed.
+ *
+ * Stores a NULL-terminated result in 'mb', which must hold at least
+ * mb_max_len(len) bytes, and returns its length.
+ */
+int
+ebcdic_to_multibyte_row(struct ea *buf, int baddr, int len, Boolean *is_zero,
+	char *mb)
+{
+    char *s = mb;
+    int i;
+
+    for (i = 0; i < len; i++) {
+	struct ea *ea = &buf[baddr + i];
+	char xmb[16];
+	ucs4_t uc;
+	int xlen;
+
+	if (ea->fa) {
+	    *is_zero = FA_IS_ZERO(ea->fa);
+	    *s++ = ' ';
+	} else if (*is_zero)
+	    *s++ = ' ';
+	else
+#if defined(X3270_DBCS) /*[*/
+	if (IS_LEFT(ctlr_dbcs_state(baddr + i))) {
+	    xlen = ebcdic_to_multibyte((ea->cc << 8) | ea[1].cc, xmb,
+		    sizeof(xmb));
+	    if (xlen > 1) {
+		memcpy(s, xmb, xlen - 1);
+		s += xlen - 1;
+	    }
+	} else if (IS_RIGHT(ctlr_dbcs_state(baddr + i))) {
+	    continue;
+	} else
+#endif /*]*/
+	{
+	    e2mb_t *e = &e2mb[E2MB_SET(ea->cs)][ea->cc];
+
+	    if (e2mb_valid && e->len != E2MB_SLOW) {
+		memcpy(s, e->mb, e->len);
+		s += e->len;
+	    } else {
+		xlen = ebcdic_to_multibyte_x(ea->cc, ea->cs, xmb, sizeof(xmb),
+			True, &uc);
+		if (xlen > 1) {
+		    memcpy(s, xmb, xlen - 1);
+		    s += xlen - 1;
+		}
+	    }
+	}
+    }
+    *s = '\0';
+    return s - mb;
+}
+#endif /*]*/
+
 /* Commonest version of ebcdic_to_multibyte_x:
  *  cs is CS_BASE
  *  blank_undef is True
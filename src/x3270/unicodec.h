@@ -43,6 +43,10 @@ extern iconv_t i_mb2u;
 extern int ebcdic_to_multibyte_x(ebc_t ebc, unsigned char cs,
 	char mb[], int mb_len, int blank_undef, ucs4_t *uc);
 extern int ebcdic_to_multibyte(ebc_t ebc, char mb[], int mb_len);
+#if !defined(PR3287) /*[*/
+extern int ebcdic_to_multibyte_row(struct ea *buf, int baddr, int len,
+	Boolean *is_zero, char *mb);
+#endif /*]*/
 extern int ebcdic_to_multibyte_string(unsigned char *ebc, size_t ebc_len,
 	char mb[], size_t mb_len);
 extern int mb_max_len(int len);
@@ -805,20 +805,32 @@ typedef struct iorec {
 } iorec_t;
 
 static iorec_t *iorecs = NULL;
+static int input_source = -1;	/* source of the input being called */
 
 static void
-io_fn(XtPointer closure, int *source _is_unused, XtInputId *id)
+io_fn(XtPointer closure, int *source, XtInputId *id)
 {
 	iorec_t *iorec;
 
 	for (iorec = iorecs; iorec != NULL; iorec = iorec->next) {
 	    if (iorec->id == *id) {
+		input_source = *source;
 		(*iorec->fn)();
 		break;
 	    }
 	}
 }
 
+/*
+ * Returns the source of the input whose callback is running, so that one
+ * callback can serve several sources.
+ */
+int
+InputSource(void)
+{
+	return input_source;
+}
+
 unsigned long
 AddInput(int sock, voidfn *fn)
 {
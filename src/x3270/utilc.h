@@ -51,6 +51,7 @@ extern unsigned long AddInput(int, void (*)(void));
 extern unsigned long AddExcept(int, void (*)(void));
 extern unsigned long AddOutput(int, void (*)(void));
 extern void RemoveInput(unsigned long);
+extern int InputSource(void);
 extern unsigned long AddTimeOut(unsigned long msec, void (*fn)(void));
 extern void RemoveTimeOut(unsigned long cookie);
 extern KeySym StringToKeysym(char *s);
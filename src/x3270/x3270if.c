@@ -257,6 +257,8 @@ single_io(int pid, int fn, char *cmd)
 				perror("x3270if: printf");
 				exit(2);
 			}
+		} else if (!strncmp(buf, "event: ", 7)) {
+			/* Screen change event (see Subscribe); ignore it. */
 		} else
 			(void) strcpy(status, buf);
 	}
@@ -39,6 +39,7 @@
 
 #include "actionsc.h"
 #include "hostc.h"
+#include "sessionc.h"
 #include "telnetc.h"
 #include "togglesc.h"
 #include "utilc.h"
@@ -152,3 +153,15 @@ Quit_action(Widget w, XEvent *event, String *params, Cardinal *num_params)
 		x3270_exit(0);
 	}
 }
+
+#if defined(X3270_SESSIONS) /*[*/
+/* Register the per-session state. */
+void
+xio_session_vars(void)
+{
+	SESSION_VAR(ns_read_id);
+	SESSION_VAR(ns_exception_id);
+	SESSION_VAR(reading);
+	SESSION_VAR(excepting);
+}
+#endif /*]*/
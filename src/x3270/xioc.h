@@ -37,4 +37,7 @@ extern void x_add_input(int net_sock);
 extern void x_except_off(void);
 extern void x_except_on(int net_sock);
 extern void x_remove_input(void);
+#if defined(X3270_SESSIONS) /*[*/
+extern void xio_session_vars(void);
+#endif /*]*/
 